@@ -0,0 +1,252 @@
+#!/bin/bash
+#
+# Strada Benchmark Runner
+#
+# Usage: ./bench/run_bench.sh [options] [name_pattern]
+#
+# Options:
+#   -r, --runs N       Run every benchmark N times and keep the fastest (default 1)
+#   -t, --threshold P  Flag results more than P percent slower than the baseline (default 15)
+#   -s, --save         Write the results to bench/baseline.json
+#   -b, --baseline F   Compare against F instead of bench/baseline.json
+#   -o, --output F     Also write the results to F in baseline format
+#   --strict           Exit with status 1 if anything regressed
+#   -h, --help         Show this help
+#
+# Environment:
+#   BENCH_SCALE        Multiplies every iteration count (e.g. 0.1 for a quick run)
+#
+# Every benchmark program prints "BENCH <name> <ops> <elapsed_ns>". The
+# baseline maps each name to its ns/op; its numbers only mean something on
+# the machine that recorded them, so re-save it before comparing changes.
+#
+# Examples:
+#   ./bench/run_bench.sh                 # Run everything, compare with the baseline
+#   ./bench/run_bench.sh -r 3 hash       # Best of three runs of the hash benchmarks
+#   ./bench/run_bench.sh -s              # Record a new baseline
+#
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+STRADAC="$PROJECT_DIR/stradac"
+RUNTIME="$PROJECT_DIR/runtime/strada_runtime.o"
+RUNTIME_H="$PROJECT_DIR/runtime"
+
+# Runtime build options detected by ./configure (regex engine)
+RUNTIME_LIBS=""
+if [ -f "$PROJECT_DIR/config.sh" ]; then
+    . "$PROJECT_DIR/config.sh"
+    if [ "$STRADA_HAVE_PCRE2" = "1" ]; then
+        RUNTIME_LIBS="$STRADA_PCRE2_LIBS"
+    fi
+fi
+BUILD_DIR="/tmp/strada_bench_$$"
+
+# Colors (disabled if not a terminal)
+if [ -t 1 ]; then
+    RED='\033[0;31m'
+    GREEN='\033[0;32m'
+    NC='\033[0m'
+else
+    RED=''
+    GREEN=''
+    NC=''
+fi
+
+# Options
+RUNS=1
+THRESHOLD=15
+SAVE=0
+STRICT=0
+BASELINE="$SCRIPT_DIR/baseline.json"
+OUTPUT=""
+PATTERN=""
+
+while [[ $# -gt 0 ]]; do
+    case $1 in
+        -r|--runs)
+            RUNS="$2"
+            shift 2
+            ;;
+        -t|--threshold)
+            THRESHOLD="$2"
+            shift 2
+            ;;
+        -s|--save)
+            SAVE=1
+            shift
+            ;;
+        -b|--baseline)
+            BASELINE="$2"
+            shift 2
+            ;;
+        -o|--output)
+            OUTPUT="$2"
+            shift 2
+            ;;
+        --strict)
+            STRICT=1
+            shift
+            ;;
+        -h|--help)
+            sed -n '3,27p' "$0" | sed 's/^# \{0,1\}//'
+            exit 0
+            ;;
+        *)
+            PATTERN="$1"
+            shift
+            ;;
+    esac
+done
+
+if [ ! -x "$STRADAC" ] || [ ! -f "$RUNTIME" ]; then
+    echo "Error: compiler or runtime not built. Run 'make' first."
+    exit 1
+fi
+
+mkdir -p "$BUILD_DIR"
+trap 'rm -rf "$BUILD_DIR"' EXIT
+RAW="$BUILD_DIR/raw.txt"
+: > "$RAW"
+
+# Build the benchmark programs
+PROGRAMS=()
+echo "=== Building benchmarks ==="
+for src in "$SCRIPT_DIR"/*.c; do
+    name=$(basename "$src" .c)
+    if ! gcc -O2 -o "$BUILD_DIR/$name" "$src" "$RUNTIME" -I"$RUNTIME_H" -ldl -lm -lpthread $RUNTIME_LIBS \
+            > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
+        echo "  $name: C compile failed"
+        sed -n '1,5p' "$BUILD_DIR/${name}_gcc.log"
+        exit 1
+    fi
+    PROGRAMS+=("$name")
+done
+for src in "$SCRIPT_DIR"/*.strada; do
+    name=$(basename "$src" .strada)
+    # Modules used by the benchmarks, not programs
+    if [ "$name" = "Bench" ]; then
+        continue
+    fi
+    if ! (cd "$PROJECT_DIR" && "$STRADAC" "$src" "$BUILD_DIR/$name.c") > "$BUILD_DIR/${name}_strada.log" 2>&1; then
+        echo "  $name: Strada compile failed"
+        tail -3 "$BUILD_DIR/${name}_strada.log"
+        exit 1
+    fi
+    if ! gcc -O2 -rdynamic -o "$BUILD_DIR/$name" "$BUILD_DIR/$name.c" "$RUNTIME" -I"$RUNTIME_H" \
+            -ldl -lm -lpthread $RUNTIME_LIBS > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
+        echo "  $name: C compile failed"
+        sed -n '1,5p' "$BUILD_DIR/${name}_gcc.log"
+        exit 1
+    fi
+    PROGRAMS+=("$name")
+done
+
+now_ns() {
+    date +%s%N
+}
+
+# Run everything
+echo "=== Running benchmarks (runs: $RUNS, BENCH_SCALE: ${BENCH_SCALE:-1}) ==="
+for ((run = 1; run <= RUNS; run++)); do
+    for name in "${PROGRAMS[@]}"; do
+        (cd "$PROJECT_DIR" && "$BUILD_DIR/$name" $PATTERN) | grep '^BENCH ' >> "$RAW"
+    done
+
+    # Self-compile: the whole compiler through stradac
+    if [[ -z "$PATTERN" || "selfcompile" == *"$PATTERN"* ]] && [ -f "$PROJECT_DIR/compiler/Combined.strada" ]; then
+        start=$(now_ns)
+        (cd "$PROJECT_DIR" && "$STRADAC" compiler/Combined.strada "$BUILD_DIR/selfcompile.c") > /dev/null 2>&1
+        echo "BENCH selfcompile 1 $(( $(now_ns) - start ))" >> "$RAW"
+    fi
+done
+
+if [ ! -s "$RAW" ]; then
+    echo "No benchmarks matched '$PATTERN'"
+    exit 1
+fi
+
+# Fastest run of each benchmark, in first-seen order: name ops ns_per_op
+RESULTS="$BUILD_DIR/results.txt"
+awk '{
+    ns = $4 / $3
+    if (!($2 in best)) { order[++n] = $2; best[$2] = ns; ops[$2] = $3 }
+    else if (ns < best[$2]) { best[$2] = ns }
+} END {
+    for (i = 1; i <= n; i++) printf "%s %d %.3f\n", order[i], ops[order[i]], best[order[i]]
+}' "$RAW" > "$RESULTS"
+
+# Baseline: one "name": ns_per_op pair per line
+baseline_value() {
+    [ -f "$BASELINE" ] || return
+    sed -n "s/^ *\"$1\": *\([0-9.eE+-]*\),\{0,1\} *$/\1/p" "$BASELINE"
+}
+
+# Write results as JSON; entries of an existing file that did not run are kept
+write_json() {
+    local old=""
+    if [ -f "$1" ]; then
+        old=$(sed -n 's/^ *"\([^"]*\)": *\([0-9.eE+-]*\),\{0,1\} *$/\1 \2/p' "$1")
+    fi
+    {
+        echo "{"
+        { echo "$old" | awk 'NF == 2 { print "old", $1, $2 }'; awk '{ print "new", $1, $3 }' "$RESULTS"; } |
+        awk '{
+            if (!($2 in ns)) order[++n] = $2
+            ns[$2] = $3
+        } END {
+            for (i = 1; i <= n; i++) printf "  \"%s\": %s%s\n", order[i], ns[order[i]], (i < n ? "," : "")
+        }'
+        echo "}"
+    } > "$1.tmp" && mv "$1.tmp" "$1"
+}
+
+HAD_BASELINE=0
+[ -f "$BASELINE" ] && HAD_BASELINE=1
+
+echo ""
+printf "%-20s %16s %14s %16s %10s\n" "benchmark" "ns/op" "ops/sec" "baseline" "change"
+REGRESSIONS=0
+while read -r name ops ns; do
+    base=$(baseline_value "$name")
+    opsec=$(awk -v ns="$ns" 'BEGIN { printf "%.0f", (ns > 0 ? 1e9 / ns : 0) }')
+    if [ -z "$base" ]; then
+        printf "%-20s %16s %14s %16s %10s\n" "$name" "$ns" "$opsec" "-" "new"
+        continue
+    fi
+    change=$(awk -v ns="$ns" -v b="$base" 'BEGIN { printf "%+.1f", (b > 0 ? (ns - b) * 100 / b : 0) }')
+    flag=$(awk -v c="$change" -v t="$THRESHOLD" 'BEGIN { if (c > t) print "slower"; else if (c < -t) print "faster" }')
+    line=$(printf "%-20s %16s %14s %16s %9s%%" "$name" "$ns" "$opsec" "$base" "$change")
+    if [ "$flag" = "slower" ]; then
+        REGRESSIONS=$((REGRESSIONS + 1))
+        echo -e "${RED}${line}  REGRESSION${NC}"
+    elif [ "$flag" = "faster" ]; then
+        echo -e "${GREEN}${line}  faster${NC}"
+    else
+        echo "$line"
+    fi
+done < "$RESULTS"
+
+if [ -n "$OUTPUT" ]; then
+    write_json "$OUTPUT"
+    echo ""
+    echo "Results written to $OUTPUT"
+fi
+if [ "$SAVE" = "1" ]; then
+    write_json "$BASELINE"
+    echo ""
+    echo "Baseline saved to $BASELINE"
+fi
+
+echo ""
+if [ "$HAD_BASELINE" = "0" ] && [ "$SAVE" = "0" ]; then
+    echo "No baseline at $BASELINE (record one with -s)"
+elif [ "$REGRESSIONS" -gt 0 ]; then
+    echo "$REGRESSIONS benchmark(s) more than $THRESHOLD% slower than the baseline"
+    if [ "$STRICT" = "1" ]; then
+        exit 1
+    fi
+else
+    echo "No regressions beyond $THRESHOLD%"
+fi
+exit 0
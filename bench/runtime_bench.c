@@ -0,0 +1,264 @@
+/*
+ This file is part of the Strada Language (https://github.com/mjflick/strada-lang).
+ Copyright (c) 2026 Michael J. Flickinger
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, version 2.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* runtime_bench.c - Microbenchmarks of runtime entry points called from C
+ *
+ * Each benchmark prints "BENCH <name> <ops> <elapsed_ns>"; bench/run_bench.sh
+ * turns that into ns/op and ops/sec and compares it with the baseline.
+ * BENCH_SCALE multiplies every iteration count. A name given on the
+ * command line runs only benchmarks whose name contains it.
+ */
+#include "strada_runtime.h"
+#include <time.h>
+
+static double bench_scale = 1.0;
+static const char *bench_filter = NULL;
+static volatile int64_t bench_sink;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t iters(int64_t n) {
+    int64_t scaled = (int64_t)(n * bench_scale);
+    return scaled > 0 ? scaled : 1;
+}
+
+static int wanted(const char *name) {
+    return !bench_filter || strstr(name, bench_filter) != NULL;
+}
+
+static void report(const char *name, int64_t ops, int64_t start) {
+    printf("BENCH %s %lld %lld\n", name, (long long)ops, (long long)(now_ns() - start));
+    fflush(stdout);
+}
+
+/* ===== Hashes ===== */
+
+static void bench_hash(void) {
+    char keys[1000][8];
+    StradaValue *h = strada_new_hash();
+    for (int i = 0; i < 1000; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+        strada_hash_set(h->value.hv, keys[i], strada_new_int(i));
+    }
+
+    if (wanted("hash_get")) {
+        int64_t n = iters(20000000), sum = 0;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i++) {
+            sum += strada_hash_get(h->value.hv, keys[i % 1000])->value.iv;
+        }
+        report("hash_get", n, start);
+        bench_sink = sum;
+    }
+
+    if (wanted("hash_set")) {
+        int64_t n = iters(10000000);
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i++) {
+            strada_hash_set(h->value.hv, keys[i % 1000], strada_new_int(i));
+        }
+        report("hash_set", n, start);
+    }
+    strada_decref(h);
+}
+
+/* ===== Strings ===== */
+
+static void bench_concat(void) {
+    if (!wanted("concat_sv")) return;
+    StradaValue *a = strada_new_str("prefix-");
+    StradaValue *b = strada_new_str("some longer suffix text");
+    int64_t n = iters(10000000), len = 0;
+    int64_t start = now_ns();
+    for (int64_t i = 0; i < n; i++) {
+        StradaValue *r = strada_concat_sv(a, b);
+        len += r->value.pv ? 1 : 0;
+        strada_decref(r);
+    }
+    report("concat_sv", n, start);
+    bench_sink = len;
+    strada_decref(a);
+    strada_decref(b);
+}
+
+/* ===== Method calls ===== */
+
+static StradaValue* bench_get_value(StradaValue *self, StradaValue *args) {
+    (void)args;
+    return strada_new_int(7);
+}
+
+static void bench_methods(void) {
+    strada_method_register("Bench::Point", "value", bench_get_value);
+    StradaValue *obj = strada_bless(strada_new_ref(strada_new_hash(), '%'), "Bench::Point");
+
+    if (wanted("method_call")) {
+        int64_t n = iters(10000000), sum = 0;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i++) {
+            StradaValue *r = strada_method_call(obj, "value", NULL);
+            sum += r->value.iv;
+            strada_decref(r);
+        }
+        report("method_call", n, start);
+        bench_sink = sum;
+    }
+
+    if (wanted("method_call_ic")) {
+        static StradaMethodSlot *ic = NULL;
+        int64_t n = iters(20000000), sum = 0;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i++) {
+            StradaValue *r = strada_method_call_ic(obj, "value", NULL, &ic);
+            sum += r->value.iv;
+            strada_decref(r);
+        }
+        report("method_call_ic", n, start);
+        bench_sink = sum;
+    }
+    strada_decref(obj);
+}
+
+/* ===== Regex ===== */
+
+static void bench_regex(void) {
+    const char *subjects[4] = {
+        "GET /index.html HTTP/1.1",
+        "POST /api/v2/items?id=42 HTTP/1.1",
+        "user=alice id=1234 role=admin",
+        "nothing to see here",
+    };
+
+    if (wanted("regex_match")) {
+        int64_t n = iters(2000000), hits = 0;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i++) {
+            hits += strada_regex_match(subjects[i & 3], "(GET|POST) /[a-z0-9/]+");
+        }
+        report("regex_match", n, start);
+        bench_sink = hits;
+    }
+
+    if (wanted("regex_match_rx")) {
+        StradaValue *rx = strada_regex_compile("id=([0-9]+)", "");
+        int64_t n = iters(2000000), hits = 0;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i++) {
+            hits += strada_regex_match_rx(subjects[i & 3], rx);
+        }
+        report("regex_match_rx", n, start);
+        bench_sink = hits;
+        strada_decref(rx);
+    }
+}
+
+/* ===== Channels ===== */
+
+static void *bench_producer(void *arg) {
+    StradaValue *ch = arg;
+    int64_t n = iters(2000000);
+    for (int64_t i = 0; i < n; i++) {
+        strada_channel_send(ch, strada_new_int(i));
+    }
+    return NULL;
+}
+
+static void bench_channels(void) {
+    if (wanted("channel_send_recv")) {
+        StradaValue *ch = strada_channel_new(1024);
+        int64_t n = iters(10000000), sum = 0;
+        int64_t start = now_ns();
+        for (int64_t i = 0; i < n; i += 512) {
+            for (int j = 0; j < 512; j++) {
+                strada_channel_send(ch, strada_new_int(j));
+            }
+            for (int j = 0; j < 512; j++) {
+                StradaValue *v = strada_channel_recv(ch);
+                sum += v->value.iv;
+                strada_decref(v);
+            }
+        }
+        report("channel_send_recv", (n + 511) / 512 * 512, start);
+        bench_sink = sum;
+        strada_decref(ch);
+    }
+
+    if (wanted("channel_threads")) {
+        StradaValue *ch = strada_channel_new(1024);
+        int64_t n = iters(2000000), sum = 0;
+        pthread_t producer;
+        int64_t start = now_ns();
+        pthread_create(&producer, NULL, bench_producer, ch);
+        for (int64_t i = 0; i < n; i++) {
+            StradaValue *v = strada_channel_recv(ch);
+            sum += v->value.iv;
+            strada_decref(v);
+        }
+        pthread_join(producer, NULL);
+        report("channel_threads", n, start);
+        bench_sink = sum;
+        strada_decref(ch);
+    }
+}
+
+/* ===== Thread pool ===== */
+
+static StradaValue* bench_task(StradaValue ***captures) {
+    (void)captures;
+    return strada_new_int(1);
+}
+
+static void bench_pool(void) {
+    if (!wanted("pool_submit")) return;
+    StradaValue *task = strada_closure_new((void*)bench_task, 0, 0, NULL);
+    StradaValue *futures[256];
+    int64_t n = iters(500000), sum = 0;
+    strada_pool_init(0);
+    int64_t start = now_ns();
+    for (int64_t i = 0; i < n; i += 256) {
+        for (int j = 0; j < 256; j++) {
+            futures[j] = strada_future_new(task);
+        }
+        for (int j = 0; j < 256; j++) {
+            StradaValue *r = strada_future_await(futures[j]);
+            sum += r->value.iv;
+            strada_decref(r);
+            strada_decref(futures[j]);
+        }
+    }
+    report("pool_submit", (n + 255) / 256 * 256, start);
+    bench_sink = sum;
+    strada_decref(task);
+}
+
+int main(int argc, char **argv) {
+    const char *scale = getenv("BENCH_SCALE");
+    if (scale && atof(scale) > 0) bench_scale = atof(scale);
+    if (argc > 1) bench_filter = argv[1];
+
+    bench_hash();
+    bench_concat();
+    bench_methods();
+    bench_regex();
+    bench_channels();
+    bench_pool();
+    return 0;
+}
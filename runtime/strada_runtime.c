@@ -23,6 +23,7 @@
 #define O_NDELAY O_NONBLOCK
 #endif
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 #include <math.h>
@@ -34,6 +35,12 @@
 #include <sys/time.h>
 #ifdef __linux__
 #include <sys/prctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define STRADA_HAVE_BACKTRACE 1
 #endif
 #include <signal.h>
 #include <dirent.h>
@@ -52,21 +59,259 @@
 #include <utime.h>
 #include <sys/utsname.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <locale.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define STRADA_NEON_KERNELS 1
+#endif
+#ifdef STRADA_HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
 
 /* ===== MEMORY CONFIGURATION ===== */
 
 /* Default initial capacity for new arrays (can be changed at runtime) */
 static size_t strada_default_array_capacity = 8;
 
-/* Default initial bucket count for new hashes (can be changed at runtime) */
+/* Default initial slot count for new hashes (can be changed at runtime) */
 static size_t strada_default_hash_capacity = 16;
 
+/* ===== SLAB ALLOCATOR ===== */
+
+/* Fixed-size free lists for the runtime's small headers (StradaValue,
+ * StradaArray, StradaHash).
+ *
+ * Each thread keeps a private free list per size class, so the common
+ * alloc/free path is a couple of pointer moves with no locking. Objects may
+ * be freed by a different thread than the one that allocated them: they
+ * simply land in the freeing thread's list. When a thread's list grows past
+ * two batches, one batch is handed to a global depot; a thread whose list
+ * runs dry takes a batch from the depot before carving a new chunk. Thread
+ * exit returns the whole local list to the depot.
+ *
+ * Memory is never handed back to libc. Set STRADA_ALLOC=system to bypass
+ * the slabs and use plain malloc/free (useful for valgrind and comparisons). */
+
+#define STRADA_SLAB_CHUNK_BYTES (64 * 1024)
+#define STRADA_SLAB_BATCH 64
+
+typedef struct StradaSlabNode {
+    struct StradaSlabNode *next;        /* Next free object in this chain */
+    struct StradaSlabNode *next_batch;  /* Next chain in the depot (depot only) */
+    size_t batch_count;                 /* Objects in this chain (depot only) */
+} StradaSlabNode;
+
+typedef struct StradaSlabCache {
+    StradaSlabNode *head;
+    size_t count;
+} StradaSlabCache;
+
+typedef struct StradaSlabDepot {
+    pthread_mutex_t lock;
+    StradaSlabNode *batches;            /* Stack of free chains */
+    void *chunks;                       /* All chunks (first word links them) */
+    uint64_t chunk_count;
+    uint64_t depot_objects;
+} StradaSlabDepot;
+
+#define STRADA_SLAB_SIZE(t) \
+    (((sizeof(t) > sizeof(StradaSlabNode) ? sizeof(t) : sizeof(StradaSlabNode)) + 7) & ~(size_t)7)
+
+static const size_t strada_slab_sizes[STRADA_SLAB_CLASS_COUNT] = {
+    STRADA_SLAB_SIZE(StradaValue),
+    STRADA_SLAB_SIZE(StradaArray),
+    STRADA_SLAB_SIZE(StradaHash),
+    STRADA_SLAB_SIZE(StradaValue) + STRADA_STR_INLINE_CAP
+};
+
+static const char *strada_slab_names[STRADA_SLAB_CLASS_COUNT] = {
+    "value", "array", "hash", "string"
+};
+
+static StradaSlabDepot strada_slab_depots[STRADA_SLAB_CLASS_COUNT] = {
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0 }
+};
+
+static __thread StradaSlabCache strada_slab_tcache[STRADA_SLAB_CLASS_COUNT];
+static __thread int strada_slab_tcache_registered = 0;
+
+static int strada_slab_mode = -1;       /* -1 = not decided, 0 = system, 1 = slab */
+static pthread_once_t strada_slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t strada_slab_key;
+
+static void strada_slab_push_batch(StradaSlabClass cls, StradaSlabNode *head, size_t count) {
+    StradaSlabDepot *d = &strada_slab_depots[cls];
+    head->batch_count = count;
+    pthread_mutex_lock(&d->lock);
+    head->next_batch = d->batches;
+    d->batches = head;
+    d->depot_objects += count;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/* Thread-exit destructor: return this thread's free lists to the depots */
+static void strada_slab_thread_exit(void *unused) {
+    (void)unused;
+    for (int cls = 0; cls < STRADA_SLAB_CLASS_COUNT; cls++) {
+        StradaSlabCache *c = &strada_slab_tcache[cls];
+        if (c->head) {
+            strada_slab_push_batch((StradaSlabClass)cls, c->head, c->count);
+            c->head = NULL;
+            c->count = 0;
+        }
+    }
+}
+
+/* Keep the depot locks consistent across fork() */
+static void strada_slab_atfork_prepare(void) {
+    for (int cls = 0; cls < STRADA_SLAB_CLASS_COUNT; cls++)
+        pthread_mutex_lock(&strada_slab_depots[cls].lock);
+}
+
+static void strada_slab_atfork_release(void) {
+    for (int cls = STRADA_SLAB_CLASS_COUNT - 1; cls >= 0; cls--)
+        pthread_mutex_unlock(&strada_slab_depots[cls].lock);
+}
+
+static void strada_slab_init(void) {
+    const char *env = getenv("STRADA_ALLOC");
+    pthread_key_create(&strada_slab_key, strada_slab_thread_exit);
+    pthread_atfork(strada_slab_atfork_prepare, strada_slab_atfork_release,
+                   strada_slab_atfork_release);
+    strada_slab_mode = (env && strcmp(env, "system") == 0) ? 0 : 1;
+}
+
+int strada_slab_enabled(void) {
+    if (strada_slab_mode < 0) pthread_once(&strada_slab_once, strada_slab_init);
+    return strada_slab_mode;
+}
+
+/* Arrange for strada_slab_thread_exit to return this thread's cache to
+ * the depots. Both refill and free fill the cache, so both call this. */
+static inline void strada_slab_tcache_register(void) {
+    if (!strada_slab_tcache_registered) {
+        strada_slab_tcache_registered = 1;
+        pthread_setspecific(strada_slab_key, (void*)1);
+    }
+}
+
+/* Slow path: refill an empty thread cache from the depot or a new chunk */
+static void strada_slab_refill(StradaSlabClass cls, StradaSlabCache *c) {
+    StradaSlabDepot *d = &strada_slab_depots[cls];
+
+    strada_slab_tcache_register();
+
+    pthread_mutex_lock(&d->lock);
+    StradaSlabNode *batch = d->batches;
+    if (batch) {
+        d->batches = batch->next_batch;
+        d->depot_objects -= batch->batch_count;
+        pthread_mutex_unlock(&d->lock);
+        c->head = batch;
+        c->count = batch->batch_count;
+        return;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    /* Carve a fresh chunk; the first object slot links the chunk list */
+    size_t size = strada_slab_sizes[cls];
+    char *chunk = malloc(STRADA_SLAB_CHUNK_BYTES);
+    if (!chunk) return;
+    size_t header = (sizeof(void*) + 15) & ~(size_t)15;
+    size_t n = (STRADA_SLAB_CHUNK_BYTES - header) / size;
+    char *base = chunk + header;
+    for (size_t i = 0; i < n; i++) {
+        StradaSlabNode *node = (StradaSlabNode*)(base + i * size);
+        node->next = (i + 1 < n) ? (StradaSlabNode*)(base + (i + 1) * size) : NULL;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    *(void**)chunk = d->chunks;
+    d->chunks = chunk;
+    d->chunk_count++;
+    pthread_mutex_unlock(&d->lock);
+
+    c->head = (StradaSlabNode*)base;
+    c->count = n;
+}
+
+void* strada_slab_alloc(StradaSlabClass cls) {
+    if (strada_slab_mode != 1 && strada_slab_enabled() == 0) {
+        return malloc(strada_slab_sizes[cls]);
+    }
+    StradaSlabCache *c = &strada_slab_tcache[cls];
+    if (!c->head) {
+        strada_slab_refill(cls, c);
+        if (!c->head) return malloc(strada_slab_sizes[cls]);
+    }
+    StradaSlabNode *node = c->head;
+    c->head = node->next;
+    c->count--;
+    return node;
+}
+
+void strada_slab_free(StradaSlabClass cls, void *ptr) {
+    if (!ptr) return;
+    if (strada_slab_mode != 1) {
+        free(ptr);
+        return;
+    }
+    strada_slab_tcache_register();
+    StradaSlabCache *c = &strada_slab_tcache[cls];
+    StradaSlabNode *node = (StradaSlabNode*)ptr;
+    node->next = c->head;
+    c->head = node;
+    c->count++;
+
+    /* Keep one batch locally, hand the older one to the depot */
+    if (c->count >= 2 * STRADA_SLAB_BATCH) {
+        StradaSlabNode *keep_tail = c->head;
+        for (int i = 1; i < STRADA_SLAB_BATCH; i++) keep_tail = keep_tail->next;
+        StradaSlabNode *spill = keep_tail->next;
+        keep_tail->next = NULL;
+        strada_slab_push_batch(cls, spill, c->count - STRADA_SLAB_BATCH);
+        c->count = STRADA_SLAB_BATCH;
+    }
+}
+
 /* ===== VALUE CREATION ===== */
 
-/* Forward declaration for memory profiling */
-void strada_memprof_alloc(StradaType type, size_t bytes);
-void strada_memprof_free(StradaType type, size_t bytes);
+/* Memory profiler hooks, called by every value constructor and by
+ * strada_free_value. They cost one load while profiling is off. */
+static int memprof_enabled;
+static void strada_memprof_track(StradaValue *sv);
+static void strada_memprof_untrack(StradaValue *sv);
+
+static inline void strada_memprof_alloc(StradaValue *sv) {
+    if (memprof_enabled) strada_memprof_track(sv);
+}
+
+static inline void strada_memprof_free(StradaValue *sv) {
+    if (memprof_enabled) strada_memprof_untrack(sv);
+}
+
+/* Cycle collector and weak reference hooks. Containers are tracked only
+ * after sys::gc_enable(); the free hook costs two loads until then. */
+static int gc_tracking;
+static size_t weak_live;
+static void strada_gc_track(StradaValue *sv);
+static void strada_gc_forget(StradaValue *sv);
+static void strada_gc_retype(StradaValue *sv);
+
+static inline void strada_gc_alloc(StradaValue *sv) {
+    if (gc_tracking) strada_gc_track(sv);
+}
+
+static inline void strada_gc_free(StradaValue *sv) {
+    if (gc_tracking | weak_live) strada_gc_forget(sv);
+}
 
 /* OOP debug tracing - set STRADA_DEBUG_BLESS=1 to enable */
 static int strada_debug_bless_checked = 0;
@@ -128,20 +373,20 @@ static int strada_validate_blessed_package(const char *pkg) {
 }
 
 StradaValue* strada_new_undef(void) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_UNDEF;
     sv->refcount = 1;
     sv->blessed_package = NULL;
-    strada_memprof_alloc(STRADA_UNDEF, sizeof(StradaValue));
+    strada_memprof_alloc(sv);
     return sv;
 }
 
 /* Static undef singleton for void-like returns (push, etc.)
  * This avoids allocating a new StradaValue for each void operation.
- * Has very high refcount so it's never freed. */
+ * Immortal, so incref/decref leave it alone and it's never freed. */
 static StradaValue __strada_undef_static = {
     .type = STRADA_UNDEF,
-    .refcount = INT32_MAX,  /* Effectively immortal */
+    .refcount = STRADA_REFCOUNT_IMMORTAL,
     .blessed_package = NULL
 };
 
@@ -149,23 +394,110 @@ StradaValue* strada_undef_static(void) {
     return &__strada_undef_static;
 }
 
+/* Immortal constants. Small ints double as true (1) and false (0).
+ * They are shared by every thread and never written after startup,
+ * so code that mutates a scalar in place (deref_set) must unshare first. */
+#define STRADA_SMALL_INT_COUNT (STRADA_SMALL_INT_MAX - STRADA_SMALL_INT_MIN + 1)
+StradaValue strada_small_ints[STRADA_SMALL_INT_COUNT];
+static char strada_empty_pv[1] = "";
+static StradaValue strada_empty_str_static = {
+    .type = STRADA_STR,
+    .refcount = STRADA_REFCOUNT_IMMORTAL,
+    .value.pv = strada_empty_pv,
+    .str_cap = 0,
+    .struct_size = 0,
+    .blessed_package = NULL
+};
+
+__attribute__((constructor(101)))
+static void strada_immortal_init(void) {
+    for (int k = 0; k < STRADA_SMALL_INT_COUNT; k++) {
+        strada_small_ints[k].type = STRADA_INT;
+        strada_small_ints[k].refcount = STRADA_REFCOUNT_IMMORTAL;
+        strada_small_ints[k].value.iv = (int64_t)k + STRADA_SMALL_INT_MIN;
+    }
+}
+
+StradaValue* strada_new_bool(int b) {
+    return &strada_small_ints[(b ? 1 : 0) - STRADA_SMALL_INT_MIN];
+}
+
+StradaValue* strada_true(void) {
+    return &strada_small_ints[1 - STRADA_SMALL_INT_MIN];
+}
+
+StradaValue* strada_false(void) {
+    return &strada_small_ints[0 - STRADA_SMALL_INT_MIN];
+}
+
+StradaValue* strada_empty_str(void) {
+    return &strada_empty_str_static;
+}
+
+/* New string value with room for len bytes plus the terminating NUL.
+ * Short strings share the value's allocation (STRADA_STR_INLINE_CAP). The
+ * caller fills in value.pv[0..len]. */
+static StradaValue* strada_str_alloc(size_t len) {
+    StradaValue *sv;
+    if (len < STRADA_STR_INLINE_CAP) {
+        sv = strada_slab_alloc(STRADA_SLAB_STR);
+        sv->value.pv = (char *)(sv + 1);
+        sv->str_cap = STRADA_STR_INLINE_CAP;
+    } else {
+        sv = strada_slab_alloc(STRADA_SLAB_VALUE);
+        sv->value.pv = malloc(len + 1);
+        sv->str_cap = 0;
+    }
+    sv->type = STRADA_STR;
+    sv->refcount = 1;
+    sv->struct_size = len;
+    sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
+    return sv;
+}
+
+/* Fresh, privately owned copy of an immortal scalar */
+static StradaValue* strada_unshare_immortal(StradaValue *sv) {
+    switch (sv->type) {
+        case STRADA_INT: {
+            StradaValue *copy = strada_slab_alloc(STRADA_SLAB_VALUE);
+            copy->type = STRADA_INT;
+            copy->refcount = 1;
+            copy->value.iv = sv->value.iv;
+            copy->blessed_package = NULL;
+            strada_memprof_alloc(copy);
+            return copy;
+        }
+        case STRADA_STR: {
+            StradaValue *copy = strada_str_alloc(sv->struct_size);
+            memcpy(copy->value.pv, sv->value.pv, sv->struct_size + 1);
+            return copy;
+        }
+        default:
+            return strada_new_undef();
+    }
+}
+
 StradaValue* strada_new_int(int64_t i) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    if (i >= STRADA_SMALL_INT_MIN && i <= STRADA_SMALL_INT_MAX) {
+        return &strada_small_ints[i - STRADA_SMALL_INT_MIN];
+    }
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_INT;
     sv->refcount = 1;
     sv->value.iv = i;
     sv->blessed_package = NULL;
-    strada_memprof_alloc(STRADA_INT, sizeof(StradaValue));
+    strada_memprof_alloc(sv);
     return sv;
 }
 
 StradaValue* strada_new_num(double n) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_NUM;
     sv->refcount = 1;
     sv->value.nv = n;
     sv->blessed_package = NULL;
-    strada_memprof_alloc(STRADA_NUM, sizeof(StradaValue));
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -185,44 +517,105 @@ StradaValue* strada_safe_mod(int64_t a, int64_t b) {
     return strada_new_int(a % b);
 }
 
+/* Box a native int/num local for a read that needs a StradaValue (see
+ * "unboxed locals" in CodeGen). *box is the variable's own mirror: it is
+ * updated in place while nothing else holds it and replaced otherwise.
+ * The result is borrowed, like reading a variable. */
+StradaValue* strada_box_int(StradaValue **box, int64_t i) {
+    if (i >= STRADA_SMALL_INT_MIN && i <= STRADA_SMALL_INT_MAX) {
+        return &strada_small_ints[i - STRADA_SMALL_INT_MIN];
+    }
+    StradaValue *sv = *box;
+    if (sv && sv->refcount == 1 && sv->type == STRADA_INT) {
+        sv->value.iv = i;
+        return sv;
+    }
+    if (sv) strada_decref(sv);
+    *box = strada_new_int(i);
+    return *box;
+}
+
+StradaValue* strada_box_num(StradaValue **box, double n) {
+    StradaValue *sv = *box;
+    if (sv && sv->refcount == 1 && sv->type == STRADA_NUM) {
+        sv->value.nv = n;
+        return sv;
+    }
+    if (sv) strada_decref(sv);
+    *box = strada_new_num(n);
+    return *box;
+}
+
 StradaValue* strada_new_str(const char *s) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
-    sv->type = STRADA_STR;
-    sv->refcount = 1;
-    sv->value.pv = s ? strdup(s) : strdup("");
-    sv->struct_size = s ? strlen(s) : 0;  /* Store length */
-    sv->blessed_package = NULL;
-    strada_memprof_alloc(STRADA_STR, sizeof(StradaValue) + (s ? strlen(s) + 1 : 1));
+    if (!s || !*s) return &strada_empty_str_static;
+    size_t len = strlen(s);
+    StradaValue *sv = strada_str_alloc(len);
+    memcpy(sv->value.pv, s, len + 1);
     return sv;
 }
 
 /* Take ownership of a string (no strdup - avoids leak from strada_concat) */
 StradaValue* strada_new_str_take(char *s) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    if (!s || !*s) {
+        free(s);
+        return &strada_empty_str_static;
+    }
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_STR;
     sv->refcount = 1;
     sv->value.pv = s ? s : strdup("");
     sv->struct_size = s ? strlen(s) : 0;  /* Store length */
+    sv->str_cap = 0;
     sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
 /* Create string from binary data with explicit length (may contain embedded NULLs) */
 StradaValue* strada_new_str_len(const char *s, size_t len) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
-    sv->type = STRADA_STR;
-    sv->refcount = 1;
-    sv->blessed_package = NULL;
-    if (s && len > 0) {
-        sv->value.pv = malloc(len + 1);
-        memcpy(sv->value.pv, s, len);
-        sv->value.pv[len] = '\0';  /* Null-terminate for C compatibility */
-        sv->struct_size = len;     /* Store actual length for binary data */
+    if (!s || len == 0) return &strada_empty_str_static;
+    StradaValue *sv = strada_str_alloc(len);  /* struct_size keeps the length for binary data */
+    memcpy(sv->value.pv, s, len);
+    sv->value.pv[len] = '\0';  /* Null-terminate for C compatibility */
+    return sv;
+}
+
+/* Let go of a string value's buffer, whatever holds it: inline storage
+ * needs nothing, a view releases its owner, a mapping is unmapped and a
+ * heap buffer is freed. value.pv is left dangling. */
+static void strada_str_release(StradaValue *sv) {
+    if (!sv->value.pv || STRADA_STR_IS_INLINE(sv)) return;
+    if (STRADA_STR_IS_VIEW(sv)) {
+        strada_decref(STRADA_STR_OWNER(sv));
+    } else if (STRADA_STR_IS_MAPPED(sv)) {
+        munmap(sv->value.pv, sv->str_cap & ~STRADA_STR_FLAGS);
     } else {
-        sv->value.pv = strdup("");
-        sv->struct_size = 0;
+        free(sv->value.pv);
+    }
+}
+
+/* Take ownership of a malloc'd buffer holding len bytes (NUL-terminated
+ * at s[len]) in cap allocated bytes. Binary-safe. Short strings are
+ * copied inline and the buffer freed. */
+StradaValue* strada_new_str_take_len(char *s, size_t len, size_t cap) {
+    if (!s || len == 0) {
+        free(s);
+        return &strada_empty_str_static;
+    }
+    if (len < STRADA_STR_INLINE_CAP) {
+        StradaValue *sv = strada_new_str_len(s, len);
+        free(s);
+        return sv;
     }
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
+    sv->type = STRADA_STR;
+    sv->refcount = 1;
+    sv->value.pv = s;
+    sv->struct_size = len;
+    sv->str_cap = cap & ~STRADA_STR_FLAGS;  /* Rounded down keeps flag bits clear */
+    if (sv->str_cap <= len) sv->str_cap = 0;
     sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -234,43 +627,78 @@ size_t strada_str_len(StradaValue *sv) {
 }
 
 StradaValue* strada_new_array(void) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_ARRAY;
     sv->refcount = 1;
     sv->value.av = strada_array_new();
     sv->blessed_package = NULL;
-    strada_memprof_alloc(STRADA_ARRAY, sizeof(StradaValue) + sizeof(StradaArray));
+    strada_memprof_alloc(sv);
+    strada_gc_alloc(sv);
     return sv;
 }
 
 StradaValue* strada_new_hash(void) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_HASH;
     sv->refcount = 1;
     sv->value.hv = strada_hash_new();
     sv->blessed_package = NULL;
-    strada_memprof_alloc(STRADA_HASH, sizeof(StradaValue) + sizeof(StradaHash));
+    strada_memprof_alloc(sv);
+    strada_gc_alloc(sv);
     return sv;
 }
 
 StradaValue* strada_new_filehandle(FILE *fh) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_FILEHANDLE;
     sv->refcount = 1;
     sv->value.fh = fh;
     sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
 /* ===== REFERENCE COUNTING ===== */
 
+/* Refcounts use plain increments while the main thread is the only one
+ * running; every value is owned by it, so nothing can race. The runtime
+ * switches to atomic ops just before it creates the first thread and
+ * never switches back. The pthread_create that follows publishes all
+ * earlier plain writes to the new thread. */
+static int strada_rc_atomic = 0;
+static int strada_rc_single_threaded = 0;
+
+void strada_refcount_atomic_enable(void) {
+    if (strada_rc_single_threaded) {
+        fprintf(stderr, "Error: program was compiled with --single-threaded and cannot start threads\n");
+        exit(1);
+    }
+    strada_rc_atomic = 1;
+}
+
+void strada_set_single_threaded(void) {
+    strada_rc_single_threaded = 1;
+}
+
 void strada_incref(StradaValue *sv) {
-    if (sv) __sync_add_and_fetch(&sv->refcount, 1);
+    /* Immortals are never written, so a plain read is enough to skip them */
+    if (!sv || STRADA_IS_IMMORTAL(sv)) return;
+    if (strada_rc_atomic) {
+        __sync_add_and_fetch(&sv->refcount, 1);
+    } else {
+        sv->refcount++;
+    }
 }
 
 void strada_decref(StradaValue *sv) {
-    if (!sv) return;
-    if (__sync_sub_and_fetch(&sv->refcount, 1) <= 0) {
+    if (!sv || STRADA_IS_IMMORTAL(sv)) return;
+    int rc;
+    if (strada_rc_atomic) {
+        rc = __sync_sub_and_fetch(&sv->refcount, 1);
+    } else {
+        rc = --sv->refcount;
+    }
+    if (rc <= 0) {
         strada_free_value(sv);
     }
 }
@@ -315,6 +743,18 @@ double strada_to_num(StradaValue *sv) {
     }
 }
 
+/* A value's text for reading only. A string's own bytes are returned
+ * without a copy; anything else is formatted into *tmp, which the caller
+ * frees (free(NULL) is fine). */
+const char* strada_str_peek(StradaValue *sv, char **tmp) {
+    if (sv && sv->type == STRADA_STR && sv->value.pv) {
+        *tmp = NULL;
+        return sv->value.pv;
+    }
+    *tmp = strada_to_str(sv);
+    return *tmp;
+}
+
 char* strada_to_str(StradaValue *sv) {
     static char buf[128];
     if (!sv) return strdup("");
@@ -487,20 +927,42 @@ StradaValue* strada_predecr(StradaValue **pv) {
 /* ===== ARRAY OPERATIONS ===== */
 
 StradaArray* strada_array_new(void) {
-    StradaArray *av = malloc(sizeof(StradaArray));
+    StradaArray *av = strada_slab_alloc(STRADA_SLAB_ARRAY);
     av->capacity = strada_default_array_capacity;
     av->size = 0;
+    av->head = 0;
     av->elements = calloc(av->capacity, sizeof(StradaValue*));
     av->refcount = 1;
+    av->gc_bits = 0;
     return av;
 }
 
+/* Room for at least `need` slots from elements on. When shift() has left
+ * as many free slots in front as there are elements, the elements slide
+ * back to the start instead, which keeps a push/shift queue in a buffer
+ * of bounded size. Either way the cost is paid for by the pushes or
+ * shifts since the last move, so push and shift stay amortized O(1). */
+static void strada_array_grow(StradaArray *av, size_t need) {
+    if (av->head > 0 && av->head >= av->size) {
+        StradaValue **base = av->elements - av->head;
+        memmove(base, av->elements, av->size * sizeof(StradaValue*));
+        av->elements = base;
+        av->capacity += av->head;
+        av->head = 0;
+        if (need <= av->capacity) return;
+    }
+    size_t cap = av->capacity ? av->capacity : 1;
+    while (cap < need) cap *= 2;
+    StradaValue **base = realloc(av->elements - av->head, (av->head + cap) * sizeof(StradaValue*));
+    av->elements = base + av->head;
+    av->capacity = cap;
+}
+
 void strada_array_push(StradaArray *av, StradaValue *sv) {
     if (!av) return;
 
     if (av->size >= av->capacity) {
-        av->capacity *= 2;
-        av->elements = realloc(av->elements, av->capacity * sizeof(StradaValue*));
+        strada_array_grow(av, av->size * 2);
     }
 
     av->elements[av->size++] = sv;
@@ -512,8 +974,7 @@ void strada_array_push_take(StradaArray *av, StradaValue *sv) {
     if (!av) return;
 
     if (av->size >= av->capacity) {
-        av->capacity *= 2;
-        av->elements = realloc(av->elements, av->capacity * sizeof(StradaValue*));
+        strada_array_grow(av, av->size * 2);
     }
 
     av->elements[av->size++] = sv;
@@ -527,22 +988,37 @@ StradaValue* strada_array_pop(StradaArray *av) {
 
 StradaValue* strada_array_shift(StradaArray *av) {
     if (!av || av->size == 0) return strada_new_undef();
-    
+
+    /* The first slot joins the free space in front */
     StradaValue *result = av->elements[0];
-    memmove(av->elements, av->elements + 1, (av->size - 1) * sizeof(StradaValue*));
+    av->elements++;
+    av->head++;
+    av->capacity--;
     av->size--;
+    if (av->size == 0) {
+        av->elements -= av->head;
+        av->capacity += av->head;
+        av->head = 0;
+    }
     return result;
 }
 
 void strada_array_unshift(StradaArray *av, StradaValue *sv) {
     if (!av) return;
-    
-    if (av->size >= av->capacity) {
-        av->capacity *= 2;
-        av->elements = realloc(av->elements, av->capacity * sizeof(StradaValue*));
+
+    if (av->head == 0) {
+        /* Open as many free slots in front as there are elements, so
+         * repeated unshifts only move the array once per doubling */
+        size_t room = av->size > 4 ? av->size : 4;
+        StradaValue **base = realloc(av->elements, (room + av->capacity) * sizeof(StradaValue*));
+        memmove(base + room, base, av->size * sizeof(StradaValue*));
+        av->elements = base + room;
+        av->head = room;
     }
-    
-    memmove(av->elements + 1, av->elements, av->size * sizeof(StradaValue*));
+
+    av->elements--;
+    av->head--;
+    av->capacity++;
     av->elements[0] = sv;
     av->size++;
     strada_incref(sv);
@@ -594,9 +1070,8 @@ void strada_array_set(StradaArray *av, int64_t idx, StradaValue *sv) {
     size_t uidx = (size_t)idx;
     
     /* Extend array if necessary */
-    while (uidx >= av->capacity) {
-        av->capacity *= 2;
-        av->elements = realloc(av->elements, av->capacity * sizeof(StradaValue*));
+    if (uidx >= av->capacity) {
+        strada_array_grow(av, uidx + 1 > av->capacity * 2 ? uidx + 1 : av->capacity * 2);
     }
     
     /* Fill gaps with undef */
@@ -658,7 +1133,8 @@ void strada_set_hash_default_capacity(int64_t capacity) {
 void strada_array_reserve(StradaArray *av, size_t capacity) {
     if (!av || capacity <= av->capacity) return;
 
-    av->elements = realloc(av->elements, capacity * sizeof(StradaValue*));
+    StradaValue **base = realloc(av->elements - av->head, (av->head + capacity) * sizeof(StradaValue*));
+    av->elements = base + av->head;
     /* Zero out new slots */
     for (size_t i = av->capacity; i < capacity; i++) {
         av->elements[i] = NULL;
@@ -703,93 +1179,215 @@ int64_t strada_size(StradaValue *sv) {
     }
 }
 
-/* Comparison function for qsort - alphabetical (string) sort */
-static int strada_sort_cmp_str(const void *a, const void *b) {
-    StradaValue *va = *(StradaValue **)a;
-    StradaValue *vb = *(StradaValue **)b;
-    char *sa = strada_to_str(va);
-    char *sb = strada_to_str(vb);
-    int result = strcmp(sa, sb);
-    free(sa);
-    free(sb);
-    return result;
+/* ===== KEYED SORTS =====
+ * sort, nsort and sort blocks of the form KEY($a) <=> KEY($b) (or cmp,
+ * or the reversed forms) compute each element's key once and sort
+ * (key, index) pairs: numbers with an LSD radix sort, strings with a
+ * stable merge sort on an 8-byte prefix. Equal keys keep input order. */
+
+#define STRADA_SORT_SMALL 32        /* Below this, insertion sort */
+
+typedef struct {
+    uint64_t key;
+    size_t index;
+} StradaNumKey;
+
+/* Map a double to an unsigned key with the same order; desc inverts it */
+static inline uint64_t strada_sort_num_bits(double d, int desc) {
+    if (d == 0.0) d = 0.0;          /* -0.0 sorts with 0.0 */
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    u = (u & 0x8000000000000000ULL) ? ~u : (u | 0x8000000000000000ULL);
+    return desc ? ~u : u;
 }
 
-/* Comparison function for qsort - numeric sort */
-static int strada_sort_cmp_num(const void *a, const void *b) {
-    StradaValue *va = *(StradaValue **)a;
-    StradaValue *vb = *(StradaValue **)b;
-    double na = strada_to_num(va);
-    double nb = strada_to_num(vb);
-    if (na < nb) return -1;
-    if (na > nb) return 1;
-    return 0;
+/* Result array holding input's elements in the order given by index */
+static StradaValue* strada_sort_gather(StradaArray *input, const size_t *order, size_t n) {
+    StradaValue *result = strada_new_array();
+    StradaArray *rav = result->value.av;
+    strada_array_reserve(rav, n);
+    for (size_t i = 0; i < n; i++) {
+        StradaValue *v = input->elements[order[i]];
+        strada_incref(v);
+        rav->elements[i] = v;
+    }
+    rav->size = n;
+    return result;
 }
 
-/* Sort array alphabetically (by string comparison) */
-StradaValue* strada_sort(StradaValue *arr) {
-    if (!arr) {
+/* Sort input by numeric keys (one per element); frees keys */
+StradaValue* strada_sort_num_keys(StradaArray *input, double *keys, int desc) {
+    size_t n = input ? input->size : 0;
+    if (n == 0) {
+        free(keys);
         return strada_new_array();
     }
-
-    /* Handle array references */
-    StradaArray *av = NULL;
-    if (arr->type == STRADA_REF && arr->value.rv && arr->value.rv->type == STRADA_ARRAY) {
-        av = arr->value.rv->value.av;
-    } else if (arr->type == STRADA_ARRAY) {
-        av = arr->value.av;
+    StradaNumKey *a = malloc(sizeof(StradaNumKey) * n);
+    for (size_t i = 0; i < n; i++) {
+        a[i].key = strada_sort_num_bits(keys[i], desc);
+        a[i].index = i;
     }
+    free(keys);
 
-    if (!av || av->size == 0) {
-        return strada_new_array();
+    if (n < STRADA_SORT_SMALL) {
+        for (size_t i = 1; i < n; i++) {
+            StradaNumKey v = a[i];
+            size_t j = i;
+            while (j > 0 && a[j - 1].key > v.key) {
+                a[j] = a[j - 1];
+                j--;
+            }
+            a[j] = v;
+        }
+    } else {
+        /* One counting pass for all eight byte positions; bytes that are
+         * the same in every key are skipped */
+        size_t (*counts)[256] = calloc(8, sizeof(*counts));
+        for (size_t i = 0; i < n; i++) {
+            uint64_t k = a[i].key;
+            for (int b = 0; b < 8; b++) {
+                counts[b][(k >> (b * 8)) & 0xff]++;
+            }
+        }
+        StradaNumKey *tmp = malloc(sizeof(StradaNumKey) * n);
+        StradaNumKey *src = a, *dst = tmp;
+        for (int b = 0; b < 8; b++) {
+            size_t *c = counts[b];
+            if (c[(src[0].key >> (b * 8)) & 0xff] == n) continue;
+            size_t sum = 0;
+            for (int d = 0; d < 256; d++) {
+                size_t t = c[d];
+                c[d] = sum;
+                sum += t;
+            }
+            for (size_t i = 0; i < n; i++) {
+                dst[c[(src[i].key >> (b * 8)) & 0xff]++] = src[i];
+            }
+            StradaNumKey *t = src; src = dst; dst = t;
+        }
+        if (src != a) memcpy(a, src, sizeof(StradaNumKey) * n);
+        free(tmp);
+        free(counts);
     }
 
-    /* Create a new array with sorted elements */
-    StradaValue *result = strada_new_array();
-    StradaArray *result_av = result->value.av;
-
-    /* Copy elements to result */
-    for (size_t i = 0; i < av->size; i++) {
-        strada_array_push(result_av, av->elements[i]);
-    }
+    size_t *order = malloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++) order[i] = a[i].index;
+    free(a);
+    StradaValue *result = strada_sort_gather(input, order, n);
+    free(order);
+    return result;
+}
 
-    /* Sort in place */
-    qsort(result_av->elements, result_av->size, sizeof(StradaValue*), strada_sort_cmp_str);
+typedef struct {
+    uint64_t prefix;                /* First 8 bytes, big-endian */
+    const char *s;
+    size_t index;
+} StradaStrKey;
 
-    return result;
+static inline int strada_str_key_cmp(const StradaStrKey *x, const StradaStrKey *y) {
+    if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+    return strcmp(x->s, y->s);
 }
 
-/* Sort array numerically */
-StradaValue* strada_nsort(StradaValue *arr) {
-    if (!arr) {
+/* Sort input by string keys (one per element, owned); releases keys */
+StradaValue* strada_sort_str_keys(StradaArray *input, StradaValue **keys, int desc) {
+    size_t n = input ? input->size : 0;
+    if (n == 0) {
+        free(keys);
         return strada_new_array();
     }
-
-    /* Handle array references */
-    StradaArray *av = NULL;
-    if (arr->type == STRADA_REF && arr->value.rv && arr->value.rv->type == STRADA_ARRAY) {
-        av = arr->value.rv->value.av;
-    } else if (arr->type == STRADA_ARRAY) {
-        av = arr->value.av;
+    StradaStrKey *a = malloc(sizeof(StradaStrKey) * n);
+    char **tmps = calloc(n, sizeof(char *));
+    for (size_t i = 0; i < n; i++) {
+        const char *s = strada_str_peek(keys[i], &tmps[i]);
+        uint64_t p = 0;
+        int b = 0;
+        for (; b < 8 && s[b]; b++) p = (p << 8) | (unsigned char)s[b];
+        p <<= (8 - b) * 8;
+        a[i].prefix = p;
+        a[i].s = s;
+        a[i].index = i;
+    }
+
+    /* Bottom-up merge sort over insertion-sorted runs */
+    int sign = desc ? -1 : 1;
+    for (size_t run = 0; run < n; run += 8) {
+        size_t end = run + 8 < n ? run + 8 : n;
+        for (size_t i = run + 1; i < end; i++) {
+            StradaStrKey v = a[i];
+            size_t j = i;
+            while (j > run && sign * strada_str_key_cmp(&a[j - 1], &v) > 0) {
+                a[j] = a[j - 1];
+                j--;
+            }
+            a[j] = v;
+        }
     }
-
-    if (!av || av->size == 0) {
-        return strada_new_array();
+    StradaStrKey *tmp = malloc(sizeof(StradaStrKey) * n);
+    StradaStrKey *src = a, *dst = tmp;
+    for (size_t width = 8; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                if (sign * strada_str_key_cmp(&src[i], &src[j]) > 0) {
+                    dst[k++] = src[j++];
+                } else {
+                    dst[k++] = src[i++];
+                }
+            }
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        StradaStrKey *t = src; src = dst; dst = t;
     }
 
-    /* Create a new array with sorted elements */
-    StradaValue *result = strada_new_array();
-    StradaArray *result_av = result->value.av;
+    size_t *order = malloc(sizeof(size_t) * n);
+    for (size_t i = 0; i < n; i++) order[i] = src[i].index;
+    free(a);
+    free(tmp);
+    for (size_t i = 0; i < n; i++) {
+        free(tmps[i]);
+        strada_decref(keys[i]);
+    }
+    free(tmps);
+    free(keys);
+    StradaValue *result = strada_sort_gather(input, order, n);
+    free(order);
+    return result;
+}
 
-    /* Copy elements to result */
-    for (size_t i = 0; i < av->size; i++) {
-        strada_array_push(result_av, av->elements[i]);
+/* Array behind an array value or array reference */
+static StradaArray* strada_sort_input(StradaValue *arr) {
+    if (!arr) return NULL;
+    if (arr->type == STRADA_REF && arr->value.rv && arr->value.rv->type == STRADA_ARRAY) {
+        return arr->value.rv->value.av;
     }
+    return arr->type == STRADA_ARRAY ? arr->value.av : NULL;
+}
 
-    /* Sort in place */
-    qsort(result_av->elements, result_av->size, sizeof(StradaValue*), strada_sort_cmp_num);
+/* Sort array alphabetically (by string comparison) */
+StradaValue* strada_sort(StradaValue *arr) {
+    StradaArray *av = strada_sort_input(arr);
+    size_t n = av ? av->size : 0;
+    StradaValue **keys = malloc(sizeof(StradaValue *) * (n + 1));
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = av->elements[i];
+        strada_incref(keys[i]);
+    }
+    return strada_sort_str_keys(av, keys, 0);
+}
 
-    return result;
+/* Sort array numerically */
+StradaValue* strada_nsort(StradaValue *arr) {
+    StradaArray *av = strada_sort_input(arr);
+    size_t n = av ? av->size : 0;
+    double *keys = malloc(sizeof(double) * (n + 1));
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = strada_to_num(av->elements[i]);
+    }
+    return strada_sort_num_keys(av, keys, 0);
 }
 
 /* Create array from range (start..end) */
@@ -800,6 +1398,13 @@ StradaValue* strada_range(StradaValue *start, StradaValue *end) {
     int64_t start_val = strada_to_num(start);
     int64_t end_val = strada_to_num(end);
 
+    /* One allocation for the element slots instead of repeated doubling */
+    uint64_t count = start_val <= end_val ? (uint64_t)(end_val - start_val) + 1
+                                          : (uint64_t)(start_val - end_val) + 1;
+    if (count > av->capacity && count < ((uint64_t)1 << 32)) {
+        strada_array_reserve(av, (size_t)count);
+    }
+
     if (start_val <= end_val) {
         /* Ascending range */
         for (int64_t i = start_val; i <= end_val; i++) {
@@ -817,168 +1422,489 @@ StradaValue* strada_range(StradaValue *start, StradaValue *end) {
 
 /* ===== HASH OPERATIONS ===== */
 
-static unsigned int strada_hash_string(const char *str) {
-    unsigned int hash = 5381;
-    int c;
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash;
+/* StradaHash is an open-addressing table with Robin Hood linear probing.
+ * Slots live in one flat array (power-of-two size); an empty slot has a
+ * NULL key. Each slot keeps the key's hash and length, so probes compare
+ * those before touching key bytes and resizes never rehash a key. Robin
+ * Hood placement keeps probe sequences short and lets a miss stop as soon
+ * as it meets an entry closer to its home slot than the probe is; deletes
+ * shift the following run back instead of leaving tombstones.
+ *
+ * Keys are hashed with a wyhash-style function keyed by a per-process
+ * random seed, so colliding keys cannot be precomputed. Set
+ * STRADA_HASH_SEED to a number to get a fixed seed (and a repeatable
+ * keys() order) when debugging. */
+
+#define STRADA_HASH_P0 0xa0761d6478bd642fULL
+#define STRADA_HASH_P1 0xe7037ed1a0b428dbULL
+#define STRADA_HASH_P2 0x8ebc6af09c88c6e3ULL
+#define STRADA_HASH_P3 0x589965cc75374cc3ULL
+
+static uint64_t strada_hash_seed = STRADA_HASH_P0;
+static uint64_t strada_hash_seed2 = STRADA_HASH_P1;
+
+/* 64x64 -> 128 multiply; returns the low half and stores the high half */
+static inline uint64_t strada_hash_mul128(uint64_t a, uint64_t b, uint64_t *hi) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    *hi = (uint64_t)(r >> 64);
+    return (uint64_t)r;
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo;
+#endif
 }
 
-/* Resize hash table when load factor exceeds threshold */
-static void strada_hash_resize(StradaHash *hv) {
-    if (!hv) return;
-
-    size_t old_num_buckets = hv->num_buckets;
-    size_t new_num_buckets = old_num_buckets * 2;
-    StradaHashEntry **old_buckets = hv->buckets;
-
-    /* Allocate new bucket array */
-    hv->buckets = calloc(new_num_buckets, sizeof(StradaHashEntry*));
-    hv->num_buckets = new_num_buckets;
+static inline uint64_t strada_hash_mum(uint64_t a, uint64_t b) {
+    uint64_t hi;
+    uint64_t lo = strada_hash_mul128(a, b, &hi);
+    return lo ^ hi;
+}
 
-    /* Rehash all entries into new buckets */
-    for (size_t i = 0; i < old_num_buckets; i++) {
-        StradaHashEntry *entry = old_buckets[i];
-        while (entry) {
-            StradaHashEntry *next = entry->next;
+static inline uint64_t strada_hash_r8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
 
-            /* Compute new bucket index */
-            unsigned int hash = strada_hash_string(entry->key);
-            unsigned int bucket = hash % new_num_buckets;
+static inline uint64_t strada_hash_r4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
 
-            /* Insert at head of new bucket chain */
-            entry->next = hv->buckets[bucket];
-            hv->buckets[bucket] = entry;
+static inline uint64_t strada_hash_bytes(const char *key, size_t len) {
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t seed = strada_hash_seed;
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (strada_hash_r4(p) << 32) | strada_hash_r4(p + ((len >> 3) << 2));
+            b = (strada_hash_r4(p + len - 4) << 32) | strada_hash_r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = strada_hash_mum(strada_hash_r8(p) ^ STRADA_HASH_P1, strada_hash_r8(p + 8) ^ seed);
+                see1 = strada_hash_mum(strada_hash_r8(p + 16) ^ STRADA_HASH_P2, strada_hash_r8(p + 24) ^ see1);
+                see2 = strada_hash_mum(strada_hash_r8(p + 32) ^ STRADA_HASH_P3, strada_hash_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = strada_hash_mum(strada_hash_r8(p) ^ STRADA_HASH_P1, strada_hash_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = strada_hash_r8(p + i - 16);
+        b = strada_hash_r8(p + i - 8);
+    }
+    /* Both inputs carry the secret seed, so a key cannot zero a factor */
+    uint64_t hi;
+    uint64_t lo = strada_hash_mul128(a ^ strada_hash_seed2, b ^ seed, &hi);
+    return strada_hash_mum(lo ^ STRADA_HASH_P0 ^ len, hi ^ STRADA_HASH_P1);
+}
 
-            entry = next;
+__attribute__((constructor(101)))
+static void strada_hash_seed_init(void) {
+    uint64_t seed = 0;
+    const char *env = getenv("STRADA_HASH_SEED");
+    if (env && *env) {
+        seed = strtoull(env, NULL, 0);
+    } else {
+        int fd = open("/dev/urandom", O_RDONLY);
+        if (fd < 0 || read(fd, &seed, sizeof(seed)) != (ssize_t)sizeof(seed)) {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            seed = ((uint64_t)tv.tv_sec << 32) ^ (uint64_t)tv.tv_usec ^
+                   ((uint64_t)getpid() << 16) ^ (uint64_t)(uintptr_t)&seed;
         }
+        if (fd >= 0) close(fd);
     }
+    strada_hash_seed = seed ^ strada_hash_mum(seed ^ STRADA_HASH_P0, STRADA_HASH_P1);
+    strada_hash_seed2 = strada_hash_mum(strada_hash_seed ^ STRADA_HASH_P2, STRADA_HASH_P3) | 1;
+}
 
-    free(old_buckets);
+/* 32-bit hash stored in each slot; the low bits pick the home slot */
+static inline uint32_t strada_hash_key(const char *key, size_t len) {
+    return (uint32_t)strada_hash_bytes(key, len);
 }
 
-StradaHash* strada_hash_new(void) {
-    StradaHash *hv = malloc(sizeof(StradaHash));
-    hv->num_buckets = strada_default_hash_capacity;
-    hv->num_entries = 0;
-    hv->buckets = calloc(hv->num_buckets, sizeof(StradaHashEntry*));
-    hv->refcount = 1;
-    return hv;
+#define STRADA_HASH_DIST(hv, h, slot) (((slot) - ((h) & ((hv)->num_buckets - 1))) & ((hv)->num_buckets - 1))
+
+static size_t strada_hash_round_slots(size_t want) {
+    size_t n = 8;
+    while (n < want) n <<= 1;
+    return n;
 }
 
-void strada_hash_set(StradaHash *hv, const char *key, StradaValue *sv) {
-    if (!hv || !key) return;
-    
-    unsigned int hash = strada_hash_string(key);
-    unsigned int bucket = hash % hv->num_buckets;
-    
-    /* Check if key exists */
-    StradaHashEntry *entry = hv->buckets[bucket];
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            /* IMPORTANT: incref new value BEFORE decref old value
-             * This handles the case where sv == entry->value with refcount 1.
-             * Without this order, decref would free the object before incref. */
-            strada_incref(sv);
-            strada_decref(entry->value);
-            entry->value = sv;
+/* Put an entry whose key is known to be absent */
+static void strada_hash_place(StradaHash *hv, StradaHashEntry ins) {
+    size_t mask = hv->num_buckets - 1;
+    size_t i = ins.hash & mask;
+    size_t dist = 0;
+    for (;;) {
+        StradaHashEntry *e = &hv->entries[i];
+        if (!e->key) {
+            *e = ins;
             return;
         }
-        entry = entry->next;
+        size_t edist = STRADA_HASH_DIST(hv, e->hash, i);
+        if (edist < dist) {
+            /* Take the slot from the richer entry and carry it forward */
+            StradaHashEntry tmp = *e;
+            *e = ins;
+            ins = tmp;
+            dist = edist;
+        }
+        i = (i + 1) & mask;
+        dist++;
     }
-    
-    /* Add new entry - incref the value for shared ownership */
-    entry = malloc(sizeof(StradaHashEntry));
-    entry->key = strdup(key);
-    entry->value = sv;
-    strada_incref(sv);
-    entry->next = hv->buckets[bucket];
-    hv->buckets[bucket] = entry;
-    hv->num_entries++;
+}
+
+/* Move all entries into a table of new_slots slots (stored hashes reused) */
+static void strada_hash_rebuild(StradaHash *hv, size_t new_slots) {
+    StradaHashEntry *old = hv->entries;
+    size_t old_slots = hv->num_buckets;
 
-    /* Resize if load factor exceeds 0.75 (num_entries * 4 > num_buckets * 3) */
-    if (hv->num_entries * 4 > hv->num_buckets * 3) {
-        strada_hash_resize(hv);
+    hv->entries = calloc(new_slots, sizeof(StradaHashEntry));
+    hv->num_buckets = new_slots;
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].key) strada_hash_place(hv, old[i]);
     }
+    free(old);
 }
 
-StradaValue* strada_hash_get(StradaHash *hv, const char *key) {
-    if (!hv || !key) return strada_undef_static();
+/* ===== INTERNED HASH KEYS =====
+ * Every key stored in a StradaHash is a shared, refcounted copy from one
+ * global table, so a million records with an "id" field hold one "id".
+ * Keys resolved for compiled literals are immortal.  The table is split
+ * into shards by the top hash bits; shard locks are only taken once a
+ * second thread may exist (same switch as the atomic refcounts). */
 
-    unsigned int hash = strada_hash_string(key);
-    unsigned int bucket = hash % hv->num_buckets;
+typedef struct StradaKey {
+    struct StradaKey *next;
+    int refcount;
+    uint32_t hash;
+    uint32_t len;
+    char str[];
+} StradaKey;
 
-    StradaHashEntry *entry = hv->buckets[bucket];
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            // Return borrowed reference - hash still owns it
-            return entry->value;
-        }
-        entry = entry->next;
-    }
+#define STRADA_KEY_OF(s) ((StradaKey *)((char *)(s) - offsetof(StradaKey, str)))
+#define STRADA_KEY_SHARDS 64
+#define STRADA_KEY_SHARD(h) (&strada_key_shards[(h) >> 26])
 
-    return strada_undef_static();
-}
+typedef struct {
+    pthread_mutex_t lock;
+    StradaKey **buckets;
+    size_t num_buckets;
+    size_t count;
+} StradaKeyShard;
 
-int strada_hash_exists(StradaHash *hv, const char *key) {
-    if (!hv || !key) return 0;
-    
-    unsigned int hash = strada_hash_string(key);
-    unsigned int bucket = hash % hv->num_buckets;
-    
-    StradaHashEntry *entry = hv->buckets[bucket];
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            return 1;
+static StradaKeyShard strada_key_shards[STRADA_KEY_SHARDS];
+
+static void strada_key_atfork_prepare(void) {
+    for (int i = 0; i < STRADA_KEY_SHARDS; i++)
+        pthread_mutex_lock(&strada_key_shards[i].lock);
+}
+
+static void strada_key_atfork_release(void) {
+    for (int i = STRADA_KEY_SHARDS - 1; i >= 0; i--)
+        pthread_mutex_unlock(&strada_key_shards[i].lock);
+}
+
+__attribute__((constructor(101)))
+static void strada_key_table_init(void) {
+    for (int i = 0; i < STRADA_KEY_SHARDS; i++)
+        pthread_mutex_init(&strada_key_shards[i].lock, NULL);
+    pthread_atfork(strada_key_atfork_prepare, strada_key_atfork_release,
+                   strada_key_atfork_release);
+}
+
+static inline void strada_key_lock(StradaKeyShard *s) {
+    if (strada_rc_atomic) pthread_mutex_lock(&s->lock);
+}
+
+static inline void strada_key_unlock(StradaKeyShard *s) {
+    if (strada_rc_atomic) pthread_mutex_unlock(&s->lock);
+}
+
+static void strada_key_shard_grow(StradaKeyShard *s) {
+    size_t n = s->num_buckets ? s->num_buckets * 2 : 64;
+    StradaKey **nb = calloc(n, sizeof(StradaKey *));
+    for (size_t i = 0; i < s->num_buckets; i++) {
+        StradaKey *k = s->buckets[i];
+        while (k) {
+            StradaKey *next = k->next;
+            k->next = nb[k->hash & (n - 1)];
+            nb[k->hash & (n - 1)] = k;
+            k = next;
         }
-        entry = entry->next;
     }
-    
-    return 0;
+    free(s->buckets);
+    s->buckets = nb;
+    s->num_buckets = n;
+}
+
+/* Return the interned copy of key with one reference added */
+static char* strada_key_intern(const char *key, size_t len, uint32_t hash, int immortal) {
+    StradaKeyShard *s = STRADA_KEY_SHARD(hash);
+    strada_key_lock(s);
+    if (s->num_buckets) {
+        for (StradaKey *k = s->buckets[hash & (s->num_buckets - 1)]; k; k = k->next) {
+            if (k->hash == hash && k->len == len && memcmp(k->str, key, len) == 0) {
+                if (immortal) k->refcount = STRADA_REFCOUNT_IMMORTAL;
+                else if (k->refcount < STRADA_REFCOUNT_IMMORTAL) k->refcount++;
+                strada_key_unlock(s);
+                return k->str;
+            }
+        }
+    }
+    if (s->count >= s->num_buckets) strada_key_shard_grow(s);
+    StradaKey *k = malloc(sizeof(StradaKey) + len + 1);
+    k->refcount = immortal ? STRADA_REFCOUNT_IMMORTAL : 1;
+    k->hash = hash;
+    k->len = (uint32_t)len;
+    memcpy(k->str, key, len);
+    k->str[len] = '\0';
+    size_t b = hash & (s->num_buckets - 1);
+    k->next = s->buckets[b];
+    s->buckets[b] = k;
+    s->count++;
+    strada_key_unlock(s);
+    return k->str;
+}
+
+/* Add a reference to a key that is already interned */
+static inline void strada_key_incref(char *str) {
+    StradaKey *k = STRADA_KEY_OF(str);
+    if (k->refcount >= STRADA_REFCOUNT_IMMORTAL) return;
+    StradaKeyShard *s = STRADA_KEY_SHARD(k->hash);
+    strada_key_lock(s);
+    if (k->refcount < STRADA_REFCOUNT_IMMORTAL) k->refcount++;
+    strada_key_unlock(s);
+}
+
+static void strada_key_release(char *str) {
+    StradaKey *k = STRADA_KEY_OF(str);
+    if (k->refcount >= STRADA_REFCOUNT_IMMORTAL) return;
+    StradaKeyShard *s = STRADA_KEY_SHARD(k->hash);
+    strada_key_lock(s);
+    /* Re-check under the lock: a literal may have made it immortal */
+    if (k->refcount < STRADA_REFCOUNT_IMMORTAL && --k->refcount == 0) {
+        StradaKey **pp = &s->buckets[k->hash & (s->num_buckets - 1)];
+        while (*pp != k) pp = &(*pp)->next;
+        *pp = k->next;
+        s->count--;
+        free(k);
+    }
+    strada_key_unlock(s);
+}
+
+/* Slow path of STRADA_HASH_KEY resolution: intern the literal for good */
+const char* strada_hash_key_resolve(StradaHashKey *hk) {
+    size_t len = strlen(hk->name);
+    uint32_t hash = strada_hash_key(hk->name, len);
+    char *key = strada_key_intern(hk->name, len, hash, 1);
+    /* Racing threads store identical values; the release store publishes hash */
+    __atomic_store_n(&hk->hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&hk->key, key, __ATOMIC_RELEASE);
+    return key;
+}
+
+static inline const char* strada_hash_key_get(StradaHashKey *hk) {
+    const char *key = __atomic_load_n(&hk->key, __ATOMIC_ACQUIRE);
+    return key ? key : strada_hash_key_resolve(hk);
+}
+
+static inline StradaHashEntry* strada_hash_find(StradaHash *hv, const char *key, size_t len, uint32_t hash) {
+    if (hv->num_entries == 0) return NULL;
+    size_t mask = hv->num_buckets - 1;
+    size_t i = hash & mask;
+    for (size_t dist = 0; ; dist++) {
+        StradaHashEntry *e = &hv->entries[i];
+        if (!e->key) return NULL;
+        if (e->hash == hash && e->key_len == len && memcmp(e->key, key, len) == 0) {
+            return e;
+        }
+        if (((i - (e->hash & mask)) & mask) < dist) return NULL;
+        i = (i + 1) & mask;
+    }
 }
 
-void strada_hash_delete(StradaHash *hv, const char *key) {
+StradaHash* strada_hash_new(void) {
+    /* Slots are allocated on first insert; empty hashes (and most short-lived
+     * ones) never pay for the table */
+    StradaHash *hv = strada_slab_alloc(STRADA_SLAB_HASH);
+    hv->entries = NULL;
+    hv->num_buckets = 0;
+    hv->num_entries = 0;
+    hv->refcount = 1;
+    hv->gc_bits = 0;
+    return hv;
+}
+
+/* Interned keys are unique, so literal-key lookups compare pointers */
+static inline StradaHashEntry* strada_hash_find_interned(StradaHash *hv, const char *key, uint32_t hash) {
+    if (hv->num_entries == 0) return NULL;
+    size_t mask = hv->num_buckets - 1;
+    size_t i = hash & mask;
+    for (size_t dist = 0; ; dist++) {
+        StradaHashEntry *e = &hv->entries[i];
+        if (!e->key) return NULL;
+        if (e->key == key) return e;
+        if (((i - (e->hash & mask)) & mask) < dist) return NULL;
+        i = (i + 1) & mask;
+    }
+}
+
+/* Store sv under key: ikey is the interned key when the caller has one */
+static void strada_hash_store(StradaHash *hv, const char *key, size_t len, uint32_t hash,
+                              char *ikey, StradaValue *sv) {
+    /* Check if key exists */
+    StradaHashEntry *entry = ikey ? strada_hash_find_interned(hv, ikey, hash)
+                                  : strada_hash_find(hv, key, len, hash);
+    if (entry) {
+        /* IMPORTANT: incref new value BEFORE decref old value
+         * This handles the case where sv == entry->value with refcount 1.
+         * Without this order, decref would free the object before incref. */
+        strada_incref(sv);
+        strada_decref(entry->value);
+        entry->value = sv;
+        return;
+    }
+
+    /* Grow before inserting so the load factor stays at or below 0.75 */
+    if (hv->num_buckets == 0) {
+        strada_hash_rebuild(hv, strada_hash_round_slots(strada_default_hash_capacity));
+    } else if ((hv->num_entries + 1) * 4 > hv->num_buckets * 3) {
+        strada_hash_rebuild(hv, hv->num_buckets * 2);
+    }
+
+    /* Add new entry - incref the value for shared ownership */
+    StradaHashEntry ins;
+    if (ikey) {
+        strada_key_incref(ikey);
+        ins.key = ikey;
+    } else {
+        ins.key = strada_key_intern(key, len, hash, 0);
+    }
+    ins.value = sv;
+    ins.hash = hash;
+    ins.key_len = (uint32_t)len;
+    strada_incref(sv);
+    strada_hash_place(hv, ins);
+    hv->num_entries++;
+}
+
+void strada_hash_set(StradaHash *hv, const char *key, StradaValue *sv) {
     if (!hv || !key) return;
-    
-    unsigned int hash = strada_hash_string(key);
-    unsigned int bucket = hash % hv->num_buckets;
-    
-    StradaHashEntry *entry = hv->buckets[bucket];
-    StradaHashEntry *prev = NULL;
-    
-    while (entry) {
-        if (strcmp(entry->key, key) == 0) {
-            if (prev) {
-                prev->next = entry->next;
-            } else {
-                hv->buckets[bucket] = entry->next;
-            }
-            
-            free(entry->key);
-            strada_decref(entry->value);
-            free(entry);
-            hv->num_entries--;
-            return;
+
+    size_t len = strlen(key);
+    strada_hash_store(hv, key, len, strada_hash_key(key, len), NULL, sv);
+}
+
+void strada_hash_set_h(StradaHash *hv, StradaHashKey *hk, StradaValue *sv) {
+    if (!hv) return;
+
+    char *key = (char *)strada_hash_key_get(hk);
+    strada_hash_store(hv, key, STRADA_KEY_OF(key)->len, hk->hash, key, sv);
+}
+
+StradaValue* strada_hash_get(StradaHash *hv, const char *key) {
+    if (!hv || !key || hv->num_entries == 0) return strada_undef_static();
+
+    size_t len = strlen(key);
+    StradaHashEntry *entry = strada_hash_find(hv, key, len, strada_hash_key(key, len));
+    // Return borrowed reference - hash still owns it
+    return entry ? entry->value : strada_undef_static();
+}
+
+StradaValue* strada_hash_get_h(StradaHash *hv, StradaHashKey *hk) {
+    if (!hv || hv->num_entries == 0) return strada_undef_static();
+
+    const char *key = strada_hash_key_get(hk);
+    StradaHashEntry *entry = strada_hash_find_interned(hv, key, hk->hash);
+    return entry ? entry->value : strada_undef_static();
+}
+
+int strada_hash_exists(StradaHash *hv, const char *key) {
+    if (!hv || !key || hv->num_entries == 0) return 0;
+
+    size_t len = strlen(key);
+    return strada_hash_find(hv, key, len, strada_hash_key(key, len)) != NULL;
+}
+
+int strada_hash_exists_h(StradaHash *hv, StradaHashKey *hk) {
+    if (!hv || hv->num_entries == 0) return 0;
+
+    const char *key = strada_hash_key_get(hk);
+    return strada_hash_find_interned(hv, key, hk->hash) != NULL;
+}
+
+/* Remove an entry and backward-shift the rest of its run */
+static void strada_hash_remove(StradaHash *hv, StradaHashEntry *entry) {
+    strada_key_release(entry->key);
+    strada_decref(entry->value);
+    hv->num_entries--;
+
+    /* Backward-shift the rest of the run so lookups never see a hole */
+    size_t mask = hv->num_buckets - 1;
+    size_t i = (size_t)(entry - hv->entries);
+    for (;;) {
+        size_t next = (i + 1) & mask;
+        StradaHashEntry *n = &hv->entries[next];
+        if (!n->key || STRADA_HASH_DIST(hv, n->hash, next) == 0) {
+            hv->entries[i].key = NULL;
+            hv->entries[i].value = NULL;
+            break;
         }
-        prev = entry;
-        entry = entry->next;
+        hv->entries[i] = *n;
+        i = next;
     }
 }
 
+void strada_hash_delete(StradaHash *hv, const char *key) {
+    if (!hv || !key || hv->num_entries == 0) return;
+
+    size_t len = strlen(key);
+    StradaHashEntry *entry = strada_hash_find(hv, key, len, strada_hash_key(key, len));
+    if (entry) strada_hash_remove(hv, entry);
+}
+
+void strada_hash_delete_h(StradaHash *hv, StradaHashKey *hk) {
+    if (!hv || hv->num_entries == 0) return;
+
+    const char *key = strada_hash_key_get(hk);
+    StradaHashEntry *entry = strada_hash_find_interned(hv, key, hk->hash);
+    if (entry) strada_hash_remove(hv, entry);
+}
+
 StradaArray* strada_hash_keys(StradaHash *hv) {
     StradaArray *av = strada_array_new();
     if (!hv) return av;
-    
+
     for (size_t i = 0; i < hv->num_buckets; i++) {
-        StradaHashEntry *entry = hv->buckets[i];
-        while (entry) {
-            strada_array_push_take(av, strada_new_str(entry->key));
-            entry = entry->next;
+        StradaHashEntry *entry = &hv->entries[i];
+        if (entry->key) {
+            strada_array_push_take(av, strada_new_str_len(entry->key, entry->key_len));
         }
     }
-    
+
     return av;
 }
 
@@ -987,46 +1913,21 @@ StradaArray* strada_hash_values(StradaHash *hv) {
     if (!hv) return av;
 
     for (size_t i = 0; i < hv->num_buckets; i++) {
-        StradaHashEntry *entry = hv->buckets[i];
-        while (entry) {
+        StradaHashEntry *entry = &hv->entries[i];
+        if (entry->key) {
             strada_array_push(av, entry->value);
-            entry = entry->next;
         }
     }
 
     return av;
 }
 
-/* Reserve capacity for hash (pre-allocate buckets) */
-void strada_hash_reserve(StradaHash *hv, size_t num_buckets) {
-    if (!hv || num_buckets <= hv->num_buckets) return;
-
-    size_t old_num_buckets = hv->num_buckets;
-    StradaHashEntry **old_buckets = hv->buckets;
-
-    /* Allocate new bucket array */
-    hv->buckets = calloc(num_buckets, sizeof(StradaHashEntry*));
-    hv->num_buckets = num_buckets;
-
-    /* Rehash all entries into new buckets */
-    for (size_t i = 0; i < old_num_buckets; i++) {
-        StradaHashEntry *entry = old_buckets[i];
-        while (entry) {
-            StradaHashEntry *next = entry->next;
-
-            /* Compute new bucket index */
-            unsigned int hash = strada_hash_string(entry->key);
-            unsigned int bucket = hash % num_buckets;
-
-            /* Insert at head of new bucket chain */
-            entry->next = hv->buckets[bucket];
-            hv->buckets[bucket] = entry;
-
-            entry = next;
-        }
-    }
-
-    free(old_buckets);
+/* Reserve capacity for hash (room for that many keys without growing) */
+void strada_hash_reserve(StradaHash *hv, size_t capacity) {
+    if (!hv) return;
+    size_t slots = strada_hash_round_slots(capacity + capacity / 3 + 1);
+    if (slots <= hv->num_buckets) return;
+    strada_hash_rebuild(hv, slots);
 }
 
 /* Reserve capacity for hash value (handles refs) */
@@ -1180,85 +2081,100 @@ char* strada_concat_free(char *a, char *b) {
     return result;
 }
 
-/* Optimized string concatenation working directly on StradaValues
- * KEY OPTIMIZATION: In-place append when a has refcount == 1
- * This makes $s = $s . "x" loops O(n) instead of O(n²) */
-StradaValue* strada_concat_sv(StradaValue *a, StradaValue *b) {
-    /* Get string pointer and length for b */
-    const char *str_b = "";
-    size_t len_b = 0;
-    char buf_b[32];
-
-    if (b) {
-        if (b->type == STRADA_STR && b->value.pv) {
-            str_b = b->value.pv;
-            len_b = b->struct_size;
-        } else if (b->type == STRADA_INT) {
-            len_b = snprintf(buf_b, sizeof(buf_b), "%lld", (long long)b->value.iv);
-            str_b = buf_b;
-        } else if (b->type == STRADA_NUM) {
-            len_b = snprintf(buf_b, sizeof(buf_b), "%g", b->value.nv);
-            str_b = buf_b;
-        }
-    }
-
-    /* DISABLED: In-place optimization breaks global variables.
-     * When a global like g_template_dir is passed to concat with refcount==1,
-     * modifying it in-place corrupts the global. We can't distinguish globals
-     * from temporaries at runtime, so we always create new strings.
-     * TODO: Have code generator use strada_concat_inplace for $s = $s . x patterns
-     * where we know it's safe to modify in place. */
-#if 0
-    /* KEY OPTIMIZATION: In-place append when a is a string with refcount == 1
-     * This is the common case for $s = $s . "x" patterns */
-    if (a && a->type == STRADA_STR && a->refcount == 1 && a->value.pv) {
-        size_t len_a = a->struct_size;
-        size_t new_len = len_a + len_b;
-
-        /* Realloc in place - avoids copy of existing data! */
-        a->value.pv = realloc(a->value.pv, new_len + 1);
-        if (len_b > 0) memcpy(a->value.pv + len_a, str_b, len_b);
-        a->value.pv[new_len] = '\0';
-        a->struct_size = new_len;
-        return a;  /* Return same StradaValue, no allocation! */
+/* Bytes of a concat operand: strings as-is, numbers formatted into buf */
+static const char* strada_concat_operand(StradaValue *sv, char *buf, size_t buf_size, size_t *len) {
+    *len = 0;
+    if (!sv) return "";
+    if (sv->type == STRADA_STR && sv->value.pv) {
+        *len = sv->struct_size;
+        return sv->value.pv;
+    } else if (sv->type == STRADA_INT) {
+        *len = snprintf(buf, buf_size, "%lld", (long long)sv->value.iv);
+        return buf;
+    } else if (sv->type == STRADA_NUM) {
+        *len = snprintf(buf, buf_size, "%g", sv->value.nv);
+        return buf;
     }
-#endif
+    return "";
+}
 
-    /* Fallback: create new string */
-    const char *str_a = "";
-    size_t len_a = 0;
+/* Optimized string concatenation working directly on StradaValues.
+ * Always returns a new string: a may be a global or a value someone else
+ * still reads, so it is never modified (see strada_concat_inplace). */
+StradaValue* strada_concat_sv(StradaValue *a, StradaValue *b) {
     char buf_a[32];
-
-    if (a) {
-        if (a->type == STRADA_STR && a->value.pv) {
-            str_a = a->value.pv;
-            len_a = a->struct_size;
-        } else if (a->type == STRADA_INT) {
-            len_a = snprintf(buf_a, sizeof(buf_a), "%lld", (long long)a->value.iv);
-            str_a = buf_a;
-        } else if (a->type == STRADA_NUM) {
-            len_a = snprintf(buf_a, sizeof(buf_a), "%g", a->value.nv);
-            str_a = buf_a;
-        }
-    }
-
-    /* Single allocation for result */
-    char *result = malloc(len_a + len_b + 1);
+    char buf_b[32];
+    size_t len_a;
+    size_t len_b;
+    const char *str_a = strada_concat_operand(a, buf_a, sizeof(buf_a), &len_a);
+    const char *str_b = strada_concat_operand(b, buf_b, sizeof(buf_b), &len_b);
+
+    /* Single allocation for result (none beyond the value if short) */
+    StradaValue *sv = strada_str_alloc(len_a + len_b);
+    char *result = sv->value.pv;
     if (len_a > 0) memcpy(result, str_a, len_a);
     if (len_b > 0) memcpy(result + len_a, str_b, len_b);
     result[len_a + len_b] = '\0';
 
-    /* Create result StradaValue directly */
-    StradaValue *sv = malloc(sizeof(StradaValue));
-    sv->type = STRADA_STR;
-    sv->refcount = 1;
-    sv->value.pv = result;
-    sv->struct_size = len_a + len_b;
-    sv->blessed_package = NULL;
-
     return sv;
 }
 
+/* Append b to a for `$s = $s . x` and `$s .= x` on a local the compiler
+ * knows is unaliased. Takes over the caller's reference to a and returns
+ * the new value of the variable. While a is an unshared, unblessed string
+ * its buffer grows geometrically in place (capacity in str_cap), which
+ * makes repeated appends O(n) overall. Shared and immortal values are left
+ * alone: the result is then a new string and a is released. */
+StradaValue* strada_concat_inplace(StradaValue *a, StradaValue *b) {
+    if (!a || a->type != STRADA_STR || a->refcount != 1 || !a->value.pv ||
+        a->blessed_package || a == b || STRADA_STR_IS_VIEW(a) || STRADA_STR_IS_MAPPED(a)) {
+        StradaValue *result = strada_concat_sv(a, b);
+        strada_decref(a);
+        return result;
+    }
+
+    char buf_b[32];
+    size_t len_b;
+    const char *str_b = strada_concat_operand(b, buf_b, sizeof(buf_b), &len_b);
+    size_t len_a = a->struct_size;
+    size_t need = len_a + len_b + 1;
+    size_t flags = a->str_cap & STRADA_STR_FLAGS;
+    size_t cap = a->str_cap & ~STRADA_STR_FLAGS;
+    if (cap == 0) cap = len_a + 1;
+    if (flags & STRADA_STR_ASCII) {
+        for (size_t i = 0; i < len_b; i++) {
+            if (((unsigned char)str_b[i] & 0xC0) == 0x80 || str_b[i] == '\0') {
+                flags &= ~STRADA_STR_ASCII;
+                break;
+            }
+        }
+    }
+    if (need > cap) {
+        size_t new_cap = cap < 16 ? 16 : (cap + 7) & ~(size_t)7;
+        while (new_cap < need) new_cap *= 2;
+        char *grown;
+        if (STRADA_STR_IS_INLINE(a)) {
+            /* Move out of the value's inline buffer */
+            grown = malloc(new_cap);
+            if (grown) memcpy(grown, a->value.pv, len_a);
+        } else {
+            grown = realloc(a->value.pv, new_cap);
+        }
+        if (!grown) {
+            StradaValue *result = strada_concat_sv(a, b);
+            strada_decref(a);
+            return result;
+        }
+        a->value.pv = grown;
+        a->str_cap = new_cap;
+    }
+    a->str_cap = (a->str_cap & ~STRADA_STR_FLAGS) | flags;
+    if (len_b > 0) memcpy(a->value.pv + len_a, str_b, len_b);
+    a->value.pv[len_a + len_b] = '\0';
+    a->struct_size = len_a + len_b;
+    return a;
+}
+
 /* Fast character access by byte index - returns char code, no allocation */
 StradaValue* strada_char_at(StradaValue *str, StradaValue *index) {
     if (!str || str->type != STRADA_STR || !str->value.pv) {
@@ -1277,6 +2193,32 @@ size_t strada_length(const char *s) {
     return utf8_strlen(s);
 }
 
+/* length() of a value: characters up to the first NUL, like strada_length()
+ * on its string form, without copying it. Strings found to hold neither
+ * continuation bytes nor NULs are flagged STRADA_STR_ASCII, after which
+ * this is O(1). */
+size_t strada_char_length_sv(StradaValue *sv) {
+    if (sv && sv->type == STRADA_STR && sv->value.pv) {
+        if (sv->str_cap & STRADA_STR_ASCII) return sv->struct_size;
+        const unsigned char *p = (const unsigned char *)sv->value.pv;
+        size_t n = sv->struct_size;
+        size_t count = 0;
+        size_t i = 0;
+        while (i < n && p[i]) {
+            if (!utf8_is_continuation(p[i])) count++;
+            i++;
+        }
+        if (i == n && count == n && !STRADA_IS_IMMORTAL(sv)) {
+            sv->str_cap |= STRADA_STR_ASCII;
+        }
+        return count;
+    }
+    char *s = strada_to_str(sv);
+    size_t len = utf8_strlen(s);
+    free(s);
+    return len;
+}
+
 /* Binary-safe length - uses struct_size to handle embedded NULLs.
  * Returns byte length (not character count) for binary safety. */
 size_t strada_length_sv(StradaValue *sv) {
@@ -1296,6 +2238,60 @@ size_t strada_bytes(const char *s) {
     return s ? strlen(s) : 0;
 }
 
+/* A new string value for the len bytes at pv, a NUL-terminated run inside
+ * owner's buffer. Takes a reference to owner. */
+static StradaValue* strada_str_view_new(StradaValue *owner, const char *pv, size_t len, size_t flags) {
+    StradaValue *view = strada_slab_alloc(STRADA_SLAB_VALUE);
+    view->type = STRADA_STR;
+    view->refcount = 1;
+    view->value.pv = (char *)pv;
+    view->struct_size = len;
+    view->str_cap = (size_t)owner | STRADA_STR_VIEW | flags;
+    view->blessed_package = NULL;
+    strada_incref(owner);
+    strada_memprof_alloc(view);
+    return view;
+}
+
+/* Bytes [start, start + len) of the string value str. A long tail shares
+ * str's buffer as a view (STRADA_STR_VIEW) instead of being copied; the
+ * first time, the buffer moves to a hidden owner value and str becomes a
+ * view of it too. Short or interior pieces, and tails that would pin a
+ * buffer four times their size, are copied. */
+static StradaValue* strada_str_slice(StradaValue *str, size_t start, size_t len) {
+    const char *s = str->value.pv;
+    if (start == 0 || start + len != str->struct_size || len < STRADA_STR_INLINE_CAP ||
+        STRADA_IS_IMMORTAL(str) || STRADA_STR_IS_INLINE(str)) {
+        return strada_new_str_len(s + start, len);
+    }
+    StradaValue *owner;
+    if (STRADA_STR_IS_VIEW(str)) {
+        owner = STRADA_STR_OWNER(str);
+        if (len * 4 < owner->struct_size && !STRADA_STR_IS_MAPPED(owner)) {
+            return strada_new_str_len(s + start, len);
+        }
+    } else if (STRADA_STR_IS_MAPPED(str)) {
+        /* A mapping never changes, so it can own views as it is. Pinning
+         * its pages costs only address space. */
+        owner = str;
+    } else {
+        /* Only an unshared value may change representation under its owner */
+        if (str->refcount != 1 || len * 4 < str->struct_size) {
+            return strada_new_str_len(s + start, len);
+        }
+        owner = strada_slab_alloc(STRADA_SLAB_VALUE);
+        owner->type = STRADA_STR;
+        owner->refcount = 1;
+        owner->value.pv = str->value.pv;
+        owner->struct_size = str->struct_size;
+        owner->str_cap = str->str_cap;
+        owner->blessed_package = NULL;
+        strada_memprof_alloc(owner);
+        str->str_cap = (size_t)owner | STRADA_STR_VIEW | (owner->str_cap & STRADA_STR_ASCII);
+    }
+    return strada_str_view_new(owner, s + start, len, str->str_cap & STRADA_STR_ASCII);
+}
+
 /* UTF-8 aware substr - offset and length are in characters, not bytes.
  * Binary-safe: uses struct_size instead of strlen for input strings. */
 StradaValue* strada_substr(StradaValue *str, int64_t offset, int64_t length) {
@@ -1313,15 +2309,28 @@ StradaValue* strada_substr(StradaValue *str, int64_t offset, int64_t length) {
         need_free = 1;
     }
 
-    /* Calculate character length (may differ from byte_len for UTF-8) */
+    /* Calculate character length (may differ from byte_len for UTF-8).
+     * Strings without continuation bytes or NULs remember it
+     * (STRADA_STR_ASCII) so later calls index bytes directly. */
+    int bytewise = !need_free && (str->str_cap & STRADA_STR_ASCII);
     size_t char_len = 0;
     const unsigned char *p = (const unsigned char *)s;
     size_t i = 0;
-    while (i < byte_len) {
-        if (!utf8_is_continuation(p[i])) {
-            char_len++;
+    if (bytewise) {
+        char_len = byte_len;
+    } else {
+        int has_nul = 0;
+        while (i < byte_len) {
+            if (!utf8_is_continuation(p[i])) {
+                char_len++;
+            }
+            if (p[i] == 0) has_nul = 1;
+            i++;
+        }
+        if (char_len == byte_len && !has_nul && !need_free && !STRADA_IS_IMMORTAL(str)) {
+            str->str_cap |= STRADA_STR_ASCII;
+            bytewise = 1;
         }
-        i++;
     }
 
     /* Handle negative offset (count from end) */
@@ -1343,6 +2352,11 @@ StradaValue* strada_substr(StradaValue *str, int64_t offset, int64_t length) {
     size_t char_count = 0;
     p = (const unsigned char *)s;
     i = 0;
+    if (bytewise) {
+        start_byte = (size_t)offset;
+        end_byte = (size_t)(offset + length);
+        i = byte_len;
+    }
     while (i < byte_len && char_count < (size_t)(offset + length)) {
         if (!utf8_is_continuation(p[i])) {
             if (char_count == (size_t)offset) {
@@ -1365,10 +2379,13 @@ StradaValue* strada_substr(StradaValue *str, int64_t offset, int64_t length) {
 
     /* Extract result */
     size_t result_len = end_byte - start_byte;
+    if (!need_free) {
+        return strada_str_slice(str, start_byte, result_len);
+    }
 
     /* Use strada_new_str_len for binary safety - copy from s before freeing */
     StradaValue *result = strada_new_str_len(s + start_byte, result_len);
-    if (need_free) free((void*)s);
+    free((void*)s);
     return result;
 }
 
@@ -1401,118 +2418,735 @@ StradaValue* strada_substr_bytes(StradaValue *str, int64_t offset, int64_t lengt
     }
 
     /* Extract bytes - use strada_new_str_len for binary safety */
+    if (!need_free) {
+        return strada_str_slice(str, (size_t)offset, (size_t)length);
+    }
     StradaValue *result = strada_new_str_len(s + offset, (size_t)length);
-    if (need_free) free((void*)s);
+    free((void*)s);
     return result;
 }
 
-/* Convert byte offset to character offset */
-static size_t byte_to_char_offset(const char *s, size_t byte_offset) {
-    if (!s) return 0;
-    const unsigned char *p = (const unsigned char *)s;
-    size_t chars = 0;
-    size_t bytes = 0;
+/* ===== STRING KERNELS ===== */
+/* Inner loops of index, rindex, split, uc/lc, trim and base64. Every
+ * kernel takes explicit lengths, so NULs are ordinary bytes. The SSE2
+ * (x86-64 baseline) and NEON versions are compiled in directly; SSSE3
+ * and AVX2 versions are built with target attributes and picked once at
+ * startup from the CPU's feature bits. STRADA_SIMD=scalar, sse2, ssse3
+ * or avx2 caps the choice, which is handy when comparing results. */
 
-    while (*p && bytes < byte_offset) {
-        if (!utf8_is_continuation(*p)) {
-            chars++;
-        }
-        p++;
-        bytes++;
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STRADA_X86_KERNELS 1
+#endif
+
+typedef struct {
+    /* First / last occurrence of n in h, or NULL. An empty n matches at
+     * the start / end. */
+    const char *(*find)(const char *h, size_t hlen, const char *n, size_t nlen);
+    const char *(*rfind)(const char *h, size_t hlen, const char *n, size_t nlen);
+    size_t (*count_chars)(const char *s, size_t len);      /* UTF-8 lead and ASCII bytes */
+    void (*case_map)(char *dst, const char *src, size_t len, int upper);  /* ASCII letters only */
+    size_t (*skip_space)(const char *s, size_t len);       /* Length of leading whitespace */
+    size_t (*rskip_space)(const char *s, size_t len);      /* Length without trailing whitespace */
+    /* Whole blocks only: input bytes consumed, a multiple of 3 / 4. The
+     * decoder stops at the first block that is not plain alphabet and
+     * writes at most room bytes, with stores up to 16 bytes past that. */
+    size_t (*b64_encode)(char *dst, const unsigned char *src, size_t len);
+    size_t (*b64_decode)(unsigned char *dst, const char *src, size_t len, size_t room);
+} StradaStrKernels;
+
+static int str_is_space(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const char *str_find_scalar(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen == 0) return h;
+    if (nlen == 1) return memchr(h, (unsigned char)n[0], hlen);
+    return memmem(h, hlen, n, nlen);
+}
+
+/* Candidates at start positions [i, starts), checked one by one */
+static const char *str_find_from(const char *h, size_t i, size_t starts, const char *n, size_t nlen) {
+    for (; i < starts; i++) {
+        if (h[i] == n[0] && memcmp(h + i + 1, n + 1, nlen - 1) == 0) return h + i;
     }
-    return chars;
+    return NULL;
 }
 
-/* Returns character position (not byte position) */
-int strada_index(const char *haystack, const char *needle) {
-    if (!haystack || !needle) return -1;
-
-    char *pos = strstr(haystack, needle);
-    if (pos) {
-        /* Convert byte offset to character offset */
-        return (int)byte_to_char_offset(haystack, pos - haystack);
+static const char *str_rfind_scalar(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen > hlen) return NULL;
+    if (nlen == 0) return h + hlen;
+    for (size_t i = hlen - nlen + 1; i-- > 0; ) {
+        if (h[i] == n[0] && memcmp(h + i + 1, n + 1, nlen - 1) == 0) return h + i;
     }
-    return -1;
+    return NULL;
 }
 
-int strada_index_offset(const char *haystack, const char *needle, int offset) {
-    if (!haystack || !needle) return -1;
-    if (offset < 0) offset = 0;
-
-    /* Convert character offset to byte offset */
-    size_t byte_off = utf8_offset(haystack, (size_t)offset);
-    size_t haystack_len = strlen(haystack);
-    if (byte_off >= haystack_len) return -1;
+static size_t str_count_chars_scalar(const char *s, size_t len) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!utf8_is_continuation((unsigned char)s[i])) count++;
+    }
+    return count;
+}
 
-    char *pos = strstr(haystack + byte_off, needle);
-    if (pos) {
-        /* Convert byte offset to character offset */
-        return (int)byte_to_char_offset(haystack, pos - haystack);
+static void str_case_scalar(char *dst, const char *src, size_t len, int upper) {
+    unsigned char from = upper ? 'a' : 'A';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)src[i];
+        dst[i] = (char)((unsigned char)(c - from) < 26 ? c ^ 0x20 : c);
     }
-    return -1;
 }
 
-/* ===== I/O FUNCTIONS ===== */
+static size_t str_skip_space_scalar(const char *s, size_t len) {
+    size_t i = 0;
+    while (i < len && str_is_space((unsigned char)s[i])) i++;
+    return i;
+}
 
-void strada_print(StradaValue *sv) {
-    char *str = strada_to_str(sv);
-    printf("%s", str);
-    free(str);
+static size_t str_rskip_space_scalar(const char *s, size_t len) {
+    while (len > 0 && str_is_space((unsigned char)s[len - 1])) len--;
+    return len;
 }
 
-void strada_say(StradaValue *sv) {
-    strada_print(sv);
-    printf("\n");
-    fflush(stdout);
+static size_t str_b64_none(char *dst, const unsigned char *src, size_t len) {
+    (void)dst; (void)src; (void)len;
+    return 0;
 }
 
-/* Helper: buffered write to socket */
-static void socket_buffered_write(StradaSocketBuffer *sb, const char *data, size_t len) {
-    while (len > 0) {
-        size_t space = STRADA_SOCKET_BUFSIZE - sb->write_len;
-        if (space == 0) {
-            /* Buffer full, flush it */
-            send(sb->fd, sb->write_buf, sb->write_len, 0);
-            sb->write_len = 0;
-            space = STRADA_SOCKET_BUFSIZE;
+static size_t str_b64_decode_none(unsigned char *dst, const char *src, size_t len, size_t room) {
+    (void)dst; (void)src; (void)len; (void)room;
+    return 0;
+}
+
+/* A run of first/last byte hits that fail to match (long runs of one
+ * byte, say) makes the vector loops quadratic; past that point they hand
+ * over to memmem, whose two-way search is linear. */
+#define STR_FIND_MISSES(i) (16 + ((i) >> 5))
+
+#if defined(__SSE2__)
+static const char *str_find_sse2(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen < 2 || nlen > hlen) return str_find_scalar(h, hlen, n, nlen);
+    const __m128i first = _mm_set1_epi8(n[0]);
+    const __m128i last = _mm_set1_epi8(n[nlen - 1]);
+    size_t starts = hlen - nlen + 1;
+    size_t misses = 0;
+    size_t i = 0;
+    for (; i + 16 <= starts; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(h + i)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(h + i + nlen - 1)), last);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(h + at + 1, n + 1, nlen - 2) == 0) return h + at;
+            if (++misses > STR_FIND_MISSES(i)) return str_find_scalar(h + at, hlen - at, n, nlen);
+            mask &= mask - 1;
+        }
+    }
+    return str_find_from(h, i, starts, n, nlen);
+}
+
+static const char *str_rfind_sse2(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen < 2 || nlen > hlen) return str_rfind_scalar(h, hlen, n, nlen);
+    const __m128i first = _mm_set1_epi8(n[0]);
+    const __m128i last = _mm_set1_epi8(n[nlen - 1]);
+    size_t i = hlen - nlen + 1;
+    while (i >= 16) {
+        i -= 16;
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(h + i)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(h + i + nlen - 1)), last);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+        while (mask) {
+            unsigned bit = 31u - (unsigned)__builtin_clz(mask);
+            if (memcmp(h + i + bit + 1, n + 1, nlen - 2) == 0) return h + i + bit;
+            mask &= ~(1u << bit);
         }
-        size_t to_copy = (len < space) ? len : space;
-        memcpy(sb->write_buf + sb->write_len, data, to_copy);
-        sb->write_len += to_copy;
-        data += to_copy;
-        len -= to_copy;
     }
+    /* Starts [0, i) remain */
+    return str_rfind_scalar(h, i + nlen - 1, n, nlen);
 }
 
-/* Print to filehandle or socket (no newline) */
-void strada_print_fh(StradaValue *sv, StradaValue *fh) {
-    if (!fh) return;
-
-    char *str = strada_to_str(sv);
-    size_t len = strlen(str);
+static size_t str_count_chars_sse2(const char *s, size_t len) {
+    const __m128i cont = _mm_set1_epi8((char)0xbf);   /* Bytes above it (signed) lead */
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, cont)));
+    }
+    return count + str_count_chars_scalar(s + i, len - i);
+}
 
-    if (fh->type == STRADA_FILEHANDLE && fh->value.fh) {
-        fputs(str, fh->value.fh);
-    } else if (fh->type == STRADA_SOCKET && fh->value.sock) {
-        socket_buffered_write(fh->value.sock, str, len);
-        /* Flush if data ends with newline (line-buffered behavior) */
-        if (len > 0 && str[len - 1] == '\n') {
-            StradaSocketBuffer *sb = fh->value.sock;
-            if (sb->write_len > 0) {
-                send(sb->fd, sb->write_buf, sb->write_len, 0);
-                sb->write_len = 0;
-            }
-        }
+static void str_case_sse2(char *dst, const char *src, size_t len, int upper) {
+    const __m128i below = _mm_set1_epi8(upper ? 'a' - 1 : 'A' - 1);
+    const __m128i above = _mm_set1_epi8(upper ? 'z' + 1 : 'Z' + 1);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        /* Signed compares: bytes >= 0x80 are negative and never letters */
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmpgt_epi8(above, v));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, _mm_and_si128(letter, flip)));
     }
-    free(str);
+    str_case_scalar(dst + i, src + i, len - i, upper);
 }
 
-/* Say to filehandle or socket (with newline) */
-void strada_say_fh(StradaValue *sv, StradaValue *fh) {
-    if (!fh) return;
+static unsigned str_space_mask_sse2(__m128i v) {
+    __m128i ctl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                              _mm_cmpeq_epi8(_mm_min_epu8(ctl, _mm_set1_epi8(4)), ctl));
+    return (unsigned)_mm_movemask_epi8(ws);
+}
 
-    char *str = strada_to_str(sv);
-    size_t len = strlen(str);
+static size_t str_skip_space_sse2(const char *s, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        unsigned other = str_space_mask_sse2(_mm_loadu_si128((const __m128i *)(s + i))) ^ 0xffffu;
+        if (other) return i + (size_t)__builtin_ctz(other);
+    }
+    return i + str_skip_space_scalar(s + i, len - i);
+}
+
+static size_t str_rskip_space_sse2(const char *s, size_t len) {
+    for (; len >= 16; len -= 16) {
+        unsigned other = str_space_mask_sse2(_mm_loadu_si128((const __m128i *)(s + len - 16))) ^ 0xffffu;
+        if (other) return len - 16 + (32u - (unsigned)__builtin_clz(other));
+    }
+    return str_rskip_space_scalar(s, len);
+}
+#elif defined(STRADA_NEON_KERNELS)
+/* No movemask on NEON: blocks with a hit are resolved by the scalar code */
+static const char *str_find_neon(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen < 2 || nlen > hlen) return str_find_scalar(h, hlen, n, nlen);
+    const uint8x16_t first = vdupq_n_u8((uint8_t)n[0]);
+    const uint8x16_t last = vdupq_n_u8((uint8_t)n[nlen - 1]);
+    size_t starts = hlen - nlen + 1;
+    size_t misses = 0;
+    size_t i = 0;
+    for (; i + 16 <= starts; i += 16) {
+        uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8((const uint8_t *)(h + i)), first),
+                                vceqq_u8(vld1q_u8((const uint8_t *)(h + i + nlen - 1)), last));
+        if (vmaxvq_u8(m)) {
+            const char *hit = str_find_from(h, i, i + 16, n, nlen);
+            if (hit) return hit;
+            if (++misses > STR_FIND_MISSES(i)) return str_find_scalar(h + i, hlen - i, n, nlen);
+        }
+    }
+    return str_find_from(h, i, starts, n, nlen);
+}
+
+static size_t str_count_chars_neon(const char *s, size_t len) {
+    const int8x16_t cont = vdupq_n_s8(-65);
+    const uint8x16_t one = vdupq_n_u8(1);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        int8x16_t v = vreinterpretq_s8_u8(vld1q_u8((const uint8_t *)(s + i)));
+        count += vaddvq_u8(vandq_u8(vcgtq_s8(v, cont), one));
+    }
+    return count + str_count_chars_scalar(s + i, len - i);
+}
+
+static void str_case_neon(char *dst, const char *src, size_t len, int upper) {
+    const uint8x16_t from = vdupq_n_u8(upper ? 'a' : 'A');
+    const uint8x16_t span = vdupq_n_u8(25);
+    const uint8x16_t flip = vdupq_n_u8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(src + i));
+        uint8x16_t letter = vcleq_u8(vsubq_u8(v, from), span);
+        vst1q_u8((uint8_t *)(dst + i), veorq_u8(v, vandq_u8(letter, flip)));
+    }
+    str_case_scalar(dst + i, src + i, len - i, upper);
+}
+
+static uint8x16_t str_space_neon(const char *s) {
+    uint8x16_t v = vld1q_u8((const uint8_t *)s);
+    return vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4)));
+}
+
+static size_t str_skip_space_neon(const char *s, size_t len) {
+    size_t i = 0;
+    while (i + 16 <= len && vminvq_u8(str_space_neon(s + i)) == 0xff) i += 16;
+    return i + str_skip_space_scalar(s + i, len - i);
+}
+
+static size_t str_rskip_space_neon(const char *s, size_t len) {
+    while (len >= 16 && vminvq_u8(str_space_neon(s + len - 16)) == 0xff) len -= 16;
+    return str_rskip_space_scalar(s, len);
+}
+#endif
+
+#ifdef STRADA_X86_KERNELS
+__attribute__((target("avx2")))
+static const char *str_find_avx2(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen < 2 || nlen > hlen) return str_find_scalar(h, hlen, n, nlen);
+    const __m256i first = _mm256_set1_epi8(n[0]);
+    const __m256i last = _mm256_set1_epi8(n[nlen - 1]);
+    size_t starts = hlen - nlen + 1;
+    size_t misses = 0;
+    size_t i = 0;
+    for (; i + 32 <= starts; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(h + i)), first);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(h + i + nlen - 1)), last);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        while (mask) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (memcmp(h + at + 1, n + 1, nlen - 2) == 0) return h + at;
+            if (++misses > STR_FIND_MISSES(i)) return str_find_scalar(h + at, hlen - at, n, nlen);
+            mask &= mask - 1;
+        }
+    }
+    return str_find_sse2(h + i, hlen - i, n, nlen);
+}
+
+__attribute__((target("avx2")))
+static const char *str_rfind_avx2(const char *h, size_t hlen, const char *n, size_t nlen) {
+    if (nlen < 2 || nlen > hlen) return str_rfind_scalar(h, hlen, n, nlen);
+    const __m256i first = _mm256_set1_epi8(n[0]);
+    const __m256i last = _mm256_set1_epi8(n[nlen - 1]);
+    size_t i = hlen - nlen + 1;
+    while (i >= 32) {
+        i -= 32;
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(h + i)), first);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(h + i + nlen - 1)), last);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        while (mask) {
+            unsigned bit = 31u - (unsigned)__builtin_clz(mask);
+            if (memcmp(h + i + bit + 1, n + 1, nlen - 2) == 0) return h + i + bit;
+            mask &= ~(1u << bit);
+        }
+    }
+    return str_rfind_sse2(h, i + nlen - 1, n, nlen);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t str_count_chars_avx2(const char *s, size_t len) {
+    const __m256i cont = _mm256_set1_epi8((char)0xbf);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, cont)));
+    }
+    return count + str_count_chars_sse2(s + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void str_case_avx2(char *dst, const char *src, size_t len, int upper) {
+    const __m256i below = _mm256_set1_epi8(upper ? 'a' - 1 : 'A' - 1);
+    const __m256i above = _mm256_set1_epi8(upper ? 'z' + 1 : 'Z' + 1);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, _mm256_and_si256(letter, flip)));
+    }
+    str_case_sse2(dst + i, src + i, len - i, upper);
+}
+
+/* Base64 after Mula and Lemire: a shuffle gathers each 3-byte group into
+ * a 32-bit lane, two multiplies move its four 6-bit fields into bytes,
+ * and a 16-entry table keyed by value range turns values into letters.
+ * Decoding validates with nibble tables, then packs with multiply-adds. */
+__attribute__((target("ssse3")))
+static size_t str_b64_encode_ssse3(char *dst, const unsigned char *src, size_t len) {
+    const __m128i gather = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    size_t j = 0;
+    /* 16-byte loads for 12 bytes of input */
+    for (; i + 16 <= len; i += 12, j += 16) {
+        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i)), gather);
+        __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(hi, lo);
+        __m128i range = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i *)(dst + j), _mm_add_epi8(idx, _mm_shuffle_epi8(offsets, range)));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+static size_t str_b64_decode_ssse3(unsigned char *dst, const char *src, size_t len, size_t room) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    size_t j = 0;
+    for (; i + 16 <= len && j + 12 <= room; i += 16, j += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+        __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, _mm_and_si128(in, nibble)), _mm_shuffle_epi8(lut_hi, hi));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xffff) break;
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), hi));
+        __m128i v = _mm_maddubs_epi16(_mm_add_epi8(in, roll), _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128((__m128i *)(dst + j), _mm_shuffle_epi8(v, pack));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t str_b64_encode_avx2(char *dst, const unsigned char *src, size_t len) {
+    const __m256i gather = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+    size_t i = 0;
+    size_t j = 0;
+    /* Each 128-bit lane takes 12 bytes from its own 16-byte load */
+    for (; i + 28 <= len; i += 24, j += 32) {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+                                             _mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, gather);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(hi, lo);
+        __m256i range = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i *)(dst + j), _mm256_add_epi8(idx, _mm256_shuffle_epi8(offsets, range)));
+    }
+    return i + str_b64_encode_ssse3(dst + j, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t str_b64_decode_avx2(unsigned char *dst, const char *src, size_t len, size_t room) {
+    const __m256i lut_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+    const __m256i lut_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    const __m256i lut_roll = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    size_t j = 0;
+    for (; i + 32 <= len && j + 24 <= room; i += 32, j += 24) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+        __m256i bad = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, nibble)),
+                                       _mm256_shuffle_epi8(lut_hi, hi));
+        if (!_mm256_testz_si256(bad, bad)) break;
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')), hi));
+        __m256i v = _mm256_maddubs_epi16(_mm256_add_epi8(in, roll), _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pack), lanes);
+        _mm256_storeu_si256((__m256i *)(dst + j), v);
+    }
+    if (i + 32 <= len && j + 24 <= room) return i;   /* Stopped at a block that is not plain alphabet */
+    return i + str_b64_decode_ssse3(dst + j, src + i, len - i, room - j);
+}
+#endif
+
+static StradaStrKernels strada_kernels = {
+    str_find_scalar, str_rfind_scalar, str_count_chars_scalar, str_case_scalar,
+    str_skip_space_scalar, str_rskip_space_scalar, str_b64_none, str_b64_decode_none
+};
+
+__attribute__((constructor(101)))
+static void strada_kernels_init(void) {
+    int level = 3;
+    const char *env = getenv("STRADA_SIMD");
+    if (env) {
+        if (strcmp(env, "scalar") == 0) level = 0;
+        else if (strcmp(env, "sse2") == 0 || strcmp(env, "neon") == 0) level = 1;
+        else if (strcmp(env, "ssse3") == 0) level = 2;
+    }
+    if (level < 1) return;
+#if defined(__SSE2__)
+    strada_kernels.find = str_find_sse2;
+    strada_kernels.rfind = str_rfind_sse2;
+    strada_kernels.count_chars = str_count_chars_sse2;
+    strada_kernels.case_map = str_case_sse2;
+    strada_kernels.skip_space = str_skip_space_sse2;
+    strada_kernels.rskip_space = str_rskip_space_sse2;
+#elif defined(STRADA_NEON_KERNELS)
+    strada_kernels.find = str_find_neon;
+    strada_kernels.count_chars = str_count_chars_neon;
+    strada_kernels.case_map = str_case_neon;
+    strada_kernels.skip_space = str_skip_space_neon;
+    strada_kernels.rskip_space = str_rskip_space_neon;
+#endif
+#ifdef STRADA_X86_KERNELS
+    __builtin_cpu_init();
+    if (level >= 2 && __builtin_cpu_supports("ssse3")) {
+        strada_kernels.b64_encode = str_b64_encode_ssse3;
+        strada_kernels.b64_decode = str_b64_decode_ssse3;
+    }
+    if (level >= 3 && __builtin_cpu_supports("avx2")) {
+        strada_kernels.find = str_find_avx2;
+        strada_kernels.rfind = str_rfind_avx2;
+        strada_kernels.count_chars = str_count_chars_avx2;
+        strada_kernels.case_map = str_case_avx2;
+        strada_kernels.b64_encode = str_b64_encode_avx2;
+        strada_kernels.b64_decode = str_b64_decode_avx2;
+    }
+#endif
+}
+
+/* Bytes of a value's string form. Strings are used in place; anything
+ * else is converted into *tmp, which the caller frees. */
+static const char *str_bytes(StradaValue *sv, size_t *len, char **tmp) {
+    if (sv && sv->type == STRADA_STR && sv->value.pv) {
+        *tmp = NULL;
+        *len = strada_str_len(sv);
+        return sv->value.pv;
+    }
+    *tmp = strada_to_str(sv);
+    *len = strlen(*tmp);
+    return *tmp;
+}
+
+static int str_is_ascii(StradaValue *sv) {
+    return sv && sv->type == STRADA_STR && sv->value.pv && (sv->str_cap & STRADA_STR_ASCII);
+}
+
+/* Byte offset of character number chars (len when past the end) */
+static size_t str_char_to_byte(const char *s, size_t len, size_t chars, int ascii) {
+    if (ascii || chars >= len) return chars < len ? chars : len;
+    size_t i = 0;
+    while (i < len && chars > 0) {
+        i++;
+        while (i < len && utf8_is_continuation((unsigned char)s[i])) i++;
+        chars--;
+    }
+    return i;
+}
+
+/* index(str, sub, offset): character position of the first sub starting
+ * at or after character offset, or -1 */
+int64_t strada_index_sv(StradaValue *str, StradaValue *sub, int64_t offset) {
+    size_t hlen, nlen;
+    char *htmp, *ntmp;
+    const char *h = str_bytes(str, &hlen, &htmp);
+    const char *n = str_bytes(sub, &nlen, &ntmp);
+    int ascii = str_is_ascii(str);
+    size_t start = offset > 0 ? str_char_to_byte(h, hlen, (size_t)offset, ascii) : 0;
+    const char *hit = strada_kernels.find(h + start, hlen - start, n, nlen);
+    int64_t pos = -1;
+    if (hit) {
+        size_t at = (size_t)(hit - h);
+        pos = ascii ? (int64_t)at : (int64_t)strada_kernels.count_chars(h, at);
+    }
+    free(htmp);
+    free(ntmp);
+    return pos;
+}
+
+/* rindex(str, sub, position): character position of the last sub
+ * starting at or before position, or -1 */
+int64_t strada_rindex_sv(StradaValue *str, StradaValue *sub, int64_t position) {
+    size_t hlen, nlen;
+    char *htmp, *ntmp;
+    const char *h = str_bytes(str, &hlen, &htmp);
+    const char *n = str_bytes(sub, &nlen, &ntmp);
+    int ascii = str_is_ascii(str);
+    size_t last = position > 0 ? str_char_to_byte(h, hlen, (size_t)position, ascii) : 0;
+    size_t span = hlen;
+    if (nlen <= hlen && last < hlen - nlen) span = last + nlen;
+    const char *hit = strada_kernels.rfind(h, span, n, nlen);
+    int64_t pos = -1;
+    if (hit) {
+        size_t at = (size_t)(hit - h);
+        pos = ascii ? (int64_t)at : (int64_t)strada_kernels.count_chars(h, at);
+    }
+    free(htmp);
+    free(ntmp);
+    return pos;
+}
+
+/* uc/lc of a value's string form. ASCII letters change; every other
+ * byte, UTF-8 sequences included, is copied as it is. */
+StradaValue* strada_case_sv(StradaValue *sv, int upper) {
+    size_t len;
+    char *tmp;
+    const char *s = str_bytes(sv, &len, &tmp);
+    if (len == 0) {
+        free(tmp);
+        return &strada_empty_str_static;
+    }
+    StradaValue *out = strada_str_alloc(len);
+    strada_kernels.case_map(out->value.pv, s, len, upper);
+    out->value.pv[len] = '\0';
+    if (str_is_ascii(sv)) out->str_cap |= STRADA_STR_ASCII;
+    free(tmp);
+    return out;
+}
+
+/* trim (mode 3), ltrim (1) and rtrim (2). The result is cut out with
+ * strada_str_slice, so what ltrim leaves of a long string shares its
+ * buffer. */
+StradaValue* strada_trim_sv(StradaValue *sv, int mode) {
+    size_t len;
+    char *tmp;
+    const char *s = str_bytes(sv, &len, &tmp);
+    size_t start = (mode & 1) ? strada_kernels.skip_space(s, len) : 0;
+    size_t end = (mode & 2) ? start + strada_kernels.rskip_space(s + start, len - start) : len;
+    StradaValue *out;
+    if (tmp || end == start) {
+        out = strada_new_str_len(s + start, end - start);
+    } else {
+        out = strada_str_slice(sv, start, end - start);
+    }
+    free(tmp);
+    return out;
+}
+
+/* Concatenation of arr's elements with sep between them, in one buffer
+ * sized up front. Strings are copied with their stored lengths; other
+ * values are converted once. */
+static char *str_join(const char *sep, size_t seplen, StradaArray *arr, size_t *out_len) {
+    size_t n = arr ? arr->size : 0;
+    if (n == 0) {
+        *out_len = 0;
+        return strdup("");
+    }
+    char **converted = NULL;
+    size_t total = seplen * (n - 1);
+    for (size_t i = 0; i < n; i++) {
+        StradaValue *e = arr->elements[i];
+        if (e && e->type == STRADA_STR && e->value.pv) {
+            total += strada_str_len(e);
+        } else {
+            if (!converted) converted = calloc(n, sizeof(char *));
+            converted[i] = strada_to_str(e);
+            total += strlen(converted[i]);
+        }
+    }
+    char *buf = malloc(total + 1);
+    char *p = buf;
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && seplen > 0) {
+            memcpy(p, sep, seplen);
+            p += seplen;
+        }
+        size_t len;
+        if (converted && converted[i]) {
+            len = strlen(converted[i]);
+            memcpy(p, converted[i], len);
+            free(converted[i]);
+        } else {
+            len = strada_str_len(arr->elements[i]);
+            memcpy(p, arr->elements[i]->value.pv, len);
+        }
+        p += len;
+    }
+    *p = '\0';
+    free(converted);
+    *out_len = total;
+    return buf;
+}
+
+StradaValue* strada_join_sv(StradaValue *sep, StradaArray *arr) {
+    size_t seplen, len;
+    char *tmp;
+    const char *s = str_bytes(sep, &seplen, &tmp);
+    char *buf = str_join(s, seplen, arr, &len);
+    free(tmp);
+    return strada_new_str_take_len(buf, len, len + 1);
+}
+
+/* Returns character position (not byte position) */
+int strada_index(const char *haystack, const char *needle) {
+    if (!haystack || !needle) return -1;
+
+    const char *pos = strada_kernels.find(haystack, strlen(haystack), needle, strlen(needle));
+    if (pos) {
+        /* Convert byte offset to character offset */
+        return (int)strada_kernels.count_chars(haystack, (size_t)(pos - haystack));
+    }
+    return -1;
+}
+
+int strada_index_offset(const char *haystack, const char *needle, int offset) {
+    if (!haystack || !needle) return -1;
+    if (offset < 0) offset = 0;
+
+    /* Convert character offset to byte offset */
+    size_t byte_off = utf8_offset(haystack, (size_t)offset);
+    size_t haystack_len = strlen(haystack);
+    if (byte_off >= haystack_len) return -1;
+
+    const char *pos = strada_kernels.find(haystack + byte_off, haystack_len - byte_off, needle, strlen(needle));
+    if (pos) {
+        /* Convert byte offset to character offset */
+        return (int)strada_kernels.count_chars(haystack, (size_t)(pos - haystack));
+    }
+    return -1;
+}
+
+/* ===== I/O FUNCTIONS ===== */
+
+void strada_print(StradaValue *sv) {
+    char *str = strada_to_str(sv);
+    printf("%s", str);
+    free(str);
+}
+
+void strada_say(StradaValue *sv) {
+    strada_print(sv);
+    printf("\n");
+    fflush(stdout);
+}
+
+/* Helper: buffered write to socket */
+static void socket_buffered_write(StradaSocketBuffer *sb, const char *data, size_t len) {
+    while (len > 0) {
+        size_t space = STRADA_SOCKET_BUFSIZE - sb->write_len;
+        if (space == 0) {
+            /* Buffer full, flush it */
+            send(sb->fd, sb->write_buf, sb->write_len, 0);
+            sb->write_len = 0;
+            space = STRADA_SOCKET_BUFSIZE;
+        }
+        size_t to_copy = (len < space) ? len : space;
+        memcpy(sb->write_buf + sb->write_len, data, to_copy);
+        sb->write_len += to_copy;
+        data += to_copy;
+        len -= to_copy;
+    }
+}
+
+/* Print to filehandle or socket (no newline) */
+void strada_print_fh(StradaValue *sv, StradaValue *fh) {
+    if (!fh) return;
+
+    char *str = strada_to_str(sv);
+    size_t len = strlen(str);
+
+    if (fh->type == STRADA_FILEHANDLE && fh->value.fh) {
+        fputs(str, fh->value.fh);
+    } else if (fh->type == STRADA_SOCKET && fh->value.sock) {
+        socket_buffered_write(fh->value.sock, str, len);
+        /* Flush if data ends with newline (line-buffered behavior) */
+        if (len > 0 && str[len - 1] == '\n') {
+            StradaSocketBuffer *sb = fh->value.sock;
+            if (sb->write_len > 0) {
+                send(sb->fd, sb->write_buf, sb->write_len, 0);
+                sb->write_len = 0;
+            }
+        }
+    }
+    free(str);
+}
+
+/* Say to filehandle or socket (with newline) */
+void strada_say_fh(StradaValue *sv, StradaValue *fh) {
+    if (!fh) return;
+
+    char *str = strada_to_str(sv);
+    size_t len = strlen(str);
 
     if (fh->type == STRADA_FILEHANDLE && fh->value.fh) {
         fputs(str, fh->value.fh);
@@ -1733,11 +3367,12 @@ StradaValue* strada_open(const char *filename, const char *mode) {
         return strada_new_undef();
     }
     
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_FILEHANDLE;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.fh = fh;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -1763,68 +3398,106 @@ StradaValue* strada_read_file(StradaValue *fh) {
     }
     
     char *content = malloc(size + 1);
+    if (!content) {
+        return strada_new_undef();
+    }
     size_t read_size = fread(content, 1, size, fh->value.fh);
     content[read_size] = '\0';
     
-    StradaValue *result = strada_new_str(content);
-    free(content);
+    /* The string takes the buffer as is; binary-safe */
+    StradaValue *result = strada_new_str_take_len(content, read_size, (size_t)size + 1);
     
     return result;
 }
 
-StradaValue* strada_read_line(StradaValue *fh) {
-    if (!fh) {
-        return strada_new_undef();
+/* Read one line from a FILE*, without its newline. getline() scans the
+ * stdio buffer with memchr and grows a per-thread buffer, so lines of any
+ * length come back whole. Returns NULL at EOF. */
+static StradaValue* strada_file_read_line(FILE *fp) {
+    static __thread char *line_buf = NULL;
+    static __thread size_t line_cap = 0;
+    ssize_t len = getline(&line_buf, &line_cap, fp);
+    if (len < 0) return NULL;
+    if (len > 0 && line_buf[len - 1] == '\n') len--;
+    return strada_new_str_len(line_buf, (size_t)len);
+}
+
+/* Drop carriage returns from a socket line in place */
+static size_t strada_strip_cr(char *s, size_t len) {
+    char *cr = memchr(s, '\r', len);
+    if (!cr) return len;
+    char *out = cr;
+    for (char *in = cr; in < s + len; in++) {
+        if (*in != '\r') *out++ = *in;
     }
+    return (size_t)(out - s);
+}
 
-    /* Handle filehandle (FILE*) */
-    if (fh->type == STRADA_FILEHANDLE && fh->value.fh) {
-        char buffer[4096];
-        if (fgets(buffer, sizeof(buffer), fh->value.fh)) {
-            /* Remove trailing newline */
-            size_t len = strlen(buffer);
-            if (len > 0 && buffer[len-1] == '\n') {
-                buffer[len-1] = '\0';
+/* Read one line from a socket, without its newline or any carriage
+ * returns. Scans the read buffer with memchr and refills it with recv; a
+ * line longer than the buffer is collected in a growing heap buffer.
+ * Returns NULL at EOF with nothing read. */
+static StradaValue* strada_socket_read_line(StradaSocketBuffer *sb) {
+    char *line = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+
+    for (;;) {
+        if (sb->read_pos >= sb->read_len) {
+            ssize_t n = recv(sb->fd, sb->read_buf, STRADA_SOCKET_BUFSIZE, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                /* EOF or error: return what we have */
+                if (!line) return NULL;
+                break;
             }
-            return strada_new_str(buffer);
+            sb->read_pos = 0;
+            sb->read_len = (size_t)n;
         }
-        return strada_new_undef();
-    }
 
-    /* Handle socket - buffered reading */
-    if (fh->type == STRADA_SOCKET && fh->value.sock) {
-        StradaSocketBuffer *sb = fh->value.sock;
-        char line[4096];
-        size_t line_pos = 0;
+        char *start = sb->read_buf + sb->read_pos;
+        size_t avail = sb->read_len - sb->read_pos;
+        char *nl = memchr(start, '\n', avail);
+        size_t take = nl ? (size_t)(nl - start) : avail;
+        sb->read_pos += take + (nl ? 1 : 0);
 
-        while (line_pos < sizeof(line) - 1) {
-            /* Refill buffer if empty */
-            if (sb->read_pos >= sb->read_len) {
-                ssize_t n = recv(sb->fd, sb->read_buf, STRADA_SOCKET_BUFSIZE, 0);
-                if (n <= 0) {
-                    /* EOF or error */
-                    if (line_pos == 0) return strada_new_undef();
-                    break;
-                }
-                sb->read_pos = 0;
-                sb->read_len = (size_t)n;
+        if (nl && !line) {
+            /* The whole line was in the buffer */
+            return strada_new_str_len(start, strada_strip_cr(start, take));
+        }
+        if (len + take + 1 > cap) {
+            size_t new_cap = cap ? cap * 2 : 256;
+            while (new_cap < len + take + 1) new_cap *= 2;
+            char *grown = realloc(line, new_cap);
+            if (!grown) {
+                free(line);
+                return NULL;
             }
+            line = grown;
+            cap = new_cap;
+        }
+        memcpy(line + len, start, take);
+        len += take;
+        if (nl) break;
+    }
 
-            /* Get next character from buffer */
-            char c = sb->read_buf[sb->read_pos++];
+    len = strada_strip_cr(line, len);
+    line[len] = '\0';
+    return strada_new_str_take_len(line, len, cap);
+}
 
-            if (c == '\n') {
-                break;  /* Don't include newline */
-            }
-            if (c != '\r') {  /* Skip carriage return */
-                line[line_pos++] = c;
-            }
-        }
-        line[line_pos] = '\0';
-        return strada_new_str(line);
+StradaValue* strada_read_line(StradaValue *fh) {
+    if (!fh) {
+        return strada_new_undef();
     }
 
-    return strada_new_undef();
+    StradaValue *line = NULL;
+    if (fh->type == STRADA_FILEHANDLE && fh->value.fh) {
+        line = strada_file_read_line(fh->value.fh);
+    } else if (fh->type == STRADA_SOCKET && fh->value.sock) {
+        line = strada_socket_read_line(fh->value.sock);
+    }
+    return line ? line : strada_new_undef();
 }
 
 /* Read all lines from filehandle or socket into array (list context) */
@@ -1835,70 +3508,177 @@ StradaValue* strada_read_all_lines(StradaValue *fh) {
         return arr;
     }
 
-    /* Handle filehandle (FILE*) */
+    StradaValue *line;
     if (fh->type == STRADA_FILEHANDLE && fh->value.fh) {
-        char buffer[4096];
-        while (fgets(buffer, sizeof(buffer), fh->value.fh)) {
-            /* Remove trailing newline */
-            size_t len = strlen(buffer);
-            if (len > 0 && buffer[len-1] == '\n') {
-                buffer[len-1] = '\0';
-            }
-            strada_array_push(arr->value.av, strada_new_str(buffer));
+        while ((line = strada_file_read_line(fh->value.fh)) != NULL) {
+            strada_array_push(arr->value.av, line);
+        }
+    } else if (fh->type == STRADA_SOCKET && fh->value.sock) {
+        while ((line = strada_socket_read_line(fh->value.sock)) != NULL) {
+            strada_array_push(arr->value.av, line);
         }
-        return arr;
     }
+    return arr;
+}
 
-    /* Handle socket - buffered reading */
-    if (fh->type == STRADA_SOCKET && fh->value.sock) {
-        StradaSocketBuffer *sb = fh->value.sock;
-
-        while (1) {
-            char line[4096];
-            size_t line_pos = 0;
-            int got_line = 0;
-
-            while (line_pos < sizeof(line) - 1) {
-                /* Refill buffer if empty */
-                if (sb->read_pos >= sb->read_len) {
-                    ssize_t n = recv(sb->fd, sb->read_buf, STRADA_SOCKET_BUFSIZE, 0);
-                    if (n <= 0) {
-                        /* EOF or error */
-                        if (line_pos > 0) {
-                            /* Return what we have */
-                            line[line_pos] = '\0';
-                            strada_array_push(arr->value.av, strada_new_str(line));
-                        }
-                        return arr;
-                    }
-                    sb->read_pos = 0;
-                    sb->read_len = (size_t)n;
-                }
-
-                /* Get next character from buffer */
-                char c = sb->read_buf[sb->read_pos++];
+/* Map a regular file read-only as a string value. The mapping sits at the
+ * start of an anonymous reservation one byte longer than the file, so the
+ * bytes always end in a NUL like any other string. Freeing the value
+ * unmaps it. Returns NULL if the file cannot be mapped: not a regular
+ * file, mmap failed, or a size of 0 (empty, or a /proc file whose size
+ * is not known in advance). */
+StradaValue* strada_map_file(const char *path, int advice) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return NULL;
+    }
 
-                if (c == '\n') {
-                    got_line = 1;
-                    break;  /* Don't include newline */
-                }
-                if (c != '\r') {  /* Skip carriage return */
-                    line[line_pos++] = c;
-                }
-            }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_len = (size + 1 + page - 1) & ~(page - 1);
+    char *base = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, map_len);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    if (advice != 0) {
+        madvise(base, size, advice);
+    }
 
-            line[line_pos] = '\0';
-            strada_array_push(arr->value.av, strada_new_str(line));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
+    sv->type = STRADA_STR;
+    sv->refcount = 1;
+    sv->value.pv = base;
+    sv->struct_size = size;
+    sv->str_cap = map_len | STRADA_STR_MAPPED;
+    sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
+    return sv;
+}
 
-            if (!got_line) {
-                /* Line too long or EOF */
-                break;
-            }
+/* sys::slurp_mmap: the file as a read-only mapped string, with an optional
+ * madvise hint. Files that cannot be mapped are read with strada_slurp. */
+StradaValue* strada_slurp_mmap(const char *path, const char *advice) {
+    int adv = 0;
+    if (advice && *advice) {
+        if (strcmp(advice, "sequential") == 0) adv = MADV_SEQUENTIAL;
+        else if (strcmp(advice, "random") == 0) adv = MADV_RANDOM;
+        else if (strcmp(advice, "willneed") == 0) adv = MADV_WILLNEED;
+        else if (strcmp(advice, "normal") != 0) {
+            strada_throw("sys::slurp_mmap: advice must be \"normal\", \"sequential\", \"random\" or \"willneed\"");
+            return strada_new_undef();
         }
-        return arr;
     }
-
-    return arr;
+    StradaValue *sv = strada_map_file(path, adv);
+    return sv ? sv : strada_slurp(path);
+}
+
+/* Where a line iterator reads from: a mapped file, or a file handle for
+ * anything that cannot be mapped (pipes, /proc files, ...). NULL if the
+ * file cannot be opened. */
+static StradaValue* strada_lines_source(StradaValue *file) {
+    if (!file) return NULL;
+    if (file->type == STRADA_FILEHANDLE) {
+        if (!file->value.fh) return NULL;
+        strada_incref(file);
+        return file;
+    }
+    char *path = strada_to_str(file);
+    StradaValue *src = strada_map_file(path, MADV_SEQUENTIAL);
+    if (!src) {
+        FILE *fp = fopen(path, "r");
+        if (fp) {
+            src = strada_slab_alloc(STRADA_SLAB_VALUE);
+            src->type = STRADA_FILEHANDLE;
+            src->refcount = 1;
+            src->blessed_package = NULL;
+            src->value.fh = fp;
+            strada_memprof_alloc(src);
+        }
+    }
+    free(path);
+    return src;
+}
+
+/* Next line from a line source; *pos is the offset into a mapped file.
+ * Lines in a mapped file are found with memchr and copied out directly. */
+static StradaValue* strada_lines_next(StradaValue *src, int64_t *pos) {
+    if (src->type == STRADA_FILEHANDLE) {
+        return src->value.fh ? strada_file_read_line(src->value.fh) : NULL;
+    }
+    size_t len = src->struct_size;
+    size_t at = (size_t)*pos;
+    if (at >= len) return NULL;
+    const char *start = src->value.pv + at;
+    const char *nl = memchr(start, '\n', len - at);
+    size_t n = nl ? (size_t)(nl - start) : len - at;
+    *pos = (int64_t)(at + n + (nl ? 1 : 0));
+    return strada_new_str_len(start, n);
+}
+
+/* Body of the closure returned by sys::lines: captures are the source and
+ * a private integer holding the read offset */
+static StradaValue* strada_lines_body(StradaValue ***captures) {
+    StradaValue *src = *captures[0];
+    StradaValue *pos = *captures[1];
+    StradaValue *line = strada_lines_next(src, &pos->value.iv);
+    return line ? line : strada_new_undef();
+}
+
+StradaValue* strada_lines(StradaValue *file) {
+    StradaValue *src = strada_lines_source(file);
+    if (!src) return strada_new_undef();
+    StradaValue *pos = strada_slab_alloc(STRADA_SLAB_VALUE);
+    pos->type = STRADA_INT;
+    pos->refcount = 1;
+    pos->blessed_package = NULL;
+    pos->value.iv = 0;
+    strada_memprof_alloc(pos);
+    StradaValue **captures[2] = { &src, &pos };
+    StradaValue *it = strada_closure_new((void*)strada_lines_body, 0, 2, captures);
+    strada_decref(src);
+    strada_decref(pos);
+    return it;
+}
+
+int64_t strada_each_line(StradaValue *file, StradaValue *callback) {
+    StradaValue *src = strada_lines_source(file);
+    if (!src) return -1;
+    int64_t pos = 0;
+    volatile int64_t count = 0;
+    StradaValue * volatile line = NULL;
+
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        while ((line = strada_lines_next(src, &pos)) != NULL) {
+            StradaValue *r = strada_closure_call1(callback, line);
+            strada_decref(line);
+            line = NULL;
+            if (r) strada_decref(r);
+            count++;
+        }
+        STRADA_TRY_POP();
+    } else {
+        /* Unmap before the exception moves on */
+        STRADA_TRY_POP();
+        if (line) strada_decref(line);
+        strada_decref(src);
+        strada_throw_value(strada_get_exception());
+    }
+    strada_decref(src);
+    return count;
 }
 
 void strada_write_file(StradaValue *fh, const char *content) {
@@ -1932,13 +3712,17 @@ StradaValue* strada_slurp(const char *filename) {
     }
 
     char *content = malloc(size + 1);
+    if (!content) {
+        fclose(f);
+        return strada_new_undef();
+    }
     size_t read_size = fread(content, 1, size, f);
     content[read_size] = '\0';
 
     fclose(f);
 
-    StradaValue *result = strada_new_str(content);
-    free(content);
+    /* The string takes the buffer as is; binary-safe */
+    StradaValue *result = strada_new_str_take_len(content, read_size, (size_t)size + 1);
 
     return result;
 }
@@ -1962,11 +3746,14 @@ StradaValue* strada_slurp_fh(StradaValue *fh_sv) {
     }
 
     char *content = malloc(size + 1);
+    if (!content) {
+        return strada_new_undef();
+    }
     size_t read_size = fread(content, 1, size, f);
     content[read_size] = '\0';
 
-    StradaValue *result = strada_new_str(content);
-    free(content);
+    /* The string takes the buffer as is; binary-safe */
+    StradaValue *result = strada_new_str_take_len(content, read_size, (size_t)size + 1);
 
     return result;
 }
@@ -2104,22 +3891,16 @@ void strada_dump(StradaValue *sv, int indent) {
         case STRADA_HASH: {
             StradaHash *hv = sv->value.hv;
             /* Check if hash is empty */
-            int is_empty = 1;
-            for (size_t i = 0; i < hv->num_buckets && is_empty; i++) {
-                if (hv->buckets[i]) is_empty = 0;
-            }
-            if (is_empty) {
+            if (hv->num_entries == 0) {
                 printf("{}");
             } else {
                 printf("{\n");
                 for (size_t i = 0; i < hv->num_buckets; i++) {
-                    StradaHashEntry *entry = hv->buckets[i];
-                    while (entry) {
-                        printf("%s  '%s' => ", ind, entry->key);
-                        strada_dump(entry->value, indent + 1);
-                        printf(",\n");
-                        entry = entry->next;
-                    }
+                    StradaHashEntry *entry = &hv->entries[i];
+                    if (!entry->key) continue;
+                    printf("%s  '%s' => ", ind, entry->key);
+                    strada_dump(entry->value, indent + 1);
+                    printf(",\n");
                 }
                 printf("%s}", ind);
             }
@@ -2245,22 +4026,16 @@ static void strada_dump_to_buf(StradaValue *sv, int indent, char **buf, size_t *
         case STRADA_HASH: {
             StradaHash *hv = sv->value.hv;
             /* Check if hash is empty */
-            int is_empty = 1;
-            for (size_t i = 0; i < hv->num_buckets && is_empty; i++) {
-                if (hv->buckets[i]) is_empty = 0;
-            }
-            if (is_empty) {
+            if (hv->num_entries == 0) {
                 APPEND("{}");
             } else {
                 APPEND("{\n");
                 for (size_t i = 0; i < hv->num_buckets; i++) {
-                    StradaHashEntry *entry = hv->buckets[i];
-                    while (entry) {
-                        APPEND("%s  '%s' => ", ind, entry->key);
-                        strada_dump_to_buf(entry->value, indent + 1, buf, len, cap);
-                        APPEND(",\n");
-                        entry = entry->next;
-                    }
+                    StradaHashEntry *entry = &hv->entries[i];
+                    if (!entry->key) continue;
+                    APPEND("%s  '%s' => ", ind, entry->key);
+                    strada_dump_to_buf(entry->value, indent + 1, buf, len, cap);
+                    APPEND(",\n");
                 }
                 APPEND("%s}", ind);
             }
@@ -2367,105 +4142,150 @@ StradaValue* strada_ref(StradaValue *sv) {
 
 /* ===== UTILITY FUNCTIONS ===== */
 
-/* Exception handling globals */
-StradaTryContext strada_try_stack[STRADA_MAX_TRY_DEPTH];
-int strada_try_depth = 0;
-char *strada_exception_msg = NULL;
-StradaValue *strada_exception_value = NULL;  /* Typed exception support */
-
-/* Pending cleanup for function call args in try blocks */
-#define STRADA_MAX_PENDING_CLEANUP 64
-static StradaValue *strada_pending_cleanup[STRADA_MAX_PENDING_CLEANUP];
-static int strada_pending_cleanup_count = 0;
+/* Exception handling state, one set per thread */
+__thread StradaTryContext *strada_try_stack = NULL;
+__thread int strada_try_depth = 0;
+__thread int strada_try_cap = 0;
+__thread char *strada_exception_msg = NULL;
+__thread StradaValue *strada_exception_value = NULL;  /* Typed exception support */
+
+/* Pending cleanup for function params, call args and locals in try blocks */
+__thread StradaCleanupEntry *strada_cleanup_stack = NULL;
+__thread int strada_cleanup_top = 0;
+__thread int strada_cleanup_cap = 0;
+
+/* The same state for code compiled by TinyCC, which cannot address
+ * thread-local variables itself (see strada_runtime.h) */
+StradaTryContext **strada_tls_try_stack(void) { return &strada_try_stack; }
+int *strada_tls_try_depth(void) { return &strada_try_depth; }
+int *strada_tls_try_cap(void) { return &strada_try_cap; }
+char **strada_tls_exception_msg(void) { return &strada_exception_msg; }
+StradaCleanupEntry **strada_tls_cleanup_stack(void) { return &strada_cleanup_stack; }
+int *strada_tls_cleanup_top(void) { return &strada_cleanup_top; }
+int *strada_tls_cleanup_cap(void) { return &strada_cleanup_cap; }
+
+/* Contexts are copied on growth; a jump buffer holds no pointer to itself */
+void strada_try_grow(void) {
+    int cap = strada_try_cap ? strada_try_cap * 2 : 16;
+    StradaTryContext *stack = realloc(strada_try_stack, (size_t)cap * sizeof(StradaTryContext));
+    if (!stack) {
+        fprintf(stderr, "Out of memory growing the try stack\n");
+        abort();
+    }
+    strada_try_stack = stack;
+    strada_try_cap = cap;
+}
+
+void strada_cleanup_grow(void) {
+    int cap = strada_cleanup_cap ? strada_cleanup_cap * 2 : 64;
+    StradaCleanupEntry *stack = realloc(strada_cleanup_stack, (size_t)cap * sizeof(StradaCleanupEntry));
+    if (!stack) {
+        fprintf(stderr, "Out of memory growing the cleanup stack\n");
+        abort();
+    }
+    strada_cleanup_stack = stack;
+    strada_cleanup_cap = cap;
+}
 
 void strada_cleanup_push(StradaValue *sv) {
-    if (strada_pending_cleanup_count < STRADA_MAX_PENDING_CLEANUP) {
-        strada_pending_cleanup[strada_pending_cleanup_count++] = sv;
-    }
+    if (strada_cleanup_top == strada_cleanup_cap) strada_cleanup_grow();
+    strada_cleanup_stack[strada_cleanup_top].slot = NULL;
+    strada_cleanup_stack[strada_cleanup_top].sv = sv;
+    strada_cleanup_top++;
 }
 
 void strada_cleanup_pop(void) {
-    if (strada_pending_cleanup_count > 0) {
-        strada_pending_cleanup_count--;
+    if (strada_cleanup_top > 0) {
+        strada_cleanup_top--;
     }
 }
 
-void strada_cleanup_drain(void) {
-    while (strada_pending_cleanup_count > 0) {
-        StradaValue *sv = strada_pending_cleanup[--strada_pending_cleanup_count];
+/* Drain cleanup stack down to a saved depth (decref and pop).
+ * Entries come off before they are released, so a DESTROY that throws
+ * while draining never sees them again. */
+void strada_cleanup_drain_to(int mark) {
+    if (mark < 0) mark = 0;
+    while (strada_cleanup_top > mark) {
+        StradaCleanupEntry *e = &strada_cleanup_stack[--strada_cleanup_top];
+        StradaValue *sv = e->slot ? *e->slot : e->sv;
         if (sv) strada_decref(sv);
     }
 }
 
+void strada_cleanup_drain(void) {
+    strada_cleanup_drain_to(0);
+}
+
 /* Get current cleanup stack depth (for saving at try entry) */
 int strada_cleanup_mark(void) {
-    return strada_pending_cleanup_count;
+    return strada_cleanup_top;
 }
 
 /* Restore cleanup stack to a saved depth (pop without decref, for normal try exit) */
 void strada_cleanup_restore(int mark) {
-    if (mark >= 0 && mark <= strada_pending_cleanup_count) {
-        strada_pending_cleanup_count = mark;
-    }
-}
-
-/* Drain cleanup stack down to a saved depth (decref and pop, for exception) */
-void strada_cleanup_drain_to(int mark) {
-    while (strada_pending_cleanup_count > mark) {
-        StradaValue *sv = strada_pending_cleanup[--strada_pending_cleanup_count];
-        if (sv) strada_decref(sv);
+    if (mark >= 0 && mark <= strada_cleanup_top) {
+        strada_cleanup_top = mark;
     }
 }
 
 int strada_in_try_block(void) {
-    return strada_try_depth > 0 && strada_try_stack[strada_try_depth - 1].active;
+    return strada_try_depth > 0;
 }
 
-void strada_throw(const char *msg) {
-    /* Free previous exception message if any */
-    if (strada_exception_msg) {
-        free(strada_exception_msg);
-    }
-    strada_exception_msg = msg ? strdup(msg) : strdup("Unknown error");
-
-    /* Clear any previous exception value */
-    if (strada_exception_value) {
-        strada_decref(strada_exception_value);
-        strada_exception_value = NULL;
-    }
+#if defined(__SANITIZE_ADDRESS__)
+#define STRADA_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define STRADA_ASAN 1
+#endif
+#endif
+#ifdef STRADA_ASAN
+void __asan_handle_no_return(void);
+#endif
 
-    if (strada_in_try_block()) {
-        /* Jump to the nearest catch block */
-        longjmp(strada_try_stack[strada_try_depth - 1].buf, 1);
-    } else {
-        /* No try block - fatal error */
-        fprintf(stderr, "Uncaught exception: %s\n", strada_exception_msg);
+/* Release what the frames being unwound still hold, then jump to the
+ * innermost catch. The exception is installed after draining, since a
+ * DESTROY run by the drain may use try/catch itself. */
+static void strada_unwind(char *msg, StradaValue *sv) {
+    if (!strada_in_try_block()) {
+        fprintf(stderr, "Uncaught exception: %s\n", msg);
         exit(1);
     }
-}
+    strada_cleanup_drain_to(strada_try_stack[strada_try_depth - 1].cleanup_mark);
 
-void strada_throw_value(StradaValue *sv) {
-    /* Store the actual exception value for typed catches */
-    /* Take ownership of sv directly - caller transfers ownership */
+    if (strada_exception_msg) {
+        free(strada_exception_msg);
+    }
+    strada_exception_msg = msg;
     if (strada_exception_value) {
         strada_decref(strada_exception_value);
     }
     strada_exception_value = sv;
-    /* Note: don't incref - we take ownership from caller */
 
-    /* Also store the string message for backward compat and error reporting */
-    char *msg = strada_to_str(sv);
-    if (strada_exception_msg) {
-        free(strada_exception_msg);
+    StradaTryContext *ctx = &strada_try_stack[strada_try_depth - 1];
+#if STRADA_FAST_TRY
+    if (ctx->fast) {
+#ifdef STRADA_ASAN
+        __asan_handle_no_return();
+#endif
+        __builtin_longjmp(ctx->buf.fast, 1);
     }
-    strada_exception_msg = msg;  /* Take ownership directly */
-
-    if (strada_in_try_block()) {
-        longjmp(strada_try_stack[strada_try_depth - 1].buf, 1);
-    } else {
-        fprintf(stderr, "Uncaught exception: %s\n", msg);
-        exit(1);
+#else
+    if (ctx->fast) {
+        fprintf(stderr, "strada: try entered with __builtin_setjmp, but the runtime was built without it\n");
+        abort();
     }
+#endif
+    longjmp(ctx->buf.jb, 1);
+}
+
+void strada_throw(const char *msg) {
+    strada_unwind(msg ? strdup(msg) : strdup("Unknown error"), NULL);
+}
+
+void strada_throw_value(StradaValue *sv) {
+    /* Takes ownership of sv; the string form is kept for error reporting */
+    strada_unwind(strada_to_str(sv), sv);
 }
 
 StradaValue* strada_get_exception(void) {
@@ -2588,12 +4408,13 @@ StradaValue* strada_socket_create(void) {
     buf->read_len = 0;
     buf->write_len = 0;
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_SOCKET;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.sock = buf;
 
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -2660,12 +4481,13 @@ StradaValue* strada_socket_accept(StradaValue *sock) {
     buf->read_len = 0;
     buf->write_len = 0;
 
-    StradaValue *client = malloc(sizeof(StradaValue));
+    StradaValue *client = strada_slab_alloc(STRADA_SLAB_VALUE);
     client->type = STRADA_SOCKET;
     client->refcount = 1;
     client->blessed_package = NULL;
     client->value.sock = buf;
 
+    strada_memprof_alloc(client);
     return client;
 }
 
@@ -2680,33 +4502,72 @@ int strada_socket_send(StradaValue *sock, const char *data) {
     return (int)sent;
 }
 
+/* Move up to max bytes already read into the socket's line buffer (by
+ * readline) into dst. Returns the count moved. */
+static size_t strada_socket_take_buffered(StradaSocketBuffer *sb, char *dst, size_t max) {
+    size_t avail = sb->read_len - sb->read_pos;
+    if (avail == 0 || max == 0) return 0;
+    size_t n = avail < max ? avail : max;
+    memcpy(dst, sb->read_buf + sb->read_pos, n);
+    sb->read_pos += n;
+    if (sb->read_pos == sb->read_len) {
+        sb->read_pos = 0;
+        sb->read_len = 0;
+    }
+    return n;
+}
+
+/* Send whatever print/say left in the write buffer, so direct sends stay
+ * in order behind it */
+static int strada_socket_flush_pending(StradaSocketBuffer *sb) {
+    size_t done = 0;
+    while (done < sb->write_len) {
+        ssize_t n = send(sb->fd, sb->write_buf + done, sb->write_len - done, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        done += (size_t)n;
+    }
+    sb->write_len = 0;
+    return 0;
+}
+
 /* Binary-safe version: uses struct_size to handle embedded NULLs */
 int strada_socket_send_sv(StradaValue *sock, StradaValue *data) {
     if (!sock || sock->type != STRADA_SOCKET || !sock->value.sock || !data) {
         return -1;
     }
 
-    const char *buf;
-    size_t len;
+    StradaSocketBuffer *sb = sock->value.sock;
+    if (sb->write_len > 0 && strada_socket_flush_pending(sb) < 0) {
+        return -1;
+    }
 
     if (data->type == STRADA_STR && data->value.pv) {
-        buf = data->value.pv;
-        len = data->struct_size > 0 ? data->struct_size : strlen(data->value.pv);
-    } else {
+        ssize_t sent = send(sb->fd, data->value.pv, strada_str_len(data), 0);
+        return (int)sent;
+    }
+    if (data->type == STRADA_UNDEF) {
         return -1;
     }
-
-    ssize_t sent = send(sock->value.sock->fd, buf, len, 0);
+    char *text = strada_to_str(data);
+    ssize_t sent = send(sb->fd, text, strlen(text), 0);
+    free(text);
     return (int)sent;
 }
 
 StradaValue* strada_socket_recv(StradaValue *sock, int max_len) {
-    if (!sock || sock->type != STRADA_SOCKET || !sock->value.sock) {
+    if (!sock || sock->type != STRADA_SOCKET || !sock->value.sock || max_len <= 0) {
         return strada_new_undef();
     }
+    StradaSocketBuffer *sb = sock->value.sock;
 
-    char *buffer = malloc(max_len + 1);
-    ssize_t received = recv(sock->value.sock->fd, buffer, max_len, 0);
+    /* Receive straight into the string's own buffer */
+    char *buffer = malloc((size_t)max_len + 1);
+    if (!buffer) return strada_new_undef();
+    ssize_t received = (ssize_t)strada_socket_take_buffered(sb, buffer, (size_t)max_len);
+    if (received == 0) {
+        received = recv(sb->fd, buffer, max_len, 0);
+    }
 
     if (received < 0) {
         free(buffer);
@@ -2714,11 +4575,298 @@ StradaValue* strada_socket_recv(StradaValue *sock, int max_len) {
     }
 
     buffer[received] = '\0';
-    /* Use strada_new_str_len to preserve binary data with embedded NULLs */
-    StradaValue *result = strada_new_str_len(buffer, (size_t)received);
-    free(buffer);
+    size_t cap = (size_t)max_len + 1;
+    if ((size_t)received * 2 < cap && cap > 4096) {
+        /* Don't keep a mostly empty buffer alive */
+        char *shrunk = realloc(buffer, (size_t)received + 1);
+        if (shrunk) {
+            buffer = shrunk;
+            cap = (size_t)received + 1;
+        }
+    }
+    return strada_new_str_take_len(buffer, (size_t)received, cap);
+}
 
-    return result;
+/* recv into the string that buf_ref points at, reusing its buffer when
+ * it is big enough. With append, the data goes after the current
+ * contents. Returns bytes received: 0 at EOF, -1 on error. */
+int64_t strada_socket_recv_into(StradaValue *sock, StradaValue *buf_ref, int64_t max_len, int append) {
+    if (!sock || sock->type != STRADA_SOCKET || !sock->value.sock || max_len < 0) {
+        return -1;
+    }
+    if (!buf_ref || buf_ref->type != STRADA_REF || !buf_ref->value.rv) {
+        strada_throw("sys::socket_recv_into: expected a scalar reference");
+        return -1;
+    }
+    StradaValue *target = buf_ref->value.rv;
+    if (STRADA_IS_IMMORTAL(target)) {
+        target = strada_unshare_immortal(target);
+        buf_ref->value.rv = target;
+    }
+    if (target->type != STRADA_STR && target->type != STRADA_UNDEF &&
+        target->type != STRADA_INT && target->type != STRADA_NUM) {
+        strada_throw("sys::socket_recv_into: target must be a scalar");
+        return -1;
+    }
+
+    size_t keep = 0;
+    if (append) {
+        if (target->type == STRADA_STR) {
+            keep = strada_str_len(target);
+        } else if (target->type != STRADA_UNDEF) {
+            /* A number: append to its text */
+            char *text = strada_to_str(target);
+            target->type = STRADA_STR;
+            target->value.pv = text;
+            target->struct_size = strlen(text);
+            target->str_cap = 0;
+            keep = target->struct_size;
+        }
+    }
+    size_t need = keep + (size_t)max_len + 1;
+
+    int own = target->type == STRADA_STR && target->value.pv &&
+              !STRADA_STR_IS_VIEW(target) && !STRADA_STR_IS_MAPPED(target) &&
+              !STRADA_STR_IS_INLINE(target);
+    size_t cap = own ? (target->str_cap & ~STRADA_STR_FLAGS) : 0;
+    if (own && cap == 0) cap = target->struct_size + 1;
+    if (!own || cap < need) {
+        size_t new_cap = (need + 7) & ~(size_t)7;
+        /* Repeated appends (a body read in pieces) grow geometrically */
+        if (own && keep > 0 && new_cap < cap * 2) new_cap = cap * 2;
+        char *fresh = own ? realloc(target->value.pv, new_cap) : malloc(new_cap);
+        if (!fresh) return -1;
+        if (!own && target->type == STRADA_STR && target->value.pv) {
+            if (keep > 0) memcpy(fresh, target->value.pv, keep);
+            strada_str_release(target);
+        }
+        target->type = STRADA_STR;
+        target->value.pv = fresh;
+        cap = new_cap;
+    }
+
+    StradaSocketBuffer *sb = sock->value.sock;
+    ssize_t n = (ssize_t)strada_socket_take_buffered(sb, target->value.pv + keep, (size_t)max_len);
+    if (n == 0 && max_len > 0) {
+        do {
+            n = recv(sb->fd, target->value.pv + keep, (size_t)max_len, 0);
+        } while (n < 0 && errno == EINTR);
+    }
+    size_t len = keep + (n > 0 ? (size_t)n : 0);
+    target->value.pv[len] = '\0';
+    target->struct_size = len;
+    /* Contents changed: drop the ASCII mark. Rounding down only hides
+     * a few spare bytes. */
+    cap &= ~(size_t)STRADA_STR_FLAGS;
+    target->str_cap = cap > len ? cap : 0;
+    return n < 0 ? -1 : (int64_t)n;
+}
+
+/* Send every element of an array with writev, retrying partial writes.
+ * Returns the total bytes sent, -1 on error. */
+int64_t strada_socket_writev(StradaValue *sock, StradaValue *parts_ref) {
+    if (!sock || sock->type != STRADA_SOCKET || !sock->value.sock) {
+        return -1;
+    }
+    StradaArray *arr = strada_deref_array(parts_ref);
+    if (!arr) return -1;
+    StradaSocketBuffer *sb = sock->value.sock;
+    if (sb->write_len > 0 && strada_socket_flush_pending(sb) < 0) return -1;
+
+    size_t count = arr->size;
+    if (count == 0) return 0;
+    struct iovec stack_iov[64];
+    char *stack_tmp[64];
+    struct iovec *iov = count <= 64 ? stack_iov : malloc(sizeof(struct iovec) * count);
+    char **tmp = count <= 64 ? stack_tmp : malloc(sizeof(char*) * count);
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        StradaValue *part = arr->elements[i];
+        tmp[i] = NULL;
+        if (part && part->type == STRADA_STR && part->value.pv) {
+            iov[i].iov_base = part->value.pv;
+            iov[i].iov_len = strada_str_len(part);
+        } else {
+            tmp[i] = strada_to_str(part);
+            iov[i].iov_base = tmp[i];
+            iov[i].iov_len = strlen(tmp[i]);
+        }
+        total += iov[i].iov_len;
+    }
+
+    size_t sent = 0;
+    size_t first = 0;
+    int failed = 0;
+    while (sent < total) {
+        while (first < count && iov[first].iov_len == 0) first++;
+        int batch = (int)((count - first) < 1024 ? (count - first) : 1024);  /* IOV_MAX */
+        ssize_t n = writev(sb->fd, iov + first, batch);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            failed = 1;
+            break;
+        }
+        sent += (size_t)n;
+        /* Skip what went out */
+        size_t left = (size_t)n;
+        while (left > 0) {
+            if (left >= iov[first].iov_len) {
+                left -= iov[first].iov_len;
+                iov[first].iov_len = 0;
+                first++;
+            } else {
+                iov[first].iov_base = (char *)iov[first].iov_base + left;
+                iov[first].iov_len -= left;
+                left = 0;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) free(tmp[i]);
+    if (iov != stack_iov) free(iov);
+    if (tmp != stack_tmp) free(tmp);
+    return failed && sent == 0 ? -1 : (int64_t)sent;
+}
+
+/* Copy count bytes (-1: to end of file) of a file, from offset, to the
+ * socket. Uses sendfile(2) where available, so the data never passes
+ * through user space. file is a path or a file handle. Returns bytes sent,
+ * -1 on error. */
+int64_t strada_socket_sendfile(StradaValue *sock, StradaValue *file, int64_t offset, int64_t count) {
+    if (!sock || sock->type != STRADA_SOCKET || !sock->value.sock || !file || offset < 0) {
+        return -1;
+    }
+    StradaSocketBuffer *sb = sock->value.sock;
+    if (sb->write_len > 0 && strada_socket_flush_pending(sb) < 0) return -1;
+
+    int fd;
+    int close_fd = 0;
+    if (file->type == STRADA_FILEHANDLE) {
+        if (!file->value.fh) return -1;
+        fflush(file->value.fh);
+        fd = fileno(file->value.fh);
+    } else {
+        char *path = strada_to_str(file);
+        fd = open(path, O_RDONLY);
+        free(path);
+        if (fd < 0) return -1;
+        close_fd = 1;
+    }
+    if (count < 0) {
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < offset) {
+            if (close_fd) close(fd);
+            return st.st_size < offset ? 0 : -1;
+        }
+        count = (int64_t)st.st_size - offset;
+    }
+
+    int64_t sent = 0;
+#if defined(__linux__)
+    off_t off = (off_t)offset;
+    while (sent < count) {
+        ssize_t n = sendfile(sb->fd, fd, &off, (size_t)(count - sent));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && sent == 0 && (errno == EINVAL || errno == ENOSYS)) break;  /* Fall back */
+        if (n <= 0) break;
+        sent += n;
+    }
+    if (sent > 0 || count == 0) {
+        if (close_fd) close(fd);
+        return sent;
+    }
+#endif
+    char chunk[65536];
+    while (sent < count) {
+        size_t want = (size_t)(count - sent) < sizeof(chunk) ? (size_t)(count - sent) : sizeof(chunk);
+        ssize_t got = pread(fd, chunk, want, (off_t)(offset + sent));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        ssize_t done = 0;
+        while (done < got) {
+            ssize_t n = send(sb->fd, chunk + done, (size_t)(got - done), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                if (close_fd) close(fd);
+                return sent + done > 0 ? sent + done : -1;
+            }
+            done += n;
+        }
+        sent += got;
+    }
+    if (close_fd) close(fd);
+    return sent;
+}
+
+/* Move up to max_len bytes from one socket to another. On Linux the data
+ * goes through a pipe with splice(2) and never enters user space. Returns
+ * bytes moved: 0 at EOF, -1 on error. */
+int64_t strada_socket_splice(StradaValue *from, StradaValue *to, int64_t max_len) {
+    if (!from || from->type != STRADA_SOCKET || !from->value.sock ||
+        !to || to->type != STRADA_SOCKET || !to->value.sock || max_len <= 0) {
+        return -1;
+    }
+    StradaSocketBuffer *src = from->value.sock;
+    StradaSocketBuffer *dst = to->value.sock;
+    if (dst->write_len > 0 && strada_socket_flush_pending(dst) < 0) return -1;
+
+    char chunk[16384];
+    /* Bytes readline already pulled in go first */
+    size_t buffered = strada_socket_take_buffered(src, chunk,
+                                                  (size_t)max_len < sizeof(chunk) ? (size_t)max_len : sizeof(chunk));
+    if (buffered > 0) {
+        size_t done = 0;
+        while (done < buffered) {
+            ssize_t n = send(dst->fd, chunk + done, buffered - done, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return done > 0 ? (int64_t)done : -1;
+            done += (size_t)n;
+        }
+        return (int64_t)buffered;
+    }
+
+#if defined(__linux__)
+    static __thread int pipe_fds[2] = { -1, -1 };
+    if (pipe_fds[0] < 0 && pipe(pipe_fds) < 0) {
+        pipe_fds[0] = pipe_fds[1] = -1;
+    }
+    if (pipe_fds[0] >= 0) {
+        ssize_t in;
+        do {
+            in = splice(src->fd, NULL, pipe_fds[1], NULL, (size_t)max_len, SPLICE_F_MOVE);
+        } while (in < 0 && errno == EINTR);
+        if (in >= 0 || errno != EINVAL) {
+            if (in <= 0) return in < 0 ? -1 : 0;
+            ssize_t out = 0;
+            while (out < in) {
+                ssize_t n = splice(pipe_fds[0], NULL, dst->fd, NULL, (size_t)(in - out), SPLICE_F_MOVE);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    /* Drop what is stuck in the pipe so the next call starts clean */
+                    close(pipe_fds[0]);
+                    close(pipe_fds[1]);
+                    pipe_fds[0] = pipe_fds[1] = -1;
+                    return out > 0 ? out : -1;
+                }
+                out += n;
+            }
+            return in;
+        }
+    }
+#endif
+    ssize_t got;
+    do {
+        got = recv(src->fd, chunk, (size_t)max_len < sizeof(chunk) ? (size_t)max_len : sizeof(chunk), 0);
+    } while (got < 0 && errno == EINTR);
+    if (got <= 0) return got < 0 ? -1 : 0;
+    ssize_t done = 0;
+    while (done < got) {
+        ssize_t n = send(dst->fd, chunk + done, (size_t)(got - done), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return done > 0 ? done : -1;
+        done += n;
+    }
+    return got;
 }
 
 /* Flush socket write buffer */
@@ -2994,12 +5142,13 @@ StradaValue* strada_udp_socket(void) {
     buf->read_len = 0;
     buf->write_len = 0;
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_SOCKET;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.sock = buf;
 
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -3127,6 +5276,7 @@ int strada_udp_sendto_sv(StradaValue *sock, StradaValue *data, const char *host,
 
 /* ===== REGEX FUNCTIONS ===== */
 
+#ifndef STRADA_HAVE_PCRE2
 /* Helper: Convert flag string to POSIX regex cflags */
 static int regex_get_cflags(const char *flags) {
     int cflags = REG_EXTENDED;
@@ -3232,79 +5382,315 @@ static char* regex_preprocess_pattern(const char *pattern, const char *flags) {
     *out = '\0';
     return result;
 }
+#endif
 
-StradaValue* strada_regex_compile(const char *pattern, const char *flags) {
-    regex_t *rx = malloc(sizeof(regex_t));
-    int cflags = regex_get_cflags(flags);
-    char *processed = regex_preprocess_pattern(pattern, flags);
+/* ---- Regex engine ----
+ * PCRE2 (with JIT) when configured with it, POSIX regcomp/regexec
+ * otherwise. Match positions are reported as regmatch_t either way. */
+struct StradaRx {
+#ifdef STRADA_HAVE_PCRE2
+    pcre2_code *code;
+#else
+    regex_t posix;
+#endif
+    size_t nsub;                /* Number of capture groups */
+    char *literal;              /* The text matched, for patterns without metacharacters */
+    size_t literal_len;
+};
+typedef struct StradaRx StradaRx;
+
+static int rx_compile(StradaRx *rx, const char *pattern, const char *flags);
+static void rx_note_literal(StradaRx *rx, const char *pattern, const char *flags);
+static int rx_exec(StradaRx *rx, const char *str, size_t nmatch, regmatch_t *m);
+static void rx_free(StradaRx *rx);
+
+/* ---- Compiled regex cache ----
+ * Each thread keeps a small LRU of compiled patterns keyed by (pattern,
+ * flags), so a =~ inside a loop compiles its pattern once. The cache and
+ * the thread's last captures are released when the thread exits. */
+#define STRADA_REGEX_CACHE_SIZE 64
+
+typedef struct {
+    char *pattern;              /* NULL = unused entry */
+    uint64_t hash;
+    int flag_bits;
+    unsigned long last_used;
+    StradaRx rx;
+} StradaRegexCacheEntry;
+
+typedef struct {
+    StradaRegexCacheEntry entries[STRADA_REGEX_CACHE_SIZE];
+    StradaRegexCacheEntry *last_hit;
+    unsigned long tick;
+    StradaValue *captures;      /* From the last =~ on this thread */
+#ifdef STRADA_HAVE_PCRE2
+    pcre2_match_data *md;       /* Reused by every match on this thread */
+    uint32_t md_pairs;
+#endif
+} StradaRegexThread;
+
+static __thread StradaRegexThread *strada_regex_tls = NULL;
+static pthread_key_t strada_regex_key;
+static pthread_once_t strada_regex_once = PTHREAD_ONCE_INIT;
+
+static void strada_regex_thread_exit(void *p) {
+    StradaRegexThread *t = p;
+    for (int i = 0; i < STRADA_REGEX_CACHE_SIZE; i++) {
+        if (t->entries[i].pattern) {
+            rx_free(&t->entries[i].rx);
+            free(t->entries[i].pattern);
+        }
+    }
+    if (t->captures) strada_decref(t->captures);
+#ifdef STRADA_HAVE_PCRE2
+    if (t->md) pcre2_match_data_free(t->md);
+#endif
+    free(t);
+}
+
+static void strada_regex_key_init(void) {
+    pthread_key_create(&strada_regex_key, strada_regex_thread_exit);
+}
+
+static StradaRegexThread* regex_thread(void) {
+    StradaRegexThread *t = strada_regex_tls;
+    if (!t) {
+        pthread_once(&strada_regex_once, strada_regex_key_init);
+        t = calloc(1, sizeof(StradaRegexThread));
+        strada_regex_tls = t;
+        pthread_setspecific(strada_regex_key, t);
+    }
+    return t;
+}
+
+static int regex_flag_bits(const char *flags) {
+    int bits = 0;
+    if (flags) {
+        if (strchr(flags, 'i')) bits |= 1;
+        if (strchr(flags, 'm')) bits |= 2;
+        if (strchr(flags, 's')) bits |= 4;
+        if (strchr(flags, 'x')) bits |= 8;
+    }
+    return bits;
+}
+
+#ifdef STRADA_HAVE_PCRE2
+/* PCRE2 understands Perl syntax and flags natively, so the pattern is
+ * compiled as written. */
+static int rx_compile(StradaRx *rx, const char *pattern, const char *flags) {
+    uint32_t options = 0;
+    if (flags) {
+        if (strchr(flags, 'i')) options |= PCRE2_CASELESS;
+        if (strchr(flags, 'm')) options |= PCRE2_MULTILINE;
+        if (strchr(flags, 's')) options |= PCRE2_DOTALL;
+        if (strchr(flags, 'x')) options |= PCRE2_EXTENDED;
+    }
+    int errcode;
+    PCRE2_SIZE erroffset;
+    rx->code = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, options,
+                             &errcode, &erroffset, NULL);
+    if (!rx->code) return 0;
+    /* JIT is optional - pcre2_match() falls back to the interpreter */
+    pcre2_jit_compile(rx->code, PCRE2_JIT_COMPLETE);
+    uint32_t count = 0;
+    pcre2_pattern_info(rx->code, PCRE2_INFO_CAPTURECOUNT, &count);
+    rx->nsub = count;
+    rx_note_literal(rx, pattern, flags);
+    return 1;
+}
+
+static int rx_exec(StradaRx *rx, const char *str, size_t nmatch, regmatch_t *m) {
+    StradaRegexThread *t = regex_thread();
+    if (!t->md || t->md_pairs < rx->nsub + 1) {
+        if (t->md) pcre2_match_data_free(t->md);
+        t->md_pairs = rx->nsub + 1 < 16 ? 16 : (uint32_t)rx->nsub + 1;
+        t->md = pcre2_match_data_create(t->md_pairs, NULL);
+    }
+    int rc = pcre2_match(rx->code, (PCRE2_SPTR)str, PCRE2_ZERO_TERMINATED, 0, 0, t->md, NULL);
+    if (rc < 0) return 0;
+
+    PCRE2_SIZE *ov = pcre2_get_ovector_pointer(t->md);
+    for (size_t i = 0; i < nmatch; i++) {
+        if ((int)i < rc && ov[2 * i] != PCRE2_UNSET) {
+            m[i].rm_so = (regoff_t)ov[2 * i];
+            m[i].rm_eo = (regoff_t)ov[2 * i + 1];
+        } else {
+            m[i].rm_so = -1;
+            m[i].rm_eo = -1;
+        }
+    }
+    return 1;
+}
 
-    int result = regcomp(rx, processed, cflags);
+static void rx_free(StradaRx *rx) {
+    pcre2_code_free(rx->code);
+    free(rx->literal);
+}
+#else
+static int rx_compile(StradaRx *rx, const char *pattern, const char *flags) {
+    char *processed = regex_preprocess_pattern(pattern, flags);
+    int result = regcomp(&rx->posix, processed, regex_get_cflags(flags));
     free(processed);
-    if (result != 0) {
+    if (result != 0) return 0;
+    rx->nsub = rx->posix.re_nsub;
+    rx_note_literal(rx, pattern, flags);
+    return 1;
+}
+
+static int rx_exec(StradaRx *rx, const char *str, size_t nmatch, regmatch_t *m) {
+    return regexec(&rx->posix, str, nmatch, nmatch ? m : NULL, 0) == 0;
+}
+
+static void rx_free(StradaRx *rx) {
+    regfree(&rx->posix);
+    free(rx->literal);
+}
+#endif
+
+/* A pattern of plain text, with no flags, matches only that text: split
+ * looks for it with the search kernel instead of running the engine.
+ * Escaped punctuation and \t, \n, \r count as text. */
+static void rx_note_literal(StradaRx *rx, const char *pattern, const char *flags) {
+    rx->literal = NULL;
+    rx->literal_len = 0;
+    if ((flags && *flags) || !*pattern) return;
+    char *text = malloc(strlen(pattern) + 1);
+    size_t n = 0;
+    for (const char *p = pattern; *p; p++) {
+        char c = *p;
+        if (strchr("^$.|?*+()[]{}", c)) {
+            free(text);
+            return;
+        }
+        if (c == '\\') {
+            c = *++p;
+            if (c == 't') c = '\t';
+            else if (c == 'n') c = '\n';
+            else if (c == 'r') c = '\r';
+            else if (!c || isalnum((unsigned char)c)) {
+                free(text);
+                return;
+            }
+        }
+        text[n++] = c;
+    }
+    text[n] = '\0';
+    rx->literal = text;
+    rx->literal_len = n;
+}
+
+/* Compiled pattern from this thread's cache (NULL if it does not compile).
+ * The pointer stays valid until the next cache lookup on this thread. */
+static StradaRx* regex_cached(const char *pattern, const char *flags) {
+    StradaRegexThread *t = regex_thread();
+    int bits = regex_flag_bits(flags);
+    uint64_t hash = strada_hash_bytes(pattern, strlen(pattern)) ^ (uint64_t)bits;
+
+    StradaRegexCacheEntry *e = t->last_hit;
+    if (e && e->hash == hash && e->flag_bits == bits && strcmp(e->pattern, pattern) == 0) {
+        e->last_used = ++t->tick;
+        return &e->rx;
+    }
+
+    StradaRegexCacheEntry *victim = NULL;
+    for (int i = 0; i < STRADA_REGEX_CACHE_SIZE; i++) {
+        e = &t->entries[i];
+        if (!e->pattern) {
+            if (!victim || victim->pattern) victim = e;
+            continue;
+        }
+        if (e->hash == hash && e->flag_bits == bits && strcmp(e->pattern, pattern) == 0) {
+            e->last_used = ++t->tick;
+            t->last_hit = e;
+            return &e->rx;
+        }
+        if (!victim || (victim->pattern && e->last_used < victim->last_used)) victim = e;
+    }
+
+    StradaRx rx;
+    if (!rx_compile(&rx, pattern, flags)) return NULL;
+
+    if (victim->pattern) {
+        rx_free(&victim->rx);
+        free(victim->pattern);
+    }
+    victim->pattern = strdup(pattern);
+    victim->hash = hash;
+    victim->flag_bits = bits;
+    victim->last_used = ++t->tick;
+    victim->rx = rx;
+    t->last_hit = victim;
+    return &victim->rx;
+}
+
+StradaValue* strada_regex_compile(const char *pattern, const char *flags) {
+    StradaRx *rx = malloc(sizeof(StradaRx));
+    if (!rx_compile(rx, pattern, flags)) {
         free(rx);
         return strada_new_undef();
     }
     
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_REGEX;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.rx = rx;
 
+    strada_memprof_alloc(sv);
     return sv;
 }
 
-int strada_regex_match(const char *str, const char *pattern) {
-    regex_t rx;
-    char *processed = regex_preprocess_pattern(pattern, NULL);
-    int result = regcomp(&rx, processed, REG_EXTENDED);
-    free(processed);
+/* Regex for a constant pattern at one call site, compiled on first use and
+ * kept for the life of the process. Returns NULL if the pattern is invalid. */
+StradaValue* strada_regex_static(StradaValue **slot, const char *pattern, const char *flags) {
+    StradaValue *rx = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (rx) return rx;
 
-    if (result != 0) {
-        return 0;
+    rx = strada_regex_compile(pattern, flags);
+    if (rx->type != STRADA_REGEX) {
+        strada_decref(rx);
+        return NULL;
     }
-
-    result = regexec(&rx, str, 0, NULL, 0);
-    regfree(&rx);
-
-    return (result == 0) ? 1 : 0;
+    StradaValue *expected = NULL;
+    if (!__atomic_compare_exchange_n(slot, &expected, rx, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* Another thread compiled it first */
+        strada_decref(rx);
+        return expected;
+    }
+    rx->refcount = STRADA_REFCOUNT_IMMORTAL;
+    return rx;
 }
 
-/* Global storage for last regex captures */
-static StradaValue *last_regex_captures = NULL;
+int strada_regex_match(const char *str, const char *pattern) {
+    StradaRx *rx = regex_cached(pattern, NULL);
+    if (!rx) return 0;
 
-int strada_regex_match_with_capture(const char *str, const char *pattern, const char *flags) {
-    regex_t rx;
-    int cflags = regex_get_cflags(flags);
-    char *processed = regex_preprocess_pattern(pattern, flags);
+    return rx_exec(rx, str, 0, NULL);
+}
 
-    if (regcomp(&rx, processed, cflags) != 0) {
-        free(processed);
-        /* Clear previous captures on failed compile */
-        if (last_regex_captures) {
-            last_regex_captures = NULL;
-        }
-        return 0;
-    }
-    free(processed);
+static void regex_set_captures(StradaValue *captures) {
+    StradaRegexThread *t = regex_thread();
+    if (t->captures) strada_decref(t->captures);
+    t->captures = captures;
+}
 
-    size_t nmatch = rx.re_nsub + 1;
-    regmatch_t *matches = malloc(sizeof(regmatch_t) * nmatch);
+/* Match and record $1.. for captures() */
+static int regex_exec_capture(StradaRx *rx, const char *str) {
+    size_t nmatch = rx->nsub + 1;
+    regmatch_t small[10];
+    regmatch_t *matches = nmatch <= 10 ? small : malloc(sizeof(regmatch_t) * nmatch);
 
-    int matched = (regexec(&rx, str, nmatch, matches, 0) == 0);
+    int matched = rx_exec(rx, str, nmatch, matches);
 
     /* Create new captures array */
-    StradaArray *captures = strada_array_new();
+    StradaValue *sv = strada_new_array();
+    StradaArray *captures = sv->value.av;
 
     if (matched) {
         for (size_t i = 0; i < nmatch; i++) {
             if (matches[i].rm_so != -1) {
-                int len = matches[i].rm_eo - matches[i].rm_so;
-                char *capture = malloc(len + 1);
-                strncpy(capture, str + matches[i].rm_so, len);
-                capture[len] = '\0';
-                strada_array_push_take(captures, strada_new_str(capture));
-                free(capture);
+                strada_array_push_take(captures, strada_new_str_len(str + matches[i].rm_so,
+                                                                    matches[i].rm_eo - matches[i].rm_so));
             } else {
                 strada_array_push_take(captures, strada_new_undef());
             }
@@ -3312,74 +5698,62 @@ int strada_regex_match_with_capture(const char *str, const char *pattern, const
     }
 
     /* Store captures for later retrieval */
-    StradaValue *sv = strada_new_array();
-    sv->value.av = captures;
-    last_regex_captures = sv;
-
-    free(matches);
-    regfree(&rx);
+    regex_set_captures(sv);
 
+    if (matches != small) free(matches);
     return matched;
 }
 
+int strada_regex_match_with_capture(const char *str, const char *pattern, const char *flags) {
+    StradaRx *rx = regex_cached(pattern, flags);
+    if (!rx) {
+        /* Clear previous captures on failed compile */
+        regex_set_captures(NULL);
+        return 0;
+    }
+    return regex_exec_capture(rx, str);
+}
+
+int strada_regex_match_rx(const char *str, StradaValue *rx) {
+    if (!rx || rx->type != STRADA_REGEX) {
+        regex_set_captures(NULL);
+        return 0;
+    }
+    return regex_exec_capture(rx->value.rx, str);
+}
+
 StradaValue* strada_captures(void) {
-    if (last_regex_captures) {
-        return last_regex_captures;
+    StradaValue *captures = regex_thread()->captures;
+    if (captures) {
+        /* The caller gets its own reference; the thread keeps one */
+        strada_incref(captures);
+        return captures;
     }
     /* Return empty array if no captures */
     return strada_new_array();
 }
 
 StradaValue* strada_regex_match_all(const char *str, const char *pattern) {
-    StradaArray *matches = strada_array_new();
-    regex_t rx;
-    char *processed = regex_preprocess_pattern(pattern, NULL);
-
-    if (regcomp(&rx, processed, REG_EXTENDED) != 0) {
-        free(processed);
-        StradaValue *sv = strada_new_array();
-        sv->value.av = matches;
-        return sv;
-    }
-    free(processed);
-    
+    StradaValue *sv = strada_new_array();
+    StradaRx *rx = regex_cached(pattern, NULL);
+    if (!rx) return sv;
+
     const char *p = str;
     regmatch_t match;
     
-    while (regexec(&rx, p, 1, &match, 0) == 0) {
-        int len = match.rm_eo - match.rm_so;
-        char *matched = malloc(len + 1);
-        strncpy(matched, p + match.rm_so, len);
-        matched[len] = '\0';
-        
-        strada_array_push_take(matches, strada_new_str(matched));
-        free(matched);
-        
+    while (rx_exec(rx, p, 1, &match)) {
+        strada_array_push_take(sv->value.av, strada_new_str_len(p + match.rm_so,
+                                                                match.rm_eo - match.rm_so));
         p += match.rm_eo;
         if (match.rm_eo == 0) break; // Prevent infinite loop on empty matches
     }
     
-    regfree(&rx);
-    
-    StradaValue *sv = strada_new_array();
-    sv->value.av = matches;
     return sv;
 }
 
-char* strada_regex_replace(const char *str, const char *pattern, const char *replacement, const char *flags) {
-    regex_t rx;
+static char* regex_replace_first(StradaRx *rx, const char *str, const char *replacement) {
     regmatch_t match;
-    int cflags = regex_get_cflags(flags);
-    char *processed = regex_preprocess_pattern(pattern, flags);
-
-    if (regcomp(&rx, processed, cflags) != 0) {
-        free(processed);
-        return strdup(str);
-    }
-    free(processed);
-
-    if (regexec(&rx, str, 1, &match, 0) != 0) {
-        regfree(&rx);
+    if (!rx_exec(rx, str, 1, &match)) {
         return strdup(str);
     }
 
@@ -3392,65 +5766,111 @@ char* strada_regex_replace(const char *str, const char *pattern, const char *rep
     char *result = malloc(before_len + repl_len + after_len + 1);
 
     // Copy parts
-    strncpy(result, str, before_len);
-    strcpy(result + before_len, replacement);
-    strcpy(result + before_len + repl_len, str + after_start);
-
-    regfree(&rx);
+    memcpy(result, str, before_len);
+    memcpy(result + before_len, replacement, repl_len);
+    memcpy(result + before_len + repl_len, str + after_start, after_len + 1);
     return result;
 }
 
-char* strada_regex_replace_all(const char *str, const char *pattern, const char *replacement, const char *flags) {
-    regex_t rx;
-    int cflags = regex_get_cflags(flags);
-    char *processed = regex_preprocess_pattern(pattern, flags);
-
-    if (regcomp(&rx, processed, cflags) != 0) {
-        free(processed);
-        return strdup(str);
-    }
-    free(processed);
-
+static char* regex_replace_every(StradaRx *rx, const char *str, const char *replacement) {
+    size_t repl_len = strlen(replacement);
     size_t result_size = strlen(str) * 2 + 1;
     char *result = malloc(result_size);
-    result[0] = '\0';
+    size_t offset = 0;
 
     const char *p = str;
     regmatch_t match;
-    size_t offset = 0;
 
-    while (regexec(&rx, p, 1, &match, 0) == 0) {
+    while (rx_exec(rx, p, 1, &match)) {
         // Ensure buffer is large enough
-        size_t needed = offset + match.rm_so + strlen(replacement) + strlen(p + match.rm_eo) + 1;
+        size_t needed = offset + match.rm_so + repl_len + strlen(p + match.rm_eo) + 1;
         if (needed > result_size) {
             result_size = needed * 2;
             result = realloc(result, result_size);
         }
 
-        // Copy before match
-        strncat(result, p, match.rm_so);
+        // Copy before match, then the replacement
+        memcpy(result + offset, p, match.rm_so);
         offset += match.rm_so;
-
-        // Copy replacement
-        strcat(result, replacement);
-        offset += strlen(replacement);
+        memcpy(result + offset, replacement, repl_len);
+        offset += repl_len;
 
         p += match.rm_eo;
         if (match.rm_eo == 0) break; // Prevent infinite loop
     }
 
     // Copy remaining
-    strcat(result, p);
-
-    regfree(&rx);
+    size_t rest = strlen(p);
+    if (offset + rest + 1 > result_size) {
+        result = realloc(result, offset + rest + 1);
+    }
+    memcpy(result + offset, p, rest + 1);
     return result;
 }
 
+char* strada_regex_replace(const char *str, const char *pattern, const char *replacement, const char *flags) {
+    StradaRx *rx = regex_cached(pattern, flags);
+    if (!rx) return strdup(str);
+    return regex_replace_first(rx, str, replacement);
+}
+
+char* strada_regex_replace_all(const char *str, const char *pattern, const char *replacement, const char *flags) {
+    StradaRx *rx = regex_cached(pattern, flags);
+    if (!rx) return strdup(str);
+    return regex_replace_every(rx, str, replacement);
+}
+
+char* strada_regex_replace_rx(const char *str, StradaValue *rx, const char *replacement, int global) {
+    if (!rx || rx->type != STRADA_REGEX) return strdup(str);
+    return global ? regex_replace_every(rx->value.rx, str, replacement)
+                  : regex_replace_first(rx->value.rx, str, replacement);
+}
+
+/* The fields of one split() share a single copy of the source. A field
+ * of STRADA_STR_INLINE_CAP bytes or more becomes a view of a hidden
+ * owner holding that copy, with the byte after the field overwritten by
+ * a NUL so the view is terminated like a strada_str_slice() tail. Shorter
+ * fields are stored inline as usual. The copy is made for the first long
+ * field and freed with the last view of it. */
+typedef struct {
+    StradaArray *parts;
+    const char *src;
+    size_t src_len;
+    StradaValue *owner;
+} StradaSplitOut;
+
+static void split_out_init(StradaSplitOut *out, const char *src, size_t src_len) {
+    out->parts = strada_array_new();
+    out->src = src;
+    out->src_len = src_len;
+    out->owner = NULL;
+}
+
+/* Push the field of len bytes at p, which lies within the source and is
+ * followed by sep_len separator bytes. A field followed by an empty match
+ * is copied, since its terminator would be the next field's first byte. */
+static void split_out_push(StradaSplitOut *out, const char *p, size_t len, size_t sep_len) {
+    if (len < STRADA_STR_INLINE_CAP || (sep_len == 0 && p + len < out->src + out->src_len)) {
+        strada_array_push_take(out->parts, strada_new_str_len(p, len));
+        return;
+    }
+    if (!out->owner) {
+        out->owner = strada_new_str_len(out->src, out->src_len);
+    }
+    char *buf = out->owner->value.pv + (size_t)(p - out->src);
+    buf[len] = '\0';
+    strada_array_push_take(out->parts, strada_str_view_new(out->owner, buf, len, 0));
+}
+
+static StradaArray* split_out_finish(StradaSplitOut *out) {
+    if (out->owner) strada_decref(out->owner);
+    return out->parts;
+}
+
 /* String split - literal string delimiter (no regex) */
 StradaArray* strada_string_split(const char *str, const char *delim) {
-    StradaArray *parts = strada_array_new();
-
     if (!str || !delim) {
+        StradaArray *parts = strada_array_new();
         if (str) strada_array_push_take(parts, strada_new_str(str));
         return parts;
     }
@@ -3458,6 +5878,7 @@ StradaArray* strada_string_split(const char *str, const char *delim) {
     size_t delim_len = strlen(delim);
     if (delim_len == 0) {
         /* Empty delimiter - split into individual characters */
+        StradaArray *parts = strada_array_new();
         const char *p = str;
         while (*p) {
             char ch[2] = {*p, '\0'};
@@ -3467,89 +5888,123 @@ StradaArray* strada_string_split(const char *str, const char *delim) {
         return parts;
     }
 
+    size_t len = strlen(str);
     const char *p = str;
     const char *found;
+    StradaSplitOut out;
+    split_out_init(&out, str, len);
 
-    while ((found = strstr(p, delim)) != NULL) {
+    while ((found = strada_kernels.find(p, len - (size_t)(p - str), delim, delim_len)) != NULL) {
         /* Add part before delimiter */
-        size_t part_len = found - p;
-        char *part = malloc(part_len + 1);
-        strncpy(part, p, part_len);
-        part[part_len] = '\0';
-
-        strada_array_push_take(parts, strada_new_str(part));
-        free(part);
-
+        split_out_push(&out, p, (size_t)(found - p), delim_len);
         p = found + delim_len;
     }
 
     /* Add remaining part */
-    strada_array_push_take(parts, strada_new_str(p));
+    split_out_push(&out, p, len - (size_t)(p - str), 0);
 
-    return parts;
+    return split_out_finish(&out);
 }
 
-StradaArray* strada_regex_split(const char *str, const char *pattern) {
-    StradaArray *parts = strada_array_new();
-    regex_t rx;
-    char *processed = regex_preprocess_pattern(pattern, NULL);
-
-    if (regcomp(&rx, processed, REG_EXTENDED) != 0) {
-        free(processed);
-        strada_array_push_take(parts, strada_new_str(str));
-        return parts;
+/* The fields regex_split_with() produces, for a pattern that is plain
+ * text (StradaRx.literal) */
+static StradaArray* literal_split(const char *text, size_t text_len, const char *s, size_t len) {
+    StradaSplitOut out;
+    split_out_init(&out, s, len);
+    const char *p = s;
+    const char *end = s + len;
+    const char *hit;
+    while ((hit = strada_kernels.find(p, (size_t)(end - p), text, text_len)) != NULL) {
+        split_out_push(&out, p, (size_t)(hit - p), text_len);
+        p = hit + text_len;
     }
-    free(processed);
+    if (p < end) {
+        split_out_push(&out, p, (size_t)(end - p), 0);
+    }
+    return split_out_finish(&out);
+}
 
+static StradaArray* regex_split_with(StradaRx *rx, const char *str) {
+    size_t len = strlen(str);
+    if (rx->literal) return literal_split(rx->literal, rx->literal_len, str, len);
+    StradaSplitOut out;
+    split_out_init(&out, str, len);
     const char *p = str;
     regmatch_t match;
 
-    while (regexec(&rx, p, 1, &match, 0) == 0) {
+    while (rx_exec(rx, p, 1, &match)) {
         // Add part before match
-        char *part = malloc(match.rm_so + 1);
-        strncpy(part, p, match.rm_so);
-        part[match.rm_so] = '\0';
-
-        strada_array_push_take(parts, strada_new_str(part));
-        free(part);
-
+        split_out_push(&out, p, match.rm_so, match.rm_eo - match.rm_so);
         p += match.rm_eo;
         if (match.rm_eo == 0) break;
     }
 
     // Add remaining part
     if (*p) {
-        strada_array_push_take(parts, strada_new_str(p));
+        split_out_push(&out, p, len - (size_t)(p - str), 0);
+    }
+    return split_out_finish(&out);
+}
+
+StradaArray* strada_regex_split(const char *str, const char *pattern) {
+    StradaRx *rx = regex_cached(pattern, NULL);
+    if (!rx) {
+        StradaArray *parts = strada_array_new();
+        strada_array_push_take(parts, strada_new_str(str));
+        return parts;
+    }
+    return regex_split_with(rx, str);
+}
+
+StradaArray* strada_regex_split_rx(const char *str, StradaValue *rx) {
+    if (!rx || rx->type != STRADA_REGEX) {
+        StradaArray *parts = strada_array_new();
+        strada_array_push_take(parts, strada_new_str(str));
+        return parts;
     }
+    return regex_split_with(rx->value.rx, str);
+}
 
-    regfree(&rx);
+/* split() on a value: plain-text patterns split the whole string by its
+ * stored length, embedded NULs included */
+static StradaArray* regex_split_value(StradaRx *rx, StradaValue *str) {
+    size_t len;
+    char *tmp;
+    const char *s = str_bytes(str, &len, &tmp);
+    StradaArray *parts;
+    if (!rx) {
+        parts = strada_array_new();
+        strada_array_push_take(parts, strada_new_str(s));
+    } else if (rx->literal) {
+        parts = literal_split(rx->literal, rx->literal_len, s, len);
+    } else {
+        parts = regex_split_with(rx, s);
+    }
+    free(tmp);
     return parts;
 }
 
+StradaArray* strada_regex_split_sv(StradaValue *str, const char *pattern) {
+    return regex_split_value(regex_cached(pattern, NULL), str);
+}
+
+StradaArray* strada_regex_split_rx_sv(StradaValue *str, StradaValue *rx) {
+    return regex_split_value(rx && rx->type == STRADA_REGEX ? rx->value.rx : NULL, str);
+}
+
 StradaArray* strada_regex_capture(const char *str, const char *pattern) {
     StradaArray *captures = strada_array_new();
-    regex_t rx;
-    char *processed = regex_preprocess_pattern(pattern, NULL);
+    StradaRx *rx = regex_cached(pattern, NULL);
+    if (!rx) return captures;
 
-    if (regcomp(&rx, processed, REG_EXTENDED) != 0) {
-        free(processed);
-        return captures;
-    }
-    free(processed);
-    
-    size_t nmatch = rx.re_nsub + 1;
+    size_t nmatch = rx->nsub + 1;
     regmatch_t *matches = malloc(sizeof(regmatch_t) * nmatch);
     
-    if (regexec(&rx, str, nmatch, matches, 0) == 0) {
+    if (rx_exec(rx, str, nmatch, matches)) {
         for (size_t i = 0; i < nmatch; i++) {
             if (matches[i].rm_so != -1) {
-                int len = matches[i].rm_eo - matches[i].rm_so;
-                char *capture = malloc(len + 1);
-                strncpy(capture, str + matches[i].rm_so, len);
-                capture[len] = '\0';
-                
-                strada_array_push_take(captures, strada_new_str(capture));
-                free(capture);
+                strada_array_push_take(captures, strada_new_str_len(str + matches[i].rm_so,
+                                                                    matches[i].rm_eo - matches[i].rm_so));
             } else {
                 strada_array_push_take(captures, strada_new_undef());
             }
@@ -3557,20 +6012,30 @@ StradaArray* strada_regex_capture(const char *str, const char *pattern) {
     }
     
     free(matches);
-    regfree(&rx);
-    
     return captures;
 }
 
 /* ===== MEMORY MANAGEMENT ===== */
 
+static int strada_future_wait(StradaFuture *f, int until_released, const struct timespec *deadline);
+static void strada_future_run_conts(StradaFutureCont *cont);
+
 void strada_free_value(StradaValue *sv) {
     if (!sv) return;
 
     /* Track memory free for profiling */
-    strada_memprof_free(sv->type, sizeof(StradaValue));
-
-    /* Call DESTROY method if this is a blessed reference */
+    strada_memprof_free(sv);
+    /* Leave the collector's lists and clear weak refs to sv first, so
+     * nothing released below can reach a half-freed value */
+    strada_gc_free(sv);
+
+    /* Call DESTROY method if this is a blessed reference. Weak refs share
+     * the package without owning the object, and the cycle collector
+     * marks objects whose DESTROY it has already run. */
+    if (sv->blessed_package && sv->type == STRADA_REF &&
+        (sv->struct_size & (STRADA_REF_WEAK | STRADA_REF_DESTROYED))) {
+        sv->blessed_package = NULL;
+    }
     if (sv->blessed_package) {
         strada_check_debug_bless();
 
@@ -3590,14 +6055,20 @@ void strada_free_value(StradaValue *sv) {
             sv->blessed_package = NULL;  /* Clear to prevent crash */
         } else {
             strada_call_destroy(sv);
-            free(sv->blessed_package);
+            /* The name belongs to the package registry */
             sv->blessed_package = NULL;
         }
     }
 
+    /* A value that still holds an inline string came from the string class */
+    StradaSlabClass cls = STRADA_SLAB_VALUE;
     switch (sv->type) {
         case STRADA_STR:
-            free(sv->value.pv);
+            if (STRADA_STR_IS_INLINE(sv)) {
+                cls = STRADA_SLAB_STR;
+            } else {
+                strada_str_release(sv);
+            }
             break;
         case STRADA_ARRAY:
             strada_free_array(sv->value.av);
@@ -3606,8 +6077,9 @@ void strada_free_value(StradaValue *sv) {
             strada_free_hash(sv->value.hv);
             break;
         case STRADA_REF:
-            /* Decrement reference count on the referent */
-            if (sv->value.rv) {
+            /* Decrement reference count on the referent (weak refs
+             * dropped out of the registry in strada_gc_free) */
+            if (sv->value.rv && !(sv->struct_size & STRADA_REF_WEAK)) {
                 strada_decref(sv->value.rv);
             }
             break;
@@ -3618,7 +6090,7 @@ void strada_free_value(StradaValue *sv) {
             break;
         case STRADA_REGEX:
             if (sv->value.rx) {
-                regfree(sv->value.rx);
+                rx_free(sv->value.rx);
                 free(sv->value.rx);
             }
             break;
@@ -3667,13 +6139,14 @@ void strada_free_value(StradaValue *sv) {
         case STRADA_FUTURE:
             if (sv->value.ptr) {
                 StradaFuture *f = (StradaFuture*)sv->value.ptr;
-                /* Wait for completion before cleanup to avoid race conditions */
+                /* Wait until the pool is done with the task before cleanup */
                 pthread_mutex_lock(&f->mutex);
-                while (f->state == FUTURE_PENDING || f->state == FUTURE_RUNNING) {
+                if (f->state == FUTURE_PENDING || f->state == FUTURE_RUNNING) {
                     f->cancel_requested = 1;  /* Request cancellation */
-                    pthread_cond_wait(&f->cond, &f->mutex);
                 }
                 pthread_mutex_unlock(&f->mutex);
+                strada_future_wait(f, 1, NULL);
+                pthread_mutex_unlock(&f->mutex);
 
                 if (f->closure) strada_decref(f->closure);
                 if (f->result) strada_decref(f->result);
@@ -3688,12 +6161,18 @@ void strada_free_value(StradaValue *sv) {
                 StradaChannel *ch = (StradaChannel*)sv->value.ptr;
                 /* Close channel first to wake any waiting threads */
                 pthread_mutex_lock(&ch->mutex);
-                ch->closed = 1;
+                __atomic_store_n(&ch->closed, 1, __ATOMIC_SEQ_CST);
                 pthread_cond_broadcast(&ch->not_empty);
                 pthread_cond_broadcast(&ch->not_full);
                 pthread_mutex_unlock(&ch->mutex);
 
                 /* Free all queued items */
+                if (ch->ring) {
+                    for (size_t i = 0; i < (size_t)ch->capacity; i++) {
+                        if (ch->ring[i].value) strada_decref(ch->ring[i].value);
+                    }
+                    free(ch->ring);
+                }
                 StradaChannelNode *node = ch->head;
                 while (node) {
                     StradaChannelNode *next = node->next;
@@ -3717,7 +6196,7 @@ void strada_free_value(StradaValue *sv) {
             break;
     }
 
-    free(sv);
+    strada_slab_free(cls, sv);
 }
 
 void strada_free_array(StradaArray *av) {
@@ -3730,8 +6209,8 @@ void strada_free_array(StradaArray *av) {
         strada_decref(av->elements[i]);
     }
 
-    free(av->elements);
-    free(av);
+    free(av->elements - av->head);
+    strada_slab_free(STRADA_SLAB_ARRAY, av);
 }
 
 void strada_free_hash(StradaHash *hv) {
@@ -3741,18 +6220,15 @@ void strada_free_hash(StradaHash *hv) {
     if (hv->refcount > 0) return;
 
     for (size_t i = 0; i < hv->num_buckets; i++) {
-        StradaHashEntry *entry = hv->buckets[i];
-        while (entry) {
-            StradaHashEntry *next = entry->next;
-            free(entry->key);
+        StradaHashEntry *entry = &hv->entries[i];
+        if (entry->key) {
+            strada_key_release(entry->key);
             strada_decref(entry->value);
-            free(entry);
-            entry = next;
         }
     }
 
-    free(hv->buckets);
-    free(hv);
+    free(hv->entries);
+    strada_slab_free(STRADA_SLAB_HASH, hv);
 }
 
 /* ===== FFI - FOREIGN FUNCTION INTERFACE ===== */
@@ -4510,13 +6986,14 @@ StradaValue* strada_from_pointer(void *ptr) {
 /* ===== C STRUCT SUPPORT ===== */
 
 StradaValue* strada_cstruct_new(const char *struct_name, size_t size) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_CSTRUCT;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.ptr = calloc(1, size);  /* Allocate and zero the struct */
     sv->struct_name = struct_name ? strdup(struct_name) : NULL;
     sv->struct_size = size;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -4546,13 +7023,14 @@ void* strada_cstruct_get_field(StradaValue *sv, const char *field, size_t offset
 /* ===== C POINTER SUPPORT ===== */
 
 StradaValue* strada_cpointer_new(void *ptr) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_CPOINTER;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.ptr = ptr;
     sv->struct_name = NULL;
     sv->struct_size = 0;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -4566,7 +7044,12 @@ void* strada_cpointer_get(StradaValue *sv) {
 /* ===== CLOSURE SUPPORT ===== */
 
 StradaValue* strada_closure_new(void *func, int params, int captures, StradaValue ***cap_array) {
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    return strada_closure_new_v(func, NULL, params, captures, cap_array);
+}
+
+StradaValue* strada_closure_new_v(void *func, StradaClosureEntryV call_v, int params,
+                                  int captures, StradaValue ***cap_array) {
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_CLOSURE;
     sv->refcount = 1;
     sv->blessed_package = NULL;
@@ -4575,8 +7058,10 @@ StradaValue* strada_closure_new(void *func, int params, int captures, StradaValu
 
     StradaClosure *cl = malloc(sizeof(StradaClosure));
     cl->func_ptr = func;
+    cl->call_v = call_v;
     cl->param_count = params;
     cl->capture_count = captures;
+    cl->gc_bits = 0;
 
     /* Make a deep copy of captures to ensure thread safety.
      * The original cap_array contains pointers to stack variables which may
@@ -4597,6 +7082,8 @@ StradaValue* strada_closure_new(void *func, int params, int captures, StradaValu
     }
 
     sv->value.ptr = cl;
+    strada_memprof_alloc(sv);
+    strada_gc_alloc(sv);
     return sv;
 }
 
@@ -4606,97 +7093,102 @@ StradaValue*** strada_closure_get_captures(StradaValue *closure) {
     return cl->captures;
 }
 
-/* Closure call - handles up to 10 arguments
- * Also handles plain function pointers (STRADA_CPOINTER) for compatibility */
-StradaValue* strada_closure_call(StradaValue *closure, int argc, ...) {
-    if (!closure) return strada_new_undef();
-
-    va_list args;
-    va_start(args, argc);
+/* Closures built by strada_closure_new() have no argument-array entry, and
+ * \&func references are bare function pointers, so calls to them go
+ * through a switch on argc. */
+#define STRADA_CL_MAX_FIXED 16
+#define STRADA_AT1 StradaValue*
+#define STRADA_AT2 STRADA_AT1, StradaValue*
+#define STRADA_AT3 STRADA_AT2, StradaValue*
+#define STRADA_AT4 STRADA_AT3, StradaValue*
+#define STRADA_AT5 STRADA_AT4, StradaValue*
+#define STRADA_AT6 STRADA_AT5, StradaValue*
+#define STRADA_AT7 STRADA_AT6, StradaValue*
+#define STRADA_AT8 STRADA_AT7, StradaValue*
+#define STRADA_AT9 STRADA_AT8, StradaValue*
+#define STRADA_AT10 STRADA_AT9, StradaValue*
+#define STRADA_AT11 STRADA_AT10, StradaValue*
+#define STRADA_AT12 STRADA_AT11, StradaValue*
+#define STRADA_AT13 STRADA_AT12, StradaValue*
+#define STRADA_AT14 STRADA_AT13, StradaValue*
+#define STRADA_AT15 STRADA_AT14, StradaValue*
+#define STRADA_AT16 STRADA_AT15, StradaValue*
+#define STRADA_AV1 argv[0]
+#define STRADA_AV2 STRADA_AV1, argv[1]
+#define STRADA_AV3 STRADA_AV2, argv[2]
+#define STRADA_AV4 STRADA_AV3, argv[3]
+#define STRADA_AV5 STRADA_AV4, argv[4]
+#define STRADA_AV6 STRADA_AV5, argv[5]
+#define STRADA_AV7 STRADA_AV6, argv[6]
+#define STRADA_AV8 STRADA_AV7, argv[7]
+#define STRADA_AV9 STRADA_AV8, argv[8]
+#define STRADA_AV10 STRADA_AV9, argv[9]
+#define STRADA_AV11 STRADA_AV10, argv[10]
+#define STRADA_AV12 STRADA_AV11, argv[11]
+#define STRADA_AV13 STRADA_AV12, argv[12]
+#define STRADA_AV14 STRADA_AV13, argv[13]
+#define STRADA_AV15 STRADA_AV14, argv[14]
+#define STRADA_AV16 STRADA_AV15, argv[15]
+#define STRADA_PLAIN_CASE(n) \
+    case n: return ((StradaValue* (*)(STRADA_AT##n))fn)(STRADA_AV##n);
+#define STRADA_CAPT_CASE(n) \
+    case n: return ((StradaValue* (*)(StradaValue***, STRADA_AT##n))fn)(caps, STRADA_AV##n);
+#define STRADA_CL_CASES(X) \
+    X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) \
+    X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+
+static StradaValue* strada_call_plain(void *fn, int argc, StradaValue **argv) {
+    switch (argc) {
+        case 0: return ((StradaValue* (*)(void))fn)();
+        STRADA_CL_CASES(STRADA_PLAIN_CASE)
+    }
+    strada_throw("function reference called with too many arguments");
+    return NULL;
+}
 
-    /* Collect arguments into array */
-    StradaValue *argv[10];
-    for (int i = 0; i < argc && i < 10; i++) {
-        argv[i] = va_arg(args, StradaValue*);
+static StradaValue* strada_call_captured(void *fn, StradaValue ***caps, int argc, StradaValue **argv) {
+    switch (argc) {
+        case 0: return ((StradaValue* (*)(StradaValue***))fn)(caps);
+        STRADA_CL_CASES(STRADA_CAPT_CASE)
     }
-    va_end(args);
+    strada_throw("closure called with too many arguments");
+    return NULL;
+}
 
-    StradaValue *result;
+/* Call a closure or function reference with an argument array.
+ * Closures compiled by stradac carry an entry taking the array itself, so
+ * any number of arguments works and missing ones arrive as undef. */
+StradaValue* strada_closure_call_v(StradaValue *closure, int argc, StradaValue **argv) {
+    if (!closure) return strada_new_undef();
 
-    /* Handle plain function pointers (from \&func syntax) */
+    /* Plain function pointers (from \&func syntax) have no captures parameter */
     if (closure->type == STRADA_CPOINTER) {
-        void *func_ptr = closure->value.ptr;
-        /* Plain function pointer types - no captures parameter */
-        typedef StradaValue* (*PlainFunc0)(void);
-        typedef StradaValue* (*PlainFunc1)(StradaValue*);
-        typedef StradaValue* (*PlainFunc2)(StradaValue*, StradaValue*);
-        typedef StradaValue* (*PlainFunc3)(StradaValue*, StradaValue*, StradaValue*);
-        typedef StradaValue* (*PlainFunc4)(StradaValue*, StradaValue*, StradaValue*, StradaValue*);
-        typedef StradaValue* (*PlainFunc5)(StradaValue*, StradaValue*, StradaValue*, StradaValue*, StradaValue*);
-
-        switch (argc) {
-            case 0:
-                result = ((PlainFunc0)func_ptr)();
-                break;
-            case 1:
-                result = ((PlainFunc1)func_ptr)(argv[0]);
-                break;
-            case 2:
-                result = ((PlainFunc2)func_ptr)(argv[0], argv[1]);
-                break;
-            case 3:
-                result = ((PlainFunc3)func_ptr)(argv[0], argv[1], argv[2]);
-                break;
-            case 4:
-                result = ((PlainFunc4)func_ptr)(argv[0], argv[1], argv[2], argv[3]);
-                break;
-            case 5:
-                result = ((PlainFunc5)func_ptr)(argv[0], argv[1], argv[2], argv[3], argv[4]);
-                break;
-            default:
-                result = strada_new_undef();
-                break;
-        }
-        return result;
+        return strada_call_plain(closure->value.ptr, argc, argv);
     }
-
-    /* Handle closures */
     if (closure->type != STRADA_CLOSURE) return strada_new_undef();
 
     StradaClosure *cl = (StradaClosure*)closure->value.ptr;
+    if (cl->call_v) {
+        return cl->call_v(cl->captures, argc, argv);
+    }
+    return strada_call_captured(cl->func_ptr, cl->captures, argc, argv);
+}
 
-    /* Function pointer types for different arities (triple pointer for capture-by-reference) */
-    typedef StradaValue* (*Func0)(StradaValue***);
-    typedef StradaValue* (*Func1)(StradaValue***, StradaValue*);
-    typedef StradaValue* (*Func2)(StradaValue***, StradaValue*, StradaValue*);
-    typedef StradaValue* (*Func3)(StradaValue***, StradaValue*, StradaValue*, StradaValue*);
-    typedef StradaValue* (*Func4)(StradaValue***, StradaValue*, StradaValue*, StradaValue*, StradaValue*);
-    typedef StradaValue* (*Func5)(StradaValue***, StradaValue*, StradaValue*, StradaValue*, StradaValue*, StradaValue*);
+/* Varargs form kept for C callers and older generated code */
+StradaValue* strada_closure_call(StradaValue *closure, int argc, ...) {
+    StradaValue *local[STRADA_CL_MAX_FIXED];
+    StradaValue **argv = argc > STRADA_CL_MAX_FIXED
+        ? malloc(sizeof(StradaValue*) * argc) : local;
 
-    switch (argc) {
-        case 0:
-            result = ((Func0)cl->func_ptr)(cl->captures);
-            break;
-        case 1:
-            result = ((Func1)cl->func_ptr)(cl->captures, argv[0]);
-            break;
-        case 2:
-            result = ((Func2)cl->func_ptr)(cl->captures, argv[0], argv[1]);
-            break;
-        case 3:
-            result = ((Func3)cl->func_ptr)(cl->captures, argv[0], argv[1], argv[2]);
-            break;
-        case 4:
-            result = ((Func4)cl->func_ptr)(cl->captures, argv[0], argv[1], argv[2], argv[3]);
-            break;
-        case 5:
-            result = ((Func5)cl->func_ptr)(cl->captures, argv[0], argv[1], argv[2], argv[3], argv[4]);
-            break;
-        default:
-            result = strada_new_undef();
-            break;
+    va_list args;
+    va_start(args, argc);
+    for (int i = 0; i < argc; i++) {
+        argv[i] = va_arg(args, StradaValue*);
     }
+    va_end(args);
 
+    StradaValue *result = strada_closure_call_v(closure, argc, argv);
+    if (argv != local) free(argv);
     return result;
 }
 
@@ -4706,7 +7198,7 @@ StradaValue* strada_closure_call(StradaValue *closure, int argc, ...) {
 static void* strada_thread_wrapper(void *arg) {
     StradaThread *st = (StradaThread *)arg;
     /* Call the closure with 0 arguments */
-    st->result = strada_closure_call(st->closure, 0);
+    st->result = strada_closure_call0(st->closure);
     return NULL;
 }
 
@@ -4720,6 +7212,7 @@ StradaValue* strada_thread_create(StradaValue *closure) {
     st->result = NULL;
     strada_incref(closure);  /* Keep closure alive */
 
+    strada_refcount_atomic_enable();
     int rc = pthread_create(&st->thread, NULL, strada_thread_wrapper, st);
     if (rc != 0) {
         strada_decref(closure);
@@ -4876,84 +7369,260 @@ StradaValue* strada_cond_destroy(StradaValue *cond_val) {
 /* Global thread pool */
 StradaThreadPool *strada_thread_pool = NULL;
 
-/* Default pool size */
-#define STRADA_DEFAULT_POOL_SIZE 4
+/* Pool worker index of the current thread (-1 outside the pool) and its
+ * victim-selection state for stealing */
+static __thread int strada_pool_self = -1;
+static __thread uint32_t strada_pool_rng = 0;
+
+#define STRADA_POOL_MIN_DEFAULT 4
+#define STRADA_POOL_MAX_SIZE 1024
+#define STRADA_TASK_RING_INITIAL 64
+#define STRADA_POOL_BATCH 32
+
+/* Pool size when none is given: STRADA_POOL_SIZE, else the online CPUs.
+ * Small machines still get STRADA_POOL_MIN_DEFAULT workers so tasks that
+ * block on I/O or sleep keep overlapping. */
+static int strada_pool_default_size(void) {
+    const char *env = getenv("STRADA_POOL_SIZE");
+    long n = env ? strtol(env, NULL, 10) : 0;
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < STRADA_POOL_MIN_DEFAULT) n = STRADA_POOL_MIN_DEFAULT;
+    }
+    if (n > STRADA_POOL_MAX_SIZE) n = STRADA_POOL_MAX_SIZE;
+    return (int)n;
+}
 
-/* Worker thread function */
-static void* strada_pool_worker(void *arg) {
-    StradaThreadPool *pool = (StradaThreadPool *)arg;
+int strada_pool_size(void) {
+    StradaThreadPool *pool = __atomic_load_n(&strada_thread_pool, __ATOMIC_ACQUIRE);
+    return pool ? pool->worker_count : strada_pool_default_size();
+}
 
-    while (1) {
-        StradaTask *task = NULL;
+static StradaTaskRing* strada_task_ring_new(int64_t capacity) {
+    StradaTaskRing *r = malloc(sizeof(StradaTaskRing) + sizeof(StradaTask *) * capacity);
+    r->mask = capacity - 1;
+    r->prev = NULL;
+    return r;
+}
 
-        /* Get next task from queue */
-        pthread_mutex_lock(&pool->queue_mutex);
-        while (pool->running && pool->queue_head == NULL) {
-            pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
+/* Owner only: push at the bottom, doubling the ring when it is full */
+static void strada_deque_push(StradaTaskDeque *d, StradaTask *task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    StradaTaskRing *r = __atomic_load_n(&d->ring, __ATOMIC_RELAXED);
+    if (b - t > r->mask) {
+        StradaTaskRing *grown = strada_task_ring_new((r->mask + 1) * 2);
+        for (int64_t i = t; i < b; i++) {
+            grown->slots[i & grown->mask] = __atomic_load_n(&r->slots[i & r->mask], __ATOMIC_RELAXED);
+        }
+        grown->prev = r;
+        __atomic_store_n(&d->ring, grown, __ATOMIC_RELEASE);
+        r = grown;
+    }
+    __atomic_store_n(&r->slots[b & r->mask], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+/* Owner only: pop the most recently pushed task */
+static StradaTask* strada_deque_pop(StradaTaskDeque *d) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    StradaTaskRing *r = __atomic_load_n(&d->ring, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    StradaTask *task = NULL;
+    if (t <= b) {
+        task = __atomic_load_n(&r->slots[b & r->mask], __ATOMIC_RELAXED);
+        if (t == b) {
+            /* Last task: race the thieves for it */
+            if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                task = NULL;
+            }
+            __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
         }
+    } else {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
 
-        if (!pool->running && pool->queue_head == NULL) {
-            pthread_mutex_unlock(&pool->queue_mutex);
-            break;  /* Shutdown */
+/* Any thread: take the oldest task. NULL if empty or another thread won */
+static StradaTask* strada_deque_steal(StradaTaskDeque *d) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+    StradaTaskRing *r = __atomic_load_n(&d->ring, __ATOMIC_ACQUIRE);
+    StradaTask *task = __atomic_load_n(&r->slots[t & r->mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return task;
+}
+
+/* 1 if any queue holds a task (the deques may be mid-steal) */
+static int strada_pool_has_work(StradaThreadPool *pool) {
+    if (__atomic_load_n(&pool->queue_head, __ATOMIC_SEQ_CST) != NULL) return 1;
+    for (int i = 0; i < pool->worker_count; i++) {
+        StradaTaskDeque *d = &pool->deques[i];
+        if (__atomic_load_n(&d->top, __ATOMIC_SEQ_CST) < __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST)) {
+            return 1;
         }
+    }
+    return 0;
+}
+
+/* Wake one idle worker after a push to a deque */
+static void strada_pool_wake(StradaThreadPool *pool) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->idle_count, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        pthread_cond_signal(&pool->queue_cond);
+        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+}
 
-        /* Dequeue task */
+/* Next task for worker self: its own deque, then the injection queue
+ * (moving a share of it to the local deque for others to steal), then the
+ * other workers' deques starting from a random victim. */
+static StradaTask* strada_pool_find_task(StradaThreadPool *pool, int self) {
+    StradaTaskDeque *own = &pool->deques[self];
+    StradaTask *task = strada_deque_pop(own);
+    if (task) return task;
+
+    if (__atomic_load_n(&pool->queue_head, __ATOMIC_RELAXED) != NULL) {
+        int moved = 0;
+        pthread_mutex_lock(&pool->queue_mutex);
         task = pool->queue_head;
         if (task) {
-            pool->queue_head = task->next;
-            if (pool->queue_head == NULL) {
-                pool->queue_tail = NULL;
-            }
+            StradaTask *next = task->next;
             pool->queue_size--;
+            int share = pool->queue_size / pool->worker_count;
+            if (share > STRADA_POOL_BATCH) share = STRADA_POOL_BATCH;
+            while (share-- > 0 && next) {
+                StradaTask *extra = next;
+                next = extra->next;
+                pool->queue_size--;
+                strada_deque_push(own, extra);
+                moved = 1;
+            }
+            __atomic_store_n(&pool->queue_head, next, __ATOMIC_RELAXED);
+            if (next == NULL) pool->queue_tail = NULL;
         }
         pthread_mutex_unlock(&pool->queue_mutex);
+        if (moved) strada_pool_wake(pool);
+        if (task) return task;
+    }
+
+    int n = pool->worker_count;
+    if (n < 2) return NULL;
+    if (strada_pool_rng == 0) strada_pool_rng = (uint32_t)(self + 1) * 2654435761u;
+    strada_pool_rng ^= strada_pool_rng << 13;
+    strada_pool_rng ^= strada_pool_rng >> 17;
+    strada_pool_rng ^= strada_pool_rng << 5;
+    int start = (int)(strada_pool_rng % (uint32_t)n);
+    for (int i = 0; i < n; i++) {
+        int victim = (start + i) % n;
+        if (victim == self) continue;
+        task = strada_deque_steal(&pool->deques[victim]);
+        if (task) return task;
+    }
+    return NULL;
+}
 
-        if (task) {
-            StradaFuture *f = task->future;
+/* Run a task on the current thread and complete its future */
+static void strada_pool_run_task(StradaTask *task) {
+    StradaFuture *f = task->future;
 
-            /* Check if cancelled before starting */
-            pthread_mutex_lock(&f->mutex);
-            if (f->cancel_requested) {
-                f->state = FUTURE_CANCELLED;
-                pthread_cond_broadcast(&f->cond);
-                pthread_mutex_unlock(&f->mutex);
-                free(task);
-                continue;
-            }
-            f->state = FUTURE_RUNNING;
-            pthread_mutex_unlock(&f->mutex);
+    /* Check if cancelled before starting */
+    pthread_mutex_lock(&f->mutex);
+    if (f->cancel_requested) {
+        f->state = FUTURE_CANCELLED;
+        f->in_pool = 0;
+        StradaFutureCont *conts = f->conts;
+        f->conts = NULL;
+        pthread_cond_broadcast(&f->cond);
+        pthread_mutex_unlock(&f->mutex);
+        strada_future_run_conts(conts);
+        return;
+    }
+    f->state = FUTURE_RUNNING;
+    pthread_mutex_unlock(&f->mutex);
 
-            /* Execute with exception handling */
-            /* Use volatile to prevent issues with setjmp/longjmp */
-            StradaValue * volatile result = NULL;
-            StradaValue * volatile error = NULL;
+    /* Execute with exception handling */
+    /* Use volatile to prevent issues with setjmp/longjmp */
+    StradaValue * volatile result = NULL;
+    StradaValue * volatile error = NULL;
 
-            if (setjmp(*STRADA_TRY_PUSH()) == 0) {
-                result = strada_closure_call(f->closure, 0);
-                STRADA_TRY_POP();
-            } else {
-                STRADA_TRY_POP();
-                error = strada_get_exception();
-            }
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        result = strada_closure_call0(task->closure);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        error = strada_get_exception();
+    }
 
-            /* Store result */
-            pthread_mutex_lock(&f->mutex);
-            if (f->cancel_requested) {
-                f->state = FUTURE_CANCELLED;
-                if (result) strada_decref((StradaValue*)result);
-                if (error) strada_decref((StradaValue*)error);
-            } else {
-                f->result = (StradaValue*)result;
-                f->error = (StradaValue*)error;
-                f->state = FUTURE_COMPLETED;
-            }
-            pthread_cond_broadcast(&f->cond);
-            pthread_mutex_unlock(&f->mutex);
+    if (f->detached) {
+        if (result) strada_decref((StradaValue*)result);
+        if (error) strada_decref((StradaValue*)error);
+        strada_decref(f->closure);
+        pthread_mutex_destroy(&f->mutex);
+        pthread_cond_destroy(&f->cond);
+        free(f);
+        return;
+    }
+
+    /* Store result; f may be freed as soon as the mutex is released */
+    pthread_mutex_lock(&f->mutex);
+    if (f->cancel_requested) {
+        f->state = FUTURE_CANCELLED;
+        if (result) strada_decref((StradaValue*)result);
+        if (error) strada_decref((StradaValue*)error);
+    } else {
+        f->result = (StradaValue*)result;
+        f->error = (StradaValue*)error;
+        f->state = FUTURE_COMPLETED;
+    }
+    f->in_pool = 0;
+    StradaFutureCont *conts = f->conts;
+    f->conts = NULL;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->mutex);
+    strada_future_run_conts(conts);
+}
+
+/* Worker thread function */
+static void* strada_pool_worker(void *arg) {
+    int self = (int)(intptr_t)arg;
+    StradaThreadPool *pool = strada_thread_pool;
+    strada_pool_self = self;
 
-            free(task);
+    while (1) {
+        StradaTask *task = strada_pool_find_task(pool, self);
+        if (task) {
+            strada_pool_run_task(task);
+            continue;
+        }
+
+        /* Nothing to do: sleep until a submit wakes us. idle_count is
+         * raised before the final check, so a concurrent push either is
+         * seen here or sees us waiting and signals. */
+        pthread_mutex_lock(&pool->queue_mutex);
+        if (!pool->running && !strada_pool_has_work(pool)) {
+            pthread_mutex_unlock(&pool->queue_mutex);
+            break;  /* Shutdown */
         }
+        __atomic_add_fetch(&pool->idle_count, 1, __ATOMIC_SEQ_CST);
+        if (pool->running && !strada_pool_has_work(pool)) {
+            pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
+        }
+        __atomic_sub_fetch(&pool->idle_count, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->queue_mutex);
     }
 
+    strada_pool_self = -1;
     return NULL;
 }
 
@@ -4962,7 +7631,10 @@ void strada_pool_init(int num_workers) {
     if (strada_thread_pool != NULL) return;  /* Already initialized */
 
     if (num_workers <= 0) {
-        num_workers = STRADA_DEFAULT_POOL_SIZE;
+        num_workers = strada_pool_default_size();
+    }
+    if (num_workers > STRADA_POOL_MAX_SIZE) {
+        num_workers = STRADA_POOL_MAX_SIZE;
     }
 
     StradaThreadPool *pool = malloc(sizeof(StradaThreadPool));
@@ -4971,20 +7643,26 @@ void strada_pool_init(int num_workers) {
     pool->queue_head = NULL;
     pool->queue_tail = NULL;
     pool->queue_size = 0;
+    pool->idle_count = 0;
 
     pthread_mutex_init(&pool->queue_mutex, NULL);
     pthread_cond_init(&pool->queue_cond, NULL);
     pthread_cond_init(&pool->empty_cond, NULL);
 
-    pool->workers = malloc(sizeof(pthread_t) * num_workers);
+    pool->deques = calloc(num_workers, sizeof(StradaTaskDeque));
     for (int i = 0; i < num_workers; i++) {
-        pthread_create(&pool->workers[i], NULL, strada_pool_worker, pool);
+        pool->deques[i].ring = strada_task_ring_new(STRADA_TASK_RING_INITIAL);
     }
 
-    strada_thread_pool = pool;
+    strada_refcount_atomic_enable();
+    __atomic_store_n(&strada_thread_pool, pool, __ATOMIC_RELEASE);
+    pool->workers = malloc(sizeof(pthread_t) * num_workers);
+    for (int i = 0; i < num_workers; i++) {
+        pthread_create(&pool->workers[i], NULL, strada_pool_worker, (void *)(intptr_t)i);
+    }
 }
 
-/* Shutdown thread pool */
+/* Shutdown thread pool (queued tasks still run first) */
 void strada_pool_shutdown(void) {
     if (strada_thread_pool == NULL) return;
 
@@ -5001,6 +7679,15 @@ void strada_pool_shutdown(void) {
     }
 
     /* Cleanup */
+    for (int i = 0; i < pool->worker_count; i++) {
+        StradaTaskRing *r = pool->deques[i].ring;
+        while (r) {
+            StradaTaskRing *prev = r->prev;
+            free(r);
+            r = prev;
+        }
+    }
+    free(pool->deques);
     pthread_mutex_destroy(&pool->queue_mutex);
     pthread_cond_destroy(&pool->queue_cond);
     pthread_cond_destroy(&pool->empty_cond);
@@ -5009,54 +7696,123 @@ void strada_pool_shutdown(void) {
     strada_thread_pool = NULL;
 }
 
-/* Submit task to pool */
+/* Submit task to pool. From a worker, the task goes on that worker's own
+ * deque; from any other thread, on the shared injection queue. */
 void strada_pool_submit(StradaFuture *future) {
     /* Auto-initialize pool if needed */
-    if (strada_thread_pool == NULL) {
-        strada_pool_init(STRADA_DEFAULT_POOL_SIZE);
+    if (__atomic_load_n(&strada_thread_pool, __ATOMIC_ACQUIRE) == NULL) {
+        strada_pool_init(0);
     }
 
     StradaThreadPool *pool = strada_thread_pool;
 
-    StradaTask *task = malloc(sizeof(StradaTask));
+    StradaTask *task = &future->task;
     task->closure = future->closure;
     task->future = future;
     task->next = NULL;
+    future->in_pool = 1;
+
+    if (strada_pool_self >= 0) {
+        strada_deque_push(&pool->deques[strada_pool_self], task);
+        strada_pool_wake(pool);
+        return;
+    }
 
     pthread_mutex_lock(&pool->queue_mutex);
     if (pool->queue_tail) {
         pool->queue_tail->next = task;
         pool->queue_tail = task;
     } else {
-        pool->queue_head = task;
+        __atomic_store_n(&pool->queue_head, task, __ATOMIC_RELAXED);
         pool->queue_tail = task;
     }
     pool->queue_size++;
-    pthread_cond_signal(&pool->queue_cond);  /* Wake one worker */
+    if (pool->idle_count > 0) {
+        pthread_cond_signal(&pool->queue_cond);  /* Wake one worker */
+    }
     pthread_mutex_unlock(&pool->queue_mutex);
 }
 
-/* Create a new future */
-StradaValue* strada_future_new(StradaValue *closure) {
+/* Block until f is finished (or, with until_released, until the pool is
+ * done with its task), or until deadline passes. A pool worker runs other
+ * tasks while it waits, so awaiting work queued on its own deque cannot
+ * deadlock the pool. Returns with f->mutex held; 0 means timed out. */
+static int strada_future_wait(StradaFuture *f, int until_released, const struct timespec *deadline) {
+    int self = strada_pool_self;
+    pthread_mutex_lock(&f->mutex);
+    while (until_released ? f->in_pool
+                          : (f->state == FUTURE_PENDING || f->state == FUTURE_RUNNING)) {
+        struct timespec now;
+        if (deadline) {
+            clock_gettime(CLOCK_REALTIME, &now);
+            if (now.tv_sec > deadline->tv_sec ||
+                (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec)) {
+                return 0;
+            }
+        }
+        if (self >= 0) {
+            pthread_mutex_unlock(&f->mutex);
+            StradaTask *task = strada_pool_find_task(strada_thread_pool, self);
+            if (task) strada_pool_run_task(task);
+            pthread_mutex_lock(&f->mutex);
+            if (task) continue;
+            /* Nothing to help with; check back shortly */
+            struct timespec nap;
+            clock_gettime(CLOCK_REALTIME, &nap);
+            nap.tv_nsec += 1000000;
+            if (nap.tv_nsec >= 1000000000) {
+                nap.tv_sec++;
+                nap.tv_nsec -= 1000000000;
+            }
+            if (deadline && (deadline->tv_sec < nap.tv_sec ||
+                             (deadline->tv_sec == nap.tv_sec && deadline->tv_nsec < nap.tv_nsec))) {
+                nap = *deadline;
+            }
+            pthread_cond_timedwait(&f->cond, &f->mutex, &nap);
+        } else if (deadline) {
+            pthread_cond_timedwait(&f->cond, &f->mutex, deadline);
+        } else {
+            pthread_cond_wait(&f->cond, &f->mutex);
+        }
+    }
+    return 1;
+}
+
+/* Allocate and initialize a future's state */
+static StradaFuture* strada_future_alloc(StradaValue *closure) {
     StradaFuture *f = malloc(sizeof(StradaFuture));
     f->result = NULL;
     f->error = NULL;
     f->closure = closure;
-    strada_incref(closure);
     f->state = FUTURE_PENDING;
     f->cancel_requested = 0;
     f->has_deadline = 0;
     memset(&f->deadline, 0, sizeof(f->deadline));
+    f->in_pool = 0;
+    f->detached = 0;
+    f->conts = NULL;
 
     pthread_mutex_init(&f->mutex, NULL);
     pthread_cond_init(&f->cond, NULL);
+    return f;
+}
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+static StradaValue* strada_future_wrap(StradaFuture *f) {
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_FUTURE;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->struct_name = NULL;
     sv->value.ptr = f;
+    strada_memprof_alloc(sv);
+    return sv;
+}
+
+/* Create a new future */
+StradaValue* strada_future_new(StradaValue *closure) {
+    strada_incref(closure);
+    StradaFuture *f = strada_future_alloc(closure);
+    StradaValue *sv = strada_future_wrap(f);
 
     /* Submit to thread pool */
     strada_pool_submit(f);
@@ -5064,24 +7820,123 @@ StradaValue* strada_future_new(StradaValue *closure) {
     return sv;
 }
 
-/* Await: block until future completes */
-StradaValue* strada_future_await(StradaValue *future) {
-    /* If not a future, pass through the value as-is (makes await idempotent) */
-    if (!future) {
-        return strada_new_undef();
-    }
-    if (future->type != STRADA_FUTURE) {
-        strada_incref(future);
-        return future;
-    }
+/* Run closure on the pool with nobody waiting for it. Takes ownership of
+ * closure; the result is discarded. */
+static void strada_pool_spawn(StradaValue *closure) {
+    StradaFuture *f = strada_future_alloc(closure);
+    f->detached = 1;
+    strada_pool_submit(f);
+}
 
-    StradaFuture *f = (StradaFuture*)future->value.ptr;
+/* Create a future that no task runs; strada_future_settle completes it */
+StradaValue* strada_future_pending(void) {
+    return strada_future_wrap(strada_future_alloc(NULL));
+}
+
+/* Body of an async::then continuation: captures are callback, source, target */
+static StradaValue* strada_future_then_body(StradaValue ***captures) {
+    StradaValue *callback = *captures[0];
+    StradaValue *source = *captures[1];
+    StradaValue *target = *captures[2];
+    StradaValue * volatile result = NULL;
+    StradaValue * volatile error = NULL;
+
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        StradaValue *value = strada_future_await(source);  /* Already settled */
+        result = strada_closure_call1(callback, value);
+        strada_decref(value);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        error = strada_get_exception();
+    }
+    strada_future_settle(target, (StradaValue*)result, (StradaValue*)error);
+    return strada_undef_static();
+}
+
+/* Hand each continuation to the pool. Called without any future's lock. */
+static void strada_future_run_conts(StradaFutureCont *cont) {
+    while (cont) {
+        StradaFutureCont *next = cont->next;
+        StradaValue **captures[3] = { &cont->callback, &cont->source, &cont->target };
+        strada_pool_spawn(strada_closure_new((void*)strada_future_then_body, 0, 3, captures));
+        strada_decref(cont->callback);
+        strada_decref(cont->source);
+        strada_decref(cont->target);
+        free(cont);
+        cont = next;
+    }
+}
 
+/* Complete a pending future. Takes ownership of result and error; does
+ * nothing (but release them) if the future already finished. */
+void strada_future_settle(StradaValue *future, StradaValue *result, StradaValue *error) {
+    if (!future || future->type != STRADA_FUTURE) {
+        if (result) strada_decref(result);
+        if (error) strada_decref(error);
+        return;
+    }
+    StradaFuture *f = (StradaFuture*)future->value.ptr;
     pthread_mutex_lock(&f->mutex);
-    while (f->state == FUTURE_PENDING || f->state == FUTURE_RUNNING) {
-        pthread_cond_wait(&f->cond, &f->mutex);
+    if (f->state != FUTURE_PENDING && f->state != FUTURE_RUNNING) {
+        pthread_mutex_unlock(&f->mutex);
+        if (result) strada_decref(result);
+        if (error) strada_decref(error);
+        return;
+    }
+    f->result = result;
+    f->error = error;
+    f->state = FUTURE_COMPLETED;
+    StradaFutureCont *conts = f->conts;
+    f->conts = NULL;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->mutex);
+    strada_future_run_conts(conts);
+}
+
+/* async::then - future for callback(result of future), run on the pool
+ * once future settles. Nothing blocks while it waits. */
+StradaValue* strada_future_then(StradaValue *future, StradaValue *callback) {
+    StradaValue *target = strada_future_pending();
+    StradaFutureCont *cont = malloc(sizeof(StradaFutureCont));
+    cont->callback = callback;
+    cont->source = future ? future : strada_new_undef();
+    cont->target = target;
+    cont->next = NULL;
+    strada_incref(callback);
+    if (future) strada_incref(future);
+    strada_incref(target);
+
+    if (future && future->type == STRADA_FUTURE) {
+        StradaFuture *f = (StradaFuture*)future->value.ptr;
+        pthread_mutex_lock(&f->mutex);
+        if (f->state == FUTURE_PENDING || f->state == FUTURE_RUNNING) {
+            cont->next = f->conts;
+            f->conts = cont;
+            pthread_mutex_unlock(&f->mutex);
+            return target;
+        }
+        pthread_mutex_unlock(&f->mutex);
+    }
+    strada_future_run_conts(cont);
+    return target;
+}
+
+/* Await: block until future completes */
+StradaValue* strada_future_await(StradaValue *future) {
+    /* If not a future, pass through the value as-is (makes await idempotent) */
+    if (!future) {
+        return strada_new_undef();
+    }
+    if (future->type != STRADA_FUTURE) {
+        strada_incref(future);
+        return future;
     }
 
+    StradaFuture *f = (StradaFuture*)future->value.ptr;
+
+    strada_future_wait(f, 0, NULL);
+
     StradaFutureState state = f->state;
     StradaValue *result = f->result;
     StradaValue *error = f->error;
@@ -5127,15 +7982,11 @@ StradaValue* strada_future_await_timeout(StradaValue *future, int64_t timeout_ms
         deadline.tv_nsec -= 1000000000;
     }
 
-    pthread_mutex_lock(&f->mutex);
-    while (f->state == FUTURE_PENDING || f->state == FUTURE_RUNNING) {
-        int rc = pthread_cond_timedwait(&f->cond, &f->mutex, &deadline);
-        if (rc == ETIMEDOUT) {
-            f->state = FUTURE_TIMEOUT;
-            pthread_mutex_unlock(&f->mutex);
-            strada_throw("Future timed out");
-            return strada_new_undef();
-        }
+    if (!strada_future_wait(f, 0, &deadline)) {
+        f->state = FUTURE_TIMEOUT;
+        pthread_mutex_unlock(&f->mutex);
+        strada_throw("Future timed out");
+        return strada_new_undef();
     }
 
     StradaFutureState state = f->state;
@@ -5197,11 +8048,15 @@ void strada_future_cancel(StradaValue *future) {
     pthread_mutex_lock(&f->mutex);
     f->cancel_requested = 1;
     /* If still pending, mark as cancelled immediately */
+    StradaFutureCont *conts = NULL;
     if (f->state == FUTURE_PENDING) {
         f->state = FUTURE_CANCELLED;
+        conts = f->conts;
+        f->conts = NULL;
         pthread_cond_broadcast(&f->cond);
     }
     pthread_mutex_unlock(&f->mutex);
+    strada_future_run_conts(conts);
 }
 
 /* Check if cancelled */
@@ -5282,6 +8137,177 @@ StradaValue* strada_async_timeout(StradaValue *future, StradaValue *timeout_ms)
  * Channel Implementation - Thread-safe Communication
  * ============================================================ */
 
+/* Bounded channels: a lock-free MPMC ring. Each cell's seq tells which
+ * position may use it next, so senders and receivers claim positions with
+ * one CAS and never take the mutex. Threads that find the ring full (or
+ * empty) spin briefly, then park on not_full (not_empty); the other side
+ * only takes the mutex to signal when someone is parked. */
+
+#define STRADA_CHANNEL_SPIN 128
+#define STRADA_CHANNEL_BATCH 64
+
+static inline void strada_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* Claim up to n consecutive free cells and fill them from values (whose
+ * references the ring takes over). Returns how many were stored, 0 if the
+ * ring is full. */
+static size_t strada_ring_try_push(StradaChannel *ch, StradaValue **values, size_t n) {
+    size_t cap = (size_t)ch->capacity;
+    size_t pos = __atomic_load_n(&ch->send_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        size_t k = 0;
+        while (k < n && k < cap &&
+               __atomic_load_n(&ch->ring[(pos + k) % cap].seq, __ATOMIC_ACQUIRE) == pos + k) {
+            k++;
+        }
+        if (k == 0) {
+            size_t seq = __atomic_load_n(&ch->ring[pos % cap].seq, __ATOMIC_ACQUIRE);
+            if ((intptr_t)(seq - pos) < 0) return 0;  /* Full */
+            pos = __atomic_load_n(&ch->send_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&ch->send_pos, &pos, pos + k, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            for (size_t i = 0; i < k; i++) {
+                StradaChannelCell *cell = &ch->ring[(pos + i) % cap];
+                cell->value = values[i];
+                __atomic_store_n(&cell->seq, pos + i + 1, __ATOMIC_RELEASE);
+            }
+            return k;
+        }
+    }
+}
+
+/* Take up to n consecutive filled cells into out. Returns how many were
+ * taken, 0 if the ring is empty. */
+static size_t strada_ring_try_pop(StradaChannel *ch, StradaValue **out, size_t n) {
+    size_t cap = (size_t)ch->capacity;
+    size_t pos = __atomic_load_n(&ch->recv_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        size_t k = 0;
+        while (k < n && k < cap &&
+               __atomic_load_n(&ch->ring[(pos + k) % cap].seq, __ATOMIC_ACQUIRE) == pos + k + 1) {
+            k++;
+        }
+        if (k == 0) {
+            size_t seq = __atomic_load_n(&ch->ring[pos % cap].seq, __ATOMIC_ACQUIRE);
+            if ((intptr_t)(seq - (pos + 1)) < 0) return 0;  /* Empty */
+            pos = __atomic_load_n(&ch->recv_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&ch->recv_pos, &pos, pos + k, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            for (size_t i = 0; i < k; i++) {
+                StradaChannelCell *cell = &ch->ring[(pos + i) % cap];
+                out[i] = cell->value;
+                cell->value = NULL;
+                __atomic_store_n(&cell->seq, pos + i + cap, __ATOMIC_RELEASE);
+            }
+            return k;
+        }
+    }
+}
+
+/* Signal one (or every) thread parked on cond, if any */
+static void strada_channel_wake(StradaChannel *ch, int *waiters, pthread_cond_t *cond, int all) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&ch->mutex);
+        if (all) {
+            pthread_cond_broadcast(cond);
+        } else {
+            pthread_cond_signal(cond);
+        }
+        pthread_mutex_unlock(&ch->mutex);
+    }
+}
+
+/* Blocking send of n values. Returns how many were sent; fewer than n
+ * only if the channel was closed. */
+static size_t strada_ring_send(StradaChannel *ch, StradaValue **values, size_t n) {
+    size_t sent = 0;
+    int spin = 0;
+    while (sent < n) {
+        if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) break;
+        size_t k = strada_ring_try_push(ch, values + sent, n - sent);
+        if (k > 0) {
+            sent += k;
+            strada_channel_wake(ch, &ch->recv_waiters, &ch->not_empty, k > 1);
+            spin = 0;
+            continue;
+        }
+        if (spin++ < STRADA_CHANNEL_SPIN) {
+            strada_cpu_relax();
+            continue;
+        }
+        /* Full: park until a receiver frees a cell. waiters is raised
+         * before the last attempt, so a concurrent pop sees it. */
+        pthread_mutex_lock(&ch->mutex);
+        __atomic_add_fetch(&ch->send_waiters, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+            k = strada_ring_try_push(ch, values + sent, n - sent);
+            if (k > 0) break;
+            pthread_cond_wait(&ch->not_full, &ch->mutex);
+        }
+        __atomic_sub_fetch(&ch->send_waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&ch->mutex);
+        if (k > 0) {
+            sent += k;
+            strada_channel_wake(ch, &ch->recv_waiters, &ch->not_empty, k > 1);
+        }
+        spin = 0;
+    }
+    return sent;
+}
+
+/* Blocking receive of 1..n values into out. Returns 0 only once the
+ * channel is closed and drained. */
+static size_t strada_ring_recv(StradaChannel *ch, StradaValue **out, size_t n) {
+    int spin = 0;
+    for (;;) {
+        size_t k = strada_ring_try_pop(ch, out, n);
+        if (k > 0) {
+            strada_channel_wake(ch, &ch->send_waiters, &ch->not_full, k > 1);
+            return k;
+        }
+        if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+            /* Drain sends that claimed a cell before the close */
+            while (__atomic_load_n(&ch->recv_pos, __ATOMIC_ACQUIRE) !=
+                   __atomic_load_n(&ch->send_pos, __ATOMIC_ACQUIRE)) {
+                k = strada_ring_try_pop(ch, out, n);
+                if (k > 0) return k;
+                strada_cpu_relax();
+            }
+            return 0;
+        }
+        if (spin++ < STRADA_CHANNEL_SPIN) {
+            strada_cpu_relax();
+            continue;
+        }
+        /* Empty: park until a sender fills a cell or the channel closes */
+        pthread_mutex_lock(&ch->mutex);
+        __atomic_add_fetch(&ch->recv_waiters, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) {
+            k = strada_ring_try_pop(ch, out, n);
+            if (k > 0) break;
+            pthread_cond_wait(&ch->not_empty, &ch->mutex);
+        }
+        __atomic_sub_fetch(&ch->recv_waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&ch->mutex);
+        if (k > 0) {
+            strada_channel_wake(ch, &ch->send_waiters, &ch->not_full, k > 1);
+            return k;
+        }
+        spin = 0;
+    }
+}
+
 /* Create a new channel with optional capacity (0 = unbounded) */
 StradaValue* strada_channel_new(int capacity) {
     StradaChannel *ch = malloc(sizeof(StradaChannel));
@@ -5294,15 +8320,28 @@ StradaValue* strada_channel_new(int capacity) {
     ch->head = NULL;
     ch->tail = NULL;
     ch->size = 0;
-    ch->capacity = capacity;  /* 0 means unbounded */
+    ch->capacity = capacity > 0 ? capacity : 0;  /* 0 means unbounded */
     ch->closed = 0;
+    ch->ring = NULL;
+    ch->send_waiters = 0;
+    ch->recv_waiters = 0;
+    ch->send_pos = 0;
+    ch->recv_pos = 0;
+    if (ch->capacity > 0) {
+        ch->ring = malloc(sizeof(StradaChannelCell) * (size_t)ch->capacity);
+        for (size_t i = 0; i < (size_t)ch->capacity; i++) {
+            ch->ring[i].seq = i;
+            ch->ring[i].value = NULL;
+        }
+    }
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_CHANNEL;
     sv->refcount = 1;
     sv->value.ptr = ch;
     sv->blessed_package = NULL;
 
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -5315,6 +8354,16 @@ void strada_channel_send(StradaValue *channel, StradaValue *value) {
 
     StradaChannel *ch = (StradaChannel*)channel->value.ptr;
 
+    if (ch->ring) {
+        StradaValue *item = value ? value : strada_new_undef();
+        if (value) strada_incref(value);
+        if (strada_ring_send(ch, &item, 1) == 0) {
+            strada_decref(item);
+            strada_throw("channel::send: channel is closed");
+        }
+        return;
+    }
+
     pthread_mutex_lock(&ch->mutex);
 
     /* Check if closed */
@@ -5366,6 +8415,12 @@ StradaValue* strada_channel_recv(StradaValue *channel) {
 
     StradaChannel *ch = (StradaChannel*)channel->value.ptr;
 
+    if (ch->ring) {
+        StradaValue *item;
+        if (strada_ring_recv(ch, &item, 1) == 0) return strada_new_undef();
+        return item;
+    }
+
     pthread_mutex_lock(&ch->mutex);
 
     /* Wait while channel is empty and not closed */
@@ -5405,6 +8460,18 @@ int strada_channel_try_send(StradaValue *channel, StradaValue *value) {
 
     StradaChannel *ch = (StradaChannel*)channel->value.ptr;
 
+    if (ch->ring) {
+        if (__atomic_load_n(&ch->closed, __ATOMIC_ACQUIRE)) return 0;
+        StradaValue *item = value ? value : strada_new_undef();
+        if (value) strada_incref(value);
+        if (strada_ring_try_push(ch, &item, 1) == 0) {
+            strada_decref(item);
+            return 0;
+        }
+        strada_channel_wake(ch, &ch->recv_waiters, &ch->not_empty, 0);
+        return 1;
+    }
+
     pthread_mutex_lock(&ch->mutex);
 
     /* Can't send if closed */
@@ -5450,6 +8517,13 @@ StradaValue* strada_channel_try_recv(StradaValue *channel) {
 
     StradaChannel *ch = (StradaChannel*)channel->value.ptr;
 
+    if (ch->ring) {
+        StradaValue *item;
+        if (strada_ring_try_pop(ch, &item, 1) == 0) return strada_new_undef();
+        strada_channel_wake(ch, &ch->send_waiters, &ch->not_full, 0);
+        return item;
+    }
+
     pthread_mutex_lock(&ch->mutex);
 
     /* Empty? Return undef immediately */
@@ -5485,7 +8559,7 @@ void strada_channel_close(StradaValue *channel) {
     StradaChannel *ch = (StradaChannel*)channel->value.ptr;
 
     pthread_mutex_lock(&ch->mutex);
-    ch->closed = 1;
+    __atomic_store_n(&ch->closed, 1, __ATOMIC_SEQ_CST);
     /* Wake up all waiting threads */
     pthread_cond_broadcast(&ch->not_empty);
     pthread_cond_broadcast(&ch->not_full);
@@ -5515,6 +8589,15 @@ int strada_channel_len(StradaValue *channel) {
 
     StradaChannel *ch = (StradaChannel*)channel->value.ptr;
 
+    if (ch->ring) {
+        size_t recv_pos = __atomic_load_n(&ch->recv_pos, __ATOMIC_ACQUIRE);
+        size_t send_pos = __atomic_load_n(&ch->send_pos, __ATOMIC_ACQUIRE);
+        intptr_t n = (intptr_t)(send_pos - recv_pos);
+        if (n < 0) n = 0;
+        if (n > ch->capacity) n = ch->capacity;
+        return (int)n;
+    }
+
     pthread_mutex_lock(&ch->mutex);
     int size = ch->size;
     pthread_mutex_unlock(&ch->mutex);
@@ -5522,129 +8605,977 @@ int strada_channel_len(StradaValue *channel) {
     return size;
 }
 
-/* ============================================================
- * Atomic Implementation - Lock-free Integer Operations
- * ============================================================ */
-
-/* Create a new atomic integer */
-StradaValue* strada_atomic_new(int64_t initial) {
-    StradaAtomicValue *a = malloc(sizeof(StradaAtomicValue));
-    if (!a) return strada_new_undef();
-
-    a->value = initial;
-
-    StradaValue *sv = malloc(sizeof(StradaValue));
-    sv->type = STRADA_ATOMIC;
-    sv->refcount = 1;
-    sv->value.ptr = a;
-    sv->blessed_package = NULL;
-
-    return sv;
-}
-
-/* Load value atomically */
-int64_t strada_atomic_load(StradaValue *atomic) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
+/* Send every element of an array (blocks while full, throws if closed).
+ * Bounded channels claim runs of free cells with one CAS each. */
+int64_t strada_channel_send_many(StradaValue *channel, StradaValue *items_ref) {
+    if (!channel || channel->type != STRADA_CHANNEL) {
+        strada_throw("channel::send_many: invalid channel");
+        return 0;
+    }
+    StradaArray *arr = strada_deref_array(items_ref);
+    if (!arr) {
+        strada_throw("channel::send_many: expected an array reference");
         return 0;
     }
 
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    return __atomic_load_n(&a->value, __ATOMIC_SEQ_CST);
-}
+    StradaChannel *ch = (StradaChannel*)channel->value.ptr;
+    size_t n = arr->size;
+    if (n == 0) return 0;
+
+    StradaValue **items = malloc(sizeof(StradaValue *) * n);
+    for (size_t i = 0; i < n; i++) {
+        StradaValue *v = arr->elements[i];
+        if (v) {
+            strada_incref(v);
+        } else {
+            v = strada_new_undef();
+        }
+        items[i] = v;
+    }
 
-/* Store value atomically */
-void strada_atomic_store(StradaValue *atomic, int64_t value) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
-        return;
+    size_t sent = 0;
+    if (ch->ring) {
+        sent = strada_ring_send(ch, items, n);
+    } else {
+        pthread_mutex_lock(&ch->mutex);
+        if (!ch->closed) {
+            for (; sent < n; sent++) {
+                StradaChannelNode *node = malloc(sizeof(StradaChannelNode));
+                node->value = items[sent];
+                node->next = NULL;
+                if (ch->tail) {
+                    ch->tail->next = node;
+                } else {
+                    ch->head = node;
+                }
+                ch->tail = node;
+                ch->size++;
+            }
+            pthread_cond_broadcast(&ch->not_empty);
+        }
+        pthread_mutex_unlock(&ch->mutex);
     }
 
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    __atomic_store_n(&a->value, value, __ATOMIC_SEQ_CST);
+    for (size_t i = sent; i < n; i++) {
+        strada_decref(items[i]);
+    }
+    free(items);
+    if (sent < n) {
+        strada_throw("channel::send_many: channel is closed");
+    }
+    return (int64_t)sent;
 }
 
-/* Add to atomic and return OLD value */
-int64_t strada_atomic_add(StradaValue *atomic, int64_t delta) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
-        return 0;
+/* Receive up to max values as an array. Blocks until at least one value
+ * is available; returns an empty array once the channel is closed and
+ * drained. */
+StradaValue* strada_channel_recv_many(StradaValue *channel, int64_t max) {
+    if (!channel || channel->type != STRADA_CHANNEL) {
+        strada_throw("channel::recv_many: invalid channel");
+        return strada_new_array();
     }
 
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    return __atomic_fetch_add(&a->value, delta, __ATOMIC_SEQ_CST);
-}
-
-/* Subtract from atomic and return OLD value */
-int64_t strada_atomic_sub(StradaValue *atomic, int64_t delta) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
-        return 0;
+    StradaChannel *ch = (StradaChannel*)channel->value.ptr;
+    StradaValue *result = strada_new_array();
+    if (max <= 0) return result;
+
+    if (ch->ring) {
+        StradaValue *buf[STRADA_CHANNEL_BATCH];
+        size_t want = max < STRADA_CHANNEL_BATCH ? (size_t)max : STRADA_CHANNEL_BATCH;
+        size_t k = strada_ring_recv(ch, buf, want);
+        size_t got = 0;
+        while (k > 0) {
+            for (size_t i = 0; i < k; i++) {
+                strada_array_push_take(result->value.av, buf[i]);
+            }
+            got += k;
+            if (got >= (size_t)max) break;
+            want = (size_t)max - got;
+            if (want > STRADA_CHANNEL_BATCH) want = STRADA_CHANNEL_BATCH;
+            k = strada_ring_try_pop(ch, buf, want);
+            if (k > 0) strada_channel_wake(ch, &ch->send_waiters, &ch->not_full, 1);
+        }
+        return result;
     }
 
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    return __atomic_fetch_sub(&a->value, delta, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&ch->mutex);
+    while (ch->head == NULL && !ch->closed) {
+        pthread_cond_wait(&ch->not_empty, &ch->mutex);
+    }
+    int64_t got = 0;
+    while (ch->head && got < max) {
+        StradaChannelNode *node = ch->head;
+        ch->head = node->next;
+        if (ch->head == NULL) {
+            ch->tail = NULL;
+        }
+        ch->size--;
+        strada_array_push_take(result->value.av, node->value);
+        free(node);
+        got++;
+    }
+    pthread_cond_broadcast(&ch->not_full);
+    pthread_mutex_unlock(&ch->mutex);
+    return result;
 }
 
-/* Compare-and-swap: if value == expected, set to desired. Returns 1 on success */
-int strada_atomic_cas(StradaValue *atomic, int64_t expected, int64_t desired) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
-        return 0;
-    }
+/* ============================================================
+ * Event Loop Implementation - Readiness for Sockets and Timers
+ * ============================================================ */
 
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    return __atomic_compare_exchange_n(&a->value, &expected, desired,
-                                       0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-}
+/* One thread waits for descriptor readiness and deadlines for the whole
+ * process. Futures from async::readable/writable/sleep are settled here,
+ * so nothing else blocks while they wait. Watcher and timer callbacks are
+ * run on the async pool; a watcher is paused until its callback returns,
+ * so one watcher never runs twice at once. */
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define STRADA_LOOP_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/event.h>
+#define STRADA_LOOP_KQUEUE 1
+#else
+#define STRADA_LOOP_POLL 1
+#endif
 
-/* Increment and return NEW value */
-int64_t strada_atomic_inc(StradaValue *atomic) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
-        return 0;
-    }
+#define STRADA_LOOP_MAX_EVENTS 256
+
+/* A future waiting for one event or deadline, or a watcher/timer whose
+ * callback runs on each event */
+typedef struct StradaLoopWaiter {
+    int64_t id;                     /* Handle for unwatch; 0 for futures */
+    int fd;                         /* -1 for timers and sleeps */
+    int events;                     /* STRADA_LOOP_READ | STRADA_LOOP_WRITE */
+    int active;                     /* 0 while its callback is running */
+    StradaValue *future;            /* Settled once, then the waiter is freed */
+    StradaValue *callback;          /* Watchers and timers */
+    int64_t deadline;               /* Monotonic ms, valid if heap_index >= 0 */
+    int64_t interval;               /* Repeating timers */
+    int heap_index;
+    struct StradaLoopWaiter *next_fd;
+} StradaLoopWaiter;
 
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    return __atomic_add_fetch(&a->value, 1, __ATOMIC_SEQ_CST);
+typedef struct {
+    StradaLoopWaiter *waiters;
+    int armed;                      /* Events the backend is watching */
+    int registered;                 /* epoll: fd is in the set */
+} StradaLoopFd;
+
+/* Work found while holding the loop lock, done after releasing it */
+typedef struct {
+    StradaValue *future;            /* Settle with result */
+    StradaValue *result;
+    StradaValue *callback;          /* Dispatch (or just release) */
+    StradaValue *arg;
+    int64_t id;
+    int dispatch;
+} StradaLoopAction;
+
+typedef struct {
+    int fd;
+    int events;
+} StradaLoopEvent;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    int backend_fd;                 /* epoll or kqueue descriptor */
+    int wake_pipe[2];
+    int waiting;                    /* Loop thread is in the backend */
+    int woken;                      /* Wake byte not yet drained */
+    StradaLoopFd *fds;
+    int fd_cap;
+    StradaLoopWaiter **heap;        /* Min-heap on deadline */
+    int heap_len;
+    int heap_cap;
+    StradaLoopWaiter **slots;       /* id -> watcher or timer */
+    int slot_cap;
+    int *free_slots;
+    int free_len;
+    int64_t serial;
+    StradaLoopAction *actions;
+    int action_len;
+    int action_cap;
+} StradaLoop;
+
+static StradaLoop strada_loop;
+static pthread_once_t strada_loop_once = PTHREAD_ONCE_INIT;
+
+static int64_t strada_loop_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-/* Decrement and return NEW value */
-int64_t strada_atomic_dec(StradaValue *atomic) {
-    if (!atomic || atomic->type != STRADA_ATOMIC) {
-        return 0;
+/* Make the loop thread recompute its timeout (or, with poll, its fd set) */
+static void strada_loop_wake(StradaLoop *loop) {
+    if (loop->waiting && !loop->woken) {
+        loop->woken = 1;
+        ssize_t r = write(loop->wake_pipe[1], "x", 1);
+        (void)r;
     }
-
-    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
-    return __atomic_sub_fetch(&a->value, 1, __ATOMIC_SEQ_CST);
 }
 
-/* ===== C STRUCT SUPPORT ===== */
-/* String and type functions for strada_runtime.c - append to end of file */
+/* ----- Deadline heap ----- */
 
-/* ===== COMPREHENSIVE STRING FUNCTIONS ===== */
+static void strada_loop_heap_set(StradaLoop *loop, int i, StradaLoopWaiter *w) {
+    loop->heap[i] = w;
+    w->heap_index = i;
+}
 
-/* Returns character position (not byte position) */
-int strada_rindex(const char *haystack, const char *needle) {
-    if (!haystack || !needle) return -1;
+static void strada_loop_heap_up(StradaLoop *loop, int i) {
+    StradaLoopWaiter *w = loop->heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (loop->heap[parent]->deadline <= w->deadline) break;
+        strada_loop_heap_set(loop, i, loop->heap[parent]);
+        i = parent;
+    }
+    strada_loop_heap_set(loop, i, w);
+}
 
-    const char *last_pos = NULL;
-    const char *pos = haystack;
+static void strada_loop_heap_down(StradaLoop *loop, int i) {
+    StradaLoopWaiter *w = loop->heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= loop->heap_len) break;
+        if (child + 1 < loop->heap_len &&
+            loop->heap[child + 1]->deadline < loop->heap[child]->deadline) {
+            child++;
+        }
+        if (w->deadline <= loop->heap[child]->deadline) break;
+        strada_loop_heap_set(loop, i, loop->heap[child]);
+        i = child;
+    }
+    strada_loop_heap_set(loop, i, w);
+}
+
+static void strada_loop_heap_push(StradaLoop *loop, StradaLoopWaiter *w) {
+    if (loop->heap_len == loop->heap_cap) {
+        loop->heap_cap = loop->heap_cap ? loop->heap_cap * 2 : 64;
+        loop->heap = realloc(loop->heap, sizeof(StradaLoopWaiter*) * loop->heap_cap);
+    }
+    loop->heap[loop->heap_len] = w;
+    w->heap_index = loop->heap_len++;
+    strada_loop_heap_up(loop, w->heap_index);
+    if (w->heap_index == 0) strada_loop_wake(loop);  /* New earliest deadline */
+}
+
+static void strada_loop_heap_remove(StradaLoop *loop, StradaLoopWaiter *w) {
+    int i = w->heap_index;
+    if (i < 0) return;
+    w->heap_index = -1;
+    loop->heap_len--;
+    if (i == loop->heap_len) return;
+    strada_loop_heap_set(loop, i, loop->heap[loop->heap_len]);
+    strada_loop_heap_up(loop, i);
+    strada_loop_heap_down(loop, loop->heap[i]->heap_index);
+}
+
+/* ----- Backend ----- */
+
+static void strada_loop_backend_init(StradaLoop *loop) {
+#if defined(STRADA_LOOP_EPOLL)
+    loop->backend_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = loop->wake_pipe[0];
+    epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, loop->wake_pipe[0], &ev);
+#elif defined(STRADA_LOOP_KQUEUE)
+    loop->backend_fd = kqueue();
+    struct kevent ch;
+    EV_SET(&ch, loop->wake_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    kevent(loop->backend_fd, &ch, 1, NULL, 0, NULL);
+#else
+    loop->backend_fd = -1;
+#endif
+}
 
-    while ((pos = strstr(pos, needle)) != NULL) {
-        last_pos = pos;
-        pos++;
+/* Make the backend watch fd for the events its active waiters want. Each
+ * registration is one-shot: after firing it stays quiet until re-armed.
+ * Returns -1 if the backend refused the descriptor. */
+static int strada_loop_arm(StradaLoop *loop, int fd) {
+    StradaLoopFd *e = &loop->fds[fd];
+    int want = 0;
+    for (StradaLoopWaiter *w = e->waiters; w; w = w->next_fd) {
+        if (w->active) want |= w->events;
     }
+    if (want == e->armed) return 0;
+    int rc = 0;
 
-    if (last_pos) {
-        return (int)byte_to_char_offset(haystack, last_pos - haystack);
+#if defined(STRADA_LOOP_EPOLL)
+    if (want == 0) {
+        if (e->registered) epoll_ctl(loop->backend_fd, EPOLL_CTL_DEL, fd, NULL);
+        e->registered = 0;
+    } else {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLONESHOT | EPOLLRDHUP;
+        if (want & STRADA_LOOP_READ) ev.events |= EPOLLIN;
+        if (want & STRADA_LOOP_WRITE) ev.events |= EPOLLOUT;
+        ev.data.fd = fd;
+        /* The fd may have been closed (dropping it from the set) and its
+         * number reused behind our back */
+        rc = epoll_ctl(loop->backend_fd, e->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+        if (rc < 0 && errno == ENOENT) {
+            rc = epoll_ctl(loop->backend_fd, EPOLL_CTL_ADD, fd, &ev);
+        } else if (rc < 0 && errno == EEXIST) {
+            rc = epoll_ctl(loop->backend_fd, EPOLL_CTL_MOD, fd, &ev);
+        }
+        e->registered = (rc == 0);
+        if (rc < 0) want = 0;
+    }
+#elif defined(STRADA_LOOP_KQUEUE)
+    struct kevent ch[2];
+    int n = 0;
+    if ((want & STRADA_LOOP_READ) && !(e->armed & STRADA_LOOP_READ)) {
+        EV_SET(&ch[n++], fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    } else if (!(want & STRADA_LOOP_READ) && (e->armed & STRADA_LOOP_READ)) {
+        EV_SET(&ch[n++], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    }
+    if ((want & STRADA_LOOP_WRITE) && !(e->armed & STRADA_LOOP_WRITE)) {
+        EV_SET(&ch[n++], fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    } else if (!(want & STRADA_LOOP_WRITE) && (e->armed & STRADA_LOOP_WRITE)) {
+        EV_SET(&ch[n++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    }
+    if (n > 0 && kevent(loop->backend_fd, ch, n, NULL, 0, NULL) < 0) {
+        rc = -1;
+        want = 0;
     }
-    return -1;
+#else
+    strada_loop_wake(loop);  /* poll rebuilds its set each time round */
+#endif
+    e->armed = want;
+    return rc;
+}
+
+/* Wait up to timeout_ms (-1: forever). Called and returns with the loop
+ * lock held; releases it while waiting. */
+static int strada_loop_backend_wait(StradaLoop *loop, StradaLoopEvent *out, int timeout_ms) {
+    int n = 0;
+#if defined(STRADA_LOOP_EPOLL)
+    struct epoll_event evs[STRADA_LOOP_MAX_EVENTS];
+    pthread_mutex_unlock(&loop->mutex);
+    int got = epoll_wait(loop->backend_fd, evs, STRADA_LOOP_MAX_EVENTS, timeout_ms);
+    pthread_mutex_lock(&loop->mutex);
+    for (int i = 0; i < got; i++) {
+        int ev = 0;
+        if (evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) ev |= STRADA_LOOP_READ;
+        if (evs[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) ev |= STRADA_LOOP_WRITE;
+        out[n].fd = evs[i].data.fd;
+        out[n].events = ev;
+        n++;
+    }
+#elif defined(STRADA_LOOP_KQUEUE)
+    struct kevent evs[STRADA_LOOP_MAX_EVENTS];
+    struct timespec ts, *tsp = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        tsp = &ts;
+    }
+    pthread_mutex_unlock(&loop->mutex);
+    int got = kevent(loop->backend_fd, NULL, 0, evs, STRADA_LOOP_MAX_EVENTS, tsp);
+    pthread_mutex_lock(&loop->mutex);
+    for (int i = 0; i < got; i++) {
+        out[n].fd = (int)evs[i].ident;
+        out[n].events = evs[i].filter == EVFILT_WRITE ? STRADA_LOOP_WRITE : STRADA_LOOP_READ;
+        n++;
+    }
+#else
+    int count = 1;
+    for (int fd = 0; fd < loop->fd_cap; fd++) {
+        if (loop->fds[fd].armed) count++;
+    }
+    struct pollfd *pfds = malloc(sizeof(struct pollfd) * count);
+    pfds[0].fd = loop->wake_pipe[0];
+    pfds[0].events = POLLIN;
+    int k = 1;
+    for (int fd = 0; fd < loop->fd_cap; fd++) {
+        int armed = loop->fds[fd].armed;
+        if (!armed) continue;
+        pfds[k].fd = fd;
+        pfds[k].events = (short)(((armed & STRADA_LOOP_READ) ? POLLIN : 0) |
+                                 ((armed & STRADA_LOOP_WRITE) ? POLLOUT : 0));
+        k++;
+    }
+    pthread_mutex_unlock(&loop->mutex);
+    int got = poll(pfds, (nfds_t)count, timeout_ms);
+    pthread_mutex_lock(&loop->mutex);
+    for (int i = 0; i < count && got > 0 && n < STRADA_LOOP_MAX_EVENTS; i++) {
+        short re = pfds[i].revents;
+        if (!re) continue;
+        int ev = 0;
+        if (re & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) ev |= STRADA_LOOP_READ;
+        if (re & (POLLOUT | POLLHUP | POLLERR | POLLNVAL)) ev |= STRADA_LOOP_WRITE;
+        out[n].fd = pfds[i].fd;
+        out[n].events = ev;
+        n++;
+    }
+    free(pfds);
+#endif
+    return n;
+}
+
+/* ----- Waiters ----- */
+
+static void strada_loop_act(StradaLoop *loop, StradaValue *future, StradaValue *result,
+                            StradaValue *callback, StradaValue *arg, int64_t id, int dispatch) {
+    if (loop->action_len == loop->action_cap) {
+        loop->action_cap = loop->action_cap ? loop->action_cap * 2 : 64;
+        loop->actions = realloc(loop->actions, sizeof(StradaLoopAction) * loop->action_cap);
+    }
+    StradaLoopAction *a = &loop->actions[loop->action_len++];
+    a->future = future;
+    a->result = result;
+    a->callback = callback;
+    a->arg = arg;
+    a->id = id;
+    a->dispatch = dispatch;
+}
+
+static StradaLoopFd* strada_loop_fd(StradaLoop *loop, int fd) {
+    if (fd >= loop->fd_cap) {
+        int cap = loop->fd_cap ? loop->fd_cap : 64;
+        while (cap <= fd) cap *= 2;
+        loop->fds = realloc(loop->fds, sizeof(StradaLoopFd) * cap);
+        memset(loop->fds + loop->fd_cap, 0, sizeof(StradaLoopFd) * (cap - loop->fd_cap));
+        loop->fd_cap = cap;
+    }
+    return &loop->fds[fd];
+}
+
+static void strada_loop_detach_fd(StradaLoop *loop, StradaLoopWaiter *w) {
+    StradaLoopWaiter **pp = &loop->fds[w->fd].waiters;
+    while (*pp && *pp != w) pp = &(*pp)->next_fd;
+    if (*pp) *pp = w->next_fd;
+    strada_loop_arm(loop, w->fd);
+}
+
+static StradaLoopWaiter* strada_loop_waiter_new(int fd, int events) {
+    StradaLoopWaiter *w = calloc(1, sizeof(StradaLoopWaiter));
+    w->fd = fd;
+    w->events = events;
+    w->active = 1;
+    w->heap_index = -1;
+    return w;
+}
+
+/* Give a watcher or timer an id that unwatch can find it by */
+static void strada_loop_assign_id(StradaLoop *loop, StradaLoopWaiter *w) {
+    if (loop->free_len == 0) {
+        int old = loop->slot_cap;
+        loop->slot_cap = old ? old * 2 : 64;
+        loop->slots = realloc(loop->slots, sizeof(StradaLoopWaiter*) * loop->slot_cap);
+        loop->free_slots = realloc(loop->free_slots, sizeof(int) * loop->slot_cap);
+        for (int i = loop->slot_cap - 1; i >= old; i--) {
+            loop->slots[i] = NULL;
+            loop->free_slots[loop->free_len++] = i;
+        }
+    }
+    int slot = loop->free_slots[--loop->free_len];
+    loop->slots[slot] = w;
+    w->id = (++loop->serial << 32) | (int64_t)slot;
 }
 
-char* strada_upper(const char *str) {
+static StradaLoopWaiter* strada_loop_find(StradaLoop *loop, int64_t id) {
+    int64_t slot = id & 0xffffffff;
+    if (id <= 0 || slot >= loop->slot_cap) return NULL;
+    StradaLoopWaiter *w = loop->slots[slot];
+    return (w && w->id == id) ? w : NULL;
+}
+
+static void strada_loop_release_id(StradaLoop *loop, StradaLoopWaiter *w) {
+    int slot = (int)(w->id & 0xffffffff);
+    loop->slots[slot] = NULL;
+    loop->free_slots[loop->free_len++] = slot;
+}
+
+static StradaValue* strada_loop_event_name(int events) {
+    if (events == (STRADA_LOOP_READ | STRADA_LOOP_WRITE)) return strada_new_str("rw");
+    return strada_new_str(events & STRADA_LOOP_WRITE ? "w" : "r");
+}
+
+/* Descriptor fd became ready for events */
+static void strada_loop_fire_fd(StradaLoop *loop, int fd, int events) {
+    if (fd < 0 || fd >= loop->fd_cap) return;
+    StradaLoopFd *e = &loop->fds[fd];
+#if defined(STRADA_LOOP_KQUEUE)
+    e->armed &= ~events;
+#else
+    e->armed = 0;
+#endif
+    StradaLoopWaiter **pp = &e->waiters;
+    while (*pp) {
+        StradaLoopWaiter *w = *pp;
+        if (!w->active || !(w->events & events)) {
+            pp = &w->next_fd;
+            continue;
+        }
+        if (w->future) {
+            *pp = w->next_fd;
+            strada_loop_heap_remove(loop, w);
+            strada_loop_act(loop, w->future, strada_new_int(1), NULL, NULL, 0, 0);
+            free(w);
+            continue;
+        }
+        w->active = 0;
+        strada_incref(w->callback);
+        strada_loop_act(loop, NULL, NULL, w->callback,
+                        strada_loop_event_name(w->events & events), w->id, 1);
+        pp = &w->next_fd;
+    }
+    strada_loop_arm(loop, fd);
+}
+
+/* w's deadline passed (it has already left the heap) */
+static void strada_loop_fire_timer(StradaLoop *loop, StradaLoopWaiter *w) {
+    if (w->future) {
+        if (w->fd >= 0) {
+            strada_loop_detach_fd(loop, w);
+            strada_loop_act(loop, w->future, strada_new_int(0), NULL, NULL, 0, 0);
+        } else {
+            strada_loop_act(loop, w->future, NULL, NULL, NULL, 0, 0);
+        }
+        free(w);
+        return;
+    }
+    if (w->interval > 0) {
+        w->active = 0;
+        strada_incref(w->callback);
+        strada_loop_act(loop, NULL, NULL, w->callback, NULL, w->id, 1);
+        return;
+    }
+    /* One-shot timer: done once dispatched */
+    strada_loop_release_id(loop, w);
+    strada_loop_act(loop, NULL, NULL, w->callback, NULL, 0, 1);
+    free(w);
+}
+
+static void strada_loop_rearm(int64_t id);
+
+/* Pool task for a watcher or timer: captures are callback, arg, id */
+static StradaValue* strada_loop_callback_body(StradaValue ***captures) {
+    StradaValue *callback = *captures[0];
+    StradaValue *arg = *captures[1];
+    int64_t id = strada_to_int(*captures[2]);
+
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        StradaValue *r = arg ? strada_closure_call1(callback, arg)
+                             : strada_closure_call0(callback);
+        if (r) strada_decref(r);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        StradaValue *err = strada_get_exception();
+        char *msg = strada_to_str(err);
+        fprintf(stderr, "Uncaught exception in event callback: %s\n", msg);
+        free(msg);
+        strada_decref(err);
+    }
+    if (id) strada_loop_rearm(id);
+    return strada_undef_static();
+}
+
+/* Carry out the actions gathered under the lock */
+static void strada_loop_run_actions(StradaLoopAction *acts, int count) {
+    for (int i = 0; i < count; i++) {
+        StradaLoopAction *a = &acts[i];
+        if (a->future) {
+            strada_future_settle(a->future, a->result, NULL);
+            strada_decref(a->future);
+        } else if (a->dispatch) {
+            StradaValue *idv = strada_new_int(a->id);
+            StradaValue **captures[3] = { &a->callback, &a->arg, &idv };
+            strada_pool_spawn(strada_closure_new((void*)strada_loop_callback_body, 0, 3, captures));
+            strada_decref(idv);
+            if (a->arg) strada_decref(a->arg);
+            strada_decref(a->callback);
+        } else if (a->callback) {
+            strada_decref(a->callback);
+        }
+    }
+}
+
+static void* strada_loop_main(void *arg) {
+    (void)arg;
+    StradaLoop *loop = &strada_loop;
+    StradaLoopEvent events[STRADA_LOOP_MAX_EVENTS];
+    StradaLoopAction *acts = NULL;
+    int acts_cap = 0;
+
+    pthread_mutex_lock(&loop->mutex);
+    while (1) {
+        int timeout = -1;
+        if (loop->heap_len > 0) {
+            int64_t wait = loop->heap[0]->deadline - strada_loop_now();
+            timeout = wait < 0 ? 0 : (wait > INT_MAX ? INT_MAX : (int)wait);
+        }
+        loop->waiting = 1;
+        int n = strada_loop_backend_wait(loop, events, timeout);
+        loop->waiting = 0;
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].fd == loop->wake_pipe[0]) {
+                char buf[64];
+                while (read(loop->wake_pipe[0], buf, sizeof(buf)) > 0) {}
+                loop->woken = 0;
+                continue;
+            }
+            strada_loop_fire_fd(loop, events[i].fd, events[i].events);
+        }
+        int64_t now = strada_loop_now();
+        while (loop->heap_len > 0 && loop->heap[0]->deadline <= now) {
+            StradaLoopWaiter *w = loop->heap[0];
+            strada_loop_heap_remove(loop, w);
+            strada_loop_fire_timer(loop, w);
+        }
+
+        if (loop->action_len > 0) {
+            /* Swap buffers so registrations can queue while we work */
+            StradaLoopAction *mine = loop->actions;
+            int count = loop->action_len;
+            int cap = loop->action_cap;
+            loop->actions = acts;
+            loop->action_cap = acts_cap;
+            loop->action_len = 0;
+            acts = mine;
+            acts_cap = cap;
+            pthread_mutex_unlock(&loop->mutex);
+            strada_loop_run_actions(acts, count);
+            pthread_mutex_lock(&loop->mutex);
+        }
+    }
+    return NULL;
+}
+
+static void strada_loop_start(void) {
+    StradaLoop *loop = &strada_loop;
+    pthread_mutex_init(&loop->mutex, NULL);
+    if (pipe(loop->wake_pipe) < 0) {
+        fprintf(stderr, "Error: event loop: cannot create wake pipe: %s\n", strerror(errno));
+        exit(1);
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(loop->wake_pipe[i], F_SETFL, fcntl(loop->wake_pipe[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(loop->wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    strada_loop_backend_init(loop);
+
+    strada_refcount_atomic_enable();
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, strada_loop_main, NULL) != 0) {
+        fprintf(stderr, "Error: event loop: cannot start thread\n");
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/* Lock the loop, starting its thread on first use */
+static StradaLoop* strada_loop_lock(void) {
+    pthread_once(&strada_loop_once, strada_loop_start);
+    pthread_mutex_lock(&strada_loop.mutex);
+    return &strada_loop;
+}
+
+static void strada_loop_rearm(int64_t id) {
+    StradaLoop *loop = strada_loop_lock();
+    StradaLoopWaiter *w = strada_loop_find(loop, id);
+    if (w && !w->active) {
+        w->active = 1;
+        if (w->fd >= 0) {
+            strada_loop_arm(loop, w->fd);
+        } else {
+            w->deadline = strada_loop_now() + w->interval;
+            strada_loop_heap_push(loop, w);
+        }
+    }
+    pthread_mutex_unlock(&loop->mutex);
+}
+
+/* Descriptor behind a socket, file handle or integer fd; -1 if none */
+static int strada_loop_fd_of(StradaValue *sock) {
+    if (!sock) return -1;
+    if (sock->type == STRADA_SOCKET) {
+        return sock->value.sock ? sock->value.sock->fd : -1;
+    }
+    if (sock->type == STRADA_FILEHANDLE) {
+        return sock->value.fh ? fileno(sock->value.fh) : -1;
+    }
+    if (sock->type == STRADA_INT || sock->type == STRADA_NUM) {
+        return (int)strada_to_int(sock);
+    }
+    return -1;
+}
+
+/* async::readable / async::writable: a future that becomes 1 when the
+ * descriptor is ready, or 0 if timeout_ms (>= 0) passes first */
+StradaValue* strada_loop_io(StradaValue *sock, int events, int64_t timeout_ms) {
+    int fd = strada_loop_fd_of(sock);
+    if (fd < 0) {
+        strada_throw(events & STRADA_LOOP_WRITE ? "async::writable: not a socket or descriptor"
+                                                : "async::readable: not a socket or descriptor");
+        return strada_new_undef();
+    }
+    StradaValue *future = strada_future_pending();
+
+    /* Data already buffered by the socket (or a regular file, which is
+     * always ready) needs no wait */
+    struct stat st;
+    if ((sock->type == STRADA_SOCKET && (events & STRADA_LOOP_READ) &&
+         sock->value.sock->read_pos < sock->value.sock->read_len) ||
+        (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))) {
+        strada_future_settle(future, strada_new_int(1), NULL);
+        return future;
+    }
+
+    StradaLoop *loop = strada_loop_lock();
+    StradaLoopWaiter *w = strada_loop_waiter_new(fd, events);
+    w->future = future;
+    strada_incref(future);
+    StradaLoopFd *e = strada_loop_fd(loop, fd);
+    w->next_fd = e->waiters;
+    e->waiters = w;
+    if (strada_loop_arm(loop, fd) < 0) {
+        /* Not pollable (or closed): report it ready so the caller's own
+         * read or write sees the error */
+        strada_loop_detach_fd(loop, w);
+        pthread_mutex_unlock(&loop->mutex);
+        free(w);
+        strada_decref(future);
+        strada_future_settle(future, strada_new_int(1), NULL);
+        return future;
+    }
+    if (timeout_ms >= 0) {
+        w->deadline = strada_loop_now() + timeout_ms;
+        strada_loop_heap_push(loop, w);
+    }
+    pthread_mutex_unlock(&loop->mutex);
+    return future;
+}
+
+/* async::sleep: a future that settles (to undef) after ms */
+StradaValue* strada_loop_sleep(int64_t ms) {
+    StradaValue *future = strada_future_pending();
+    StradaLoop *loop = strada_loop_lock();
+    StradaLoopWaiter *w = strada_loop_waiter_new(-1, 0);
+    w->future = future;
+    strada_incref(future);
+    w->deadline = strada_loop_now() + (ms > 0 ? ms : 0);
+    strada_loop_heap_push(loop, w);
+    pthread_mutex_unlock(&loop->mutex);
+    return future;
+}
+
+/* async::watch: run callback($events) on the pool each time the
+ * descriptor is ready, until unwatched */
+int64_t strada_loop_watch(StradaValue *sock, StradaValue *events, StradaValue *callback) {
+    int fd = strada_loop_fd_of(sock);
+    if (fd < 0) {
+        strada_throw("async::watch: not a socket or descriptor");
+        return 0;
+    }
+    char *spec = strada_to_str(events);
+    int mask = 0;
+    if (strchr(spec, 'r')) mask |= STRADA_LOOP_READ;
+    if (strchr(spec, 'w')) mask |= STRADA_LOOP_WRITE;
+    free(spec);
+    if (!mask) {
+        strada_throw("async::watch: events must be \"r\", \"w\" or \"rw\"");
+        return 0;
+    }
+    if (!callback || (callback->type != STRADA_CLOSURE && callback->type != STRADA_CPOINTER)) {
+        strada_throw("async::watch: callback must be a function");
+        return 0;
+    }
+
+    StradaLoop *loop = strada_loop_lock();
+    StradaLoopWaiter *w = strada_loop_waiter_new(fd, mask);
+    w->callback = callback;
+    strada_incref(callback);
+    strada_loop_assign_id(loop, w);
+    StradaLoopFd *e = strada_loop_fd(loop, fd);
+    w->next_fd = e->waiters;
+    e->waiters = w;
+    if (strada_loop_arm(loop, fd) < 0) {
+        int err = errno;
+        strada_loop_release_id(loop, w);
+        strada_loop_detach_fd(loop, w);
+        pthread_mutex_unlock(&loop->mutex);
+        free(w);
+        strada_decref(callback);
+        char msg[256];
+        snprintf(msg, sizeof(msg), "async::watch: cannot watch descriptor %d: %s", fd, strerror(err));
+        strada_throw(msg);
+        return 0;
+    }
+    int64_t id = w->id;
+    pthread_mutex_unlock(&loop->mutex);
+    return id;
+}
+
+/* async::timer / async::interval: run callback() on the pool after ms;
+ * with repeat, again ms after each run finishes */
+int64_t strada_loop_timer(int64_t ms, StradaValue *callback, int repeat) {
+    if (!callback || (callback->type != STRADA_CLOSURE && callback->type != STRADA_CPOINTER)) {
+        strada_throw(repeat ? "async::interval: callback must be a function"
+                            : "async::timer: callback must be a function");
+        return 0;
+    }
+    if (ms < 0) ms = 0;
+    StradaLoop *loop = strada_loop_lock();
+    StradaLoopWaiter *w = strada_loop_waiter_new(-1, 0);
+    w->callback = callback;
+    strada_incref(callback);
+    w->interval = repeat ? (ms > 0 ? ms : 1) : 0;
+    strada_loop_assign_id(loop, w);
+    w->deadline = strada_loop_now() + ms;
+    strada_loop_heap_push(loop, w);
+    int64_t id = w->id;
+    pthread_mutex_unlock(&loop->mutex);
+    return id;
+}
+
+/* async::unwatch: stop a watcher or timer. A callback already running
+ * finishes. Returns 1 if id was live. */
+int strada_loop_unwatch(int64_t id) {
+    StradaLoop *loop = strada_loop_lock();
+    StradaLoopWaiter *w = strada_loop_find(loop, id);
+    if (!w) {
+        pthread_mutex_unlock(&loop->mutex);
+        return 0;
+    }
+    strada_loop_release_id(loop, w);
+    strada_loop_heap_remove(loop, w);
+    if (w->fd >= 0) {
+        w->active = 0;
+        strada_loop_detach_fd(loop, w);
+    }
+    StradaValue *callback = w->callback;
+    free(w);
+    pthread_mutex_unlock(&loop->mutex);
+    strada_decref(callback);
+    return 1;
+}
+
+/* ============================================================
+ * Atomic Implementation - Lock-free Integer Operations
+ * ============================================================ */
+
+/* Create a new atomic integer */
+StradaValue* strada_atomic_new(int64_t initial) {
+    StradaAtomicValue *a = malloc(sizeof(StradaAtomicValue));
+    if (!a) return strada_new_undef();
+
+    a->value = initial;
+
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
+    sv->type = STRADA_ATOMIC;
+    sv->refcount = 1;
+    sv->value.ptr = a;
+    sv->blessed_package = NULL;
+
+    strada_memprof_alloc(sv);
+    return sv;
+}
+
+/* Load value atomically */
+int64_t strada_atomic_load(StradaValue *atomic) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return 0;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    return __atomic_load_n(&a->value, __ATOMIC_SEQ_CST);
+}
+
+/* Store value atomically */
+void strada_atomic_store(StradaValue *atomic, int64_t value) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    __atomic_store_n(&a->value, value, __ATOMIC_SEQ_CST);
+}
+
+/* Add to atomic and return OLD value */
+int64_t strada_atomic_add(StradaValue *atomic, int64_t delta) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return 0;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    return __atomic_fetch_add(&a->value, delta, __ATOMIC_SEQ_CST);
+}
+
+/* Subtract from atomic and return OLD value */
+int64_t strada_atomic_sub(StradaValue *atomic, int64_t delta) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return 0;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    return __atomic_fetch_sub(&a->value, delta, __ATOMIC_SEQ_CST);
+}
+
+/* Compare-and-swap: if value == expected, set to desired. Returns 1 on success */
+int strada_atomic_cas(StradaValue *atomic, int64_t expected, int64_t desired) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return 0;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    return __atomic_compare_exchange_n(&a->value, &expected, desired,
+                                       0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/* Increment and return NEW value */
+int64_t strada_atomic_inc(StradaValue *atomic) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return 0;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    return __atomic_add_fetch(&a->value, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Decrement and return NEW value */
+int64_t strada_atomic_dec(StradaValue *atomic) {
+    if (!atomic || atomic->type != STRADA_ATOMIC) {
+        return 0;
+    }
+
+    StradaAtomicValue *a = (StradaAtomicValue*)atomic->value.ptr;
+    return __atomic_sub_fetch(&a->value, 1, __ATOMIC_SEQ_CST);
+}
+
+/* ===== C STRUCT SUPPORT ===== */
+/* String and type functions for strada_runtime.c - append to end of file */
+
+/* ===== COMPREHENSIVE STRING FUNCTIONS ===== */
+
+/* Returns character position (not byte position) */
+int strada_rindex(const char *haystack, const char *needle) {
+    if (!haystack || !needle) return -1;
+
+    const char *last_pos = strada_kernels.rfind(haystack, strlen(haystack), needle, strlen(needle));
+    if (last_pos) {
+        return (int)strada_kernels.count_chars(haystack, (size_t)(last_pos - haystack));
+    }
+    return -1;
+}
+
+char* strada_upper(const char *str) {
     if (!str) return strdup("");
     
     size_t len = strlen(str);
     char *result = malloc(len + 1);
-    
-    for (size_t i = 0; i < len; i++) {
-        result[i] = toupper((unsigned char)str[i]);
-    }
+    strada_kernels.case_map(result, str, len, 1);
     result[len] = '\0';
     
     return result;
@@ -5655,10 +9586,7 @@ char* strada_lower(const char *str) {
     
     size_t len = strlen(str);
     char *result = malloc(len + 1);
-    
-    for (size_t i = 0; i < len; i++) {
-        result[i] = tolower((unsigned char)str[i]);
-    }
+    strada_kernels.case_map(result, str, len, 0);
     result[len] = '\0';
     
     return result;
@@ -5688,55 +9616,29 @@ char* strada_lcfirst(const char *str) {
     return result;
 }
 
+/* Bytes [start, end) of str as a new C string */
+static char *str_cut(const char *str, size_t start, size_t end) {
+    char *result = malloc(end - start + 1);
+    memcpy(result, str + start, end - start);
+    result[end - start] = '\0';
+    return result;
+}
+
 char* strada_trim(const char *str) {
     if (!str) return strdup("");
-    
-    while (*str && isspace((unsigned char)*str)) {
-        str++;
-    }
-    
-    if (!*str) return strdup("");
-    
-    const char *end = str + strlen(str) - 1;
-    while (end > str && isspace((unsigned char)*end)) {
-        end--;
-    }
-    
-    size_t len = end - str + 1;
-    char *result = malloc(len + 1);
-    memcpy(result, str, len);
-    result[len] = '\0';
-    
-    return result;
+    size_t len = strlen(str);
+    size_t start = strada_kernels.skip_space(str, len);
+    return str_cut(str, start, start + strada_kernels.rskip_space(str + start, len - start));
 }
 
 char* strada_ltrim(const char *str) {
     if (!str) return strdup("");
-    
-    while (*str && isspace((unsigned char)*str)) {
-        str++;
-    }
-    
-    return strdup(str);
+    return strdup(str + strada_kernels.skip_space(str, strlen(str)));
 }
 
 char* strada_rtrim(const char *str) {
     if (!str) return strdup("");
-    
-    size_t len = strlen(str);
-    if (len == 0) return strdup("");
-    
-    const char *end = str + len - 1;
-    while (end >= str && isspace((unsigned char)*end)) {
-        end--;
-    }
-    
-    len = end - str + 1;
-    char *result = malloc(len + 1);
-    memcpy(result, str, len);
-    result[len] = '\0';
-    
-    return result;
+    return str_cut(str, 0, strada_kernels.rskip_space(str, strlen(str)));
 }
 
 /* UTF-8 aware reverse - reverses characters, not bytes */
@@ -5969,6 +9871,9 @@ StradaValue* strada_byte_substr(StradaValue *sv, int start, int len) {
         actual_len = str_len - start;
     }
 
+    if (!allocated_str) {
+        return strada_str_slice(sv, (size_t)start, actual_len);
+    }
     StradaValue *result = strada_new_str_len(str + start, actual_len);
     free(allocated_str);
     return result;
@@ -6476,30 +10381,23 @@ static const int8_t base64_decode_table[256] = {
 StradaValue* strada_base64_encode(StradaValue *sv) {
     if (!sv) return strada_new_str("");
 
-    const unsigned char *data = NULL;
-    char *allocated_str = NULL;
-    size_t len = 0;
-
-    if (sv->type == STRADA_STR && sv->value.pv) {
-        data = (const unsigned char *)sv->value.pv;
-        len = sv->struct_size > 0 ? sv->struct_size : strlen(sv->value.pv);
-    } else {
-        allocated_str = strada_to_str(sv);
-        data = (const unsigned char *)allocated_str;
-        len = allocated_str ? strlen(allocated_str) : 0;
-    }
-
-    if (!data || len == 0) {
+    size_t len;
+    char *allocated_str;
+    const unsigned char *data = (const unsigned char *)str_bytes(sv, &len, &allocated_str);
+    if (len == 0) {
         free(allocated_str);
         return strada_new_str("");
     }
 
     /* Output length: 4 chars for every 3 bytes, rounded up */
     size_t out_len = ((len + 2) / 3) * 4;
-    char *result = malloc(out_len + 1);
+    StradaValue *ret = strada_str_alloc(out_len);
+    char *result = ret->value.pv;
 
-    size_t i, j;
-    for (i = 0, j = 0; i < len; ) {
+    /* Whole blocks go through the vector kernel, the rest 3 bytes at a time */
+    size_t i = strada_kernels.b64_encode(result, data, len);
+    size_t j = i / 3 * 4;
+    while (i < len) {
         uint32_t octet_a = i < len ? data[i++] : 0;
         uint32_t octet_b = i < len ? data[i++] : 0;
         uint32_t octet_c = i < len ? data[i++] : 0;
@@ -6522,8 +10420,7 @@ StradaValue* strada_base64_encode(StradaValue *sv) {
     }
 
     result[out_len] = '\0';
-    StradaValue *ret = strada_new_str(result);
-    free(result);
+    ret->str_cap |= STRADA_STR_ASCII;
     free(allocated_str);
     return ret;
 }
@@ -6532,34 +10429,27 @@ StradaValue* strada_base64_encode(StradaValue *sv) {
 StradaValue* strada_base64_decode(StradaValue *sv) {
     if (!sv) return strada_new_str("");
 
-    const char *str = NULL;
-    char *to_free = NULL;
-
-    if (sv->type == STRADA_STR && sv->value.pv) {
-        str = sv->value.pv;
-    } else {
-        to_free = strada_to_str(sv);
-        str = to_free;
-    }
-
-    if (!str || !str[0]) {
-        if (to_free) free(to_free);
-        return strada_new_str("");
-    }
-
-    size_t len = strlen(str);
+    size_t len;
+    char *to_free;
+    const char *str = str_bytes(sv, &len, &to_free);
+    if (len < 4) {
+        free(to_free);
+        return strada_new_str("");
+    }
 
     /* Remove padding from length calculation */
     size_t pad = 0;
-    if (len >= 1 && str[len - 1] == '=') pad++;
-    if (len >= 2 && str[len - 2] == '=') pad++;
+    if (str[len - 1] == '=') pad++;
+    if (str[len - 2] == '=') pad++;
 
-    /* Output length: 3 bytes for every 4 chars, minus padding */
+    /* Output length: 3 bytes for every 4 chars, minus padding. The
+     * vector kernel may store up to 16 bytes past what it decodes. */
     size_t out_len = (len / 4) * 3 - pad;
-    unsigned char *result = malloc(out_len + 1);
+    unsigned char *result = malloc(out_len + 17);
 
-    size_t i, j;
-    for (i = 0, j = 0; i + 3 < len; i += 4) {
+    size_t i = strada_kernels.b64_decode(result, str, len, out_len);
+    size_t j = i / 4 * 3;
+    for (; i + 3 < len; i += 4) {
         /* Get 4 input characters, decode each */
         int8_t sextet_a = base64_decode_table[(unsigned char)str[i]];
         int8_t sextet_b = base64_decode_table[(unsigned char)str[i + 1]];
@@ -6583,10 +10473,26 @@ StradaValue* strada_base64_decode(StradaValue *sv) {
     }
 
     result[out_len] = '\0';
-    StradaValue *ret = strada_new_str_len((char *)result, out_len);
-    free(result);
-    if (to_free) free(to_free);
-    return ret;
+    free(to_free);
+    return strada_new_str_take_len((char *)result, out_len, out_len + 17);
+}
+
+/* FNV-1a 64-bit digest of a string's bytes as 16 hex digits. Stable
+ * across runs and machines (unlike the seeded hash tables), for cache
+ * keys; not a cryptographic hash. */
+StradaValue* strada_fnv1a(StradaValue *sv) {
+    size_t len = 0;
+    char *allocated_str = NULL;
+    const unsigned char *data = sv ? (const unsigned char *)str_bytes(sv, &len, &allocated_str) : NULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    free(allocated_str);
+    char out[17];
+    snprintf(out, sizeof(out), "%016llx", (unsigned long long)h);
+    return strada_new_str(out);
 }
 
 char* strada_chomp(const char *str) {
@@ -6603,191 +10509,1729 @@ char* strada_chomp(const char *str) {
     } else if (str[len - 1] == '\r') {
         len--;
     }
-    
-    char *result = malloc(len + 1);
-    memcpy(result, str, len);
-    result[len] = '\0';
-    
-    return result;
+    
+    char *result = malloc(len + 1);
+    memcpy(result, str, len);
+    result[len] = '\0';
+    
+    return result;
+}
+
+char* strada_chop(const char *str) {
+    if (!str) return strdup("");
+    
+    size_t len = strlen(str);
+    if (len == 0) return strdup("");
+    
+    len--;
+    char *result = malloc(len + 1);
+    memcpy(result, str, len);
+    result[len] = '\0';
+    
+    return result;
+}
+
+int strada_strcmp(const char *s1, const char *s2) {
+    if (!s1 && !s2) return 0;
+    if (!s1) return -1;
+    if (!s2) return 1;
+    return strcmp(s1, s2);
+}
+
+int strada_strncmp(const char *s1, const char *s2, int n) {
+    if (!s1 && !s2) return 0;
+    if (!s1) return -1;
+    if (!s2) return 1;
+    return strncmp(s1, s2, n);
+}
+
+char* strada_join(const char *sep, StradaArray *arr) {
+    size_t len;
+    if (!sep) sep = "";
+    return str_join(sep, strlen(sep), arr, &len);
+}
+
+/* ===== STRING BUILDER ===== */
+/* Efficient string building with O(1) amortized append */
+
+#define SB_INITIAL_CAPACITY 1024
+
+StradaValue* strada_sb_new(void) {
+    StradaStringBuilder *sb = malloc(sizeof(StradaStringBuilder));
+    sb->capacity = SB_INITIAL_CAPACITY;
+    sb->length = 0;
+    sb->buffer = malloc(sb->capacity);
+    sb->buffer[0] = '\0';
+
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
+    sv->type = STRADA_CPOINTER;
+    sv->refcount = 1;
+    sv->value.ptr = sb;
+    sv->struct_name = "StringBuilder";
+    sv->struct_size = sizeof(StradaStringBuilder);
+    sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
+    return sv;
+}
+
+StradaValue* strada_sb_new_cap(StradaValue *capacity) {
+    size_t cap = (size_t)strada_to_int(capacity);
+    if (cap < 64) cap = 64;
+
+    StradaStringBuilder *sb = malloc(sizeof(StradaStringBuilder));
+    sb->capacity = cap;
+    sb->length = 0;
+    sb->buffer = malloc(sb->capacity);
+    sb->buffer[0] = '\0';
+
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
+    sv->type = STRADA_CPOINTER;
+    sv->refcount = 1;
+    sv->value.ptr = sb;
+    sv->struct_name = "StringBuilder";
+    sv->struct_size = sizeof(StradaStringBuilder);
+    sv->blessed_package = NULL;
+    strada_memprof_alloc(sv);
+    return sv;
+}
+
+void strada_sb_append(StradaValue *sb_val, StradaValue *str_val) {
+    if (!sb_val || sb_val->type != STRADA_CPOINTER) return;
+    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
+    if (!sb) return;
+
+    char *str = strada_to_str(str_val);
+    size_t len = strlen(str);
+
+    /* Grow buffer if needed (double capacity) */
+    while (sb->length + len + 1 > sb->capacity) {
+        sb->capacity *= 2;
+        sb->buffer = realloc(sb->buffer, sb->capacity);
+    }
+
+    memcpy(sb->buffer + sb->length, str, len);
+    sb->length += len;
+    sb->buffer[sb->length] = '\0';
+    free(str);
+}
+
+void strada_sb_append_str(StradaValue *sb_val, const char *str) {
+    if (!sb_val || sb_val->type != STRADA_CPOINTER || !str) return;
+    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
+    if (!sb) return;
+
+    size_t len = strlen(str);
+
+    /* Grow buffer if needed (double capacity) */
+    while (sb->length + len + 1 > sb->capacity) {
+        sb->capacity *= 2;
+        sb->buffer = realloc(sb->buffer, sb->capacity);
+    }
+
+    memcpy(sb->buffer + sb->length, str, len);
+    sb->length += len;
+    sb->buffer[sb->length] = '\0';
+}
+
+StradaValue* strada_sb_to_string(StradaValue *sb_val) {
+    if (!sb_val || sb_val->type != STRADA_CPOINTER) return strada_new_str("");
+    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
+    if (!sb) return strada_new_str("");
+
+    return strada_new_str(sb->buffer);
+}
+
+StradaValue* strada_sb_length(StradaValue *sb_val) {
+    if (!sb_val || sb_val->type != STRADA_CPOINTER) return strada_new_int(0);
+    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
+    if (!sb) return strada_new_int(0);
+
+    return strada_new_int(sb->length);
+}
+
+void strada_sb_clear(StradaValue *sb_val) {
+    if (!sb_val || sb_val->type != STRADA_CPOINTER) return;
+    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
+    if (!sb) return;
+
+    sb->length = 0;
+    sb->buffer[0] = '\0';
+}
+
+void strada_sb_free(StradaValue *sb_val) {
+    if (!sb_val || sb_val->type != STRADA_CPOINTER) return;
+    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
+    if (sb) {
+        free(sb->buffer);
+        free(sb);
+    }
+    sb_val->value.ptr = NULL;
+}
+
+/* ===== JSON ===== */
+/* Native JSON engine behind lib/JSON.strada. The decoder is a one-pass
+ * recursive descent parser that builds hashes and arrays directly; string
+ * bodies and encoder output are scanned 16 bytes at a time for the bytes
+ * that need attention (quote, backslash, control characters). */
+
+#define STRADA_JSON_MAX_DEPTH 512
+
+static __thread char strada_json_errbuf[160];
+
+/* Offset of the first '"', '\\' or control byte in s[0..n), or n */
+static size_t strada_json_scan_plain(const char *s, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+#elif defined(STRADA_NEON_KERNELS)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t bslash = vdupq_n_u8('\\');
+    const uint8x16_t ctl = vdupq_n_u8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(s + i));
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)), vcleq_u8(v, ctl));
+        if (vmaxvq_u8(m)) break;
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\' || c < 0x20) return i;
+    }
+    return n;
+}
+
+typedef struct {
+    const char *p;
+    const char *start;
+    const char *end;
+    int depth;
+    int failed;
+    StradaValue *events;            /* Event callback, or NULL to build values */
+    StradaValue * volatile pending; /* Value being handed to the callback */
+    char *scratch;                  /* Buffer for strings with escapes */
+    size_t scratch_cap;
+} StradaJsonParser;
+
+static void strada_json_fail(StradaJsonParser *jp, const char *what) {
+    if (jp->failed) return;
+    jp->failed = 1;
+    size_t off = (size_t)(jp->p - jp->start);
+    if (jp->p < jp->end) {
+        unsigned char c = (unsigned char)*jp->p;
+        if (c >= 0x20 && c < 0x7f) {
+            snprintf(strada_json_errbuf, sizeof(strada_json_errbuf),
+                     "%s at offset %zu near '%c'", what, off, c);
+            return;
+        }
+    }
+    snprintf(strada_json_errbuf, sizeof(strada_json_errbuf), "%s at offset %zu", what, off);
+}
+
+static inline void strada_json_skip_ws(StradaJsonParser *jp) {
+    const char *p = jp->p;
+    while (p < jp->end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    jp->p = p;
+}
+
+static int strada_json_hex4(const char *p, unsigned *out) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (unsigned)(c - 'A' + 10);
+        else return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+static size_t strada_json_put_utf8(char *dst, unsigned cp) {
+    if (cp < 0x80) { dst[0] = (char)cp; return 1; }
+    if (cp < 0x800) {
+        dst[0] = (char)(0xC0 | (cp >> 6));
+        dst[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        dst[0] = (char)(0xE0 | (cp >> 12));
+        dst[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        dst[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    dst[0] = (char)(0xF0 | (cp >> 18));
+    dst[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    dst[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    dst[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/* Parse the string at jp->p (on the opening quote). Returns its bytes and
+ * length; the bytes point into the input when there are no escapes and
+ * into jp->scratch otherwise. NULL on error. */
+static const char* strada_json_string(StradaJsonParser *jp, size_t *len_out) {
+    const char *p = jp->p + 1;
+    const char *end = jp->end;
+    size_t run = strada_json_scan_plain(p, (size_t)(end - p));
+    if (p + run < end && p[run] == '"') {
+        jp->p = p + run + 1;
+        *len_out = run;
+        return p;
+    }
+
+    /* Escapes: decode into scratch. The result is never longer than the
+     * remaining input. */
+    size_t need = (size_t)(end - p) + 1;
+    if (jp->scratch_cap < need) {
+        char *grown = realloc(jp->scratch, need);
+        if (!grown) { strada_json_fail(jp, "out of memory"); return NULL; }
+        jp->scratch = grown;
+        jp->scratch_cap = need;
+    }
+    char *out = jp->scratch;
+    size_t n = 0;
+    memcpy(out, p, run);
+    n = run;
+    p += run;
+    while (p < end) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"') {
+            jp->p = p + 1;
+            *len_out = n;
+            return out;
+        }
+        if (c < 0x20) {
+            jp->p = p;
+            strada_json_fail(jp, "control character in string");
+            return NULL;
+        }
+        if (c != '\\') {
+            size_t more = strada_json_scan_plain(p, (size_t)(end - p));
+            memcpy(out + n, p, more);
+            n += more;
+            p += more;
+            continue;
+        }
+        if (p + 1 >= end) break;
+        char e = p[1];
+        p += 2;
+        switch (e) {
+            case '"': out[n++] = '"'; break;
+            case '\\': out[n++] = '\\'; break;
+            case '/': out[n++] = '/'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'n': out[n++] = '\n'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (p + 4 > end || !strada_json_hex4(p, &cp)) {
+                    jp->p = p - 2;
+                    strada_json_fail(jp, "bad \\u escape");
+                    return NULL;
+                }
+                p += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && p + 6 <= end && p[0] == '\\' && p[1] == 'u') {
+                    unsigned lo;
+                    if (strada_json_hex4(p + 2, &lo) && lo >= 0xDC00 && lo < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        p += 6;
+                    }
+                }
+                /* \uXXXX is 6 input bytes and at most 3 output bytes; a
+                 * surrogate pair is 12 input bytes and 4 output bytes */
+                n += strada_json_put_utf8(out + n, cp);
+                break;
+            }
+            default:
+                jp->p = p - 2;
+                strada_json_fail(jp, "bad escape");
+                return NULL;
+        }
+    }
+    jp->p = end;
+    strada_json_fail(jp, "unterminated string");
+    return NULL;
+}
+
+static StradaValue* strada_json_number(StradaJsonParser *jp) {
+    const char *p = jp->p;
+    const char *end = jp->end;
+    const char *start = p;
+    int neg = 0, is_float = 0;
+    if (p < end && *p == '-') { neg = 1; p++; }
+    if (p >= end || *p < '0' || *p > '9') { jp->p = p; strada_json_fail(jp, "bad number"); return NULL; }
+    const char *digits = p;
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    size_t ndigits = (size_t)(p - digits);
+    if (p < end && *p == '.') {
+        is_float = 1;
+        p++;
+        if (p >= end || *p < '0' || *p > '9') { jp->p = p; strada_json_fail(jp, "bad number"); return NULL; }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        is_float = 1;
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p >= end || *p < '0' || *p > '9') { jp->p = p; strada_json_fail(jp, "bad number"); return NULL; }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    jp->p = p;
+    if (!is_float && ndigits <= 18) {
+        int64_t v = 0;
+        for (const char *d = digits; d < digits + ndigits; d++) v = v * 10 + (*d - '0');
+        return strada_new_int(neg ? -v : v);
+    }
+    /* strtod needs a terminated copy of exactly the validated text */
+    char small[64];
+    size_t n = (size_t)(p - start);
+    char *buf = n < sizeof(small) ? small : malloc(n + 1);
+    if (!buf) { strada_json_fail(jp, "out of memory"); return NULL; }
+    memcpy(buf, start, n);
+    buf[n] = '\0';
+    double d = strtod(buf, NULL);
+    if (buf != small) free(buf);
+    return strada_new_num(d);
+}
+
+/* Hand an event to the callback set for event mode */
+static void strada_json_emit(StradaJsonParser *jp, const char *event, StradaValue *value) {
+    StradaValue *ev = strada_new_str(event);
+    jp->pending = value;
+    StradaValue *r = strada_closure_call2(jp->events, ev, value ? value : strada_undef_static());
+    jp->pending = NULL;
+    if (r) strada_decref(r);
+    strada_decref(ev);
+    if (value) strada_decref(value);
+}
+
+static StradaValue* strada_json_value(StradaJsonParser *jp);
+
+static StradaValue* strada_json_array(StradaJsonParser *jp) {
+    StradaValue *arr = jp->events ? NULL : strada_new_array();
+    if (jp->events) strada_json_emit(jp, "start_array", NULL);
+    jp->p++;
+    strada_json_skip_ws(jp);
+    if (jp->p < jp->end && *jp->p == ']') {
+        jp->p++;
+    } else {
+        for (;;) {
+            StradaValue *v = strada_json_value(jp);
+            if (jp->failed) break;
+            if (arr) strada_array_push_take(arr->value.av, v);
+            strada_json_skip_ws(jp);
+            if (jp->p < jp->end && *jp->p == ',') {
+                jp->p++;
+                continue;
+            }
+            if (jp->p < jp->end && *jp->p == ']') {
+                jp->p++;
+                break;
+            }
+            strada_json_fail(jp, "expected ',' or ']'");
+            break;
+        }
+    }
+    if (jp->failed) {
+        if (arr) strada_decref(arr);
+        return NULL;
+    }
+    if (jp->events) {
+        strada_json_emit(jp, "end_array", NULL);
+        return NULL;
+    }
+    return strada_ref_create_take(arr);
+}
+
+static StradaValue* strada_json_object(StradaJsonParser *jp) {
+    StradaValue *obj = jp->events ? NULL : strada_new_hash();
+    if (jp->events) strada_json_emit(jp, "start_object", NULL);
+    jp->p++;
+    strada_json_skip_ws(jp);
+    if (jp->p < jp->end && *jp->p == '}') {
+        jp->p++;
+    } else {
+        for (;;) {
+            strada_json_skip_ws(jp);
+            if (jp->p >= jp->end || *jp->p != '"') {
+                strada_json_fail(jp, "expected string key");
+                break;
+            }
+            size_t klen;
+            const char *key = strada_json_string(jp, &klen);
+            if (!key) break;
+            /* The key may live in scratch, which the value can reuse */
+            char kbuf[128];
+            char *kcopy = klen < sizeof(kbuf) ? kbuf : malloc(klen + 1);
+            if (!kcopy) { strada_json_fail(jp, "out of memory"); break; }
+            memcpy(kcopy, key, klen);
+            kcopy[klen] = '\0';
+            if (jp->events) strada_json_emit(jp, "key", strada_new_str_len(kcopy, klen));
+            strada_json_skip_ws(jp);
+            if (jp->p >= jp->end || *jp->p != ':') {
+                if (kcopy != kbuf) free(kcopy);
+                strada_json_fail(jp, "expected ':'");
+                break;
+            }
+            jp->p++;
+            StradaValue *v = strada_json_value(jp);
+            if (!jp->failed && obj) {
+                strada_hash_store(obj->value.hv, kcopy, klen, strada_hash_key(kcopy, klen), NULL, v);
+                strada_decref(v);
+            }
+            if (kcopy != kbuf) free(kcopy);
+            if (jp->failed) break;
+            strada_json_skip_ws(jp);
+            if (jp->p < jp->end && *jp->p == ',') {
+                jp->p++;
+                continue;
+            }
+            if (jp->p < jp->end && *jp->p == '}') {
+                jp->p++;
+                break;
+            }
+            strada_json_fail(jp, "expected ',' or '}'");
+            break;
+        }
+    }
+    if (jp->failed) {
+        if (obj) strada_decref(obj);
+        return NULL;
+    }
+    if (jp->events) {
+        strada_json_emit(jp, "end_object", NULL);
+        return NULL;
+    }
+    return strada_ref_create_take(obj);
+}
+
+/* Parse one value. Returns a new reference (NULL in event mode or on
+ * error; check jp->failed). */
+static StradaValue* strada_json_value(StradaJsonParser *jp) {
+    strada_json_skip_ws(jp);
+    if (jp->p >= jp->end) {
+        strada_json_fail(jp, "unexpected end of input");
+        return NULL;
+    }
+    StradaValue *v = NULL;
+    const char *p = jp->p;
+    size_t left = (size_t)(jp->end - p);
+    switch (*p) {
+        case '{':
+        case '[':
+            if (++jp->depth > STRADA_JSON_MAX_DEPTH) {
+                strada_json_fail(jp, "nesting too deep");
+                return NULL;
+            }
+            v = *p == '{' ? strada_json_object(jp) : strada_json_array(jp);
+            jp->depth--;
+            return v;
+        case '"': {
+            size_t len;
+            const char *s = strada_json_string(jp, &len);
+            if (!s) return NULL;
+            v = strada_new_str_len(s, len);
+            break;
+        }
+        case 't':
+            if (left < 4 || memcmp(p, "true", 4) != 0) goto bad;
+            jp->p += 4;
+            v = strada_new_int(1);
+            break;
+        case 'f':
+            if (left < 5 || memcmp(p, "false", 5) != 0) goto bad;
+            jp->p += 5;
+            v = strada_new_int(0);
+            break;
+        case 'n':
+            if (left < 4 || memcmp(p, "null", 4) != 0) goto bad;
+            jp->p += 4;
+            v = strada_new_undef();
+            break;
+        default:
+            if (*p == '-' || (*p >= '0' && *p <= '9')) {
+                v = strada_json_number(jp);
+                if (!v) return NULL;
+                break;
+            }
+            goto bad;
+    }
+    if (jp->events) {
+        strada_json_emit(jp, "value", v);
+        return NULL;
+    }
+    return v;
+bad:
+    strada_json_fail(jp, "unexpected character");
+    return NULL;
+}
+
+static void strada_json_init(StradaJsonParser *jp, const char *text, size_t len, StradaValue *events) {
+    jp->p = text;
+    jp->start = text;
+    jp->end = text + len;
+    jp->depth = 0;
+    jp->failed = 0;
+    jp->events = events;
+    jp->pending = NULL;
+    jp->scratch = NULL;
+    jp->scratch_cap = 0;
+}
+
+/* Parse a whole document: one value and nothing but whitespace after it */
+static StradaValue* strada_json_document(StradaJsonParser *jp) {
+    StradaValue *v = strada_json_value(jp);
+    if (!jp->failed) {
+        strada_json_skip_ws(jp);
+        if (jp->p < jp->end) strada_json_fail(jp, "unexpected text after JSON value");
+    }
+    if (jp->failed && v) {
+        strada_decref(v);
+        v = NULL;
+    }
+    return v;
+}
+
+static const char* strada_json_text(StradaValue *text, size_t *len, char **tmp) {
+    const char *s = strada_str_peek(text, tmp);
+    *len = text && text->type == STRADA_STR ? strada_str_len(text) : strlen(s);
+    return s;
+}
+
+StradaValue* strada_json_decode(StradaValue *text) {
+    char *tmp = NULL;
+    size_t len;
+    const char *s = strada_json_text(text, &len, &tmp);
+    StradaJsonParser jp;
+    strada_json_init(&jp, s, len, NULL);
+    strada_json_errbuf[0] = '\0';
+    StradaValue *v = strada_json_document(&jp);
+    free(jp.scratch);
+    free(tmp);
+    return v ? v : strada_new_undef();
+}
+
+const char* strada_json_error(void) {
+    return strada_json_errbuf;
+}
+
+/* Event (SAX) mode: callback($event, $value) for start_object, end_object,
+ * start_array, end_array, key and value. Returns 1 if the document was
+ * valid. An exception from the callback stops the parse and propagates. */
+int strada_json_parse_events(StradaValue *text, StradaValue *callback) {
+    char * volatile tmp = NULL;
+    size_t len;
+    const char *s = strada_json_text(text, &len, (char **)&tmp);
+    StradaJsonParser jp;
+    strada_json_init(&jp, s, len, callback);
+    strada_json_errbuf[0] = '\0';
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        strada_json_document(&jp);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        if (jp.pending) strada_decref(jp.pending);
+        free(jp.scratch);
+        free(tmp);
+        strada_throw_value(strada_get_exception());
+    }
+    free(jp.scratch);
+    free(tmp);
+    return !jp.failed;
+}
+
+/* Newline-delimited JSON: decode each non-blank line and pass the value to
+ * callback. Returns the number of documents; throws on an invalid line. */
+static int64_t strada_json_each_text(const char *s, size_t len, StradaValue *callback) {
+    StradaJsonParser jp;
+    volatile int64_t count = 0;
+    StradaValue * volatile doc = NULL;
+    char * volatile scratch = NULL;
+    volatile size_t scratch_cap = 0;
+    strada_json_errbuf[0] = '\0';
+
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        const char *end = s + len;
+        const char *line = s;
+        int64_t lineno = 0;
+        while (line < end) {
+            const char *nl = memchr(line, '\n', (size_t)(end - line));
+            const char *stop = nl ? nl : end;
+            lineno++;
+            const char *q = line;
+            while (q < stop && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+            if (q < stop) {
+                strada_json_init(&jp, line, (size_t)(stop - line), NULL);
+                jp.scratch = scratch;
+                jp.scratch_cap = scratch_cap;
+                doc = strada_json_document(&jp);
+                scratch = jp.scratch;
+                scratch_cap = jp.scratch_cap;
+                if (!doc) {
+                    char msg[256];
+                    snprintf(msg, sizeof(msg), "JSON::decode_each: line %lld: %s",
+                             (long long)lineno, strada_json_errbuf);
+                    strada_throw(msg);
+                }
+                StradaValue *r = strada_closure_call1(callback, doc);
+                if (r) strada_decref(r);
+                strada_decref(doc);
+                doc = NULL;
+                count++;
+            }
+            line = nl ? nl + 1 : end;
+        }
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        if (doc) strada_decref(doc);
+        free(scratch);
+        strada_throw_value(strada_get_exception());
+    }
+    free(scratch);
+    return count;
+}
+
+int64_t strada_json_decode_each(StradaValue *text, StradaValue *callback) {
+    char *text_copy = NULL;
+    size_t len;
+    const char *s = strada_json_text(text, &len, &text_copy);
+    char * volatile tmp = text_copy;
+    if (!tmp) {
+        /* Hold the string in case the callback releases the caller's copy */
+        strada_incref(text);
+    }
+    volatile int64_t n = 0;
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        n = strada_json_each_text(s, len, callback);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        if (tmp) free(tmp); else strada_decref(text);
+        strada_throw_value(strada_get_exception());
+    }
+    if (tmp) free(tmp); else strada_decref(text);
+    return n;
+}
+
+/* NDJSON from a file, read through a mapping when possible. -1 if the
+ * file cannot be read. */
+int64_t strada_json_each_file(const char *path, StradaValue *callback) {
+    StradaValue *src = strada_map_file(path, MADV_SEQUENTIAL);
+    if (!src) {
+        src = strada_slurp(path);
+        if (!src || src->type != STRADA_STR) {
+            if (src) strada_decref(src);
+            return -1;
+        }
+    }
+    StradaValue * volatile held = src;
+    volatile int64_t n = 0;
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        n = strada_json_each_text(src->value.pv, strada_str_len(src), callback);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        strada_decref(held);
+        strada_throw_value(strada_get_exception());
+    }
+    strada_decref(src);
+    return n;
+}
+
+/* Encoder output buffer */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} StradaJsonOut;
+
+static void strada_json_grow(StradaJsonOut *o, size_t more) {
+    size_t need = o->len + more + 1;
+    if (need <= o->cap) return;
+    size_t cap = o->cap ? o->cap : 256;
+    while (cap < need) cap *= 2;
+    char *grown = realloc(o->buf, cap);
+    if (!grown) {
+        fprintf(stderr, "Out of memory in JSON::encode\n");
+        exit(1);
+    }
+    o->buf = grown;
+    o->cap = cap;
+}
+
+static inline void strada_json_put(StradaJsonOut *o, const char *s, size_t n) {
+    strada_json_grow(o, n);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static inline void strada_json_putc(StradaJsonOut *o, char c) {
+    strada_json_grow(o, 1);
+    o->buf[o->len++] = c;
+}
+
+static void strada_json_put_string(StradaJsonOut *o, const char *s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    strada_json_grow(o, n + 2);
+    o->buf[o->len++] = '"';
+    size_t i = 0;
+    while (i < n) {
+        size_t run = strada_json_scan_plain(s + i, n - i);
+        if (run) {
+            strada_json_put(o, s + i, run);
+            i += run;
+            if (i >= n) break;
+        }
+        unsigned char c = (unsigned char)s[i++];
+        char esc[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t elen = 2;
+        switch (c) {
+            case '"': esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            default:
+                esc[1] = 'u'; esc[2] = '0'; esc[3] = '0';
+                esc[4] = hex[c >> 4]; esc[5] = hex[c & 15];
+                elen = 6;
+        }
+        strada_json_put(o, esc, elen);
+    }
+    strada_json_putc(o, '"');
+}
+
+/* Whether s is a JSON number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? */
+static int strada_json_is_number(const char *s, size_t n) {
+    size_t i = 0;
+    if (i < n && s[i] == '-') i++;
+    if (i >= n) return 0;
+    if (s[i] == '0') {
+        i++;
+    } else if (s[i] >= '1' && s[i] <= '9') {
+        while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+    } else {
+        return 0;
+    }
+    if (i < n && s[i] == '.') {
+        i++;
+        if (i >= n || s[i] < '0' || s[i] > '9') return 0;
+        while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) i++;
+        if (i >= n || s[i] < '0' || s[i] > '9') return 0;
+        while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+    }
+    return i == n;
+}
+
+static int strada_json_key_cmp(const void *a, const void *b) {
+    const StradaHashEntry *x = *(const StradaHashEntry * const *)a;
+    const StradaHashEntry *y = *(const StradaHashEntry * const *)b;
+    size_t n = x->key_len < y->key_len ? x->key_len : y->key_len;
+    int c = memcmp(x->key, y->key, n);
+    if (c) return c;
+    return x->key_len < y->key_len ? -1 : x->key_len > y->key_len;
+}
+
+typedef struct {
+    StradaJsonOut out;
+    int canonical;
+    int depth;
+    const void *open[STRADA_JSON_MAX_DEPTH];   /* Containers being encoded */
+} StradaJsonEncoder;
+
+static void strada_json_encode_value(StradaJsonEncoder *en, StradaValue *v) {
+    StradaJsonOut *o = &en->out;
+    if (!v || v->type == STRADA_UNDEF) {
+        strada_json_put(o, "null", 4);
+        return;
+    }
+    /* References to references encode their target */
+    while (v->type == STRADA_REF && v->value.rv && v->value.rv->type == STRADA_REF) {
+        v = v->value.rv;
+    }
+    StradaValue *target = v->type == STRADA_REF ? v->value.rv : v;
+    if (target && (target->type == STRADA_HASH || target->type == STRADA_ARRAY)) {
+        const void *c = target->type == STRADA_HASH ? (const void *)target->value.hv
+                                                    : (const void *)target->value.av;
+        int cyclic = 0;
+        for (int i = 0; i < en->depth; i++) {
+            if (en->open[i] == c) { cyclic = 1; break; }
+        }
+        if (cyclic || en->depth >= STRADA_JSON_MAX_DEPTH) {
+            strada_json_put(o, "null", 4);
+            return;
+        }
+        en->open[en->depth++] = c;
+        if (target->type == STRADA_ARRAY) {
+            StradaArray *av = target->value.av;
+            strada_json_putc(o, '[');
+            for (size_t i = 0; i < av->size; i++) {
+                if (i) strada_json_putc(o, ',');
+                strada_json_encode_value(en, av->elements[i]);
+            }
+            strada_json_putc(o, ']');
+        } else {
+            StradaHash *hv = target->value.hv;
+            strada_json_putc(o, '{');
+            size_t n = 0;
+            if (en->canonical && hv->num_entries > 1) {
+                StradaHashEntry **sorted = malloc(sizeof(StradaHashEntry *) * hv->num_entries);
+                for (size_t i = 0; i < hv->num_buckets; i++) {
+                    if (hv->entries[i].key) sorted[n++] = &hv->entries[i];
+                }
+                qsort(sorted, n, sizeof(StradaHashEntry *), strada_json_key_cmp);
+                for (size_t i = 0; i < n; i++) {
+                    if (i) strada_json_putc(o, ',');
+                    strada_json_put_string(o, sorted[i]->key, sorted[i]->key_len);
+                    strada_json_putc(o, ':');
+                    strada_json_encode_value(en, sorted[i]->value);
+                }
+                free(sorted);
+            } else {
+                for (size_t i = 0; i < hv->num_buckets; i++) {
+                    StradaHashEntry *e = &hv->entries[i];
+                    if (!e->key) continue;
+                    if (n++) strada_json_putc(o, ',');
+                    strada_json_put_string(o, e->key, e->key_len);
+                    strada_json_putc(o, ':');
+                    strada_json_encode_value(en, e->value);
+                }
+            }
+            strada_json_putc(o, '}');
+        }
+        en->depth--;
+        return;
+    }
+    if (v->type == STRADA_REF) {
+        strada_json_encode_value(en, target);
+        return;
+    }
+
+    char num[40];
+    switch (v->type) {
+        case STRADA_INT: {
+            int n = snprintf(num, sizeof(num), "%lld", (long long)v->value.iv);
+            strada_json_put(o, num, (size_t)n);
+            return;
+        }
+        case STRADA_NUM: {
+            double d = v->value.nv;
+            if (isnan(d) || isinf(d)) {
+                strada_json_put(o, "null", 4);
+                return;
+            }
+            /* Shortest of %.15g/%.17g that reads back as the same double */
+            int n = snprintf(num, sizeof(num), "%.15g", d);
+            if (strtod(num, NULL) != d) n = snprintf(num, sizeof(num), "%.17g", d);
+            strada_json_put(o, num, (size_t)n);
+            return;
+        }
+        case STRADA_STR: {
+            const char *s = v->value.pv ? v->value.pv : "";
+            size_t n = strada_str_len(v);
+            /* Strings that read as numbers are written as numbers */
+            if (strada_json_is_number(s, n)) strada_json_put(o, s, n);
+            else strada_json_put_string(o, s, n);
+            return;
+        }
+        default: {
+            char *s = strada_to_str(v);
+            strada_json_put_string(o, s, strlen(s));
+            free(s);
+            return;
+        }
+    }
+}
+
+StradaValue* strada_json_encode(StradaValue *value, int canonical) {
+    StradaJsonEncoder *en = malloc(sizeof(StradaJsonEncoder));
+    en->out.buf = NULL;
+    en->out.len = 0;
+    en->out.cap = 0;
+    en->canonical = canonical;
+    en->depth = 0;
+    strada_json_encode_value(en, value);
+    strada_json_grow(&en->out, 0);
+    en->out.buf[en->out.len] = '\0';
+    StradaValue *result = strada_new_str_take_len(en->out.buf, en->out.len, en->out.cap);
+    free(en);
+    return result;
+}
+
+/* ===== CSV ===== */
+/* Record parser behind lib/Text/CSV.strada. Outside quotes only the
+ * separator, the quote and (in files) the newline need a look; inside
+ * quotes only the quote and the escape do. Those bytes are found 16 at a
+ * time, and fields without quotes are copied straight from the input. */
+
+#define STRADA_CSV_TOKEN_MAX 15
+#define STRADA_CSV_CHUNK_MIN (1 << 20)
+
+typedef struct {
+    char sep[STRADA_CSV_TOKEN_MAX + 1];
+    char quote[STRADA_CSV_TOKEN_MAX + 1];
+    char escape[STRADA_CSV_TOKEN_MAX + 1];
+    size_t sep_len, quote_len, escape_len;
+    int doubled;                    /* escape == quote: "" inside quotes is a quote */
+    unsigned char plain[3];         /* First bytes to stop at outside quotes */
+    unsigned char quoted[2];        /* ... and inside */
+    int nplain, nquoted;            /* nplain counts the newline, used by records only */
+} StradaCsvFormat;
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} StradaCsvBuf;
+
+static void strada_csv_put(StradaCsvBuf *b, const char *s, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + n) cap *= 2;
+        char *grown = realloc(b->buf, cap);
+        if (!grown) {
+            fprintf(stderr, "Out of memory in Text::CSV\n");
+            exit(1);
+        }
+        b->buf = grown;
+        b->cap = cap;
+    }
+    memcpy(b->buf + b->len, s, n);
+    b->len += n;
+}
+
+/* Offset of the first byte of s[0..n) that is one of stop[0..count), or n */
+static size_t strada_csv_scan(const char *s, size_t n, const unsigned char *stop, int count) {
+    if (count == 0) return n;
+    unsigned char a = stop[0];
+    unsigned char b = count > 1 ? stop[1] : a;
+    unsigned char c = count > 2 ? stop[2] : a;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8((char)a);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    const __m128i vc = _mm_set1_epi8((char)c);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                                 _mm_cmpeq_epi8(v, vc));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+#elif defined(STRADA_NEON_KERNELS)
+    const uint8x16_t va = vdupq_n_u8(a);
+    const uint8x16_t vb = vdupq_n_u8(b);
+    const uint8x16_t vc = vdupq_n_u8(c);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t *)(s + i));
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, va), vceqq_u8(v, vb)), vceqq_u8(v, vc));
+        if (vmaxvq_u8(m)) break;
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned char x = (unsigned char)s[i];
+        if (x == a || x == b || x == c) return i;
+    }
+    return n;
 }
 
-char* strada_chop(const char *str) {
-    if (!str) return strdup("");
-    
-    size_t len = strlen(str);
-    if (len == 0) return strdup("");
-    
-    len--;
-    char *result = malloc(len + 1);
-    memcpy(result, str, len);
-    result[len] = '\0';
-    
-    return result;
+static int strada_csv_token(StradaHash *hv, const char *key, char *out, size_t *out_len) {
+    StradaValue *v = strada_hash_get(hv, key);
+    char *tmp;
+    size_t n;
+    const char *s = str_bytes(v, &n, &tmp);
+    if (v->type == STRADA_UNDEF) n = 0;
+    if (n > STRADA_CSV_TOKEN_MAX) {
+        free(tmp);
+        return 0;
+    }
+    memcpy(out, s, n);
+    out[n] = '\0';
+    *out_len = n;
+    free(tmp);
+    return 1;
 }
 
-int strada_strcmp(const char *s1, const char *s2) {
-    if (!s1 && !s2) return 0;
-    if (!s1) return -1;
-    if (!s2) return 1;
-    return strcmp(s1, s2);
+/* Read sep_char, quote_char and escape_char from a Text::CSV object.
+ * Throws if one is longer than STRADA_CSV_TOKEN_MAX bytes. */
+static void strada_csv_format(StradaValue *csv, StradaCsvFormat *fmt) {
+    StradaHash *hv = strada_deref_hash(csv);
+    memset(fmt, 0, sizeof(*fmt));
+    if (!hv) {
+        strada_throw("Text::CSV: not a Text::CSV object");
+        return;
+    }
+    if (!strada_csv_token(hv, "sep_char", fmt->sep, &fmt->sep_len) ||
+        !strada_csv_token(hv, "quote_char", fmt->quote, &fmt->quote_len) ||
+        !strada_csv_token(hv, "escape_char", fmt->escape, &fmt->escape_len)) {
+        strada_throw("Text::CSV: sep_char, quote_char and escape_char are limited to 15 bytes");
+        return;
+    }
+    fmt->doubled = fmt->escape_len == fmt->quote_len && memcmp(fmt->escape, fmt->quote, fmt->quote_len) == 0;
+    if (fmt->sep_len) fmt->plain[fmt->nplain++] = (unsigned char)fmt->sep[0];
+    if (fmt->quote_len) {
+        fmt->plain[fmt->nplain++] = (unsigned char)fmt->quote[0];
+        fmt->quoted[fmt->nquoted++] = (unsigned char)fmt->quote[0];
+    }
+    if (fmt->escape_len && !fmt->doubled) fmt->quoted[fmt->nquoted++] = (unsigned char)fmt->escape[0];
+    fmt->plain[fmt->nplain++] = '\n';
 }
 
-int strada_strncmp(const char *s1, const char *s2, int n) {
-    if (!s1 && !s2) return 0;
-    if (!s1) return -1;
-    if (!s2) return 1;
-    return strncmp(s1, s2, n);
+static inline int strada_csv_at(const char *s, size_t n, size_t i, const char *tok, size_t len) {
+    return len && len <= n - i && memcmp(s + i, tok, len) == 0;
 }
 
-char* strada_join(const char *sep, StradaArray *arr) {
-    if (!arr || arr->size == 0) return strdup("");
-    if (!sep) sep = "";
-    
-    size_t total_len = 0;
-    size_t sep_len = strlen(sep);
-    
-    for (size_t i = 0; i < arr->size; i++) {
-        char *str = strada_to_str(arr->elements[i]);
-        total_len += strlen(str);
-        free(str);
-        if (i < arr->size - 1) {
-            total_len += sep_len;
-        }
+/* Finish the field made of what is in fb followed by s[from..to) */
+static void strada_csv_field(StradaArray *row, StradaCsvBuf *fb, const char *s, size_t from, size_t to) {
+    if (fb->len == 0) {
+        strada_array_push_take(row, strada_new_str_len(s + from, to - from));
+        return;
     }
-    
-    char *result = malloc(total_len + 1);
-    char *ptr = result;
-    
-    for (size_t i = 0; i < arr->size; i++) {
-        char *str = strada_to_str(arr->elements[i]);
-        size_t len = strlen(str);
-        memcpy(ptr, str, len);
-        ptr += len;
-        free(str);
-        
-        if (i < arr->size - 1) {
-            memcpy(ptr, sep, sep_len);
-            ptr += sep_len;
+    strada_csv_put(fb, s + from, to - from);
+    strada_array_push_take(row, strada_new_str_len(fb->buf, fb->len));
+    fb->len = 0;
+}
+
+#define STRADA_CSV_OK 1
+#define STRADA_CSV_BAD_QUOTE 0
+#define STRADA_CSV_OPEN_QUOTE -1
+
+/* Parse one record from s[0..n) into row. With records set the record
+ * ends at the first newline outside quotes (a '\r' before it is dropped)
+ * and *used is set past that newline; otherwise all of s is one record.
+ * Returns STRADA_CSV_OK, STRADA_CSV_BAD_QUOTE (a quote in the middle of
+ * an unquoted field, at offset *err_at) or STRADA_CSV_OPEN_QUOTE (the
+ * input ended inside quotes). */
+static int strada_csv_record(const StradaCsvFormat *fmt, const char *s, size_t n, int records,
+                             StradaCsvBuf *fb, StradaArray *row, size_t *used, size_t *err_at) {
+    int nplain = records ? fmt->nplain : fmt->nplain - 1;
+    size_t pos = 0, run = 0, end = n;
+    fb->len = 0;
+    for (;;) {
+        /* Outside quotes: the current field is fb + s[run..pos) */
+        size_t j = pos + strada_csv_scan(s + pos, n - pos, fmt->plain, nplain);
+        if (j >= n) break;
+        if (strada_csv_at(s, n, j, fmt->sep, fmt->sep_len)) {
+            strada_csv_field(row, fb, s, run, j);
+            pos = run = j + fmt->sep_len;
+            continue;
+        }
+        if (strada_csv_at(s, n, j, fmt->quote, fmt->quote_len)) {
+            if (fb->len > 0 || j > run) {
+                *err_at = j;
+                return STRADA_CSV_BAD_QUOTE;
+            }
+            pos = run = j + fmt->quote_len;
+            for (;;) {
+                /* Inside quotes: the field is fb + s[run..pos) */
+                size_t k = pos + strada_csv_scan(s + pos, n - pos, fmt->quoted, fmt->nquoted);
+                if (k >= n) return STRADA_CSV_OPEN_QUOTE;
+                if (strada_csv_at(s, n, k, fmt->quote, fmt->quote_len)) {
+                    if (fmt->doubled && strada_csv_at(s, n, k + fmt->quote_len, fmt->quote, fmt->quote_len)) {
+                        strada_csv_put(fb, s + run, k + fmt->quote_len - run);
+                        pos = run = k + 2 * fmt->quote_len;
+                        continue;
+                    }
+                    strada_csv_put(fb, s + run, k - run);
+                    pos = run = k + fmt->quote_len;
+                    break;
+                }
+                if (!fmt->doubled && strada_csv_at(s, n, k, fmt->escape, fmt->escape_len)) {
+                    if (k + fmt->escape_len < n) {
+                        /* The byte after the escape is taken as is */
+                        strada_csv_put(fb, s + run, k - run);
+                        run = k + fmt->escape_len;
+                        pos = run + 1;
+                    } else {
+                        pos = n;
+                    }
+                    continue;
+                }
+                pos = k + 1;
+            }
+            continue;
+        }
+        if (records && s[j] == '\n') {
+            end = j;
+            break;
+        }
+        pos = j + 1;
+    }
+    *used = end < n ? end + 1 : n;
+    if (records && end > run && s[end - 1] == '\r') end--;
+    strada_csv_field(row, fb, s, run, end);
+    return STRADA_CSV_OK;
+}
+
+/* Offset just past the first record boundary at or after target, for a
+ * scan that starts at the record boundary from. Only quoting is tracked,
+ * so this runs at close to memchr speed; n if no boundary follows. */
+static size_t strada_csv_boundary(const StradaCsvFormat *fmt, const char *s, size_t n,
+                                  size_t from, size_t target) {
+    unsigned char quote_only[1];
+    int nquote = 0;
+    if (fmt->quote_len) quote_only[nquote++] = (unsigned char)fmt->quote[0];
+    unsigned char quote_nl[2] = { '\n', fmt->quote_len ? (unsigned char)fmt->quote[0] : '\n' };
+    size_t pos = from;
+    while (pos < n) {
+        size_t j = pos < target ? pos + strada_csv_scan(s + pos, target - pos, quote_only, nquote)
+                                : pos + strada_csv_scan(s + pos, n - pos, quote_nl, 2);
+        if (j >= n) return n;
+        if (pos < target && j == target) {
+            pos = target;
+            continue;
+        }
+        if (j >= target && s[j] == '\n') return j + 1;
+        if (!strada_csv_at(s, n, j, fmt->quote, fmt->quote_len)) {
+            pos = j + 1;
+            continue;
+        }
+        pos = j + fmt->quote_len;
+        for (;;) {
+            size_t k = pos + strada_csv_scan(s + pos, n - pos, fmt->quoted, fmt->nquoted);
+            if (k >= n) return n;
+            if (strada_csv_at(s, n, k, fmt->quote, fmt->quote_len)) {
+                if (fmt->doubled && strada_csv_at(s, n, k + fmt->quote_len, fmt->quote, fmt->quote_len)) {
+                    pos = k + 2 * fmt->quote_len;
+                    continue;
+                }
+                pos = k + fmt->quote_len;
+                break;
+            }
+            if (!fmt->doubled && strada_csv_at(s, n, k, fmt->escape, fmt->escape_len)) {
+                pos = k + fmt->escape_len + 1;
+                continue;
+            }
+            pos = k + 1;
         }
     }
-    
-    *ptr = '\0';
-    return result;
+    return n;
+}
+
+/* Store fields (taken) and error on the object, as Text::CSV::parse does */
+static void strada_csv_result(StradaValue *csv, StradaValue *fields, const char *error) {
+    StradaHash *hv = strada_deref_hash(csv);
+    StradaValue *err = strada_new_str(error);
+    strada_hash_set(hv, "error", err);
+    strada_hash_set(hv, "fields", fields);
+    strada_decref(err);
+    strada_decref(fields);
+}
+
+static const char *strada_csv_message(int status) {
+    return status == STRADA_CSV_BAD_QUOTE ? "Unexpected quote in field" : "Unmatched quote";
+}
+
+/* Text::CSV::parse: one line, with its line ending dropped. Fields or
+ * the error go on the object; returns 1 on success. */
+int strada_csv_parse(StradaValue *csv, StradaValue *line) {
+    StradaCsvFormat fmt;
+    strada_csv_format(csv, &fmt);
+    char *tmp;
+    size_t n;
+    const char *s = str_bytes(line, &n, &tmp);
+    if (n > 0 && s[n - 1] == '\n') n--;
+    if (n > 0 && s[n - 1] == '\r') n--;
+
+    StradaCsvBuf fb = { NULL, 0, 0 };
+    StradaValue *row = strada_new_array();
+    size_t used, err_at;
+    int status = strada_csv_record(&fmt, s, n, 0, &fb, row->value.av, &used, &err_at);
+    free(fb.buf);
+    free(tmp);
+    if (status != STRADA_CSV_OK) {
+        strada_decref(row);
+        strada_csv_result(csv, strada_ref_create_take(strada_new_array()), strada_csv_message(status));
+        return 0;
+    }
+    strada_csv_result(csv, strada_ref_create_take(row), "");
+    return 1;
 }
 
-/* ===== STRING BUILDER ===== */
-/* Efficient string building with O(1) amortized append */
-
-#define SB_INITIAL_CAPACITY 1024
+/* Next physical line of fh with its newline appended to rec; 0 at EOF */
+static int strada_csv_read_line(StradaValue *fh, StradaCsvBuf *rec, char **line, size_t *cap) {
+    if (fh && fh->type == STRADA_FILEHANDLE && fh->value.fh) {
+        ssize_t got = getline(line, cap, fh->value.fh);
+        if (got <= 0) return 0;
+        strada_csv_put(rec, *line, (size_t)got);
+        return 1;
+    }
+    if (fh && fh->type == STRADA_SOCKET && fh->value.sock) {
+        StradaValue *l = strada_socket_read_line(fh->value.sock);
+        if (!l) return 0;
+        strada_csv_put(rec, l->value.pv, strada_str_len(l));
+        strada_csv_put(rec, "\n", 1);
+        strada_decref(l);
+        return 1;
+    }
+    return 0;
+}
 
-StradaValue* strada_sb_new(void) {
-    StradaStringBuilder *sb = malloc(sizeof(StradaStringBuilder));
-    sb->capacity = SB_INITIAL_CAPACITY;
-    sb->length = 0;
-    sb->buffer = malloc(sb->capacity);
-    sb->buffer[0] = '\0';
+/* Text::CSV::getline: read whole lines until they make a complete record
+ * (quoted fields may span lines). Returns the fields, or undef at EOF or
+ * on a malformed record, with the error on the object. */
+StradaValue* strada_csv_getline(StradaValue *csv, StradaValue *fh) {
+    StradaCsvFormat fmt;
+    strada_csv_format(csv, &fmt);
+    StradaCsvBuf rec = { NULL, 0, 0 };
+    StradaCsvBuf fb = { NULL, 0, 0 };
+    char *line = NULL;
+    size_t cap = 0;
+    StradaValue *result = NULL;
+    int status = STRADA_CSV_OK;
+
+    while (strada_csv_read_line(fh, &rec, &line, &cap)) {
+        StradaValue *row = strada_new_array();
+        size_t used, err_at;
+        status = strada_csv_record(&fmt, rec.buf, rec.len, 1, &fb, row->value.av, &used, &err_at);
+        if (status == STRADA_CSV_OK) {
+            result = strada_ref_create_take(row);
+            strada_incref(result);
+            strada_csv_result(csv, result, "");
+            break;
+        }
+        strada_decref(row);
+        if (status == STRADA_CSV_BAD_QUOTE) break;
+    }
+    if (status != STRADA_CSV_OK) {
+        /* A bad quote, or EOF inside a quoted field */
+        strada_csv_result(csv, strada_ref_create_take(strada_new_array()), strada_csv_message(status));
+    }
+    free(line);
+    free(rec.buf);
+    free(fb.buf);
+    return result ? result : strada_new_undef();
+}
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
-    sv->type = STRADA_CPOINTER;
-    sv->refcount = 1;
-    sv->value.ptr = sb;
-    sv->struct_name = "StringBuilder";
-    sv->struct_size = sizeof(StradaStringBuilder);
-    sv->blessed_package = NULL;
-    return sv;
+/* Body of one parse_file_parallel chunk. Captures: the source string,
+ * the format (a string holding a StradaCsvFormat), start and end offsets,
+ * the chunk number, the callback and a slot for the rows, which keeps
+ * them owned by the closure if the callback throws. */
+static StradaValue* strada_csv_chunk_body(StradaValue ***captures) {
+    StradaValue *src = *captures[0];
+    const StradaCsvFormat *fmt = (const StradaCsvFormat *)(*captures[1])->value.pv;
+    size_t at = (size_t)(*captures[2])->value.iv;
+    size_t end = (size_t)(*captures[3])->value.iv;
+    StradaValue *index = *captures[4];
+    StradaValue *callback = *captures[5];
+    const char *s = src->value.pv;
+
+    StradaValue *rows = strada_new_array();
+    strada_decref(*captures[6]);
+    *captures[6] = strada_ref_create_take(rows);
+    StradaCsvBuf fb = { NULL, 0, 0 };
+    while (at < end) {
+        StradaValue *row = strada_new_array();
+        size_t used, err_at = end - at;
+        int status = strada_csv_record(fmt, s + at, end - at, 1, &fb, row->value.av, &used, &err_at);
+        if (status != STRADA_CSV_OK) {
+            char msg[160];
+            snprintf(msg, sizeof(msg), "Text::CSV::parse_file_parallel: %s at byte %zu",
+                     strada_csv_message(status), at + err_at);
+            strada_decref(row);
+            free(fb.buf);
+            strada_throw(msg);
+        }
+        strada_array_push_take(rows->value.av, strada_ref_create_take(row));
+        at += used;
+    }
+    free(fb.buf);
+
+    StradaValue *r = strada_closure_call2(callback, *captures[6], index);
+    if (r) strada_decref(r);
+    return strada_new_int((int64_t)rows->value.av->size);
+}
+
+/* Text::CSV::parse_file_parallel: map the file, cut it into chunks at
+ * record boundaries and parse the chunks on the async pool, calling
+ * callback(rows, chunk) from the worker that parsed them. Returns the
+ * number of records, or -1 if the file cannot be read; the first failure
+ * in file order (a malformed record or a callback exception) is rethrown
+ * once every chunk has finished. chunk_size <= 0 picks one based on the
+ * pool size. */
+int64_t strada_csv_parse_file_parallel(StradaValue *csv, const char *path, StradaValue *callback,
+                                       int64_t chunk_size) {
+    StradaCsvFormat fmt;
+    strada_csv_format(csv, &fmt);
+    StradaValue *src = strada_map_file(path, MADV_SEQUENTIAL);
+    if (!src) {
+        src = strada_slurp(path);
+        if (!src || src->type != STRADA_STR) {
+            if (src) strada_decref(src);
+            return -1;
+        }
+    }
+    const char *s = src->value.pv;
+    size_t n = strada_str_len(src);
+    if (chunk_size <= 0) {
+        chunk_size = (int64_t)(n / ((size_t)strada_pool_size() * 4));
+        if (chunk_size < STRADA_CSV_CHUNK_MIN) chunk_size = STRADA_CSV_CHUNK_MIN;
+    }
+
+    StradaValue *fmt_sv = strada_new_str_len((const char *)&fmt, sizeof(fmt));
+    StradaValue *futures = strada_new_array();
+    size_t at = 0;
+    int64_t chunks = 0;
+    while (at < n) {
+        size_t target = (size_t)chunk_size < n - at ? at + (size_t)chunk_size : n;
+        size_t end = strada_csv_boundary(&fmt, s, n, at, target);
+        StradaValue *start_sv = strada_new_int((int64_t)at);
+        StradaValue *end_sv = strada_new_int((int64_t)end);
+        StradaValue *index_sv = strada_new_int(chunks++);
+        StradaValue *rows_sv = strada_new_undef();
+        StradaValue **captures[7] = { &src, &fmt_sv, &start_sv, &end_sv, &index_sv, &callback, &rows_sv };
+        StradaValue *body = strada_closure_new((void*)strada_csv_chunk_body, 0, 7, captures);
+        strada_array_push_take(futures->value.av, strada_future_new(body));
+        strada_decref(body);
+        strada_decref(start_sv);
+        strada_decref(end_sv);
+        strada_decref(index_sv);
+        strada_decref(rows_sv);
+        at = end;
+    }
+    strada_decref(fmt_sv);
+    strada_decref(src);
+
+    /* Wait for every chunk before reporting, so none is still running */
+    int64_t total = 0;
+    StradaValue *error = NULL;
+    StradaArray *av = futures->value.av;
+    for (size_t i = 0; i < av->size; i++) {
+        StradaFuture *f = (StradaFuture*)av->elements[i]->value.ptr;
+        strada_future_wait(f, 0, NULL);
+        if (f->error) {
+            if (!error) {
+                error = f->error;
+                strada_incref(error);
+            }
+        } else if (f->result) {
+            total += strada_to_int(f->result);
+        }
+        pthread_mutex_unlock(&f->mutex);
+    }
+    strada_decref(futures);
+    if (error) {
+        strada_throw_value(error);
+    }
+    return total;
 }
 
-StradaValue* strada_sb_new_cap(StradaValue *capacity) {
-    size_t cap = (size_t)strada_to_int(capacity);
-    if (cap < 64) cap = 64;
+/* ===== PARALLEL MAP / GREP / SORT ===== */
 
-    StradaStringBuilder *sb = malloc(sizeof(StradaStringBuilder));
-    sb->capacity = cap;
-    sb->length = 0;
-    sb->buffer = malloc(sb->capacity);
-    sb->buffer[0] = '\0';
+/* pmap, pgrep and psort cut their input into chunks and run the block on
+ * the async pool while the calling thread waits. The block is a closure
+ * that may read, but not modify, the input and the variables it captures;
+ * each task writes only its own results, which are joined in input order. */
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
-    sv->type = STRADA_CPOINTER;
-    sv->refcount = 1;
-    sv->value.ptr = sb;
-    sv->struct_name = "StringBuilder";
-    sv->struct_size = sizeof(StradaStringBuilder);
-    sv->blessed_package = NULL;
-    return sv;
-}
+#define STRADA_PAR_MIN_CHUNK 16     /* Fewer elements per chunk run inline */
+#define STRADA_PAR_CHUNKS_PER_WORKER 4
 
-void strada_sb_append(StradaValue *sb_val, StradaValue *str_val) {
-    if (!sb_val || sb_val->type != STRADA_CPOINTER) return;
-    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
-    if (!sb) return;
+typedef void (*StradaParTask)(void *ctx, size_t task);
 
-    char *str = strada_to_str(str_val);
-    size_t len = strlen(str);
+/* Body of one pool task. Captures: the task function and its context
+ * (both as integers) and the task number. */
+static StradaValue* strada_par_task_body(StradaValue ***captures) {
+    StradaParTask fn = (StradaParTask)(intptr_t)(*captures[0])->value.iv;
+    void *ctx = (void *)(intptr_t)(*captures[1])->value.iv;
+    fn(ctx, (size_t)(*captures[2])->value.iv);
+    return strada_new_undef();
+}
 
-    /* Grow buffer if needed (double capacity) */
-    while (sb->length + len + 1 > sb->capacity) {
-        sb->capacity *= 2;
-        sb->buffer = realloc(sb->buffer, sb->capacity);
+/* Run fn(ctx, 0 .. ntasks-1) on the pool and wait for all of them. The
+ * first failure in task order is rethrown once every task has finished. */
+static void strada_par_run(size_t ntasks, StradaParTask fn, void *ctx) {
+    if (ntasks == 1) {
+        fn(ctx, 0);
+        return;
+    }
+    StradaValue *fn_sv = strada_new_int((int64_t)(intptr_t)fn);
+    StradaValue *ctx_sv = strada_new_int((int64_t)(intptr_t)ctx);
+    StradaValue *futures = strada_new_array();
+    strada_array_reserve(futures->value.av, ntasks);
+    for (size_t i = 0; i < ntasks; i++) {
+        StradaValue *task_sv = strada_new_int((int64_t)i);
+        StradaValue **captures[3] = { &fn_sv, &ctx_sv, &task_sv };
+        StradaValue *body = strada_closure_new((void*)strada_par_task_body, 0, 3, captures);
+        strada_array_push_take(futures->value.av, strada_future_new(body));
+        strada_decref(body);
+        strada_decref(task_sv);
+    }
+    strada_decref(fn_sv);
+    strada_decref(ctx_sv);
+
+    StradaValue *error = NULL;
+    StradaArray *av = futures->value.av;
+    for (size_t i = 0; i < av->size; i++) {
+        StradaFuture *f = (StradaFuture*)av->elements[i]->value.ptr;
+        strada_future_wait(f, 0, NULL);
+        if (f->error && !error) {
+            error = f->error;
+            strada_incref(error);
+        }
+        pthread_mutex_unlock(&f->mutex);
+    }
+    strada_decref(futures);
+    if (error) {
+        strada_throw_value(error);
     }
+}
 
-    memcpy(sb->buffer + sb->length, str, len);
-    sb->length += len;
-    sb->buffer[sb->length] = '\0';
-    free(str);
+typedef struct {
+    StradaValue *block;             /* Closure; NULL for psort's string order */
+    StradaValue **in;               /* Input elements (borrowed) */
+    size_t n;
+    size_t chunk;                   /* Elements per task */
+    StradaValue **out;              /* pmap/pgrep: one result array per task */
+    StradaValue **scratch;          /* psort: merge buffer */
+    size_t width;                   /* psort: run length being merged */
+} StradaParJob;
+
+/* How many tasks to cut n elements into */
+static size_t strada_par_tasks(size_t n, size_t *chunk) {
+    size_t tasks = (size_t)strada_pool_size() * STRADA_PAR_CHUNKS_PER_WORKER;
+    if (tasks > n / STRADA_PAR_MIN_CHUNK) tasks = n / STRADA_PAR_MIN_CHUNK;
+    if (tasks < 1) tasks = 1;
+    *chunk = (n + tasks - 1) / tasks;
+    return (n + *chunk - 1) / *chunk;
+}
+
+static void strada_pmap_task(void *ctx, size_t task) {
+    StradaParJob *job = ctx;
+    size_t lo = task * job->chunk;
+    size_t hi = lo + job->chunk < job->n ? lo + job->chunk : job->n;
+    StradaArray *out = job->out[task]->value.av;
+    for (size_t i = lo; i < hi; i++) {
+        StradaValue *r = strada_closure_call1(job->block, job->in[i]);
+        /* A list result is flattened, as in map */
+        StradaValue *flat = r;
+        if (flat && flat->type == STRADA_REF) flat = flat->value.rv;
+        if (flat && flat->type == STRADA_ARRAY) {
+            StradaArray *fa = flat->value.av;
+            for (size_t j = 0; j < fa->size; j++) {
+                strada_array_push(out, fa->elements[j]);
+            }
+            strada_decref(r);
+        } else {
+            strada_array_push_take(out, r);
+        }
+    }
 }
 
-void strada_sb_append_str(StradaValue *sb_val, const char *str) {
-    if (!sb_val || sb_val->type != STRADA_CPOINTER || !str) return;
-    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
-    if (!sb) return;
+static void strada_pgrep_task(void *ctx, size_t task) {
+    StradaParJob *job = ctx;
+    size_t lo = task * job->chunk;
+    size_t hi = lo + job->chunk < job->n ? lo + job->chunk : job->n;
+    StradaArray *out = job->out[task]->value.av;
+    for (size_t i = lo; i < hi; i++) {
+        StradaValue *r = strada_closure_call1(job->block, job->in[i]);
+        if (strada_to_bool(r)) {
+            strada_array_push(out, job->in[i]);
+        }
+        strada_decref(r);
+    }
+}
 
-    size_t len = strlen(str);
+/* Shared driver for pmap and pgrep */
+static StradaValue* strada_par_collect(StradaValue *block, StradaArray *input, StradaParTask fn) {
+    StradaValue *result = strada_new_array();
+    if (!input || input->size == 0) return result;
+    StradaParJob job = { block, input->elements, input->size, 0, NULL, NULL, 0 };
+    size_t tasks = strada_par_tasks(job.n, &job.chunk);
+    job.out = malloc(sizeof(StradaValue *) * tasks);
+    for (size_t t = 0; t < tasks; t++) {
+        job.out[t] = strada_new_array();
+    }
+
+    StradaValue * volatile error = NULL;
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        strada_par_run(tasks, fn, &job);
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        error = strada_get_exception();
+    }
 
-    /* Grow buffer if needed (double capacity) */
-    while (sb->length + len + 1 > sb->capacity) {
-        sb->capacity *= 2;
-        sb->buffer = realloc(sb->buffer, sb->capacity);
+    size_t total = 0;
+    for (size_t t = 0; t < tasks; t++) {
+        total += job.out[t]->value.av->size;
+    }
+    StradaArray *rav = result->value.av;
+    strada_array_reserve(rav, total);
+    for (size_t t = 0; t < tasks; t++) {
+        StradaArray *part = job.out[t]->value.av;
+        /* Move the elements over without touching their refcounts */
+        memcpy(rav->elements + rav->size, part->elements, sizeof(StradaValue *) * part->size);
+        rav->size += part->size;
+        part->size = 0;
+        strada_decref(job.out[t]);
+    }
+    free(job.out);
+    if (error) {
+        strada_decref(result);
+        strada_throw_value((StradaValue *)error);
     }
+    return result;
+}
 
-    memcpy(sb->buffer + sb->length, str, len);
-    sb->length += len;
-    sb->buffer[sb->length] = '\0';
+StradaValue* strada_pmap(StradaValue *block, StradaArray *input) {
+    return strada_par_collect(block, input, strada_pmap_task);
 }
 
-StradaValue* strada_sb_to_string(StradaValue *sb_val) {
-    if (!sb_val || sb_val->type != STRADA_CPOINTER) return strada_new_str("");
-    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
-    if (!sb) return strada_new_str("");
+StradaValue* strada_pgrep(StradaValue *block, StradaArray *input) {
+    return strada_par_collect(block, input, strada_pgrep_task);
+}
 
-    return strada_new_str(sb->buffer);
+/* psort's order: the block's result, or string order without a block */
+static int strada_psort_cmp(StradaParJob *job, StradaValue *a, StradaValue *b) {
+    if (!job->block) {
+        char *ta = NULL, *tb = NULL;
+        const char *sa = strada_str_peek(a, &ta);
+        const char *sb = strada_str_peek(b, &tb);
+        int c = strcmp(sa, sb);
+        free(ta);
+        free(tb);
+        return c;
+    }
+    StradaValue *r = strada_closure_call2(job->block, a, b);
+    int64_t c = strada_to_int(r);
+    strada_decref(r);
+    return c > 0 ? 1 : (c < 0 ? -1 : 0);
 }
 
-StradaValue* strada_sb_length(StradaValue *sb_val) {
-    if (!sb_val || sb_val->type != STRADA_CPOINTER) return strada_new_int(0);
-    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
-    if (!sb) return strada_new_int(0);
+/* Stable merge of src[lo..mid) and src[mid..hi) into dst[lo..hi) */
+static void strada_psort_merge(StradaParJob *job, StradaValue **src, StradaValue **dst,
+                               size_t lo, size_t mid, size_t hi) {
+    size_t i = lo, j = mid, k = lo;
+    while (i < mid && j < hi) {
+        if (strada_psort_cmp(job, src[j], src[i]) < 0) {
+            dst[k++] = src[j++];
+        } else {
+            dst[k++] = src[i++];
+        }
+    }
+    while (i < mid) dst[k++] = src[i++];
+    while (j < hi) dst[k++] = src[j++];
+}
+
+/* Sort one chunk in place: insertion-sorted runs of 8, then merges */
+static void strada_psort_chunk_task(void *ctx, size_t task) {
+    StradaParJob *job = ctx;
+    size_t lo = task * job->chunk;
+    size_t hi = lo + job->chunk < job->n ? lo + job->chunk : job->n;
+    StradaValue **a = job->in;
+    for (size_t run = lo; run < hi; run += 8) {
+        size_t end = run + 8 < hi ? run + 8 : hi;
+        for (size_t i = run + 1; i < end; i++) {
+            StradaValue *v = a[i];
+            size_t j = i;
+            while (j > run && strada_psort_cmp(job, v, a[j - 1]) < 0) {
+                a[j] = a[j - 1];
+                j--;
+            }
+            a[j] = v;
+        }
+    }
+    StradaValue **src = a, **dst = job->scratch;
+    for (size_t width = 8; width < hi - lo; width *= 2) {
+        for (size_t s = lo; s < hi; s += 2 * width) {
+            size_t mid = s + width < hi ? s + width : hi;
+            size_t end = s + 2 * width < hi ? s + 2 * width : hi;
+            strada_psort_merge(job, src, dst, s, mid, end);
+        }
+        StradaValue **t = src; src = dst; dst = t;
+    }
+    if (src != a) {
+        memcpy(a + lo, src + lo, sizeof(StradaValue *) * (hi - lo));
+    }
+}
 
-    return strada_new_int(sb->length);
+/* One round of merging sorted runs of job->width from in into scratch */
+static void strada_psort_merge_task(void *ctx, size_t task) {
+    StradaParJob *job = ctx;
+    size_t lo = task * 2 * job->width;
+    size_t mid = lo + job->width < job->n ? lo + job->width : job->n;
+    size_t hi = lo + 2 * job->width < job->n ? lo + 2 * job->width : job->n;
+    strada_psort_merge(job, job->in, job->scratch, lo, mid, hi);
 }
 
-void strada_sb_clear(StradaValue *sb_val) {
-    if (!sb_val || sb_val->type != STRADA_CPOINTER) return;
-    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
-    if (!sb) return;
+/* A stable merge sort by the block. In parallel, chunks and merge rounds
+ * run on the pool; otherwise the whole array is one chunk. */
+static StradaValue* strada_merge_sort(StradaValue *block, StradaArray *input, int parallel) {
+    StradaValue *result = strada_new_array();
+    if (!input || input->size == 0) return result;
+    size_t n = input->size;
+    StradaArray *rav = result->value.av;
+    strada_array_reserve(rav, n);
+    for (size_t i = 0; i < n; i++) {
+        rav->elements[i] = input->elements[i];
+        strada_incref(rav->elements[i]);
+    }
+    rav->size = n;
+
+    StradaParJob job = { block, malloc(sizeof(StradaValue *) * n), n, 0, NULL,
+                         malloc(sizeof(StradaValue *) * n), 0 };
+    memcpy(job.in, rav->elements, sizeof(StradaValue *) * n);
+    size_t tasks = 1;
+    job.chunk = n;
+    if (parallel) {
+        tasks = strada_par_tasks(n, &job.chunk);
+    }
+
+    StradaValue * volatile error = NULL;
+    if (setjmp(*STRADA_TRY_PUSH()) == 0) {
+        strada_par_run(tasks, strada_psort_chunk_task, &job);
+        for (job.width = job.chunk; job.width < n; job.width *= 2) {
+            strada_par_run((n + 2 * job.width - 1) / (2 * job.width), strada_psort_merge_task, &job);
+            StradaValue **t = job.in; job.in = job.scratch; job.scratch = t;
+        }
+        STRADA_TRY_POP();
+    } else {
+        STRADA_TRY_POP();
+        error = strada_get_exception();
+    }
+    if (!error) {
+        memcpy(rav->elements, job.in, sizeof(StradaValue *) * n);
+    }
+    free(job.in);
+    free(job.scratch);
+    if (error) {
+        strada_decref(result);
+        strada_throw_value((StradaValue *)error);
+    }
+    return result;
+}
 
-    sb->length = 0;
-    sb->buffer[0] = '\0';
+/* psort { $a <=> $b } @array. block is NULL for plain string order. */
+StradaValue* strada_psort(StradaValue *block, StradaArray *input) {
+    return strada_merge_sort(block, input, 1);
 }
 
-void strada_sb_free(StradaValue *sb_val) {
-    if (!sb_val || sb_val->type != STRADA_CPOINTER) return;
-    StradaStringBuilder *sb = (StradaStringBuilder*)sb_val->value.ptr;
-    if (sb) {
-        free(sb->buffer);
-        free(sb);
-    }
-    sb_val->value.ptr = NULL;
+/* sort { ... } @array for comparators CodeGen cannot turn into keys */
+StradaValue* strada_sort_block(StradaValue *block, StradaArray *input) {
+    return strada_merge_sort(block, input, 0);
 }
 
 /* ===== TYPE INTROSPECTION AND CASTING ===== */
@@ -6872,15 +12316,17 @@ StradaValue* strada_ref_create(StradaValue *sv) {
     /* Create a reference to a value (shared ownership - increfs target) */
     if (!sv) return strada_new_undef();
 
-    StradaValue *ref = malloc(sizeof(StradaValue));
+    StradaValue *ref = strada_slab_alloc(STRADA_SLAB_VALUE);
     ref->type = STRADA_REF;
     ref->refcount = 1;
     ref->value.rv = sv;
     ref->blessed_package = NULL;
+    ref->struct_size = 0;
 
     /* Increment refcount of referenced value */
     strada_incref(sv);
 
+    strada_memprof_alloc(ref);
     return ref;
 }
 
@@ -6889,13 +12335,15 @@ StradaValue* strada_ref_create_take(StradaValue *sv) {
     /* Use for wrapping newly created values like in strada_anon_array */
     if (!sv) return strada_new_undef();
 
-    StradaValue *ref = malloc(sizeof(StradaValue));
+    StradaValue *ref = strada_slab_alloc(STRADA_SLAB_VALUE);
     ref->type = STRADA_REF;
     ref->refcount = 1;
     ref->value.rv = sv;
     ref->blessed_package = NULL;
+    ref->struct_size = 0;
 
     /* No incref - caller donates their refcount */
+    strada_memprof_alloc(ref);
     return ref;
 }
 
@@ -7000,18 +12448,31 @@ StradaValue* strada_new_ref(StradaValue *target, char ref_type) {
     (void)ref_type;  /* Reserved for future type checking */
     if (!target) return strada_new_undef();
 
-    StradaValue *ref = malloc(sizeof(StradaValue));
+    StradaValue *ref = strada_slab_alloc(STRADA_SLAB_VALUE);
     ref->type = STRADA_REF;
     ref->refcount = 1;
     ref->value.rv = target;
     ref->blessed_package = NULL;
+    ref->struct_size = 0;
 
     /* Increment refcount of referenced value */
     strada_incref(target);
 
+    strada_memprof_alloc(ref);
     return ref;
 }
 
+StradaValue* strada_new_scalar_ref(StradaValue **slot) {
+    /* \$var - the variable may hold a shared immortal (e.g. a small int
+     * literal). Give it a private copy first so $$ref = ... can write
+     * through to the variable without touching the shared constant. */
+    if (!slot || !*slot) return strada_new_undef();
+    if (STRADA_IS_IMMORTAL(*slot)) {
+        *slot = strada_unshare_immortal(*slot);
+    }
+    return strada_new_ref(*slot, '$');
+}
+
 StradaValue* strada_deref(StradaValue *ref) {
     /* $$ref - dereference a scalar reference */
     /* Returns an owned reference (increfs the value) */
@@ -7032,11 +12493,19 @@ StradaValue* strada_deref_set(StradaValue *ref, StradaValue *new_value) {
     StradaValue *target = ref->value.rv;
     if (!target) return new_value;
 
+    /* Never write into a shared immortal; point this ref at a private copy */
+    if (STRADA_IS_IMMORTAL(target)) {
+        target = strada_unshare_immortal(target);
+        ref->value.rv = target;
+    }
+
     /* Free old string if target was a string */
     if (target->type == STRADA_STR && target->value.pv) {
-        free(target->value.pv);
+        strada_str_release(target);
         target->value.pv = NULL;
     }
+    /* A container or weak ref stops being one */
+    if (gc_tracking | weak_live) strada_gc_retype(target);
 
     /* Copy the new value's type and content into target */
     target->type = new_value->type;
@@ -7049,6 +12518,8 @@ StradaValue* strada_deref_set(StradaValue *ref, StradaValue *new_value) {
             break;
         case STRADA_STR:
             target->value.pv = new_value->value.pv ? strdup(new_value->value.pv) : NULL;
+            target->struct_size = target->value.pv ? strlen(target->value.pv) : 0;
+            target->str_cap = 0;
             break;
         case STRADA_ARRAY:
             target->value.av = new_value->value.av;
@@ -7060,6 +12531,7 @@ StradaValue* strada_deref_set(StradaValue *ref, StradaValue *new_value) {
             break;
         case STRADA_REF:
             target->value.rv = new_value->value.rv;
+            target->struct_size = 0;
             if (target->value.rv) strada_incref(new_value->value.rv);
             break;
         default:
@@ -7144,14 +12616,32 @@ StradaValue* strada_anon_hash(int count, ...) {
     va_start(args, count);
 
     for (int i = 0; i < count; i++) {
-        const char *key = va_arg(args, const char*);
+        const char *key = va_arg(args, const char*);
+        StradaValue *val = va_arg(args, StradaValue*);
+        strada_hash_set(sv->value.hv, key, val);
+    }
+
+    va_end(args);
+
+    /* Return as reference - take ownership since we just created the hash */
+    return strada_ref_create_take(sv);
+}
+
+/* Same as strada_anon_hash with compiler-emitted literal keys */
+StradaValue* strada_anon_hash_h(int count, ...) {
+    StradaValue *sv = strada_new_hash();
+
+    va_list args;
+    va_start(args, count);
+
+    for (int i = 0; i < count; i++) {
+        StradaHashKey *hk = va_arg(args, StradaHashKey*);
         StradaValue *val = va_arg(args, StradaValue*);
-        strada_hash_set(sv->value.hv, key, val);
+        strada_hash_set_h(sv->value.hv, hk, val);
     }
 
     va_end(args);
 
-    /* Return as reference - take ownership since we just created the hash */
     return strada_ref_create_take(sv);
 }
 
@@ -7224,12 +12714,13 @@ StradaValue* strada_hash_from_ref(StradaValue *ref) {
     /* Create new hash and copy entries */
     StradaValue *result = strada_new_hash();
     
+    strada_hash_reserve(result->value.hv, src->num_entries);
     for (size_t i = 0; i < src->num_buckets; i++) {
-        StradaHashEntry *entry = src->buckets[i];
-        while (entry) {
+        StradaHashEntry *entry = &src->entries[i];
+        if (entry->key) {
             strada_incref(entry->value);
-            strada_hash_set(result->value.hv, entry->key, entry->value);
-            entry = entry->next;
+            strada_hash_store(result->value.hv, NULL, entry->key_len, entry->hash,
+                              entry->key, entry->value);
         }
     }
     
@@ -7280,7 +12771,7 @@ StradaValue* strada_new_array_from_av(StradaArray *av) {
     /* Wrap a StradaArray in a StradaValue - takes ownership of av */
     if (!av) return strada_new_array();
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_ARRAY;
     sv->refcount = 1;
     sv->blessed_package = NULL;
@@ -7290,6 +12781,8 @@ StradaValue* strada_new_array_from_av(StradaArray *av) {
      * All callers (strada_hash_keys, strada_hash_values, strada_regex_capture)
      * create new arrays with refcount=1 that we adopt. */
 
+    strada_memprof_alloc(sv);
+    strada_gc_alloc(sv);
     return sv;
 }
 
@@ -7337,12 +12830,13 @@ StradaValue* strada_clone(StradaValue *sv) {
         case STRADA_HASH: {
             StradaValue *new_hash = strada_new_hash();
             if (sv->value.hv) {
-                /* Iterate over hash buckets */
+                /* Iterate over hash slots */
+                strada_hash_reserve(new_hash->value.hv, sv->value.hv->num_entries);
                 for (size_t i = 0; i < sv->value.hv->num_buckets; i++) {
-                    StradaHashEntry *entry = sv->value.hv->buckets[i];
-                    while (entry) {
-                        strada_hash_set(new_hash->value.hv, entry->key, strada_clone(entry->value));
-                        entry = entry->next;
+                    StradaHashEntry *entry = &sv->value.hv->entries[i];
+                    if (entry->key) {
+                        strada_hash_store(new_hash->value.hv, NULL, entry->key_len, entry->hash,
+                                          entry->key, strada_clone(entry->value));
                     }
                 }
             }
@@ -8375,11 +13869,12 @@ StradaValue* strada_fdopen_read(StradaValue *fd_val) {
     FILE *fp = fdopen(fd, "r");
     if (!fp) return strada_new_undef();
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_FILEHANDLE;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.fh = fp;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -8389,11 +13884,12 @@ StradaValue* strada_fdopen_write(StradaValue *fd_val) {
     FILE *fp = fdopen(fd, "w");
     if (!fp) return strada_new_undef();
 
-    StradaValue *sv = malloc(sizeof(StradaValue));
+    StradaValue *sv = strada_slab_alloc(STRADA_SLAB_VALUE);
     sv->type = STRADA_FILEHANDLE;
     sv->refcount = 1;
     sv->blessed_package = NULL;
     sv->value.fh = fp;
+    strada_memprof_alloc(sv);
     return sv;
 }
 
@@ -8503,32 +13999,78 @@ StradaValue* strada_getproctitle(void) {
 
 /* ===== OOP - BLESSED REFERENCES (like Perl's bless) ===== */
 
-/* Method registry: package -> method name -> function pointer */
-#define OOP_MAX_PACKAGES 256
-#define OOP_MAX_METHODS 256
+/* Method registry: packages live in a hash table keyed by name and are never
+ * freed, so a package's name is also its identity. Blessed references point
+ * at that canonical name, which lets call-site caches match on a pointer.
+ *
+ * Each package keeps a hashed cache of resolved methods (inheritance already
+ * followed). Registering a method or adding a parent bumps oop_generation;
+ * caches and call-site entries built under an older generation are ignored. */
 #define OOP_MAX_NAME_LEN 256
-#define OOP_MAX_PARENTS 16  /* Max parents for multiple inheritance */
 
 typedef struct {
-    char name[OOP_MAX_NAME_LEN];
+    char *name;
     StradaMethod func;
 } OopMethod;
 
-typedef struct {
-    char name[OOP_MAX_NAME_LEN];
-    char parents[OOP_MAX_PARENTS][OOP_MAX_NAME_LEN];  /* Multiple parents */
+/* A resolved (package, method) pair; call sites hold pointers to these, so
+ * they are never freed, only retired when their generation goes stale */
+struct StradaMethodSlot {
+    const char *package;     /* Canonical name of the receiving package */
+    StradaMethod func;       /* NULL caches "no such method" */
+    unsigned gen;
+    uint32_t hash;
+    char name[];
+};
+
+typedef struct OopPackage {
+    struct OopPackage *next;          /* Registry chain */
+    uint32_t hash;
+    struct OopPackage **parents;      /* Multiple inheritance, in order */
     int parent_count;
-    OopMethod methods[OOP_MAX_METHODS];
+    int parent_cap;
+    OopMethod *methods;
     int method_count;
+    int method_cap;
+    StradaMethodSlot **cache;         /* Open addressing, power of two */
+    size_t cache_slots;
+    size_t cache_count;
+    unsigned cache_gen;
+    unsigned visit_mark;              /* For inheritance walks */
+    char name[];
 } OopPackage;
 
-static OopPackage oop_packages[OOP_MAX_PACKAGES];
-static int oop_package_count = 0;
+static OopPackage **oop_pkg_buckets = NULL;
+static size_t oop_pkg_num_buckets = 0;
+static size_t oop_package_count = 0;
 static int oop_initialized = 0;
+static unsigned oop_generation = 1;
+static unsigned oop_visit_counter = 0;
+static StradaMethodSlot **oop_retired = NULL;  /* Stale slots kept for call sites */
+static size_t oop_retired_count = 0;
+static size_t oop_retired_cap = 0;
+static pthread_mutex_t oop_lock = PTHREAD_MUTEX_INITIALIZER;
 static char oop_current_package[OOP_MAX_NAME_LEN] = "";
 static char oop_current_method_package[OOP_MAX_NAME_LEN] = "";  /* For SUPER:: */
 static int oop_destroying = 0;  /* Prevent recursive DESTROY */
 
+/* The registry is only locked once threads may exist */
+static inline void oop_registry_lock(void) {
+    if (strada_rc_atomic) pthread_mutex_lock(&oop_lock);
+}
+
+static inline void oop_registry_unlock(void) {
+    if (strada_rc_atomic) pthread_mutex_unlock(&oop_lock);
+}
+
+static void oop_atfork_prepare(void) { pthread_mutex_lock(&oop_lock); }
+static void oop_atfork_release(void) { pthread_mutex_unlock(&oop_lock); }
+
+__attribute__((constructor(101)))
+static void oop_lock_init(void) {
+    pthread_atfork(oop_atfork_prepare, oop_atfork_release, oop_atfork_release);
+}
+
 /* Forward declaration */
 static OopPackage* oop_get_or_create_package(const char *name);
 
@@ -8543,7 +14085,9 @@ void strada_set_package(const char *package) {
 
     /* Ensure package exists in registry */
     if (!oop_initialized) strada_oop_init();
+    oop_registry_lock();
     oop_get_or_create_package(package);
+    oop_registry_unlock();
 }
 
 const char* strada_current_package(void) {
@@ -8556,16 +14100,16 @@ const char* strada_current_package(void) {
 
 void strada_oop_init(void) {
     if (oop_initialized) return;
-    memset(oop_packages, 0, sizeof(oop_packages));
-    oop_package_count = 0;
     oop_initialized = 1;
 }
 
+/* Callers hold the registry lock */
 static OopPackage* oop_find_package(const char *name) {
-    for (int i = 0; i < oop_package_count; i++) {
-        if (strcmp(oop_packages[i].name, name) == 0) {
-            return &oop_packages[i];
-        }
+    if (oop_pkg_num_buckets == 0) return NULL;
+    size_t len = strlen(name);
+    uint32_t hash = strada_hash_key(name, len);
+    for (OopPackage *p = oop_pkg_buckets[hash & (oop_pkg_num_buckets - 1)]; p; p = p->next) {
+        if (p->hash == hash && strcmp(p->name, name) == 0) return p;
     }
     return NULL;
 }
@@ -8574,16 +14118,30 @@ static OopPackage* oop_get_or_create_package(const char *name) {
     OopPackage *pkg = oop_find_package(name);
     if (pkg) return pkg;
 
-    if (oop_package_count >= OOP_MAX_PACKAGES) {
-        fprintf(stderr, "Error: Too many packages (max %d)\n", OOP_MAX_PACKAGES);
-        exit(1);
-    }
-
-    pkg = &oop_packages[oop_package_count++];
-    strncpy(pkg->name, name, OOP_MAX_NAME_LEN - 1);
-    pkg->name[OOP_MAX_NAME_LEN - 1] = '\0';
-    pkg->parent_count = 0;
-    pkg->method_count = 0;
+    if (oop_package_count >= oop_pkg_num_buckets) {
+        size_t n = oop_pkg_num_buckets ? oop_pkg_num_buckets * 2 : 64;
+        OopPackage **nb = calloc(n, sizeof(OopPackage *));
+        for (size_t i = 0; i < oop_pkg_num_buckets; i++) {
+            OopPackage *p = oop_pkg_buckets[i];
+            while (p) {
+                OopPackage *next = p->next;
+                p->next = nb[p->hash & (n - 1)];
+                nb[p->hash & (n - 1)] = p;
+                p = next;
+            }
+        }
+        free(oop_pkg_buckets);
+        oop_pkg_buckets = nb;
+        oop_pkg_num_buckets = n;
+    }
+
+    size_t len = strlen(name);
+    pkg = calloc(1, sizeof(OopPackage) + len + 1);
+    memcpy(pkg->name, name, len + 1);
+    pkg->hash = strada_hash_key(name, len);
+    pkg->next = oop_pkg_buckets[pkg->hash & (oop_pkg_num_buckets - 1)];
+    oop_pkg_buckets[pkg->hash & (oop_pkg_num_buckets - 1)] = pkg;
+    oop_package_count++;
     return pkg;
 }
 
@@ -8600,16 +14158,11 @@ StradaValue* strada_bless(StradaValue *ref, const char *package) {
     /* Initialize OOP system if needed */
     if (!oop_initialized) strada_oop_init();
 
-    /* Ensure package exists in registry */
-    oop_get_or_create_package(package);
-
-    /* Free old blessed_package if exists */
-    if (ref->blessed_package) {
-        free(ref->blessed_package);
-    }
-
-    /* Set the blessed package */
-    ref->blessed_package = strdup(package);
+    /* Point at the registry's copy of the name (shared, never freed) */
+    oop_registry_lock();
+    OopPackage *pkg = oop_get_or_create_package(package);
+    oop_registry_unlock();
+    ref->blessed_package = pkg->name;
 
     return ref;
 }
@@ -8628,27 +14181,26 @@ void strada_inherit(const char *child, const char *parent) {
 
     if (!oop_initialized) strada_oop_init();
 
+    oop_registry_lock();
     OopPackage *pkg = oop_get_or_create_package(child);
+    /* Ensure parent exists too */
+    OopPackage *ppkg = oop_get_or_create_package(parent);
 
     /* Check if already inheriting from this parent */
     for (int i = 0; i < pkg->parent_count; i++) {
-        if (strcmp(pkg->parents[i], parent) == 0) {
+        if (pkg->parents[i] == ppkg) {
+            oop_registry_unlock();
             return;  /* Already inherited */
         }
     }
 
-    if (pkg->parent_count >= OOP_MAX_PARENTS) {
-        fprintf(stderr, "Error: Too many parents for package '%s' (max %d)\n",
-                child, OOP_MAX_PARENTS);
-        exit(1);
+    if (pkg->parent_count == pkg->parent_cap) {
+        pkg->parent_cap = pkg->parent_cap ? pkg->parent_cap * 2 : 4;
+        pkg->parents = realloc(pkg->parents, pkg->parent_cap * sizeof(OopPackage *));
     }
-
-    strncpy(pkg->parents[pkg->parent_count], parent, OOP_MAX_NAME_LEN - 1);
-    pkg->parents[pkg->parent_count][OOP_MAX_NAME_LEN - 1] = '\0';
-    pkg->parent_count++;
-
-    /* Ensure parent exists too */
-    oop_get_or_create_package(parent);
+    pkg->parents[pkg->parent_count++] = ppkg;
+    oop_generation++;
+    oop_registry_unlock();
 }
 
 void strada_inherit_from(const char *parent) {
@@ -8670,104 +14222,138 @@ void strada_method_register(const char *package, const char *name, StradaMethod
 
     if (!oop_initialized) strada_oop_init();
 
+    oop_registry_lock();
     OopPackage *pkg = oop_get_or_create_package(package);
-
-    if (pkg->method_count >= OOP_MAX_METHODS) {
-        fprintf(stderr, "Error: Too many methods in package %s (max %d)\n",
-                package, OOP_MAX_METHODS);
-        exit(1);
-    }
+    oop_generation++;
 
     /* Check if method already exists */
     for (int i = 0; i < pkg->method_count; i++) {
         if (strcmp(pkg->methods[i].name, name) == 0) {
             /* Update existing method */
             pkg->methods[i].func = func;
+            oop_registry_unlock();
             return;
         }
     }
 
     /* Add new method */
+    if (pkg->method_count == pkg->method_cap) {
+        pkg->method_cap = pkg->method_cap ? pkg->method_cap * 2 : 16;
+        pkg->methods = realloc(pkg->methods, pkg->method_cap * sizeof(OopMethod));
+    }
     OopMethod *m = &pkg->methods[pkg->method_count++];
-    strncpy(m->name, name, OOP_MAX_NAME_LEN - 1);
-    m->name[OOP_MAX_NAME_LEN - 1] = '\0';
+    m->name = strdup(name);
     m->func = func;
+    oop_registry_unlock();
 }
 
-static const char* oop_method_lookup_package_in(const char *package, const char *method,
-                                                const char *visited[], int *visited_count) {
-    /* Recursive depth-first search to find which package has this method */
-    if (!package || !method || !package[0]) return NULL;
-
-    /* Check if already visited (prevent infinite loops) */
-    for (int i = 0; i < *visited_count; i++) {
-        if (strcmp(visited[i], package) == 0) return NULL;
-    }
-    if (*visited_count < 64) {
-        visited[(*visited_count)++] = package;
+static OopMethod* oop_own_method(OopPackage *pkg, const char *method) {
+    for (int i = 0; i < pkg->method_count; i++) {
+        if (strcmp(pkg->methods[i].name, method) == 0) return &pkg->methods[i];
     }
+    return NULL;
+}
 
-    OopPackage *pkg = oop_find_package(package);
-    if (!pkg) return NULL;
+/* Depth-first, left-to-right search through the inheritance graph;
+ * each package is visited once per walk */
+static OopPackage* oop_resolve_in(OopPackage *pkg, const char *method, unsigned mark) {
+    if (pkg->visit_mark == mark) return NULL;
+    pkg->visit_mark = mark;
 
-    /* Check this package's methods */
-    for (int i = 0; i < pkg->method_count; i++) {
-        if (strcmp(pkg->methods[i].name, method) == 0) {
-            return package;
-        }
-    }
+    if (oop_own_method(pkg, method)) return pkg;
 
-    /* Recursively check parent packages */
     for (int i = 0; i < pkg->parent_count; i++) {
-        const char *result = oop_method_lookup_package_in(pkg->parents[i], method,
-                                                          visited, visited_count);
-        if (result) return result;
+        OopPackage *found = oop_resolve_in(pkg->parents[i], method, mark);
+        if (found) return found;
     }
-
     return NULL;
 }
 
-const char* strada_method_lookup_package(const char *package, const char *method) {
-    /* Find which package (including parents) has this method */
-    if (!package || !method) return NULL;
-    if (!oop_initialized) return NULL;
+static OopPackage* oop_resolve(OopPackage *pkg, const char *method) {
+    return oop_resolve_in(pkg, method, ++oop_visit_counter);
+}
 
-    const char *visited[64];
-    int visited_count = 0;
-    return oop_method_lookup_package_in(package, method, visited, &visited_count);
+static void oop_retire_slot(StradaMethodSlot *slot) {
+    if (oop_retired_count == oop_retired_cap) {
+        oop_retired_cap = oop_retired_cap ? oop_retired_cap * 2 : 64;
+        oop_retired = realloc(oop_retired, oop_retired_cap * sizeof(StradaMethodSlot *));
+    }
+    oop_retired[oop_retired_count++] = slot;
 }
 
-static StradaMethod oop_lookup_method_in(const char *package, const char *method,
-                                         const char *visited[], int *visited_count) {
-    /* Recursive depth-first search through inheritance hierarchy */
-    if (!package || !method || !package[0]) return NULL;
+static void oop_cache_insert(OopPackage *pkg, StradaMethodSlot *slot) {
+    size_t mask = pkg->cache_slots - 1;
+    size_t i = slot->hash & mask;
+    while (pkg->cache[i]) i = (i + 1) & mask;
+    pkg->cache[i] = slot;
+}
 
-    /* Check if already visited (prevent infinite loops) */
-    for (int i = 0; i < *visited_count; i++) {
-        if (strcmp(visited[i], package) == 0) return NULL;
-    }
-    if (*visited_count < 64) {
-        visited[(*visited_count)++] = package;
-    }
+/* Resolved method slot for pkg (registry lock held) */
+static StradaMethodSlot* oop_cache_lookup(OopPackage *pkg, const char *method) {
+    size_t len = strlen(method);
+    uint32_t hash = strada_hash_key(method, len);
 
-    OopPackage *pkg = oop_find_package(package);
-    if (!pkg) return NULL;
+    if (pkg->cache_gen != oop_generation) {
+        /* Something was registered since this cache was built */
+        for (size_t i = 0; i < pkg->cache_slots; i++) {
+            if (pkg->cache[i]) {
+                oop_retire_slot(pkg->cache[i]);
+                pkg->cache[i] = NULL;
+            }
+        }
+        pkg->cache_count = 0;
+        pkg->cache_gen = oop_generation;
+    }
 
-    /* Look for method in this package */
-    for (int i = 0; i < pkg->method_count; i++) {
-        if (strcmp(pkg->methods[i].name, method) == 0) {
-            return pkg->methods[i].func;
+    if (pkg->cache_slots) {
+        size_t mask = pkg->cache_slots - 1;
+        for (size_t i = hash & mask; pkg->cache[i]; i = (i + 1) & mask) {
+            StradaMethodSlot *s = pkg->cache[i];
+            if (s->hash == hash && strcmp(s->name, method) == 0) return s;
         }
     }
 
-    /* Search all parents (depth-first, left-to-right) */
-    for (int i = 0; i < pkg->parent_count; i++) {
-        StradaMethod func = oop_lookup_method_in(pkg->parents[i], method,
-                                                  visited, visited_count);
-        if (func) return func;
+    if ((pkg->cache_count + 1) * 2 > pkg->cache_slots) {
+        StradaMethodSlot **old = pkg->cache;
+        size_t old_slots = pkg->cache_slots;
+        pkg->cache_slots = old_slots ? old_slots * 2 : 16;
+        pkg->cache = calloc(pkg->cache_slots, sizeof(StradaMethodSlot *));
+        for (size_t i = 0; i < old_slots; i++) {
+            if (old[i]) oop_cache_insert(pkg, old[i]);
+        }
+        free(old);
     }
 
-    return NULL;
+    OopPackage *owner = oop_resolve(pkg, method);
+    StradaMethodSlot *slot = malloc(sizeof(StradaMethodSlot) + len + 1);
+    slot->package = pkg->name;
+    slot->func = owner ? oop_own_method(owner, method)->func : NULL;
+    slot->gen = oop_generation;
+    slot->hash = hash;
+    memcpy(slot->name, method, len + 1);
+    oop_cache_insert(pkg, slot);
+    pkg->cache_count++;
+    return slot;
+}
+
+static StradaMethodSlot* oop_lookup_slot(const char *package, const char *method) {
+    oop_registry_lock();
+    OopPackage *pkg = oop_find_package(package);
+    StradaMethodSlot *slot = pkg ? oop_cache_lookup(pkg, method) : NULL;
+    oop_registry_unlock();
+    return slot;
+}
+
+const char* strada_method_lookup_package(const char *package, const char *method) {
+    /* Find which package (including parents) has this method */
+    if (!package || !method) return NULL;
+    if (!oop_initialized) return NULL;
+
+    oop_registry_lock();
+    OopPackage *pkg = oop_find_package(package);
+    OopPackage *owner = pkg ? oop_resolve(pkg, method) : NULL;
+    oop_registry_unlock();
+    return owner ? owner->name : NULL;
 }
 
 static StradaMethod oop_lookup_method(const char *package, const char *method) {
@@ -8775,13 +14361,12 @@ static StradaMethod oop_lookup_method(const char *package, const char *method) {
     if (!package || !method) return NULL;
     if (!oop_initialized) return NULL;
 
-    const char *visited[64];
-    int visited_count = 0;
-    return oop_lookup_method_in(package, method, visited, &visited_count);
+    StradaMethodSlot *slot = oop_lookup_slot(package, method);
+    return slot ? slot->func : NULL;
 }
 
-StradaValue* strada_method_call(StradaValue *obj, const char *method, StradaValue *args) {
-    /* Call a method on a blessed reference */
+static StradaValue* oop_method_call_slow(StradaValue *obj, const char *method,
+                                         StradaValue *args, StradaMethodSlot **ic) {
     if (!obj || !method) {
         fprintf(stderr, "Error: Cannot call method '%s' on undefined value\n",
                 method ? method : "(null)");
@@ -8796,48 +14381,52 @@ StradaValue* strada_method_call(StradaValue *obj, const char *method, StradaValu
     if (!oop_initialized) strada_oop_init();
 
     /* Handle UNIVERSAL methods: isa and can */
-    if (strcmp(method, "isa") == 0) {
+    if (method[0] == 'i' && strcmp(method, "isa") == 0) {
         /* $obj->isa("ClassName") - check if object is of a type */
         StradaValue *result;
         if (args && args->type == STRADA_ARRAY && args->value.av && args->value.av->size > 0) {
             StradaValue *classname = args->value.av->elements[0];
             if (classname && classname->type == STRADA_STR && classname->value.pv) {
-                result = strada_new_int(strada_isa(obj, classname->value.pv) ? 1 : 0);
+                result = strada_new_bool(strada_isa(obj, classname->value.pv));
             } else {
-                result = strada_new_int(0);
+                result = strada_false();
             }
         } else {
-            result = strada_new_int(0);
+            result = strada_false();
         }
         if (args) strada_decref(args);
         return result;
     }
 
-    if (strcmp(method, "can") == 0) {
+    if (method[0] == 'c' && strcmp(method, "can") == 0) {
         /* $obj->can("method_name") - check if object can do a method */
         StradaValue *result;
         if (args && args->type == STRADA_ARRAY && args->value.av && args->value.av->size > 0) {
             StradaValue *methname = args->value.av->elements[0];
             if (methname && methname->type == STRADA_STR && methname->value.pv) {
-                result = strada_new_int(strada_can(obj, methname->value.pv) ? 1 : 0);
+                result = strada_new_bool(strada_can(obj, methname->value.pv));
             } else {
-                result = strada_new_int(0);
+                result = strada_false();
             }
         } else {
-            result = strada_new_int(0);
+            result = strada_false();
         }
         if (args) strada_decref(args);
         return result;
     }
 
-    StradaMethod func = oop_lookup_method(obj->blessed_package, method);
-    if (!func) {
+    StradaMethodSlot *slot = oop_lookup_slot(obj->blessed_package, method);
+    if (!slot || !slot->func) {
         fprintf(stderr, "Error: Can't locate method '%s' in package '%s' or its parents\n",
                 method, obj->blessed_package);
         exit(1);
     }
+    /* Only cache when the object's name is the registry's own copy */
+    if (ic && slot->package == obj->blessed_package) {
+        __atomic_store_n(ic, slot, __ATOMIC_RELEASE);
+    }
 
-    StradaValue *result = func(obj, args);
+    StradaValue *result = slot->func(obj, args);
     /* Free the args array (created by strada_pack_args) after the call */
     if (args) {
         strada_decref(args);
@@ -8845,38 +14434,48 @@ StradaValue* strada_method_call(StradaValue *obj, const char *method, StradaValu
     return result;
 }
 
+StradaValue* strada_method_call(StradaValue *obj, const char *method, StradaValue *args) {
+    /* Call a method on a blessed reference */
+    return oop_method_call_slow(obj, method, args, NULL);
+}
+
+/* Method call through a call-site cache: a hit is one pointer compare on
+ * the blessed package plus a generation check */
+StradaValue* strada_method_call_ic(StradaValue *obj, const char *method, StradaValue *args,
+                                   StradaMethodSlot **ic) {
+    StradaMethodSlot *slot = __atomic_load_n(ic, __ATOMIC_ACQUIRE);
+    if (slot && obj && slot->package == obj->blessed_package &&
+        slot->gen == __atomic_load_n(&oop_generation, __ATOMIC_RELAXED)) {
+        StradaValue *result = slot->func(obj, args);
+        if (args) strada_decref(args);
+        return result;
+    }
+    return oop_method_call_slow(obj, method, args, ic);
+}
+
 /* Helper to get first parent package (for SUPER:: calls) */
 const char* strada_get_parent_package(const char *package) {
     if (!package || !oop_initialized) return NULL;
 
+    oop_registry_lock();
     OopPackage *pkg = oop_find_package(package);
-    if (!pkg || pkg->parent_count == 0) return NULL;
-
-    return pkg->parents[0];
+    const char *parent = (pkg && pkg->parent_count > 0) ? pkg->parents[0]->name : NULL;
+    oop_registry_unlock();
+    return parent;
 }
 
 /* Recursive helper for isa check */
-static int oop_isa_check(const char *current_pkg, const char *target,
-                         const char *visited[], int *visited_count) {
-    if (!current_pkg || !current_pkg[0]) return 0;
-
+static int oop_isa_check(OopPackage *pkg, const char *target, unsigned mark) {
     /* Check if this is the target */
-    if (strcmp(current_pkg, target) == 0) return 1;
+    if (strcmp(pkg->name, target) == 0) return 1;
 
     /* Check if already visited */
-    for (int i = 0; i < *visited_count; i++) {
-        if (strcmp(visited[i], current_pkg) == 0) return 0;
-    }
-    if (*visited_count < 64) {
-        visited[(*visited_count)++] = current_pkg;
-    }
-
-    OopPackage *pkg = oop_find_package(current_pkg);
-    if (!pkg) return 0;
+    if (pkg->visit_mark == mark) return 0;
+    pkg->visit_mark = mark;
 
     /* Check all parents */
     for (int i = 0; i < pkg->parent_count; i++) {
-        if (oop_isa_check(pkg->parents[i], target, visited, visited_count)) {
+        if (oop_isa_check(pkg->parents[i], target, mark)) {
             return 1;
         }
     }
@@ -8888,10 +14487,13 @@ static int oop_isa_check(const char *current_pkg, const char *target,
 int strada_isa(StradaValue *obj, const char *package) {
     if (!obj || !package || !obj->blessed_package) return 0;
     if (!oop_initialized) return 0;
+    if (strcmp(obj->blessed_package, package) == 0) return 1;
 
-    const char *visited[64];
-    int visited_count = 0;
-    return oop_isa_check(obj->blessed_package, package, visited, &visited_count);
+    oop_registry_lock();
+    OopPackage *pkg = oop_find_package(obj->blessed_package);
+    int result = pkg ? oop_isa_check(pkg, package, ++oop_visit_counter) : 0;
+    oop_registry_unlock();
+    return result;
 }
 
 /* Check if object can do a method */
@@ -8918,7 +14520,9 @@ StradaValue* strada_super_call(StradaValue *obj, const char *from_package,
     if (!oop_initialized) strada_oop_init();
 
     /* Find the package we're calling from */
+    oop_registry_lock();
     OopPackage *pkg = oop_find_package(from_package);
+    oop_registry_unlock();
     if (!pkg) {
         fprintf(stderr, "Error: Package '%s' not found for SUPER:: call\n", from_package);
         exit(1);
@@ -8927,71 +14531,830 @@ StradaValue* strada_super_call(StradaValue *obj, const char *from_package,
     /* Search for method in all parents */
     StradaMethod func = NULL;
     for (int i = 0; i < pkg->parent_count; i++) {
-        func = oop_lookup_method(pkg->parents[i], method);
+        func = oop_lookup_method(pkg->parents[i]->name, method);
         if (func) break;
     }
 
-    if (!func) {
-        fprintf(stderr, "Error: Can't locate SUPER::%s via package '%s'\n",
-                method, from_package);
-        exit(1);
+    if (!func) {
+        fprintf(stderr, "Error: Can't locate SUPER::%s via package '%s'\n",
+                method, from_package);
+        exit(1);
+    }
+
+    /* Save and set method package context */
+    char saved_pkg[OOP_MAX_NAME_LEN];
+    snprintf(saved_pkg, OOP_MAX_NAME_LEN, "%s", oop_current_method_package);
+
+    StradaValue *result = func(obj, args);
+    /* Free the args array (created by strada_pack_args) after the call */
+    if (args) {
+        strada_decref(args);
+    }
+    return result;
+}
+
+/* Set current method package (for SUPER:: context) */
+void strada_set_method_package(const char *package) {
+    if (package) {
+        strncpy(oop_current_method_package, package, OOP_MAX_NAME_LEN - 1);
+        oop_current_method_package[OOP_MAX_NAME_LEN - 1] = '\0';
+    } else {
+        oop_current_method_package[0] = '\0';
+    }
+}
+
+const char* strada_get_method_package(void) {
+    if (oop_current_method_package[0] == '\0') return NULL;
+    return oop_current_method_package;
+}
+
+/* Call DESTROY on an object if it has one */
+void strada_call_destroy(StradaValue *obj) {
+    if (!obj || !obj->blessed_package || oop_destroying) return;
+    if (!oop_initialized) return;
+
+    strada_check_debug_bless();
+    if (strada_debug_bless) {
+        fprintf(stderr, "[FREE] obj=%p blessed_package ptr=%p\n",
+                (void*)obj, (void*)obj->blessed_package);
+    }
+
+    /* Validate blessed_package before using it */
+    if (!strada_validate_blessed_package(obj->blessed_package)) {
+        fprintf(stderr, "Error: strada_call_destroy skipping due to corrupted blessed_package (obj=%p)\n", (void*)obj);
+        return;
+    }
+
+    if (strada_debug_bless) {
+        fprintf(stderr, "[FREE] obj=%p package='%s'\n",
+                (void*)obj, obj->blessed_package);
+    }
+
+    StradaMethod destroy = oop_lookup_method(obj->blessed_package, "DESTROY");
+    if (destroy) {
+        oop_destroying = 1;  /* Prevent recursive DESTROY */
+        destroy(obj, NULL);
+        oop_destroying = 0;
+    }
+}
+
+/* ============================================================
+ * WEAK REFERENCES AND CYCLE COLLECTOR
+ * A weak reference points at its referent without owning it; when the
+ * referent is freed every weak ref to it becomes undef. Each referent
+ * with weak refs has an entry in a registry keyed by its address, and
+ * arrays, hashes and closures also carry a flag so freeing them only
+ * looks the registry up when there is something to clear.
+ *
+ * The cycle collector (off until sys::gc_enable) tracks arrays, hashes
+ * and closures and finds groups that only keep each other alive, the
+ * way Python's gc does: every container in the scanned set starts with
+ * its refcount, references from inside the set are subtracted, and
+ * whatever is left with no count and cannot be reached from a container
+ * that has one is garbage. A reference value between two containers
+ * counts as internal when all of its holders are in the set.
+ *
+ * Collection is incremental. New containers go on the young list; after
+ * `threshold` of them a step scans the young list plus a slice of the
+ * old containers (and what that slice reaches, up to a cap), so the
+ * pause is bounded by the threshold rather than by the heap. Survivors
+ * move to the old lists, and a pass over all old containers completes
+ * every few steps. sys::gc_collect() scans everything at once.
+ *
+ * Scanning reads refcounts and container contents without locks, so
+ * automatic steps only run while the main thread is the only one;
+ * once a program starts threads, call sys::gc_collect() at a point
+ * where the others are idle.
+ * ============================================================ */
+
+#define STRADA_GC_WEAK_TARGET 0x80000000u
+#define STRADA_GC_SLOT_MASK   0x7fffffffu
+
+static pthread_mutex_t gc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void gc_lock(void) {
+    if (strada_rc_atomic) pthread_mutex_lock(&gc_mutex);
+}
+
+static inline void gc_unlock(void) {
+    if (strada_rc_atomic) pthread_mutex_unlock(&gc_mutex);
+}
+
+/* Collector slot and weak flag of an array, hash or closure */
+static inline uint32_t *gc_bits_of(StradaValue *sv) {
+    switch (sv->type) {
+        case STRADA_ARRAY:
+            return sv->value.av ? &sv->value.av->gc_bits : NULL;
+        case STRADA_HASH:
+            return sv->value.hv ? &sv->value.hv->gc_bits : NULL;
+        case STRADA_CLOSURE:
+            return sv->value.ptr ? &((StradaClosure *)sv->value.ptr)->gc_bits : NULL;
+        default:
+            return NULL;
+    }
+}
+
+/* ----- Weak reference registry ----- */
+
+typedef struct WeakEntry {
+    StradaValue *target;
+    StradaValue **refs;
+    int count;
+    int cap;
+    struct WeakEntry *next;
+} WeakEntry;
+
+static WeakEntry **weak_buckets = NULL;
+static size_t weak_nbuckets = 0;
+static size_t weak_other = 0;  /* Targets without gc_bits to flag them */
+
+static inline size_t weak_bucket(StradaValue *target) {
+    uintptr_t h = (uintptr_t)target;
+    h ^= h >> 17;
+    h *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 20) & (weak_nbuckets - 1);
+}
+
+static WeakEntry **weak_find(StradaValue *target) {
+    if (weak_nbuckets == 0) return NULL;
+    WeakEntry **link = &weak_buckets[weak_bucket(target)];
+    while (*link && (*link)->target != target) link = &(*link)->next;
+    return *link ? link : NULL;
+}
+
+static void weak_grow(void) {
+    size_t n = weak_nbuckets ? weak_nbuckets * 2 : 64;
+    WeakEntry **fresh = calloc(n, sizeof(WeakEntry *));
+    WeakEntry **old = weak_buckets;
+    size_t old_n = weak_nbuckets;
+    weak_buckets = fresh;
+    weak_nbuckets = n;
+    for (size_t i = 0; i < old_n; i++) {
+        WeakEntry *e = old[i];
+        while (e) {
+            WeakEntry *next = e->next;
+            size_t b = weak_bucket(e->target);
+            e->next = weak_buckets[b];
+            weak_buckets[b] = e;
+            e = next;
+        }
+    }
+    free(old);
+}
+
+/* Caller holds gc_lock */
+static void weak_register(StradaValue *target, StradaValue *weak) {
+    WeakEntry **link = weak_find(target);
+    WeakEntry *e;
+    if (link) {
+        e = *link;
+    } else {
+        if (weak_live + 1 > weak_nbuckets) weak_grow();
+        e = calloc(1, sizeof(WeakEntry));
+        e->target = target;
+        size_t b = weak_bucket(target);
+        e->next = weak_buckets[b];
+        weak_buckets[b] = e;
+        weak_live++;
+        uint32_t *bits = gc_bits_of(target);
+        if (bits) {
+            *bits |= STRADA_GC_WEAK_TARGET;
+        } else {
+            weak_other++;
+        }
+    }
+    if (e->count == e->cap) {
+        e->cap = e->cap ? e->cap * 2 : 2;
+        e->refs = realloc(e->refs, e->cap * sizeof(StradaValue *));
+    }
+    e->refs[e->count++] = weak;
+}
+
+/* Caller holds gc_lock */
+static void weak_drop_entry(WeakEntry **link) {
+    WeakEntry *e = *link;
+    *link = e->next;
+    uint32_t *bits = gc_bits_of(e->target);
+    if (bits) {
+        *bits &= ~STRADA_GC_WEAK_TARGET;
+    } else {
+        weak_other--;
+    }
+    weak_live--;
+    free(e->refs);
+    free(e);
+}
+
+/* A weak ref is going away or being overwritten. Caller holds gc_lock. */
+static void weak_unregister(StradaValue *weak) {
+    WeakEntry **link = weak->value.rv ? weak_find(weak->value.rv) : NULL;
+    if (!link) return;
+    WeakEntry *e = *link;
+    for (int i = 0; i < e->count; i++) {
+        if (e->refs[i] == weak) {
+            e->refs[i] = e->refs[--e->count];
+            break;
+        }
+    }
+    if (e->count == 0) weak_drop_entry(link);
+}
+
+/* The referent is being freed: its weak refs read as undef from now on.
+ * Caller holds gc_lock. */
+static void weak_clear(StradaValue *target) {
+    WeakEntry **link = weak_find(target);
+    if (!link) return;
+    WeakEntry *e = *link;
+    for (int i = 0; i < e->count; i++) {
+        StradaValue *weak = e->refs[i];
+        weak->type = STRADA_UNDEF;
+        weak->value.rv = NULL;
+        weak->struct_size = 0;
+        weak->blessed_package = NULL;
+    }
+    weak_drop_entry(link);
+}
+
+StradaValue* strada_weaken(StradaValue *ref) {
+    if (!ref) return strada_new_undef();
+    if (ref->type != STRADA_REF || !ref->value.rv || (ref->struct_size & STRADA_REF_WEAK)) {
+        strada_incref(ref);
+        return ref;
+    }
+    /* A separate value, so other holders of ref keep a strong one */
+    StradaValue *weak = strada_slab_alloc(STRADA_SLAB_VALUE);
+    weak->type = STRADA_REF;
+    weak->refcount = 1;
+    weak->value.rv = ref->value.rv;
+    weak->blessed_package = ref->blessed_package;
+    weak->struct_size = STRADA_REF_WEAK;
+    gc_lock();
+    weak_register(ref->value.rv, weak);
+    gc_unlock();
+    strada_memprof_alloc(weak);
+    return weak;
+}
+
+int strada_isweak(StradaValue *sv) {
+    return sv && STRADA_IS_WEAK_REF(sv);
+}
+
+/* ----- Container tracking ----- */
+
+typedef struct GcSlot {
+    StradaValue *sv;      /* NULL while the slot is free */
+    uint32_t prev;
+    uint32_t next;        /* List links; next also chains free slots */
+    int64_t refs;         /* Refcount left after internal references */
+    uint8_t list;
+    uint8_t state;
+} GcSlot;
+
+/* Slots 0-2 are the heads of the circular lists */
+enum { GC_YOUNG, GC_PENDING, GC_VISITED, GC_LISTS };
+enum { GC_IDLE, GC_SCAN, GC_REACHABLE };
+
+static GcSlot *gc_slots = NULL;
+static uint32_t gc_nslots = 0;
+static uint32_t gc_slot_cap = 0;
+static uint32_t gc_free_slot = 0;
+static int gc_auto = 0;
+static int gc_running = 0;
+static int64_t gc_threshold = 700;
+static int64_t gc_list_len[GC_LISTS];
+
+static struct {
+    int64_t steps;
+    int64_t full;
+    int64_t passes;
+    int64_t collected;
+    int64_t finalized;
+    int64_t scanned;
+    int64_t last_scanned;
+    int64_t last_collected;
+    double last_pause;
+    double max_pause;
+    double total_pause;
+} gc_stats;
+
+static void gc_link(uint32_t idx, int list) {
+    GcSlot *head = &gc_slots[list];
+    GcSlot *s = &gc_slots[idx];
+    s->list = (uint8_t)list;
+    s->prev = head->prev;
+    s->next = list;
+    gc_slots[head->prev].next = idx;
+    head->prev = idx;
+    gc_list_len[list]++;
+}
+
+static void gc_unlink(uint32_t idx) {
+    GcSlot *s = &gc_slots[idx];
+    gc_slots[s->prev].next = s->next;
+    gc_slots[s->next].prev = s->prev;
+    gc_list_len[s->list]--;
+}
+
+static void gc_move(uint32_t idx, int list) {
+    gc_unlink(idx);
+    gc_link(idx, list);
+}
+
+static void gc_init_slots(void) {
+    gc_slot_cap = 1024;
+    gc_slots = calloc(gc_slot_cap, sizeof(GcSlot));
+    for (uint32_t i = 0; i < GC_LISTS; i++) {
+        gc_slots[i].prev = gc_slots[i].next = i;
+    }
+    gc_nslots = GC_LISTS;
+}
+
+static int64_t gc_step(int full);
+
+static void strada_gc_track(StradaValue *sv) {
+    uint32_t *bits = gc_bits_of(sv);
+    if (!bits) return;
+    gc_lock();
+    if (!gc_slots) gc_init_slots();
+    uint32_t idx;
+    if (gc_free_slot) {
+        idx = gc_free_slot;
+        gc_free_slot = gc_slots[idx].next;
+    } else {
+        if (gc_nslots == gc_slot_cap) {
+            gc_slot_cap *= 2;
+            gc_slots = realloc(gc_slots, gc_slot_cap * sizeof(GcSlot));
+        }
+        idx = gc_nslots++;
+    }
+    gc_slots[idx].sv = sv;
+    gc_slots[idx].state = GC_IDLE;
+    gc_link(idx, GC_YOUNG);
+    *bits = (*bits & STRADA_GC_WEAK_TARGET) | idx;
+    int due = gc_list_len[GC_YOUNG] >= gc_threshold;
+    gc_unlock();
+    if (due && gc_auto && !gc_running && !strada_rc_atomic && !oop_destroying) {
+        gc_step(0);
+    }
+}
+
+static void gc_untrack(StradaValue *sv, uint32_t *bits) {
+    uint32_t idx = *bits & STRADA_GC_SLOT_MASK;
+    *bits &= STRADA_GC_WEAK_TARGET;
+    if (idx >= gc_nslots || gc_slots[idx].sv != sv) return;
+    gc_unlink(idx);
+    gc_slots[idx].sv = NULL;
+    gc_slots[idx].next = gc_free_slot;
+    gc_free_slot = idx;
+}
+
+static void strada_gc_forget(StradaValue *sv) {
+    uint32_t *bits = gc_bits_of(sv);
+    if (bits ? *bits == 0 : !weak_other && !STRADA_IS_WEAK_REF(sv)) return;
+    gc_lock();
+    if (bits) {
+        if (*bits & STRADA_GC_SLOT_MASK) gc_untrack(sv, bits);
+        if (*bits & STRADA_GC_WEAK_TARGET) weak_clear(sv);
+    } else {
+        if (STRADA_IS_WEAK_REF(sv)) weak_unregister(sv);
+        if (weak_other) weak_clear(sv);
+    }
+    gc_unlock();
+}
+
+static void strada_gc_retype(StradaValue *sv) {
+    uint32_t *bits = gc_bits_of(sv);
+    if (!bits && !STRADA_IS_WEAK_REF(sv)) return;
+    gc_lock();
+    if (bits && (*bits & STRADA_GC_SLOT_MASK)) gc_untrack(sv, bits);
+    if (STRADA_IS_WEAK_REF(sv)) {
+        weak_unregister(sv);
+        sv->struct_size &= ~STRADA_REF_WEAK;
+    }
+    gc_unlock();
+}
+
+/* ----- Scanning ----- */
+
+/* Slot of a tracked container in the set being scanned, or 0 */
+static inline uint32_t gc_scan_slot(StradaValue *sv) {
+    if (!sv || STRADA_IS_IMMORTAL(sv)) return 0;
+    uint32_t *bits = gc_bits_of(sv);
+    if (!bits) return 0;
+    uint32_t idx = *bits & STRADA_GC_SLOT_MASK;
+    if (idx < GC_LISTS || idx >= gc_nslots || gc_slots[idx].sv != sv) return 0;
+    return gc_slots[idx].state != GC_IDLE ? idx : 0;
+}
+
+/* Strong reference values held by containers in the set, with how many
+ * of their holders are in it */
+typedef struct {
+    StradaValue *ref;
+    int64_t holders;
+} GcRefCount;
+
+static GcRefCount *gc_refmap = NULL;
+static size_t gc_refmap_cap = 0;
+static size_t gc_refmap_used = 0;
+
+static inline size_t gc_refmap_pos(StradaValue *ref) {
+    uintptr_t h = (uintptr_t)ref;
+    h ^= h >> 17;
+    h *= (uintptr_t)0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 16) & (gc_refmap_cap - 1);
+}
+
+static void gc_refmap_grow(void) {
+    GcRefCount *old = gc_refmap;
+    size_t old_cap = gc_refmap_cap;
+    gc_refmap_cap = old_cap ? old_cap * 2 : 1024;
+    gc_refmap = calloc(gc_refmap_cap, sizeof(GcRefCount));
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i].ref) continue;
+        size_t p = gc_refmap_pos(old[i].ref);
+        while (gc_refmap[p].ref) p = (p + 1) & (gc_refmap_cap - 1);
+        gc_refmap[p] = old[i];
+    }
+    free(old);
+}
+
+static void gc_refmap_add(StradaValue *ref) {
+    if ((gc_refmap_used + 1) * 2 > gc_refmap_cap) gc_refmap_grow();
+    size_t p = gc_refmap_pos(ref);
+    while (gc_refmap[p].ref && gc_refmap[p].ref != ref) p = (p + 1) & (gc_refmap_cap - 1);
+    if (!gc_refmap[p].ref) {
+        gc_refmap[p].ref = ref;
+        gc_refmap_used++;
+    }
+    gc_refmap[p].holders++;
+}
+
+static void gc_refmap_reset(void) {
+    if (gc_refmap_used) memset(gc_refmap, 0, gc_refmap_cap * sizeof(GcRefCount));
+    gc_refmap_used = 0;
+}
+
+/* Calls fn on every value sv owns a reference to */
+typedef void (*GcVisit)(StradaValue *child, void *arg);
+
+static void gc_visit(StradaValue *sv, GcVisit fn, void *arg) {
+    switch (sv->type) {
+        case STRADA_ARRAY: {
+            StradaArray *av = sv->value.av;
+            for (size_t i = 0; i < av->size; i++) {
+                if (av->elements[i]) fn(av->elements[i], arg);
+            }
+            break;
+        }
+        case STRADA_HASH: {
+            StradaHash *hv = sv->value.hv;
+            for (size_t i = 0; i < hv->num_buckets; i++) {
+                if (hv->entries[i].key && hv->entries[i].value) fn(hv->entries[i].value, arg);
+            }
+            break;
+        }
+        case STRADA_CLOSURE: {
+            StradaClosure *cl = sv->value.ptr;
+            for (int i = 0; cl->captures && i < cl->capture_count; i++) {
+                if (cl->captures[i] && *cl->captures[i]) fn(*cl->captures[i], arg);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void gc_subtract(StradaValue *child, void *arg) {
+    (void)arg;
+    uint32_t idx = gc_scan_slot(child);
+    if (idx) {
+        gc_slots[idx].refs--;
+    } else if (child->type == STRADA_REF && !(child->struct_size & STRADA_REF_WEAK) &&
+               gc_scan_slot(child->value.rv)) {
+        gc_refmap_add(child);
+    }
+}
+
+typedef struct {
+    uint32_t *items;
+    size_t len;
+    size_t cap;
+} GcStack;
+
+static void gc_push(GcStack *st, uint32_t idx) {
+    if (st->len == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 256;
+        st->items = realloc(st->items, st->cap * sizeof(uint32_t));
+    }
+    st->items[st->len++] = idx;
+}
+
+static void gc_mark_child(StradaValue *child, void *arg) {
+    uint32_t idx = gc_scan_slot(child);
+    if (!idx && child->type == STRADA_REF && !(child->struct_size & STRADA_REF_WEAK)) {
+        idx = gc_scan_slot(child->value.rv);
+    }
+    if (idx && gc_slots[idx].state == GC_SCAN) {
+        gc_slots[idx].state = GC_REACHABLE;
+        gc_push((GcStack *)arg, idx);
+    }
+}
+
+/* Moves the unreachable slots of work[] to its front and returns how
+ * many there are. held is the number of references the caller owns on
+ * each container. States are left set for the caller to inspect. */
+static size_t gc_find_garbage(uint32_t *work, size_t n, int held) {
+    for (size_t i = 0; i < n; i++) {
+        GcSlot *s = &gc_slots[work[i]];
+        s->state = GC_SCAN;
+        s->refs = s->sv->refcount - held;
+    }
+    gc_refmap_reset();
+    for (size_t i = 0; i < n; i++) {
+        gc_visit(gc_slots[work[i]].sv, gc_subtract, NULL);
+    }
+    /* A reference whose holders are all in the set is internal too */
+    for (size_t i = 0; i < gc_refmap_cap && gc_refmap_used; i++) {
+        StradaValue *ref = gc_refmap[i].ref;
+        if (ref && gc_refmap[i].holders >= ref->refcount) {
+            gc_slots[gc_scan_slot(ref->value.rv)].refs--;
+        }
     }
 
-    /* Save and set method package context */
-    char saved_pkg[OOP_MAX_NAME_LEN];
-    snprintf(saved_pkg, OOP_MAX_NAME_LEN, "%s", oop_current_method_package);
+    GcStack stack = { NULL, 0, 0 };
+    for (size_t i = 0; i < n; i++) {
+        if (gc_slots[work[i]].refs > 0) {
+            gc_slots[work[i]].state = GC_REACHABLE;
+            gc_push(&stack, work[i]);
+        }
+    }
+    while (stack.len > 0) {
+        uint32_t idx = stack.items[--stack.len];
+        gc_visit(gc_slots[idx].sv, gc_mark_child, &stack);
+    }
+    free(stack.items);
 
-    StradaValue *result = func(obj, args);
-    /* Free the args array (created by strada_pack_args) after the call */
-    if (args) {
-        strada_decref(args);
+    size_t garbage = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (gc_slots[work[i]].state == GC_SCAN) {
+            uint32_t t = work[garbage];
+            work[garbage++] = work[i];
+            work[i] = t;
+        }
     }
-    return result;
+    return garbage;
 }
 
-/* Set current method package (for SUPER:: context) */
-void strada_set_method_package(const char *package) {
-    if (package) {
-        strncpy(oop_current_method_package, package, OOP_MAX_NAME_LEN - 1);
-        oop_current_method_package[OOP_MAX_NAME_LEN - 1] = '\0';
-    } else {
-        oop_current_method_package[0] = '\0';
+/* Drops everything a garbage container holds, which breaks its cycles */
+static void gc_clear(StradaValue *sv) {
+    switch (sv->type) {
+        case STRADA_ARRAY: {
+            StradaArray *av = sv->value.av;
+            while (av->size > 0) {
+                StradaValue *v = av->elements[--av->size];
+                av->elements[av->size] = NULL;
+                strada_decref(v);
+            }
+            break;
+        }
+        case STRADA_HASH: {
+            StradaHash *hv = sv->value.hv;
+            for (size_t i = 0; i < hv->num_buckets; i++) {
+                StradaHashEntry *e = &hv->entries[i];
+                if (!e->key) continue;
+                char *key = e->key;
+                StradaValue *v = e->value;
+                e->key = NULL;
+                e->value = NULL;
+                hv->num_entries--;
+                strada_key_release(key);
+                strada_decref(v);
+            }
+            break;
+        }
+        case STRADA_CLOSURE: {
+            StradaClosure *cl = sv->value.ptr;
+            for (int i = 0; cl->captures && i < cl->capture_count; i++) {
+                if (!cl->captures[i]) continue;
+                StradaValue *v = *cl->captures[i];
+                *cl->captures[i] = strada_new_undef();
+                strada_decref(v);
+            }
+            break;
+        }
+        default:
+            break;
     }
 }
 
-const char* strada_get_method_package(void) {
-    if (oop_current_method_package[0] == '\0') return NULL;
-    return oop_current_method_package;
+/* Pulls tracked containers reachable from work[from..] into the set */
+typedef struct {
+    GcStack *work;
+    size_t cap;
+} GcPull;
+
+static void gc_pull_child(StradaValue *child, void *arg) {
+    GcPull *p = arg;
+    if (p->work->len >= p->cap) return;
+    StradaValue *target = child;
+    if (child->type == STRADA_REF && !(child->struct_size & STRADA_REF_WEAK)) target = child->value.rv;
+    if (!target || STRADA_IS_IMMORTAL(target)) return;
+    uint32_t *bits = gc_bits_of(target);
+    if (!bits) return;
+    uint32_t idx = *bits & STRADA_GC_SLOT_MASK;
+    if (idx < GC_LISTS || idx >= gc_nslots || gc_slots[idx].sv != target ||
+        gc_slots[idx].state != GC_IDLE) {
+        return;
+    }
+    gc_slots[idx].state = GC_SCAN;
+    gc_push(p->work, idx);
 }
 
-/* Call DESTROY on an object if it has one */
-void strada_call_destroy(StradaValue *obj) {
-    if (!obj || !obj->blessed_package || oop_destroying) return;
-    if (!oop_initialized) return;
+static double gc_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-    strada_check_debug_bless();
-    if (strada_debug_bless) {
-        fprintf(stderr, "[FREE] obj=%p blessed_package ptr=%p\n",
-                (void*)obj, (void*)obj->blessed_package);
+/* One collection over the young list and a slice of the old ones, or
+ * over every tracked container. Returns the containers freed. */
+static int64_t gc_step(int full) {
+    if (gc_running || !gc_slots) return 0;
+    gc_running = 1;
+    double start = gc_now();
+
+    GcStack work = { NULL, 0, 0 };
+    gc_lock();
+    for (int list = GC_YOUNG; list < GC_LISTS; list++) {
+        if (!full && list != GC_YOUNG) break;
+        for (uint32_t i = gc_slots[list].next; i != (uint32_t)list; i = gc_slots[i].next) {
+            gc_slots[i].state = GC_SCAN;
+            gc_push(&work, i);
+        }
     }
-
-    /* Validate blessed_package before using it */
-    if (!strada_validate_blessed_package(obj->blessed_package)) {
-        fprintf(stderr, "Error: strada_call_destroy skipping due to corrupted blessed_package (obj=%p)\n", (void*)obj);
-        return;
+    if (!full) {
+        /* Start a new pass over the old containers when the last one ended */
+        if (gc_list_len[GC_PENDING] == 0 && gc_list_len[GC_VISITED] > 0) {
+            for (uint32_t i = gc_slots[GC_VISITED].next; i != GC_VISITED; ) {
+                uint32_t next = gc_slots[i].next;
+                gc_move(i, GC_PENDING);
+                i = next;
+            }
+            gc_stats.passes++;
+        }
+        size_t slice = (size_t)gc_threshold * 2;
+        size_t young = work.len;
+        for (uint32_t i = gc_slots[GC_PENDING].next; i != GC_PENDING && work.len < young + slice;
+             i = gc_slots[i].next) {
+            gc_slots[i].state = GC_SCAN;
+            gc_push(&work, i);
+        }
+        /* Take in what the slice reaches so its cycles are scanned whole */
+        GcPull pull = { &work, young + slice * 4 };
+        for (size_t i = young; i < work.len && work.len < pull.cap; i++) {
+            gc_visit(gc_slots[work.items[i]].sv, gc_pull_child, &pull);
+        }
     }
+    gc_unlock();
 
-    if (strada_debug_bless) {
-        fprintf(stderr, "[FREE] obj=%p package='%s'\n",
-                (void*)obj, obj->blessed_package);
+    size_t n = work.len;
+    size_t garbage = gc_find_garbage(work.items, n, 0);
+
+    /* Objects in the garbage get DESTROY before anything is cleared */
+    GcStack finals = { NULL, 0, 0 };
+    StradaValue **dead = malloc((garbage ? garbage : 1) * sizeof(StradaValue *));
+    for (size_t i = 0; i < gc_refmap_cap && gc_refmap_used && garbage; i++) {
+        StradaValue *ref = gc_refmap[i].ref;
+        if (ref && ref->blessed_package && !(ref->struct_size & STRADA_REF_DESTROYED) &&
+            gc_refmap[i].holders >= ref->refcount &&
+            gc_slots[gc_scan_slot(ref->value.rv)].state == GC_SCAN) {
+            gc_push(&finals, (uint32_t)i);
+        }
     }
+    StradaValue **objects = finals.len ? malloc(finals.len * sizeof(StradaValue *)) : NULL;
+    for (size_t i = 0; i < finals.len; i++) {
+        objects[i] = gc_refmap[finals.items[i]].ref;
+        strada_incref(objects[i]);
+    }
+    for (size_t i = 0; i < garbage; i++) {
+        dead[i] = gc_slots[work.items[i]].sv;
+        strada_incref(dead[i]);
+    }
+    gc_lock();
+    for (size_t i = 0; i < n; i++) {
+        GcSlot *s = &gc_slots[work.items[i]];
+        s->state = GC_IDLE;
+        if (i >= garbage) gc_move(work.items[i], GC_VISITED);
+    }
+    gc_unlock();
+
+    size_t freed = garbage;
+    if (finals.len > 0) {
+        int destroying = oop_destroying;
+        for (size_t i = 0; i < finals.len; i++) {
+            objects[i]->struct_size |= STRADA_REF_DESTROYED;
+            oop_destroying = 0;
+            strada_call_destroy(objects[i]);
+        }
+        oop_destroying = destroying;
+        gc_stats.finalized += finals.len;
+        for (size_t i = 0; i < finals.len; i++) strada_decref(objects[i]);
 
-    StradaMethod destroy = oop_lookup_method(obj->blessed_package, "DESTROY");
-    if (destroy) {
-        oop_destroying = 1;  /* Prevent recursive DESTROY */
-        destroy(obj, NULL);
-        oop_destroying = 0;
+        /* DESTROY may have stored an object somewhere live: scan again */
+        for (size_t i = 0; i < garbage; i++) {
+            work.items[i] = *gc_bits_of(dead[i]) & STRADA_GC_SLOT_MASK;
+        }
+        freed = gc_find_garbage(work.items, garbage, 1);
+        for (size_t i = 0; i < garbage; i++) {
+            gc_slots[work.items[i]].state = GC_IDLE;
+        }
     }
+    free(objects);
+    free(finals.items);
+
+    /* The holds in dead[] keep every container here alive until the end */
+    StradaValue **doomed = malloc((freed ? freed : 1) * sizeof(StradaValue *));
+    for (size_t i = 0; i < freed; i++) doomed[i] = gc_slots[work.items[i]].sv;
+    for (size_t i = 0; i < freed; i++) gc_clear(doomed[i]);
+    for (size_t i = 0; i < garbage; i++) strada_decref(dead[i]);
+    free(doomed);
+    free(dead);
+    free(work.items);
+
+    double pause = gc_now() - start;
+    gc_stats.steps++;
+    if (full) gc_stats.full++;
+    gc_stats.scanned += n;
+    gc_stats.last_scanned = n;
+    gc_stats.collected += freed;
+    gc_stats.last_collected = freed;
+    gc_stats.last_pause = pause;
+    gc_stats.total_pause += pause;
+    if (pause > gc_stats.max_pause) gc_stats.max_pause = pause;
+    gc_running = 0;
+    return (int64_t)freed;
+}
+
+void strada_gc_enable(void) {
+    gc_tracking = 1;
+    gc_auto = 1;
+}
+
+void strada_gc_disable(void) {
+    gc_auto = 0;
+}
+
+int64_t strada_gc_collect(void) {
+    return gc_step(1);
+}
+
+void strada_gc_set_threshold(int64_t n) {
+    gc_threshold = n > 0 ? n : 1;
+}
+
+static void gc_stat(StradaHash *hv, const char *key, StradaValue *v) {
+    strada_hash_set(hv, key, v);
+    strada_decref(v);
+}
+
+StradaValue* strada_gc_stats(void) {
+    StradaValue *h = strada_new_hash();
+    StradaHash *hv = h->value.hv;
+    gc_lock();
+    int64_t young = gc_list_len[GC_YOUNG];
+    int64_t old = gc_list_len[GC_PENDING] + gc_list_len[GC_VISITED];
+    int64_t weak = (int64_t)weak_live;
+    gc_unlock();
+    gc_stat(hv, "enabled", strada_new_int(gc_auto));
+    gc_stat(hv, "tracking", strada_new_int(gc_tracking));
+    gc_stat(hv, "threshold", strada_new_int(gc_threshold));
+    gc_stat(hv, "tracked", strada_new_int(young + old));
+    gc_stat(hv, "young", strada_new_int(young));
+    gc_stat(hv, "old", strada_new_int(old));
+    gc_stat(hv, "weak_targets", strada_new_int(weak));
+    gc_stat(hv, "collections", strada_new_int(gc_stats.steps));
+    gc_stat(hv, "full_collections", strada_new_int(gc_stats.full));
+    gc_stat(hv, "passes", strada_new_int(gc_stats.passes));
+    gc_stat(hv, "collected", strada_new_int(gc_stats.collected));
+    gc_stat(hv, "finalized", strada_new_int(gc_stats.finalized));
+    gc_stat(hv, "scanned", strada_new_int(gc_stats.scanned));
+    gc_stat(hv, "last_scanned", strada_new_int(gc_stats.last_scanned));
+    gc_stat(hv, "last_collected", strada_new_int(gc_stats.last_collected));
+    gc_stat(hv, "last_pause_ms", strada_new_num(gc_stats.last_pause * 1000.0));
+    gc_stat(hv, "max_pause_ms", strada_new_num(gc_stats.max_pause * 1000.0));
+    gc_stat(hv, "total_pause_ms", strada_new_num(gc_stats.total_pause * 1000.0));
+    return strada_ref_create_take(h);
+}
+
+/* STRADA_GC=1 turns the collector on before main; STRADA_GC_THRESHOLD
+ * sets the step size */
+__attribute__((constructor))
+static void gc_auto_start(void) {
+    const char *threshold = getenv("STRADA_GC_THRESHOLD");
+    if (threshold && atoll(threshold) > 0) gc_threshold = atoll(threshold);
+    const char *env = getenv("STRADA_GC");
+    if (env && env[0] && strcmp(env, "0") != 0) strada_gc_enable();
 }
 
 /* ===== DIRECTORY FUNCTIONS ===== */
@@ -9574,6 +15937,8 @@ StradaValue* strada_qx(StradaValue *cmd) {
 StradaValue* sys_system(StradaValue *cmd) { return strada_system(cmd); }
 StradaValue* sys_qx(StradaValue *cmd) { return strada_qx(cmd); }
 StradaValue* sys_unlink(StradaValue *path) { return strada_unlink(path); }
+StradaValue* sys_fnv1a(StradaValue *data) { return strada_fnv1a(data); }
+StradaValue* sys_getrusage(StradaValue *who) { return strada_getrusage(who); }
 
 /* ===== ADDITIONAL FILE SYSTEM ===== */
 
@@ -9833,11 +16198,11 @@ StradaValue* strada_poll(StradaValue *fds, StradaValue *timeout) {
     if (arr->type == STRADA_REF) arr = arr->value.rv;
     if (arr->type != STRADA_ARRAY) return strada_new_int(-1);
 
-    int nfds = strada_array_length(arr->value.av);
-    struct pollfd *pfds = calloc(nfds, sizeof(struct pollfd));
+    nfds_t nfds = (nfds_t)strada_array_length(arr->value.av);
+    struct pollfd *pfds = calloc(nfds ? nfds : 1, sizeof(struct pollfd));
     if (!pfds) return strada_new_int(-1);
 
-    for (int i = 0; i < nfds; i++) {
+    for (nfds_t i = 0; i < nfds; i++) {
         StradaValue *entry = strada_array_get(arr->value.av, i);
         if (entry->type == STRADA_HASH) {
             StradaValue *fd_val = strada_hash_get(entry->value.hv, "fd");
@@ -9850,7 +16215,7 @@ StradaValue* strada_poll(StradaValue *fds, StradaValue *timeout) {
     int result = poll(pfds, nfds, strada_to_int(timeout));
 
     /* Update revents in original array */
-    for (int i = 0; i < nfds; i++) {
+    for (nfds_t i = 0; i < nfds; i++) {
         StradaValue *entry = strada_array_get(arr->value.av, i);
         if (entry->type == STRADA_HASH) {
             strada_hash_set(entry->value.hv, "revents", strada_new_int(pfds[i].revents));
@@ -10705,140 +17070,111 @@ StradaValue* strada_dl_call_version(StradaValue *fn_ptr_sv) {
 
 /* ============================================================
  * FUNCTION PROFILER
- * Track function call counts and timing
+ * Instrumented (-p): call counts and timing per function, with a call
+ * stack per thread. Sampling (STRADA_PROF=sample): SIGPROF samples of
+ * each thread's native stack, written as folded stacks at exit.
  * ============================================================ */
 
-#define PROFILE_MAX_FUNCS 4096
 #define PROFILE_MAX_STACK 256
 
-typedef struct ProfileEntry {
-    const char *name;          /* Function name (string literal, not owned) */
-    uint64_t call_count;       /* Number of times called */
-    double total_time;         /* Total time in seconds (excluding children) */
-    double self_time;          /* Self time (excluding children) */
-    double start_time;         /* Start time of current call */
-    int active;                /* Currently in this function? */
-} ProfileEntry;
-
 typedef struct ProfileStack {
-    int func_idx;              /* Index into profile_entries */
-    double start_time;         /* When we entered this function */
-    double child_time;         /* Time spent in child functions */
+    StradaProfFunc *func;      /* Descriptor of the running function */
+    uint64_t start_ns;         /* When we entered this function */
+    uint64_t child_ns;         /* Time spent in child functions */
 } ProfileStack;
 
-static ProfileEntry profile_entries[PROFILE_MAX_FUNCS];
-static int profile_entry_count = 0;
-static ProfileStack profile_stack[PROFILE_MAX_STACK];
-static int profile_stack_depth = 0;
+static __thread ProfileStack profile_stack[PROFILE_MAX_STACK];
+static __thread int profile_stack_depth = 0;
+static StradaProfFunc *profile_funcs = NULL;   /* Functions called so far */
+static int profile_func_count = 0;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
 static int profile_initialized = 0;
 
 /* Get high-resolution time */
-static double profile_get_time(void) {
+static uint64_t profile_now_ns(void) {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return ts.tv_sec + ts.tv_nsec / 1e9;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
-/* Find or create profile entry for function */
-static int profile_find_or_create(const char *name) {
-    /* Linear search - fine for typical function counts */
-    for (int i = 0; i < profile_entry_count; i++) {
-        if (profile_entries[i].name == name ||
-            (profile_entries[i].name && strcmp(profile_entries[i].name, name) == 0)) {
-            return i;
-        }
-    }
-
-    /* Create new entry */
-    if (profile_entry_count >= PROFILE_MAX_FUNCS) {
-        fprintf(stderr, "Warning: profile table full, ignoring function %s\n", name);
-        return -1;
+static void profile_register(StradaProfFunc *fn) {
+    pthread_mutex_lock(&profile_lock);
+    if (!fn->registered) {
+        fn->next = profile_funcs;
+        profile_funcs = fn;
+        profile_func_count++;
+        __atomic_store_n(&fn->registered, 1, __ATOMIC_RELEASE);
     }
-
-    int idx = profile_entry_count++;
-    profile_entries[idx].name = name;
-    profile_entries[idx].call_count = 0;
-    profile_entries[idx].total_time = 0.0;
-    profile_entries[idx].self_time = 0.0;
-    profile_entries[idx].start_time = 0.0;
-    profile_entries[idx].active = 0;
-    return idx;
+    pthread_mutex_unlock(&profile_lock);
 }
 
 void strada_profile_init(void) {
-    profile_entry_count = 0;
     profile_stack_depth = 0;
     profile_initialized = 1;
-    memset(profile_entries, 0, sizeof(profile_entries));
-    memset(profile_stack, 0, sizeof(profile_stack));
 }
 
-void strada_profile_enter(const char *func_name) {
+void strada_profile_enter(StradaProfFunc *fn) {
     if (!profile_initialized) return;
+    if (!__atomic_load_n(&fn->registered, __ATOMIC_ACQUIRE)) profile_register(fn);
+    __atomic_fetch_add(&fn->calls, 1, __ATOMIC_RELAXED);
 
-    int idx = profile_find_or_create(func_name);
-    if (idx < 0) return;
-
-    double now = profile_get_time();
-
-    /* Push onto call stack */
-    if (profile_stack_depth < PROFILE_MAX_STACK) {
-        profile_stack[profile_stack_depth].func_idx = idx;
-        profile_stack[profile_stack_depth].start_time = now;
-        profile_stack[profile_stack_depth].child_time = 0.0;
-        profile_stack_depth++;
+    /* Frames past the stack limit are counted but not timed */
+    int depth = profile_stack_depth++;
+    if (depth < PROFILE_MAX_STACK) {
+        profile_stack[depth].func = fn;
+        profile_stack[depth].start_ns = profile_now_ns();
+        profile_stack[depth].child_ns = 0;
     }
-
-    profile_entries[idx].call_count++;
-    profile_entries[idx].start_time = now;
-    profile_entries[idx].active = 1;
 }
 
-void strada_profile_exit(const char *func_name) {
-    (void)func_name;  /* Currently unused - exit uses stack frame index */
+void strada_profile_exit(StradaProfFunc *fn) {
+    (void)fn;  /* The frame records which function is running */
     if (!profile_initialized || profile_stack_depth == 0) return;
 
-    double now = profile_get_time();
-
-    /* Pop from stack */
-    profile_stack_depth--;
-    ProfileStack *frame = &profile_stack[profile_stack_depth];
-    int idx = frame->func_idx;
-
-    double elapsed = now - frame->start_time;
-    double self_time = elapsed - frame->child_time;
-
-    profile_entries[idx].total_time += elapsed;
-    profile_entries[idx].self_time += self_time;
-    profile_entries[idx].active = 0;
+    int depth = --profile_stack_depth;
+    if (depth >= PROFILE_MAX_STACK) return;
+    ProfileStack *frame = &profile_stack[depth];
+    uint64_t elapsed = profile_now_ns() - frame->start_ns;
+    uint64_t self = elapsed > frame->child_ns ? elapsed - frame->child_ns : 0;
+    __atomic_fetch_add(&frame->func->total_ns, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&frame->func->self_ns, self, __ATOMIC_RELAXED);
 
     /* Add our time to parent's child_time */
-    if (profile_stack_depth > 0) {
-        profile_stack[profile_stack_depth - 1].child_time += elapsed;
+    if (depth > 0) {
+        profile_stack[depth - 1].child_ns += elapsed;
     }
 }
 
-/* Comparison function for sorting by self_time descending */
+/* Comparison function for sorting by self time descending */
 static int profile_compare(const void *a, const void *b) {
-    const ProfileEntry *ea = (const ProfileEntry *)a;
-    const ProfileEntry *eb = (const ProfileEntry *)b;
-    if (eb->self_time > ea->self_time) return 1;
-    if (eb->self_time < ea->self_time) return -1;
+    const StradaProfFunc *ea = *(StradaProfFunc * const *)a;
+    const StradaProfFunc *eb = *(StradaProfFunc * const *)b;
+    if (eb->self_ns > ea->self_ns) return 1;
+    if (eb->self_ns < ea->self_ns) return -1;
     return 0;
 }
 
 void strada_profile_report(void) {
-    if (!profile_initialized || profile_entry_count == 0) return;
+    if (!profile_initialized || profile_func_count == 0) return;
+
+    pthread_mutex_lock(&profile_lock);
+    int count = profile_func_count;
+    StradaProfFunc **funcs = malloc(sizeof(StradaProfFunc *) * count);
+    int n = 0;
+    for (StradaProfFunc *f = profile_funcs; f && n < count; f = f->next) {
+        funcs[n++] = f;
+    }
+    pthread_mutex_unlock(&profile_lock);
 
-    /* Sort entries by self_time */
-    qsort(profile_entries, profile_entry_count, sizeof(ProfileEntry), profile_compare);
+    /* Sort entries by self time */
+    qsort(funcs, n, sizeof(StradaProfFunc *), profile_compare);
 
     /* Calculate totals */
     double total_time = 0.0;
     uint64_t total_calls = 0;
-    for (int i = 0; i < profile_entry_count; i++) {
-        total_time += profile_entries[i].self_time;
-        total_calls += profile_entries[i].call_count;
+    for (int i = 0; i < n; i++) {
+        total_time += funcs[i]->self_ns / 1e9;
+        total_calls += funcs[i]->calls;
     }
 
     fprintf(stderr, "\n");
@@ -10848,12 +17184,13 @@ void strada_profile_report(void) {
     fprintf(stderr, "║  %%Self    Self(s)   Total(s)     Calls   Function                            ║\n");
     fprintf(stderr, "╠══════════════════════════════════════════════════════════════════════════════╣\n");
 
-    for (int i = 0; i < profile_entry_count && i < 30; i++) {
-        ProfileEntry *e = &profile_entries[i];
-        if (e->call_count == 0) continue;
+    for (int i = 0; i < n && i < 30; i++) {
+        StradaProfFunc *e = funcs[i];
+        if (e->calls == 0) continue;
         if (e->name == NULL) continue;  /* Skip entries with NULL names */
 
-        double pct = (total_time > 0) ? (e->self_time / total_time * 100.0) : 0.0;
+        double self_time = e->self_ns / 1e9;
+        double pct = (total_time > 0) ? (self_time / total_time * 100.0) : 0.0;
 
         /* Truncate function name if needed */
         char name_buf[41];
@@ -10869,23 +17206,362 @@ void strada_profile_report(void) {
         }
 
         fprintf(stderr, "║ %5.1f%%  %9.4f  %9.4f  %8lu   %-40s ║\n",
-                pct, e->self_time, e->total_time,
-                (unsigned long)e->call_count, name_buf);
+                pct, self_time, e->total_ns / 1e9,
+                (unsigned long)e->calls, name_buf);
     }
 
     fprintf(stderr, "╠══════════════════════════════════════════════════════════════════════════════╣\n");
     fprintf(stderr, "║ Total: %.4f seconds, %lu function calls, %d unique functions            ║\n",
-            total_time, (unsigned long)total_calls, profile_entry_count);
+            total_time, (unsigned long)total_calls, n);
     fprintf(stderr, "╚══════════════════════════════════════════════════════════════════════════════╝\n");
+    free(funcs);
+}
+
+/* ----- Sampling profiler -----
+ * The SIGPROF handler only copies return addresses into a preallocated
+ * buffer: [tid, depth, pc...] per sample. Addresses are turned into names
+ * (dladdr, or addr2line on the #line data of a -g build with
+ * STRADA_PROF_LINES=1) and folded after the program finishes. */
+
+#define PROF_SAMPLE_DEPTH 64
+#define PROF_SAMPLE_WORDS (1u << 22)
+
+static uintptr_t *prof_samples = NULL;
+static size_t prof_samples_used = 0;
+static uint64_t prof_samples_dropped = 0;
+static int prof_sample_hz = 0;
+static int prof_sample_running = 0;
+
+static uintptr_t prof_thread_id(void) {
+#ifdef __linux__
+    return (uintptr_t)syscall(SYS_gettid);
+#else
+    return (uintptr_t)pthread_self();
+#endif
+}
+
+static void prof_sample_handler(int sig, siginfo_t *info, void *ctx) {
+    (void)sig; (void)info; (void)ctx;
+    int saved_errno = errno;
+    void *pcs[PROF_SAMPLE_DEPTH + 2];
+#ifdef STRADA_HAVE_BACKTRACE
+    int n = backtrace(pcs, PROF_SAMPLE_DEPTH + 2);
+#else
+    int n = 0;
+#endif
+    /* Drop this handler and the signal trampoline */
+    int skip = n > 2 ? 2 : n;
+    size_t depth = (size_t)(n - skip);
+    size_t at = __atomic_fetch_add(&prof_samples_used, depth + 2, __ATOMIC_RELAXED);
+    if (at + depth + 2 > PROF_SAMPLE_WORDS) {
+        __atomic_fetch_add(&prof_samples_dropped, 1, __ATOMIC_RELAXED);
+        errno = saved_errno;
+        return;
+    }
+    uintptr_t *rec = prof_samples + at;
+    rec[1] = depth;
+    for (size_t i = 0; i < depth; i++) rec[2 + i] = (uintptr_t)pcs[skip + i];
+    __atomic_store_n(&rec[0], prof_thread_id(), __ATOMIC_RELEASE);
+    errno = saved_errno;
+}
+
+void strada_prof_sample_start(void) {
+    if (prof_sample_running) return;
+    const char *hz_env = getenv("STRADA_PROF_HZ");
+    prof_sample_hz = hz_env ? atoi(hz_env) : 997;
+    if (prof_sample_hz <= 0 || prof_sample_hz > 100000) prof_sample_hz = 997;
+
+    prof_samples = mmap(NULL, PROF_SAMPLE_WORDS * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (prof_samples == MAP_FAILED) {
+        prof_samples = NULL;
+        fprintf(stderr, "strada: STRADA_PROF=sample: cannot allocate sample buffer\n");
+        return;
+    }
+#ifdef STRADA_HAVE_BACKTRACE
+    /* The first backtrace() loads the unwinder; do it outside the handler */
+    void *warm[4];
+    backtrace(warm, 4);
+#else
+    fprintf(stderr, "strada: STRADA_PROF=sample needs backtrace(), not available here\n");
+    munmap(prof_samples, PROF_SAMPLE_WORDS * sizeof(uintptr_t));
+    prof_samples = NULL;
+    return;
+#endif
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = prof_sample_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+
+    struct itimerval it;
+    it.it_interval.tv_sec = 0;
+    it.it_interval.tv_usec = 1000000 / prof_sample_hz;
+    if (it.it_interval.tv_usec == 0) it.it_interval.tv_usec = 1;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_PROF, &it, NULL);
+    prof_sample_running = 1;
+}
+
+/* Address -> frame name cache (open addressing, grows by doubling) */
+typedef struct ProfSym {
+    uintptr_t pc;
+    char *name;
+} ProfSym;
+
+static ProfSym *prof_syms = NULL;
+static size_t prof_sym_cap = 0;
+static size_t prof_sym_count = 0;
+
+static ProfSym *prof_sym_slot(uintptr_t pc) {
+    size_t mask = prof_sym_cap - 1;
+    size_t i = (size_t)((pc * 0x9E3779B97F4A7C15ULL) >> 20) & mask;
+    while (prof_syms[i].pc && prof_syms[i].pc != pc) i = (i + 1) & mask;
+    return &prof_syms[i];
+}
+
+static ProfSym *prof_sym_get(uintptr_t pc) {
+    if ((prof_sym_count + 1) * 2 > prof_sym_cap) {
+        ProfSym *old = prof_syms;
+        size_t old_cap = prof_sym_cap;
+        prof_sym_cap = old_cap ? old_cap * 2 : 1024;
+        prof_syms = calloc(prof_sym_cap, sizeof(ProfSym));
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].pc) *prof_sym_slot(old[i].pc) = old[i];
+        }
+        free(old);
+    }
+    ProfSym *slot = prof_sym_slot(pc);
+    if (!slot->pc) {
+        slot->pc = pc;
+        prof_sym_count++;
+    }
+    return slot;
+}
+
+static char *prof_sym_from_dladdr(uintptr_t pc) {
+    Dl_info dl;
+    char buf[512];
+    if (dladdr((void *)pc, &dl) && dl.dli_sname) {
+        return strdup(dl.dli_sname);
+    }
+    if (dladdr((void *)pc, &dl) && dl.dli_fname) {
+        const char *base = strrchr(dl.dli_fname, '/');
+        snprintf(buf, sizeof(buf), "[%s]", base ? base + 1 : dl.dli_fname);
+        return strdup(buf);
+    }
+    snprintf(buf, sizeof(buf), "0x%lx", (unsigned long)pc);
+    return strdup(buf);
+}
+
+/* With STRADA_PROF_LINES=1, name frames in the executable "func@file:line"
+ * from its debug line table (the #line directives of a -g build) */
+static void prof_resolve_lines(void) {
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len <= 0) return;
+    exe[len] = '\0';
+    Dl_info self;
+    if (!dladdr((void *)prof_resolve_lines, &self)) return;
+
+    char list[] = "/tmp/strada_prof_XXXXXX";
+    int fd = mkstemp(list);
+    if (fd < 0) return;
+    FILE *out = fdopen(fd, "w");
+    size_t wanted = 0;
+    for (size_t i = 0; i < prof_sym_cap; i++) {
+        Dl_info dl;
+        if (!prof_syms[i].pc || !dladdr((void *)prof_syms[i].pc, &dl) || dl.dli_fbase != self.dli_fbase) continue;
+        fprintf(out, "0x%lx\n", (unsigned long)(prof_syms[i].pc - (uintptr_t)self.dli_fbase));
+        wanted++;
+    }
+    fclose(out);
+
+    char cmd[PATH_MAX * 2 + 64];
+    snprintf(cmd, sizeof(cmd), "addr2line -f -e '%s' < '%s' 2>/dev/null", exe, list);
+    FILE *in = wanted ? popen(cmd, "r") : NULL;
+    if (in) {
+        char func[512], where[PATH_MAX];
+        for (size_t i = 0; i < prof_sym_cap; i++) {
+            Dl_info dl;
+            if (!prof_syms[i].pc || !dladdr((void *)prof_syms[i].pc, &dl) || dl.dli_fbase != self.dli_fbase) continue;
+            if (!fgets(func, sizeof(func), in) || !fgets(where, sizeof(where), in)) break;
+            func[strcspn(func, "\n")] = '\0';
+            where[strcspn(where, " \n")] = '\0';
+            if (strncmp(where, "??", 2) == 0 || strcmp(func, "??") == 0) continue;
+            const char *base = strrchr(where, '/');
+            char label[sizeof(func) + sizeof(where) + 2];
+            snprintf(label, sizeof(label), "%s@%s", func, base ? base + 1 : where);
+            free(prof_syms[i].name);
+            prof_syms[i].name = strdup(label);
+        }
+        pclose(in);
+    }
+    unlink(list);
+}
+
+/* Folded stack -> sample count */
+typedef struct ProfStack {
+    char *stack;
+    uint64_t count;
+} ProfStack;
+
+static int prof_stack_compare(const void *a, const void *b) {
+    const ProfStack *sa = a, *sb = b;
+    if (sb->count != sa->count) return sb->count > sa->count ? 1 : -1;
+    return strcmp(sa->stack, sb->stack);
+}
+
+static int prof_string_compare(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int prof_name_is(const char *name, const char *want) {
+    if (strcmp(name, want) == 0) return 1;
+    size_t n = strlen(want);
+    return strncmp(name, want, n) == 0 && name[n] == '@';
+}
+
+void strada_prof_sample_stop(void) {
+    if (!prof_sample_running) return;
+    prof_sample_running = 0;
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    signal(SIGPROF, SIG_IGN);
+
+    size_t used = __atomic_load_n(&prof_samples_used, __ATOMIC_ACQUIRE);
+    if (used > PROF_SAMPLE_WORDS) used = PROF_SAMPLE_WORDS;
+
+    /* Name every distinct address once; callers' return addresses point
+     * just past the call, so look up pc - 1 for them */
+    size_t pos = 0;
+    while (pos + 2 <= used && prof_samples[pos]) {
+        size_t depth = prof_samples[pos + 1];
+        for (size_t i = 0; i < depth; i++) {
+            uintptr_t pc = prof_samples[pos + 2 + i] - (i > 0 ? 1 : 0);
+            ProfSym *sym = prof_sym_get(pc);
+            if (!sym->name) sym->name = prof_sym_from_dladdr(pc);
+        }
+        pos += depth + 2;
+    }
+    const char *lines = getenv("STRADA_PROF_LINES");
+    if (lines && strcmp(lines, "1") == 0) prof_resolve_lines();
+
+    /* Fold: thread label, then frames from the outermost Strada frame in */
+    size_t samples = 0, threads = 0;
+    char **folded = malloc(sizeof(char *) * (used / 2 + 1));
+    uintptr_t seen_tids[256];
+    uintptr_t main_tid = (uintptr_t)getpid();
+    size_t buf_cap = PROF_SAMPLE_DEPTH * 1100 + 64;
+    char *buf = malloc(buf_cap);
+    pos = 0;
+    while (pos + 2 <= used && prof_samples[pos]) {
+        uintptr_t tid = prof_samples[pos];
+        size_t depth = prof_samples[pos + 1];
+        uintptr_t *pcs = prof_samples + pos + 2;
+        pos += depth + 2;
+
+        int known = 0;
+        for (size_t t = 0; t < threads; t++) if (seen_tids[t] == tid) known = 1;
+        if (!known && threads < 256) seen_tids[threads++] = tid;
+
+        /* Frames below main() or the thread start routine are libc setup */
+        size_t top = depth;
+        for (size_t i = 0; i < depth; i++) {
+            const char *name = prof_sym_get(pcs[i] - (i > 0 ? 1 : 0))->name;
+            if (prof_name_is(name, "main")) { top = i + 1; break; }
+            if (prof_name_is(name, "start_thread")) { top = i; break; }
+        }
+        /* Unnamed outer frames (libc, thread trampolines) say nothing */
+        while (top > 0 && prof_sym_get(pcs[top - 1] - (top > 1 ? 1 : 0))->name[0] == '[') top--;
+        size_t len;
+        if (tid == main_tid) {
+            len = (size_t)snprintf(buf, buf_cap, "[main]");
+        } else {
+            len = (size_t)snprintf(buf, buf_cap, "[thread %lu]", (unsigned long)tid);
+        }
+        for (size_t i = top; i-- > 0;) {
+            const char *name = prof_sym_get(pcs[i] - (i > 0 ? 1 : 0))->name;
+            buf[len++] = ';';
+            for (const char *c = name; *c && len < buf_cap - 1; c++) {
+                buf[len++] = (*c == ';' || *c == ' ') ? '_' : *c;
+            }
+        }
+        buf[len] = '\0';
+        folded[samples++] = strdup(buf);
+    }
+    free(buf);
+
+    /* Identical stacks sort next to each other; count each run */
+    qsort(folded, samples, sizeof(char *), prof_string_compare);
+    size_t stack_count = 0;
+    ProfStack *stacks = malloc(sizeof(ProfStack) * (samples + 1));
+    for (size_t i = 0; i < samples; i++) {
+        if (stack_count > 0 && strcmp(stacks[stack_count - 1].stack, folded[i]) == 0) {
+            stacks[stack_count - 1].count++;
+            free(folded[i]);
+        } else {
+            stacks[stack_count].stack = folded[i];
+            stacks[stack_count].count = 1;
+            stack_count++;
+        }
+    }
+    free(folded);
+    qsort(stacks, stack_count, sizeof(ProfStack), prof_stack_compare);
+
+    char default_out[64];
+    const char *out_path = getenv("STRADA_PROF_OUT");
+    if (!out_path || !*out_path) {
+        snprintf(default_out, sizeof(default_out), "strada-prof.%d.folded", (int)getpid());
+        out_path = default_out;
+    }
+    FILE *out = fopen(out_path, "w");
+    if (out) {
+        for (size_t k = 0; k < stack_count; k++) {
+            fprintf(out, "%s %lu\n", stacks[k].stack, (unsigned long)stacks[k].count);
+        }
+        fclose(out);
+    }
+    fprintf(stderr, "strada: %lu samples at %d Hz from %lu thread(s), %lu dropped; folded stacks in %s\n",
+            (unsigned long)samples, prof_sample_hz, (unsigned long)threads,
+            (unsigned long)prof_samples_dropped, out ? out_path : "(cannot write output)");
+
+    for (size_t k = 0; k < stack_count; k++) free(stacks[k].stack);
+    free(stacks);
+    for (size_t i = 0; i < prof_sym_cap; i++) free(prof_syms[i].name);
+    free(prof_syms);
+    prof_syms = NULL;
+    prof_sym_cap = prof_sym_count = 0;
+    munmap(prof_samples, PROF_SAMPLE_WORDS * sizeof(uintptr_t));
+    prof_samples = NULL;
+}
+
+/* STRADA_PROF=sample works on any executable, with or without -p */
+__attribute__((constructor))
+static void prof_sample_auto_start(void) {
+    const char *mode = getenv("STRADA_PROF");
+    if (mode && strcmp(mode, "sample") == 0) {
+        strada_prof_sample_start();
+        if (prof_sample_running) atexit(strada_prof_sample_stop);
+    }
 }
 
 /* ============================================================
  * MEMORY PROFILER
- * Track allocations by type and detect leaks
+ * Track allocations by type and by allocation site. While profiling is
+ * on, every live value is kept in a sharded pointer table together with
+ * the site that was current when it was made, so a heap snapshot can
+ * charge live bytes to the statements that allocated them.
  * ============================================================ */
 
 static int memprof_enabled = 0;
 
+__thread StradaMemSite *strada_memprof_site = NULL;
+StradaMemSite **strada_tls_memprof_site(void) { return &strada_memprof_site; }
+
 typedef struct MemProfStats {
     uint64_t alloc_count;      /* Number of allocations */
     uint64_t free_count;       /* Number of frees */
@@ -10896,17 +17572,296 @@ typedef struct MemProfStats {
     uint64_t peak_bytes;       /* Peak bytes */
 } MemProfStats;
 
-/* Stats by type: undef, int, num, str, array, hash, ref, other */
+/* Stats by type, indexed by StradaType */
 static MemProfStats memprof_stats[16];
 static const char *memprof_type_names[] = {
     "undef", "int", "num", "str", "array", "hash", "ref",
     "filehandle", "regex", "socket", "cstruct", "cpointer", "closure",
-    "unknown", "unknown", "unknown"
+    "future", "channel", "atomic"
 };
 
+/* One live value, with its site and its size when it was made */
+typedef struct MemProfLive {
+    StradaValue *sv;           /* NULL = empty slot */
+    StradaMemSite *site;
+    size_t bytes;
+    int type;
+} MemProfLive;
+
+#define MEMPROF_SHARDS 64      /* Picked by the top 6 bits of the pointer hash */
+
+/* Linear-probing table; deletion shifts entries back, so no tombstones */
+typedef struct MemProfShard {
+    pthread_mutex_t lock;
+    MemProfLive *slots;
+    size_t cap;                /* Power of two, 0 before the first insert */
+    size_t used;
+} MemProfShard;
+
+static MemProfShard memprof_shards[MEMPROF_SHARDS];
+static pthread_once_t memprof_once = PTHREAD_ONCE_INIT;
+static int memprof_snapshot_seq = 0;
+
+/* SIGUSR2 writes a byte here; a dump thread takes the snapshot */
+static int memprof_pipe[2] = { -1, -1 };
+static int memprof_dumper_pending = 0;
+
+static inline uint64_t memprof_hash_ptr(const void *p) {
+    uint64_t h = (uint64_t)(uintptr_t)p;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline void memprof_raise(uint64_t *peak, uint64_t v) {
+    uint64_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (v > old && !__atomic_compare_exchange_n(peak, &old, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static inline void memprof_lower(uint64_t *p, uint64_t v) {
+    uint64_t old = __atomic_load_n(p, __ATOMIC_RELAXED);
+    uint64_t next;
+    do {
+        next = old >= v ? old - v : 0;
+    } while (!__atomic_compare_exchange_n(p, &old, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* Bytes a value holds now: the value itself and the storage it owns */
+static size_t memprof_value_bytes(StradaValue *sv) {
+    size_t bytes = sizeof(StradaValue);
+    switch (sv->type) {
+        case STRADA_STR: {
+            if (STRADA_STR_IS_INLINE(sv)) return strada_slab_sizes[STRADA_SLAB_STR];
+            if (!sv->value.pv || STRADA_STR_IS_VIEW(sv) || STRADA_STR_IS_MAPPED(sv)) return bytes;
+            size_t cap = sv->str_cap & ~STRADA_STR_FLAGS;
+            return bytes + (cap ? cap : sv->struct_size + 1);
+        }
+        case STRADA_ARRAY:
+            bytes += sizeof(StradaArray);
+            if (sv->value.av) bytes += (sv->value.av->head + sv->value.av->capacity) * sizeof(StradaValue*);
+            return bytes;
+        case STRADA_HASH:
+            bytes += sizeof(StradaHash);
+            if (sv->value.hv) bytes += sv->value.hv->num_buckets * sizeof(StradaHashEntry);
+            return bytes;
+        case STRADA_CLOSURE: {
+            StradaClosure *cl = (StradaClosure*)sv->value.ptr;
+            if (cl) bytes += sizeof(StradaClosure) + cl->capture_count * sizeof(StradaValue**);
+            return bytes;
+        }
+        case STRADA_CSTRUCT:
+            return bytes + sv->struct_size;
+        default:
+            return bytes;
+    }
+}
+
+static void memprof_table_grow(MemProfShard *s) {
+    size_t cap = s->cap ? s->cap * 2 : 1024;
+    MemProfLive *slots = calloc(cap, sizeof(MemProfLive));
+    if (!slots) return;
+    for (size_t i = 0; i < s->cap; i++) {
+        if (!s->slots[i].sv) continue;
+        size_t j = memprof_hash_ptr(s->slots[i].sv) & (cap - 1);
+        while (slots[j].sv) j = (j + 1) & (cap - 1);
+        slots[j] = s->slots[i];
+    }
+    free(s->slots);
+    s->slots = slots;
+    s->cap = cap;
+}
+
+/* Forget every tracked value (profiling is starting over) */
+static void memprof_table_clear(void) {
+    for (int i = 0; i < MEMPROF_SHARDS; i++) {
+        MemProfShard *s = &memprof_shards[i];
+        pthread_mutex_lock(&s->lock);
+        free(s->slots);
+        s->slots = NULL;
+        s->cap = 0;
+        s->used = 0;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+static void memprof_stats_sub(int type, size_t bytes) {
+    MemProfStats *st = &memprof_stats[type];
+    __atomic_fetch_add(&st->free_count, 1, __ATOMIC_RELAXED);
+    memprof_lower(&st->current_count, 1);
+    memprof_lower(&st->current_bytes, bytes);
+}
+
+static void memprof_start_dumper(void);
+
+static void strada_memprof_track(StradaValue *sv) {
+    if (__builtin_expect(memprof_dumper_pending, 0)) memprof_start_dumper();
+
+    size_t bytes = memprof_value_bytes(sv);
+    int type = (sv->type < 16) ? (int)sv->type : 15;
+    MemProfStats *st = &memprof_stats[type];
+    __atomic_fetch_add(&st->alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->total_bytes, bytes, __ATOMIC_RELAXED);
+    memprof_raise(&st->peak_count, __atomic_add_fetch(&st->current_count, 1, __ATOMIC_RELAXED));
+    memprof_raise(&st->peak_bytes, __atomic_add_fetch(&st->current_bytes, bytes, __ATOMIC_RELAXED));
+
+    StradaMemSite *site = strada_memprof_site;
+    if (site) __atomic_fetch_add(&site->allocs, 1, __ATOMIC_RELAXED);
+
+    uint64_t h = memprof_hash_ptr(sv);
+    MemProfShard *s = &memprof_shards[h >> 58];
+    MemProfLive stale = { NULL, NULL, 0, 0 };
+    pthread_mutex_lock(&s->lock);
+    if ((s->used + 1) * 4 > s->cap * 3) memprof_table_grow(s);
+    if (s->cap) {
+        size_t mask = s->cap - 1;
+        size_t j = h & mask;
+        while (s->slots[j].sv && s->slots[j].sv != sv) j = (j + 1) & mask;
+        if (s->slots[j].sv) stale = s->slots[j];
+        else s->used++;
+        s->slots[j].sv = sv;
+        s->slots[j].site = site;
+        s->slots[j].bytes = bytes;
+        s->slots[j].type = type;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    /* Same address still tracked: its free was not seen */
+    if (stale.sv) memprof_stats_sub(stale.type, stale.bytes);
+}
+
+static void strada_memprof_untrack(StradaValue *sv) {
+    uint64_t h = memprof_hash_ptr(sv);
+    MemProfShard *s = &memprof_shards[h >> 58];
+    MemProfLive rec = { NULL, NULL, 0, 0 };
+    pthread_mutex_lock(&s->lock);
+    if (s->cap) {
+        size_t mask = s->cap - 1;
+        size_t j = h & mask;
+        while (s->slots[j].sv && s->slots[j].sv != sv) j = (j + 1) & mask;
+        if (s->slots[j].sv) {
+            rec = s->slots[j];
+            /* Pull later entries of the probe chain into the hole */
+            size_t k = j;
+            for (;;) {
+                k = (k + 1) & mask;
+                if (!s->slots[k].sv) break;
+                size_t home = memprof_hash_ptr(s->slots[k].sv) & mask;
+                if (((k - home) & mask) >= ((k - j) & mask)) {
+                    s->slots[j] = s->slots[k];
+                    j = k;
+                }
+            }
+            s->slots[j].sv = NULL;
+            s->used--;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    /* Values made before profiling started are not in the table */
+    if (rec.sv) memprof_stats_sub(rec.type, rec.bytes);
+}
+
+static void memprof_sigusr2(int sig) {
+    (void)sig;
+    int saved = errno;
+    if (memprof_pipe[1] >= 0) {
+        char c = 1;
+        ssize_t r = write(memprof_pipe[1], &c, 1);
+        (void)r;
+    }
+    errno = saved;
+}
+
+static void *memprof_dump_main(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    char c;
+    for (;;) {
+        ssize_t r = read(fd, &c, 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        StradaValue *path = strada_memprof_snapshot(NULL);
+        if (path->type == STRADA_STR) {
+            fprintf(stderr, "strada: heap snapshot in %s\n", path->value.pv);
+        }
+        strada_decref(path);
+    }
+    return NULL;
+}
+
+static void memprof_start_dumper(void) {
+    memprof_dumper_pending = 0;
+    if (memprof_pipe[0] < 0) return;
+    pthread_t tid;
+    pthread_attr_t attr;
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    /* The dump thread takes no signals; SIGUSR2 lands on a program thread */
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_create(&tid, &attr, memprof_dump_main, (void*)(intptr_t)memprof_pipe[0]);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+static void memprof_atfork_prepare(void) {
+    for (int i = 0; i < MEMPROF_SHARDS; i++) pthread_mutex_lock(&memprof_shards[i].lock);
+}
+
+static void memprof_atfork_parent(void) {
+    for (int i = MEMPROF_SHARDS - 1; i >= 0; i--) pthread_mutex_unlock(&memprof_shards[i].lock);
+}
+
+/* The child has no dump thread: give it its own pipe and start one on
+ * its next allocation, so each worker of a forking server answers
+ * SIGUSR2 by itself */
+static void memprof_atfork_child(void) {
+    memprof_atfork_parent();
+    if (memprof_pipe[0] < 0) return;
+    close(memprof_pipe[0]);
+    close(memprof_pipe[1]);
+    memprof_pipe[0] = memprof_pipe[1] = -1;
+    int fds[2];
+    if (pipe(fds) == 0) {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        memprof_pipe[0] = fds[0];
+        memprof_pipe[1] = fds[1];
+        memprof_dumper_pending = 1;
+    }
+}
+
+static void memprof_init(void) {
+    for (int i = 0; i < MEMPROF_SHARDS; i++) pthread_mutex_init(&memprof_shards[i].lock, NULL);
+    pthread_atfork(memprof_atfork_prepare, memprof_atfork_parent, memprof_atfork_child);
+
+    /* Leave SIGUSR2 alone if the program already handles it */
+    struct sigaction cur;
+    if (sigaction(SIGUSR2, NULL, &cur) == 0 && cur.sa_handler == SIG_DFL) {
+        int fds[2];
+        if (pipe(fds) == 0) {
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            memprof_pipe[0] = fds[0];
+            memprof_pipe[1] = fds[1];
+            struct sigaction sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = memprof_sigusr2;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGUSR2, &sa, NULL);
+            memprof_start_dumper();
+        }
+    }
+}
+
 void strada_memprof_enable(void) {
-    memprof_enabled = 1;
+    pthread_once(&memprof_once, memprof_init);
+    memprof_table_clear();
     memset(memprof_stats, 0, sizeof(memprof_stats));
+    memprof_enabled = 1;
 }
 
 void strada_memprof_disable(void) {
@@ -10917,27 +17872,262 @@ void strada_memprof_reset(void) {
     memset(memprof_stats, 0, sizeof(memprof_stats));
 }
 
-/* Internal: record allocation */
-void strada_memprof_alloc(StradaType type, size_t bytes) {
-    if (!memprof_enabled) return;
-    int idx = (type < 16) ? type : 15;
-    MemProfStats *s = &memprof_stats[idx];
-    s->alloc_count++;
-    s->current_count++;
-    s->total_bytes += bytes;
-    s->current_bytes += bytes;
-    if (s->current_count > s->peak_count) s->peak_count = s->current_count;
-    if (s->current_bytes > s->peak_bytes) s->peak_bytes = s->current_bytes;
+/* STRADA_MEMPROF=1: profile from the start and report at exit */
+__attribute__((constructor))
+static void memprof_auto_start(void) {
+    const char *mode = getenv("STRADA_MEMPROF");
+    if (mode && *mode && strcmp(mode, "0") != 0) {
+        strada_memprof_enable();
+        atexit(strada_memprof_report);
+    }
+}
+
+/* Live bytes and values for one (site, type) */
+typedef struct MemProfRow {
+    StradaMemSite *site;
+    int type;
+    uint64_t count;
+    size_t bytes;
+} MemProfRow;
+
+static int memprof_row_by_key(const void *a, const void *b) {
+    const MemProfRow *x = a, *y = b;
+    if (x->site != y->site) return (uintptr_t)x->site < (uintptr_t)y->site ? -1 : 1;
+    return x->type - y->type;
+}
+
+static int memprof_row_by_bytes(const void *a, const void *b) {
+    const MemProfRow *x = a, *y = b;
+    if (x->bytes != y->bytes) return x->bytes > y->bytes ? -1 : 1;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return memprof_row_by_key(a, b);
+}
+
+/* Sort and merge rows with the same key; returns the new length */
+static size_t memprof_fold(MemProfRow *rows, size_t n) {
+    if (n == 0) return 0;
+    qsort(rows, n, sizeof(MemProfRow), memprof_row_by_key);
+    size_t out = 0;
+    for (size_t i = 1; i < n; i++) {
+        if (rows[i].site == rows[out].site && rows[i].type == rows[out].type) {
+            rows[out].count += rows[i].count;
+            rows[out].bytes += rows[i].bytes;
+        } else {
+            rows[++out] = rows[i];
+        }
+    }
+    return out + 1;
+}
+
+/* Live values grouped by site and type, largest first. Each shard is
+ * folded as it is read, so the scratch space stays near the number of
+ * groups plus one shard. */
+static MemProfRow *memprof_collect(size_t *nrows) {
+    size_t n = 0, cap = 1024;
+    MemProfRow *rows = malloc(cap * sizeof(MemProfRow));
+    if (!rows) {
+        *nrows = 0;
+        return NULL;
+    }
+    for (int i = 0; i < MEMPROF_SHARDS; i++) {
+        MemProfShard *s = &memprof_shards[i];
+        pthread_mutex_lock(&s->lock);
+        if (n + s->used > cap) {
+            size_t want = cap;
+            while (n + s->used > want) want *= 2;
+            MemProfRow *grown = realloc(rows, want * sizeof(MemProfRow));
+            if (!grown) {
+                pthread_mutex_unlock(&s->lock);
+                break;
+            }
+            rows = grown;
+            cap = want;
+        }
+        for (size_t j = 0; j < s->cap; j++) {
+            MemProfLive *e = &s->slots[j];
+            if (!e->sv) continue;
+            rows[n].site = e->site;
+            rows[n].type = e->type;
+            rows[n].count = 1;
+            rows[n].bytes = memprof_value_bytes(e->sv);
+            n++;
+        }
+        pthread_mutex_unlock(&s->lock);
+        n = memprof_fold(rows, n);
+    }
+    qsort(rows, n, sizeof(MemProfRow), memprof_row_by_bytes);
+    *nrows = n;
+    return rows;
+}
+
+static void memprof_site_label(StradaMemSite *site, char *buf, size_t len) {
+    if (site) {
+        snprintf(buf, len, "%s@%s:%d", site->func, site->file, site->line);
+    } else {
+        snprintf(buf, len, "(unknown)");
+    }
 }
 
-/* Internal: record free */
-void strada_memprof_free(StradaType type, size_t bytes) {
-    if (!memprof_enabled) return;
-    int idx = (type < 16) ? type : 15;
-    MemProfStats *s = &memprof_stats[idx];
-    s->free_count++;
-    if (s->current_count > 0) s->current_count--;
-    if (s->current_bytes >= bytes) s->current_bytes -= bytes;
+StradaValue* strada_memprof_snapshot(const char *path) {
+    char name[4096];
+    if (!path || !*path) {
+        const char *prefix = getenv("STRADA_MEMPROF_OUT");
+        int seq = __atomic_add_fetch(&memprof_snapshot_seq, 1, __ATOMIC_RELAXED);
+        snprintf(name, sizeof(name), "%s.%d.%d.heap",
+                 (prefix && *prefix) ? prefix : "strada-heap", (int)getpid(), seq);
+        path = name;
+    }
+    FILE *fp = fopen(path, "w");
+    if (!fp) return strada_new_undef();
+
+    size_t n = 0;
+    MemProfRow *rows = memprof_collect(&n);
+    uint64_t values = 0, bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+        values += rows[i].count;
+        bytes += rows[i].bytes;
+    }
+    fprintf(fp, "# strada heap snapshot: pid %d, %llu live values, %llu bytes\n",
+            (int)getpid(), (unsigned long long)values, (unsigned long long)bytes);
+    fprintf(fp, "# bytes\tcount\ttype\tsite\n");
+    char label[1024];
+    for (size_t i = 0; i < n; i++) {
+        memprof_site_label(rows[i].site, label, sizeof(label));
+        fprintf(fp, "%llu\t%llu\t%s\t%s\n", (unsigned long long)rows[i].bytes,
+                (unsigned long long)rows[i].count, memprof_type_names[rows[i].type], label);
+    }
+    fclose(fp);
+    free(rows);
+    return strada_new_str(path);
+}
+
+/* One line of a snapshot file */
+typedef struct MemProfEntry {
+    char *type;
+    char *site;
+    int64_t bytes;
+    int64_t count;
+} MemProfEntry;
+
+static int memprof_entry_cmp(const void *a, const void *b) {
+    const MemProfEntry *x = a, *y = b;
+    int c = strcmp(x->site, y->site);
+    return c ? c : strcmp(x->type, y->type);
+}
+
+static MemProfEntry *memprof_load(const char *path, size_t *count) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+    size_t n = 0, cap = 64;
+    MemProfEntry *entries = malloc(cap * sizeof(MemProfEntry));
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    while (entries && (len = getline(&line, &line_cap, fp)) > 0) {
+        if (line[0] == '#') continue;
+        if (line[len - 1] == '\n') line[--len] = '\0';
+        char *f1 = strchr(line, '\t');
+        char *f2 = f1 ? strchr(f1 + 1, '\t') : NULL;
+        char *f3 = f2 ? strchr(f2 + 1, '\t') : NULL;
+        if (!f3) continue;
+        *f3 = '\0';
+        if (n == cap) {
+            cap *= 2;
+            MemProfEntry *grown = realloc(entries, cap * sizeof(MemProfEntry));
+            if (!grown) break;
+            entries = grown;
+        }
+        entries[n].bytes = strtoll(line, NULL, 10);
+        entries[n].count = strtoll(f1 + 1, NULL, 10);
+        entries[n].type = strdup(f2 + 1);
+        entries[n].site = strdup(f3 + 1);
+        n++;
+    }
+    free(line);
+    fclose(fp);
+    if (entries) qsort(entries, n, sizeof(MemProfEntry), memprof_entry_cmp);
+    *count = n;
+    return entries;
+}
+
+static void memprof_entries_free(MemProfEntry *entries, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free(entries[i].type);
+        free(entries[i].site);
+    }
+    free(entries);
+}
+
+/* Sort helper for the diff result: largest growth first */
+typedef struct MemProfChange {
+    MemProfEntry *entry;       /* Type and site names */
+    int64_t bytes, count;      /* Change */
+    int64_t live_bytes, live_count;
+} MemProfChange;
+
+static int memprof_change_cmp(const void *a, const void *b) {
+    const MemProfChange *x = a, *y = b;
+    if (x->bytes != y->bytes) return x->bytes > y->bytes ? -1 : 1;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return memprof_entry_cmp(x->entry, y->entry);
+}
+
+StradaValue* strada_memprof_diff(const char *before, const char *after) {
+    size_t na = 0, nb = 0;
+    MemProfEntry *a = memprof_load(before, &na);
+    MemProfEntry *b = a ? memprof_load(after, &nb) : NULL;
+    if (!a || !b) {
+        if (a) memprof_entries_free(a, na);
+        return strada_new_undef();
+    }
+
+    /* Both lists are sorted by site and type: walk them together */
+    MemProfChange *changes = malloc((na + nb + 1) * sizeof(MemProfChange));
+    size_t nc = 0, i = 0, j = 0;
+    while (i < na || j < nb) {
+        int c = (i == na) ? 1 : (j == nb) ? -1 : memprof_entry_cmp(&a[i], &b[j]);
+        MemProfChange ch;
+        if (c < 0) {
+            ch.entry = &a[i];
+            ch.bytes = -a[i].bytes;
+            ch.count = -a[i].count;
+            ch.live_bytes = ch.live_count = 0;
+            i++;
+        } else if (c > 0) {
+            ch.entry = &b[j];
+            ch.bytes = b[j].bytes;
+            ch.count = b[j].count;
+            ch.live_bytes = b[j].bytes;
+            ch.live_count = b[j].count;
+            j++;
+        } else {
+            ch.entry = &b[j];
+            ch.bytes = b[j].bytes - a[i].bytes;
+            ch.count = b[j].count - a[i].count;
+            ch.live_bytes = b[j].bytes;
+            ch.live_count = b[j].count;
+            i++;
+            j++;
+        }
+        if (ch.bytes != 0 || ch.count != 0) changes[nc++] = ch;
+    }
+    qsort(changes, nc, sizeof(MemProfChange), memprof_change_cmp);
+
+    StradaValue *result = strada_new_array();
+    for (size_t k = 0; k < nc; k++) {
+        StradaValue *h = strada_new_hash();
+        strada_hash_set(h->value.hv, "site", strada_new_str(changes[k].entry->site));
+        strada_hash_set(h->value.hv, "type", strada_new_str(changes[k].entry->type));
+        strada_hash_set(h->value.hv, "bytes", strada_new_int(changes[k].bytes));
+        strada_hash_set(h->value.hv, "count", strada_new_int(changes[k].count));
+        strada_hash_set(h->value.hv, "live_bytes", strada_new_int(changes[k].live_bytes));
+        strada_hash_set(h->value.hv, "live_count", strada_new_int(changes[k].live_count));
+        strada_array_push_take(result->value.av, strada_ref_create_take(h));
+    }
+    free(changes);
+    memprof_entries_free(a, na);
+    memprof_entries_free(b, nb);
+    return strada_ref_create_take(result);
 }
 
 void strada_memprof_report(void) {
@@ -10951,7 +18141,7 @@ void strada_memprof_report(void) {
     uint64_t total_allocs = 0, total_frees = 0, total_current = 0;
     uint64_t total_cur_bytes = 0, total_peak_bytes = 0;
 
-    for (int i = 0; i < 13; i++) {
+    for (int i = 0; i < 16; i++) {
         MemProfStats *s = &memprof_stats[i];
         if (s->alloc_count == 0) continue;
 
@@ -10983,6 +18173,44 @@ void strada_memprof_report(void) {
         fprintf(stderr, "║ WARNING: %lu values still allocated (possible memory leak)                   ║\n",
                 (unsigned long)total_current);
     }
+
+    /* Largest live sites, when the program was built with --memprof */
+    size_t nrows = 0;
+    MemProfRow *rows = memprof_collect(&nrows);
+    int has_sites = 0;
+    for (size_t i = 0; i < nrows; i++) {
+        if (rows[i].site) has_sites = 1;
+    }
+    if (has_sites) {
+        fprintf(stderr, "╠══════════════════════════════════════════════════════════════════════════════╣\n");
+        fprintf(stderr, "║   Live Bytes      Live Type       Allocation site                            ║\n");
+        char label[1024];
+        for (size_t i = 0; i < nrows && i < 10; i++) {
+            memprof_site_label(rows[i].site, label, sizeof(label));
+            fprintf(stderr, "║ %12lu %9lu %-10s %-42.42s ║\n",
+                    (unsigned long)rows[i].bytes, (unsigned long)rows[i].count,
+                    memprof_type_names[rows[i].type], label);
+        }
+    }
+    free(rows);
+
+    fprintf(stderr, "╠══════════════════════════════════════════════════════════════════════════════╣\n");
+    if (strada_slab_enabled()) {
+        fprintf(stderr, "║ Slab class      Obj Size    Chunks    Slab Bytes   Depot Objs               ║\n");
+        for (int i = 0; i < STRADA_SLAB_CLASS_COUNT; i++) {
+            StradaSlabDepot *d = &strada_slab_depots[i];
+            pthread_mutex_lock(&d->lock);
+            fprintf(stderr, "║ %-12s %11lu %9lu %13lu %12lu               ║\n",
+                    strada_slab_names[i],
+                    (unsigned long)strada_slab_sizes[i],
+                    (unsigned long)d->chunk_count,
+                    (unsigned long)(d->chunk_count * STRADA_SLAB_CHUNK_BYTES),
+                    (unsigned long)d->depot_objects);
+            pthread_mutex_unlock(&d->lock);
+        }
+    } else {
+        fprintf(stderr, "║ Allocator: system malloc (STRADA_ALLOC=system)                               ║\n");
+    }
     fprintf(stderr, "╚══════════════════════════════════════════════════════════════════════════════╝\n");
 }
 
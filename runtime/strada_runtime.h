@@ -63,12 +63,17 @@ typedef enum {
     STRADA_ATOMIC      /* Atomic integer for lock-free operations */
 } StradaType;
 
+/* Entry taking the arguments as an array; missing ones are passed as undef */
+typedef StradaValue* (*StradaClosureEntryV)(StradaValue ***captures, int argc, StradaValue **argv);
+
 /* Closure structure */
 typedef struct StradaClosure {
     void *func_ptr;           /* Pointer to generated C function */
+    StradaClosureEntryV call_v; /* Same function taking an argument array, or NULL */
     int param_count;          /* Number of parameters */
     int capture_count;        /* Number of captured variables */
     StradaValue ***captures;  /* Array of pointers to pointers (capture-by-reference) */
+    uint32_t gc_bits;         /* Cycle collector slot and weak-target flag */
 } StradaClosure;
 
 /* Thread types - store pthread handles as opaque pointers */
@@ -94,29 +99,51 @@ typedef struct StradaCond {
 typedef struct StradaFuture StradaFuture;
 typedef struct StradaTask StradaTask;
 typedef struct StradaThreadPool StradaThreadPool;
+typedef struct StradaFutureCont StradaFutureCont;
 
-/* Task for thread pool queue */
+/* Task for thread pool queue. Each future embeds its own task, so
+ * submitting allocates nothing. */
 struct StradaTask {
     StradaValue *closure;           /* Closure to execute */
     StradaFuture *future;           /* Associated future */
-    struct StradaTask *next;        /* Next task in queue */
+    struct StradaTask *next;        /* Next task in the injection queue */
 };
 
+/* Growable ring buffer behind a worker's deque. Retired rings are kept
+ * until shutdown because a thief may still be reading one. */
+typedef struct StradaTaskRing {
+    int64_t mask;                   /* Capacity - 1 (capacity is a power of 2) */
+    struct StradaTaskRing *prev;    /* Retired smaller ring */
+    StradaTask *slots[];
+} StradaTaskRing;
+
+/* Per-worker Chase-Lev deque: the owner pushes and pops at the bottom,
+ * other workers steal from the top. */
+typedef struct StradaTaskDeque {
+    int64_t top;                    /* Next slot to steal (thieves) */
+    char pad_top[56];
+    int64_t bottom;                 /* Next free slot (owner only) */
+    StradaTaskRing *ring;
+    char pad_bottom[48];
+} StradaTaskDeque;
+
 /* Thread pool for async operations */
 struct StradaThreadPool {
     pthread_t *workers;             /* Worker threads */
     int worker_count;               /* Number of workers */
     int running;                    /* 1 if pool is active */
+    StradaTaskDeque *deques;        /* One deque per worker */
 
-    /* Task queue */
+    /* Injection queue for tasks submitted from outside the pool */
     StradaTask *queue_head;
     StradaTask *queue_tail;
     int queue_size;
 
     /* Synchronization */
     pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_cond;      /* Workers wait on this */
+    pthread_cond_t queue_cond;      /* Idle workers wait on this */
     pthread_cond_t empty_cond;      /* For shutdown wait */
+    int idle_count;                 /* Workers waiting on queue_cond */
 };
 
 /* Future states */
@@ -143,15 +170,35 @@ struct StradaFuture {
     /* For timeout support */
     struct timespec deadline;       /* Absolute deadline (0 = no timeout) */
     int has_deadline;
+
+    StradaTask task;                /* Pool queue node */
+    int in_pool;                    /* 1 until a worker is done with task */
+    int detached;                   /* No StradaValue; freed after running */
+
+    StradaFutureCont *conts;        /* Run when the future settles */
+};
+
+/* Continuation registered with async::then */
+struct StradaFutureCont {
+    StradaValue *callback;          /* Called with the source's result */
+    StradaValue *source;            /* Future being waited on */
+    StradaValue *target;            /* Receives the callback's result */
+    struct StradaFutureCont *next;
 };
 
 /* Global thread pool */
 extern StradaThreadPool *strada_thread_pool;
 
 /* Pool management */
-void strada_pool_init(int num_workers);
+void strada_pool_init(int num_workers);  /* <= 0: STRADA_POOL_SIZE or CPU count */
 void strada_pool_shutdown(void);
 void strada_pool_submit(StradaFuture *future);
+int strada_pool_size(void);              /* Workers in (or planned for) the pool */
+
+/* pmap / pgrep / psort: the block runs on the pool over chunks of input */
+StradaValue* strada_pmap(StradaValue *block, StradaArray *input);
+StradaValue* strada_pgrep(StradaValue *block, StradaArray *input);
+StradaValue* strada_psort(StradaValue *block, StradaArray *input);  /* block NULL: string order */
 
 /* Future creation and operations */
 StradaValue* strada_future_new(StradaValue *closure);
@@ -162,6 +209,11 @@ StradaValue* strada_future_try_get(StradaValue *future);
 void strada_future_cancel(StradaValue *future);
 int strada_future_is_cancelled(StradaValue *future);
 
+/* Futures settled by runtime code rather than by a pool task */
+StradaValue* strada_future_pending(void);
+void strada_future_settle(StradaValue *future, StradaValue *result, StradaValue *error);  /* Takes ownership */
+StradaValue* strada_future_then(StradaValue *future, StradaValue *callback);
+
 /* Combinators */
 StradaValue* strada_future_all(StradaValue *futures_array);
 StradaValue* strada_future_race(StradaValue *futures_array);
@@ -179,7 +231,17 @@ typedef struct StradaChannelNode {
     struct StradaChannelNode *next;
 } StradaChannelNode;
 
-/* Thread-safe channel for inter-thread communication */
+/* Slot of a bounded channel's ring. seq == position: free for the sender
+ * claiming that position; seq == position + 1: holds its value. */
+typedef struct StradaChannelCell {
+    size_t seq;
+    StradaValue *value;
+} StradaChannelCell;
+
+/* Thread-safe channel for inter-thread communication. Unbounded channels
+ * are a linked list under the mutex. Bounded channels are a lock-free
+ * MPMC ring; the mutex and condvars there only park threads that found
+ * the ring full or empty. */
 typedef struct StradaChannel {
     pthread_mutex_t mutex;          /* Protects all fields */
     pthread_cond_t not_empty;       /* Signaled when items added */
@@ -190,6 +252,16 @@ typedef struct StradaChannel {
     int size;                       /* Current number of items */
     int capacity;                   /* Max items (0 = unbounded) */
     int closed;                     /* 1 if channel is closed */
+
+    /* Bounded channels only */
+    StradaChannelCell *ring;        /* capacity cells */
+    int send_waiters;               /* Senders parked on not_full */
+    int recv_waiters;               /* Receivers parked on not_empty */
+    char pad_send[64];
+    size_t send_pos;                /* Next position to fill */
+    char pad_recv[56];
+    size_t recv_pos;                /* Next position to drain */
+    char pad_end[56];
 } StradaChannel;
 
 /* Channel operations */
@@ -201,6 +273,24 @@ StradaValue* strada_channel_try_recv(StradaValue *channel);
 void strada_channel_close(StradaValue *channel);
 int strada_channel_is_closed(StradaValue *channel);
 int strada_channel_len(StradaValue *channel);
+int64_t strada_channel_send_many(StradaValue *channel, StradaValue *items_ref);
+StradaValue* strada_channel_recv_many(StradaValue *channel, int64_t max);
+
+/* ============================================================
+ * Event Loop - Readiness for Sockets and Timers
+ * ============================================================ */
+
+/* One loop thread waits on epoll (Linux), kqueue (macOS/BSD) or poll.
+ * Waiting futures and watchers cost no thread while they wait; callbacks
+ * run on the async pool. */
+#define STRADA_LOOP_READ  1
+#define STRADA_LOOP_WRITE 2
+
+StradaValue* strada_loop_io(StradaValue *sock, int events, int64_t timeout_ms);  /* Future: 1 ready, 0 timed out */
+StradaValue* strada_loop_sleep(int64_t ms);                                      /* Future: undef after ms */
+int64_t strada_loop_watch(StradaValue *sock, StradaValue *events, StradaValue *callback);
+int64_t strada_loop_timer(int64_t ms, StradaValue *callback, int repeat);
+int strada_loop_unwatch(int64_t id);
 
 /* ============================================================
  * Atomic - Lock-free Integer Operations
@@ -253,52 +343,127 @@ struct StradaValue {
         StradaHash *hv;  /* Hash reference */
         StradaValue *rv; /* Generic reference */
         FILE *fh;        /* File handle */
-        regex_t *rx;     /* Compiled regex */
+        struct StradaRx *rx;  /* Compiled regex (PCRE2 or POSIX) */
         StradaSocketBuffer *sock;  /* Buffered socket */
         void *ptr;       /* Generic C pointer */
     } value;
 
-    /* C struct metadata (when type == STRADA_CSTRUCT) */
-    char *struct_name;   /* Name of C struct type */
+    /* C struct metadata (when type == STRADA_CSTRUCT). Strings keep their
+     * length in struct_size and their buffer capacity in str_cap. */
+    union {
+        char *struct_name;   /* Name of C struct type */
+        size_t str_cap;      /* Bytes allocated for pv (0 = struct_size + 1) */
+    };
     size_t struct_size;  /* Size of struct in bytes */
 
     /* Blessed package (for OOP - like Perl's bless) */
     char *blessed_package;  /* Package name this ref is blessed into, or NULL */
 };
 
-/* Array structure - like Perl's AV */
+/* Array structure - like Perl's AV. shift() advances elements instead of
+ * moving the rest down, so the allocation starts head slots earlier;
+ * elements[0..size) is always the live range. */
 struct StradaArray {
     StradaValue **elements;
     size_t size;
-    size_t capacity;
+    size_t capacity;     /* Slots from elements to the end of the allocation */
+    size_t head;         /* Free slots before elements */
     int refcount;
+    uint32_t gc_bits;    /* Cycle collector slot and weak-target flag */
 };
 
-/* Hash entry */
+/* Hash slot (key == NULL means the slot is empty) */
 typedef struct StradaHashEntry {
-    char *key;
+    char *key;           /* Interned, shared with every other hash */
     StradaValue *value;
-    struct StradaHashEntry *next;
+    uint32_t hash;       /* Cached hash of key */
+    uint32_t key_len;
 } StradaHashEntry;
 
-/* Hash structure - like Perl's HV */
+/* Hash structure - like Perl's HV. Open addressing (Robin Hood);
+ * entries is NULL until the first insert. */
 struct StradaHash {
-    StradaHashEntry **buckets;
-    size_t num_buckets;
+    StradaHashEntry *entries;
+    size_t num_buckets;  /* Slot count, a power of two (0 before first insert) */
     size_t num_entries;
     int refcount;
+    uint32_t gc_bits;    /* Cycle collector slot and weak-target flag */
 };
 
+/* Literal hash key emitted by the compiler (one per distinct string in a
+ * file). key and hash are filled in on first use, because the hash seed
+ * is chosen when the process starts. */
+typedef struct StradaHashKey {
+    const char *name;
+    const char *key;     /* Interned key, NULL until resolved */
+    uint32_t hash;
+} StradaHashKey;
+
+/* Slab allocator for runtime headers (STRADA_ALLOC=system uses malloc) */
+typedef enum {
+    STRADA_SLAB_VALUE,       /* StradaValue */
+    STRADA_SLAB_ARRAY,       /* StradaArray */
+    STRADA_SLAB_HASH,        /* StradaHash */
+    STRADA_SLAB_STR,         /* StradaValue + inline short string */
+    STRADA_SLAB_CLASS_COUNT
+} StradaSlabClass;
+
+/* Strings shorter than STRADA_STR_INLINE_CAP bytes are stored in the same
+ * allocation as their StradaValue, right after it; value.pv points there,
+ * so code reading value.pv does not need to care. */
+#define STRADA_STR_INLINE_CAP 24
+#define STRADA_STR_IS_INLINE(sv) ((sv)->value.pv == (char *)((sv) + 1))
+
+/* Flag bits in a string's str_cap (capacities and pointers are multiples
+ * of 8). A view's str_cap holds the value that owns its buffer: value.pv
+ * points at a NUL-terminated tail of that buffer, which nobody may modify
+ * while views of it exist. */
+#define STRADA_STR_VIEW   ((size_t)1)  /* str_cap is (owner | flags) */
+#define STRADA_STR_ASCII  ((size_t)2)  /* No UTF-8 continuation bytes or NULs */
+#define STRADA_STR_MAPPED ((size_t)4)  /* pv is a read-only file mapping; str_cap is (map length | flags) */
+#define STRADA_STR_FLAGS  ((size_t)7)
+#define STRADA_STR_IS_VIEW(sv) (((sv)->str_cap & STRADA_STR_VIEW) != 0)
+#define STRADA_STR_IS_MAPPED(sv) (((sv)->str_cap & STRADA_STR_MAPPED) != 0)
+#define STRADA_STR_OWNER(sv) ((StradaValue *)((sv)->str_cap & ~STRADA_STR_FLAGS))
+
+void* strada_slab_alloc(StradaSlabClass cls);
+void strada_slab_free(StradaSlabClass cls, void *ptr);
+int strada_slab_enabled(void);  /* 1 if slabs are in use, 0 for system malloc */
+
+/* Immortal values: shared statics that incref/decref never touch.
+ * Small ints, true/false, the empty string and undef_static are immortal. */
+#define STRADA_REFCOUNT_IMMORTAL 0x40000000
+#define STRADA_IS_IMMORTAL(sv) ((sv)->refcount >= STRADA_REFCOUNT_IMMORTAL)
+#define STRADA_SMALL_INT_MIN (-128)
+#define STRADA_SMALL_INT_MAX 1023
+extern StradaValue strada_small_ints[];
+/* Immortal int for a compile-time constant known to be in range */
+#define STRADA_SMALL_INT(i) (&strada_small_ints[(i) - STRADA_SMALL_INT_MIN])
+
+/* References keep flags in struct_size, which they do not otherwise use.
+ * A weak reference does not own its referent and turns into undef when
+ * the referent is freed. */
+#define STRADA_REF_WEAK      ((size_t)1)
+#define STRADA_REF_DESTROYED ((size_t)2)  /* DESTROY already ran (cycle collector) */
+#define STRADA_IS_WEAK_REF(sv) ((sv)->type == STRADA_REF && ((sv)->struct_size & STRADA_REF_WEAK))
+
 /* Value creation functions */
 StradaValue* strada_new_undef(void);
 StradaValue* strada_undef_static(void);  /* Static singleton for void returns */
-StradaValue* strada_new_int(int64_t i);
+StradaValue* strada_new_int(int64_t i);  /* Immortal for -128..1023 */
+StradaValue* strada_new_bool(int b);     /* Immortal 1 or 0 */
+StradaValue* strada_true(void);
+StradaValue* strada_false(void);
+StradaValue* strada_empty_str(void);     /* Immortal "" */
 StradaValue* strada_new_num(double n);
 StradaValue* strada_safe_div(double a, double b);      /* Returns undef if b==0 */
 StradaValue* strada_safe_mod(int64_t a, int64_t b);    /* Returns undef if b==0 */
+StradaValue* strada_box_int(StradaValue **box, int64_t i);  /* Borrowed; reuses *box */
+StradaValue* strada_box_num(StradaValue **box, double n);
 StradaValue* strada_new_str(const char *s);
 StradaValue* strada_new_str_take(char *s);  /* Take ownership of string */
 StradaValue* strada_new_str_len(const char *s, size_t len);  /* Binary-safe string */
+StradaValue* strada_new_str_take_len(char *s, size_t len, size_t cap);  /* Take a malloc'd buffer of cap bytes */
 size_t strada_str_len(StradaValue *sv);  /* Get string length (binary-safe) */
 StradaValue* strada_new_array(void);
 StradaValue* strada_new_hash(void);
@@ -307,11 +472,16 @@ StradaValue* strada_new_filehandle(FILE *fh);
 /* Reference counting */
 void strada_incref(StradaValue *sv);
 void strada_decref(StradaValue *sv);
+/* Refcounts are non-atomic until the runtime starts its first thread.
+ * C extensions that spawn their own threads must call this first. */
+void strada_refcount_atomic_enable(void);
+void strada_set_single_threaded(void);  /* --single-threaded: never go atomic */
 
 /* Type conversion */
 int64_t strada_to_int(StradaValue *sv);
 double strada_to_num(StradaValue *sv);
 char* strada_to_str(StradaValue *sv);
+const char* strada_str_peek(StradaValue *sv, char **tmp);  /* Text without copying a string; caller frees *tmp */
 int strada_to_bool(StradaValue *sv);
 
 /* String comparison with C literals (no temporaries) */
@@ -348,6 +518,11 @@ int64_t strada_size(StradaValue *sv);
 StradaValue* strada_new_array_from_av(StradaArray *av);
 StradaValue* strada_sort(StradaValue *arr);   /* Sort array alphabetically */
 StradaValue* strada_nsort(StradaValue *arr);  /* Sort array numerically */
+/* Keyed sorts for sort blocks CodeGen recognizes (KEY($a) <=> KEY($b),
+ * cmp, reversed): one key per element, consumed. Stable. */
+StradaValue* strada_sort_num_keys(StradaArray *input, double *keys, int desc);
+StradaValue* strada_sort_str_keys(StradaArray *input, StradaValue **keys, int desc);
+StradaValue* strada_sort_block(StradaValue *block, StradaArray *input);  /* Any other comparator */
 StradaValue* strada_range(StradaValue *start, StradaValue *end);  /* Create array from range */
 
 /* Hash operations */
@@ -357,6 +532,11 @@ void strada_set_hash_default_capacity(int64_t capacity);
 void strada_hash_set(StradaHash *hv, const char *key, StradaValue *sv);
 StradaValue* strada_hash_get(StradaHash *hv, const char *key);
 int strada_hash_exists(StradaHash *hv, const char *key);
+void strada_hash_set_h(StradaHash *hv, StradaHashKey *hk, StradaValue *sv);
+StradaValue* strada_hash_get_h(StradaHash *hv, StradaHashKey *hk);
+int strada_hash_exists_h(StradaHash *hv, StradaHashKey *hk);
+void strada_hash_delete_h(StradaHash *hv, StradaHashKey *hk);
+const char* strada_hash_key_resolve(StradaHashKey *hk);
 void strada_hash_delete(StradaHash *hv, const char *key);
 StradaArray* strada_hash_keys(StradaHash *hv);
 StradaArray* strada_hash_values(StradaHash *hv);
@@ -367,8 +547,10 @@ void strada_hash_reserve_sv(StradaValue *sv, int64_t capacity);
 char* strada_concat(const char *a, const char *b);
 char* strada_concat_free(char *a, char *b);  /* Concat and free inputs (avoids leaks) */
 StradaValue* strada_concat_sv(StradaValue *a, StradaValue *b);  /* Fast concat on StradaValues */
+StradaValue* strada_concat_inplace(StradaValue *a, StradaValue *b);  /* Append to an unaliased local, consumes a */
 size_t strada_length(const char *s);      /* Returns character count (UTF-8 codepoints) */
 size_t strada_length_sv(StradaValue *sv); /* Binary-safe length using struct_size */
+size_t strada_char_length_sv(StradaValue *sv); /* length(): characters, no copy */
 size_t strada_bytes(const char *s);       /* Returns byte count */
 StradaValue* strada_char_at(StradaValue *str, StradaValue *index);  /* Fast char code by index */
 StradaValue* strada_substr(StradaValue *str, int64_t offset, int64_t length);
@@ -376,6 +558,14 @@ StradaValue* strada_substr_bytes(StradaValue *str, int64_t offset, int64_t lengt
 int strada_index(const char *haystack, const char *needle);
 int strada_index_offset(const char *haystack, const char *needle, int offset);
 int strada_rindex(const char *haystack, const char *needle);
+/* Binary-safe forms on values, using the stored length and the vector
+ * string kernels. Positions are in characters; rindex with INT64_MAX
+ * searches the whole string. */
+int64_t strada_index_sv(StradaValue *str, StradaValue *sub, int64_t offset);
+int64_t strada_rindex_sv(StradaValue *str, StradaValue *sub, int64_t position);
+StradaValue* strada_case_sv(StradaValue *sv, int upper);   /* uc (1) / lc (0) */
+StradaValue* strada_trim_sv(StradaValue *sv, int mode);    /* 1 = ltrim, 2 = rtrim, 3 = trim */
+StradaValue* strada_join_sv(StradaValue *sep, StradaArray *arr);
 char* strada_upper(const char *str);
 char* strada_lower(const char *str);
 char* strada_uc(const char *str);  /* Alias for upper */
@@ -400,6 +590,7 @@ StradaValue* strada_pack(const char *fmt, StradaValue *args);  /* Pack values in
 StradaValue* strada_unpack(const char *fmt, StradaValue *data);  /* Unpack binary string to array */
 StradaValue* strada_base64_encode(StradaValue *sv);  /* Encode string to base64 */
 StradaValue* strada_base64_decode(StradaValue *sv);  /* Decode base64 to string */
+StradaValue* strada_fnv1a(StradaValue *sv);  /* Stable 64-bit digest as 16 hex digits */
 char* strada_chomp(const char *str);
 char* strada_chop(const char *str);
 int strada_strcmp(const char *s1, const char *s2);
@@ -416,6 +607,20 @@ StradaValue* strada_sb_length(StradaValue *sb);                /* Get current le
 void strada_sb_clear(StradaValue *sb);                         /* Clear buffer */
 void strada_sb_free(StradaValue *sb);                          /* Free StringBuilder */
 
+/* Native JSON engine (lib/JSON.strada wraps these) */
+StradaValue* strada_json_decode(StradaValue *text);            /* undef on invalid JSON */
+StradaValue* strada_json_encode(StradaValue *value, int canonical);
+const char* strada_json_error(void);                           /* Why the last decode failed */
+int strada_json_parse_events(StradaValue *text, StradaValue *callback);   /* Event (SAX) mode */
+int64_t strada_json_decode_each(StradaValue *text, StradaValue *callback); /* NDJSON, one call per line */
+int64_t strada_json_each_file(const char *path, StradaValue *callback);   /* NDJSON file; -1 if unreadable */
+
+/* Native CSV parser (lib/Text/CSV.strada wraps these; csv is the Text::CSV object) */
+int strada_csv_parse(StradaValue *csv, StradaValue *line);       /* Sets fields / error; 1 on success */
+StradaValue* strada_csv_getline(StradaValue *csv, StradaValue *fh); /* Next record, or undef */
+int64_t strada_csv_parse_file_parallel(StradaValue *csv, const char *path, StradaValue *callback,
+                                       int64_t chunk_size);      /* Records; -1 if unreadable */
+
 /* I/O functions */
 void strada_print(StradaValue *sv);
 void strada_say(StradaValue *sv);
@@ -432,6 +637,10 @@ StradaValue* strada_open(const char *filename, const char *mode);
 void strada_close(StradaValue *fh);
 StradaValue* strada_read_file(StradaValue *fh);
 StradaValue* strada_read_line(StradaValue *fh);
+StradaValue* strada_map_file(const char *path, int advice);   /* Read-only mapped string, NULL if unmappable */
+StradaValue* strada_slurp_mmap(const char *path, const char *advice);  /* Mapped slurp, falls back to strada_slurp */
+StradaValue* strada_lines(StradaValue *file);                 /* Line iterator closure for a path or handle */
+int64_t strada_each_line(StradaValue *file, StradaValue *callback);  /* Call callback per line; -1 if unopenable */
 StradaValue* strada_read_all_lines(StradaValue *fh);
 void strada_write_file(StradaValue *fh, const char *content);
 int strada_file_exists(const char *filename);
@@ -458,22 +667,77 @@ void strada_backtrace(void);
 char* strada_stacktrace_str(void);  /* Returns stack trace as string */
 const char* strada_caller(int level);
 
-/* Exception handling (try/catch/throw) */
-#define STRADA_MAX_TRY_DEPTH 64
+/* Exception handling (try/catch/throw)
+ *
+ * Both stacks are per thread and grow on demand. A try context
+ * remembers how deep the cleanup stack was when the try was entered;
+ * a throw releases everything pushed since then while the frames that
+ * pushed it are still live, and only then jumps to the catch.
+ *
+ * Generated code enters a try with STRADA_TRY_ENTER(). Where the
+ * compiler has __builtin_setjmp that saves only the frame, stack
+ * pointer and resume address instead of the full register set and
+ * signal state. STRADA_TRY_PUSH() still hands out a jmp_buf for
+ * setjmp() in hand-written C. */
+#ifndef STRADA_FAST_TRY
+#if defined(__GNUC__) && !defined(__TINYC__) && (!defined(__clang__) || defined(__x86_64__))
+#define STRADA_FAST_TRY 1
+#else
+#define STRADA_FAST_TRY 0
+#endif
+#endif
+
 typedef struct {
-    jmp_buf buf;
-    int active;
+    union {
+        jmp_buf jb;
+        void *fast[5];      /* __builtin_setjmp buffer */
+    } buf;
+    int fast;               /* Entered with __builtin_setjmp */
+    int cleanup_mark;       /* strada_cleanup_top at entry */
 } StradaTryContext;
 
-extern StradaTryContext strada_try_stack[STRADA_MAX_TRY_DEPTH];
-extern int strada_try_depth;
-extern char *strada_exception_msg;
+/* Pending cleanup entry: a variable slot, or a value pushed by
+ * strada_cleanup_push(). A slot is read when the entry is drained, so a
+ * variable reassigned after it was pushed releases its current value. */
+typedef struct {
+    StradaValue * volatile *slot;
+    StradaValue *sv;
+} StradaCleanupEntry;
+
+#ifdef __TINYC__
+/* TinyCC has no thread-local storage: code it compiles (strada --jit)
+ * reaches the calling thread's copies through the runtime */
+StradaTryContext **strada_tls_try_stack(void);
+int *strada_tls_try_depth(void);
+int *strada_tls_try_cap(void);
+char **strada_tls_exception_msg(void);
+StradaCleanupEntry **strada_tls_cleanup_stack(void);
+int *strada_tls_cleanup_top(void);
+int *strada_tls_cleanup_cap(void);
+#define strada_try_stack (*strada_tls_try_stack())
+#define strada_try_depth (*strada_tls_try_depth())
+#define strada_try_cap (*strada_tls_try_cap())
+#define strada_exception_msg (*strada_tls_exception_msg())
+#define strada_cleanup_stack (*strada_tls_cleanup_stack())
+#define strada_cleanup_top (*strada_tls_cleanup_top())
+#define strada_cleanup_cap (*strada_tls_cleanup_cap())
+#else
+extern __thread StradaTryContext *strada_try_stack;
+extern __thread int strada_try_depth;
+extern __thread int strada_try_cap;
+extern __thread char *strada_exception_msg;
+extern __thread StradaCleanupEntry *strada_cleanup_stack;
+extern __thread int strada_cleanup_top;
+extern __thread int strada_cleanup_cap;
+#endif
 
 void strada_throw(const char *msg);
 void strada_throw_value(StradaValue *sv);
 StradaValue* strada_get_exception(void);
 void strada_clear_exception(void);
 int strada_in_try_block(void);
+void strada_try_grow(void);
+void strada_cleanup_grow(void);
 
 /* Pending cleanup for function call args and local vars in try blocks */
 void strada_cleanup_push(StradaValue *sv);
@@ -483,10 +747,36 @@ int strada_cleanup_mark(void);         /* Get current depth */
 void strada_cleanup_restore(int mark); /* Restore to depth (no decref) */
 void strada_cleanup_drain_to(int mark); /* Drain to depth (with decref) */
 
+static inline StradaTryContext *strada_try_next(int fast) {
+    if (strada_try_depth == strada_try_cap) strada_try_grow();
+    StradaTryContext *ctx = &strada_try_stack[strada_try_depth++];
+    ctx->fast = fast;
+    ctx->cleanup_mark = strada_cleanup_top;
+    return ctx;
+}
+
+static inline void strada_cleanup_push_slot(StradaValue * volatile *slot) {
+    if (strada_cleanup_top == strada_cleanup_cap) strada_cleanup_grow();
+    strada_cleanup_stack[strada_cleanup_top].slot = slot;
+    strada_cleanup_top++;
+}
+
 /* Macros for try/catch - used by generated code */
-#define STRADA_TRY_PUSH() (strada_try_depth < STRADA_MAX_TRY_DEPTH ? \
-    (strada_try_stack[strada_try_depth].active = 1, &strada_try_stack[strada_try_depth++].buf) : NULL)
-#define STRADA_TRY_POP() (strada_try_depth > 0 ? (strada_try_stack[--strada_try_depth].active = 0, 1) : 0)
+#define STRADA_TRY_PUSH() (&strada_try_next(0)->buf.jb)
+#if STRADA_FAST_TRY
+#define STRADA_TRY_ENTER() __builtin_setjmp(strada_try_next(1)->buf.fast)
+#else
+#define STRADA_TRY_ENTER() setjmp(*STRADA_TRY_PUSH())
+#endif
+#define STRADA_TRY_POP() (strada_try_depth > 0 ? (--strada_try_depth, 1) : 0)
+/* Leave a try normally: entries pushed inside it are released by scope cleanup */
+#define STRADA_TRY_END() \
+    (strada_cleanup_top = strada_try_stack[--strada_try_depth].cleanup_mark)
+
+/* Register a variable for release if an exception unwinds past it;
+ * STRADA_CLEANUP_DROP(n) forgets the last n without releasing them */
+#define STRADA_CLEANUP_PUSH(var) strada_cleanup_push_slot(&(var))
+#define STRADA_CLEANUP_DROP(n) (strada_cleanup_top -= (n))
 
 /* Type introspection and casting */
 const char* strada_typeof(StradaValue *sv);
@@ -513,6 +803,7 @@ StradaValue* strada_ref_hash(StradaHash **ptr);       /* Reference to hash */
 
 /* New Perl-style reference functions */
 StradaValue* strada_new_ref(StradaValue *target, char ref_type);  /* \$var, \@arr, \%hash */
+StradaValue* strada_new_scalar_ref(StradaValue **slot);  /* \$var - unshares an immortal first */
 StradaValue* strada_deref(StradaValue *ref);          /* $$ref - deref scalar ref */
 StradaValue* strada_deref_set(StradaValue *ref, StradaValue *new_value); /* deref_set($ref, $val) */
 StradaHash* strada_deref_hash(StradaValue *ref);      /* For $ref->{key} */
@@ -520,6 +811,7 @@ StradaArray* strada_deref_array(StradaValue *ref);    /* For $ref->[index] */
 StradaValue* strada_deref_hash_value(StradaValue *ref);  /* deref_hash() builtin */
 StradaValue* strada_deref_array_value(StradaValue *ref); /* deref_array() builtin */
 StradaValue* strada_anon_hash(int count, ...);        /* { key => val, ... } */
+StradaValue* strada_anon_hash_h(int count, ...);      /* Same, StradaHashKey* keys */
 StradaValue* strada_anon_array(int count, ...);       /* [ elem, ... ] */
 StradaValue* strada_array_from_ref(StradaValue *ref); /* Copy array from ref */
 StradaValue* strada_hash_from_ref(StradaValue *ref);  /* Copy hash from ref */
@@ -535,6 +827,9 @@ void strada_inherit(const char *child, const char *parent);     /* Set up inheri
 void strada_inherit_from(const char *parent);                   /* Inherit from parent (1 arg, uses current package) */
 void strada_method_register(const char *package, const char *name, StradaMethod func);
 StradaValue* strada_method_call(StradaValue *obj, const char *method, StradaValue *args);
+typedef struct StradaMethodSlot StradaMethodSlot;               /* Resolved method (opaque) */
+StradaValue* strada_method_call_ic(StradaValue *obj, const char *method, StradaValue *args,
+                                   StradaMethodSlot **ic);     /* Call through call-site cache */
 const char* strada_method_lookup_package(const char *package, const char *method);
 const char* strada_get_parent_package(const char *package);     /* Get parent package */
 int strada_isa(StradaValue *obj, const char *package);          /* Check inheritance */
@@ -572,7 +867,62 @@ void* strada_cpointer_get(StradaValue *sv);
 
 /* Closure support (uses triple pointers for capture-by-reference) */
 StradaValue* strada_closure_new(void *func, int params, int captures, StradaValue ***cap_array);
+StradaValue* strada_closure_new_v(void *func, StradaClosureEntryV call_v, int params,
+                                  int captures, StradaValue ***cap_array);
 StradaValue* strada_closure_call(StradaValue *closure, int argc, ...);
+StradaValue* strada_closure_call_v(StradaValue *closure, int argc, StradaValue **argv);
+
+/* Argument i of an array entry, undef when the caller passed fewer */
+#define STRADA_CLOSURE_ARG(i) ((i) < argc ? argv[i] : strada_undef_static())
+
+/* Typed calls for 0-4 arguments. A compiled closure whose parameter count
+ * matches is called straight through func_ptr; anything else goes through
+ * strada_closure_call_v(). */
+static inline StradaClosure* strada_closure_direct(StradaValue *c, int argc) {
+    if (c && c->type == STRADA_CLOSURE) {
+        StradaClosure *cl = (StradaClosure*)c->value.ptr;
+        if (cl->call_v && cl->param_count == argc) return cl;
+    }
+    return NULL;
+}
+
+static inline StradaValue* strada_closure_call0(StradaValue *c) {
+    StradaClosure *cl = strada_closure_direct(c, 0);
+    if (cl) return ((StradaValue* (*)(StradaValue***))cl->func_ptr)(cl->captures);
+    return strada_closure_call_v(c, 0, NULL);
+}
+
+static inline StradaValue* strada_closure_call1(StradaValue *c, StradaValue *a0) {
+    StradaClosure *cl = strada_closure_direct(c, 1);
+    if (cl) return ((StradaValue* (*)(StradaValue***, StradaValue*))cl->func_ptr)(cl->captures, a0);
+    StradaValue *argv[1] = { a0 };
+    return strada_closure_call_v(c, 1, argv);
+}
+
+static inline StradaValue* strada_closure_call2(StradaValue *c, StradaValue *a0, StradaValue *a1) {
+    StradaClosure *cl = strada_closure_direct(c, 2);
+    if (cl) return ((StradaValue* (*)(StradaValue***, StradaValue*, StradaValue*))cl->func_ptr)(cl->captures, a0, a1);
+    StradaValue *argv[2] = { a0, a1 };
+    return strada_closure_call_v(c, 2, argv);
+}
+
+static inline StradaValue* strada_closure_call3(StradaValue *c, StradaValue *a0, StradaValue *a1,
+                                                StradaValue *a2) {
+    StradaClosure *cl = strada_closure_direct(c, 3);
+    if (cl) return ((StradaValue* (*)(StradaValue***, StradaValue*, StradaValue*, StradaValue*))cl->func_ptr)(
+        cl->captures, a0, a1, a2);
+    StradaValue *argv[3] = { a0, a1, a2 };
+    return strada_closure_call_v(c, 3, argv);
+}
+
+static inline StradaValue* strada_closure_call4(StradaValue *c, StradaValue *a0, StradaValue *a1,
+                                                StradaValue *a2, StradaValue *a3) {
+    StradaClosure *cl = strada_closure_direct(c, 4);
+    if (cl) return ((StradaValue* (*)(StradaValue***, StradaValue*, StradaValue*, StradaValue*,
+                                      StradaValue*))cl->func_ptr)(cl->captures, a0, a1, a2, a3);
+    StradaValue *argv[4] = { a0, a1, a2, a3 };
+    return strada_closure_call_v(c, 4, argv);
+}
 StradaValue*** strada_closure_get_captures(StradaValue *closure);
 
 /* Enhanced FFI */
@@ -645,6 +995,13 @@ char* strada_regex_replace_all(const char *str, const char *pattern, const char
 StradaArray* strada_string_split(const char *str, const char *delim);
 StradaArray* strada_regex_split(const char *str, const char *pattern);
 StradaArray* strada_regex_capture(const char *str, const char *pattern);
+/* Constant patterns hoisted by the compiler: one slot per call site */
+StradaValue* strada_regex_static(StradaValue **slot, const char *pattern, const char *flags);
+int strada_regex_match_rx(const char *str, StradaValue *rx);
+char* strada_regex_replace_rx(const char *str, StradaValue *rx, const char *replacement, int global);
+StradaArray* strada_regex_split_rx(const char *str, StradaValue *rx);
+StradaArray* strada_regex_split_sv(StradaValue *str, const char *pattern);  /* Binary-safe for plain-text patterns */
+StradaArray* strada_regex_split_rx_sv(StradaValue *str, StradaValue *rx);
 
 /* Socket functions */
 StradaValue* strada_socket_create(void);
@@ -655,6 +1012,10 @@ StradaValue* strada_socket_accept(StradaValue *sock);
 int strada_socket_send(StradaValue *sock, const char *data);
 int strada_socket_send_sv(StradaValue *sock, StradaValue *data);  /* Binary-safe version */
 StradaValue* strada_socket_recv(StradaValue *sock, int max_len);
+int64_t strada_socket_recv_into(StradaValue *sock, StradaValue *buf_ref, int64_t max_len, int append);
+int64_t strada_socket_writev(StradaValue *sock, StradaValue *parts_ref);      /* Send all parts */
+int64_t strada_socket_sendfile(StradaValue *sock, StradaValue *file, int64_t offset, int64_t count);
+int64_t strada_socket_splice(StradaValue *from, StradaValue *to, int64_t max_len);
 void strada_socket_close(StradaValue *sock);
 void strada_socket_flush(StradaValue *sock);  /* Flush write buffer */
 StradaValue* strada_socket_server(int port);
@@ -865,6 +1226,8 @@ StradaValue* strada_qx(StradaValue *cmd);  /* Backtick/qx - run command and capt
 StradaValue* sys_system(StradaValue *cmd);
 StradaValue* sys_qx(StradaValue *cmd);
 StradaValue* sys_unlink(StradaValue *path);
+StradaValue* sys_fnv1a(StradaValue *data);
+StradaValue* sys_getrusage(StradaValue *who);
 
 /* Additional file system */
 StradaValue* strada_truncate(StradaValue *path, StradaValue *length);
@@ -1058,17 +1421,78 @@ StradaValue* strada_c_memset(StradaValue *dest_sv, StradaValue *c_sv, StradaValu
 /* ============================================================
  * Profiling - Function timing and call counts
  * ============================================================ */
+/* One per profiled function, emitted by the compiler next to it (-p).
+ * Counters are shared by all threads and updated atomically; the
+ * descriptor joins the report list on its first call. */
+typedef struct StradaProfFunc {
+    const char *name;
+    uint64_t calls;
+    uint64_t self_ns;
+    uint64_t total_ns;
+    int registered;
+    struct StradaProfFunc *next;
+} StradaProfFunc;
+
 void strada_profile_init(void);
-void strada_profile_enter(const char *func_name);
-void strada_profile_exit(const char *func_name);
+void strada_profile_enter(StradaProfFunc *fn);
+void strada_profile_exit(StradaProfFunc *fn);
 void strada_profile_report(void);
+/* STRADA_PROF=sample: SIGPROF stack sampling, folded stacks at exit */
+void strada_prof_sample_start(void);
+void strada_prof_sample_stop(void);
 
 /* ============================================================
- * Memory Profiler - Track allocations by type
+ * Memory Profiler - Track allocations by type and allocation site
  * ============================================================ */
 void strada_memprof_enable(void);
 void strada_memprof_disable(void);
 void strada_memprof_report(void);
 void strada_memprof_reset(void);
+/* Write live values grouped by site and type; NULL path picks
+ * $STRADA_MEMPROF_OUT.PID.N.heap. Returns the path, or undef. */
+StradaValue* strada_memprof_snapshot(const char *path);
+/* Sites whose live bytes or count changed between two snapshots */
+StradaValue* strada_memprof_diff(const char *before, const char *after);
+
+/* ============================================================
+ * Weak References and Cycle Collector
+ * ============================================================ */
+StradaValue* strada_weaken(StradaValue *ref);  /* Weak copy of ref (owned); other values are returned increfed */
+int strada_isweak(StradaValue *sv);
+/* Track containers made from now on and collect cycles among them */
+void strada_gc_enable(void);
+void strada_gc_disable(void);                  /* Stop automatic collection; tracking goes on */
+int64_t strada_gc_collect(void);               /* Full collection; returns containers freed */
+void strada_gc_set_threshold(int64_t n);       /* New containers between automatic steps */
+StradaValue* strada_gc_stats(void);            /* Hash ref of collector counters */
+
+/* Allocation site: one per statement when compiled with --memprof.
+ * Values made while a site is current are charged to it. */
+typedef struct StradaMemSite {
+    const char *func;
+    const char *file;
+    int line;
+    uint64_t allocs;
+} StradaMemSite;
+
+#ifdef __TINYC__
+StradaMemSite **strada_tls_memprof_site(void);
+#define strada_memprof_site (*strada_tls_memprof_site())
+#else
+extern __thread StradaMemSite *strada_memprof_site;
+#endif
+
+static inline void strada_memprof_site_restore(StradaMemSite **saved) {
+    strada_memprof_site = *saved;
+}
+
+#define STRADA_MEMPROF_SITE(fn, file, line) do { \
+        static StradaMemSite __strada_msite = { fn, file, line, 0 }; \
+        strada_memprof_site = &__strada_msite; \
+    } while (0)
+
+/* Hands the caller's site back when the function returns */
+#define STRADA_MEMPROF_FRAME() \
+    StradaMemSite *__strada_msite_saved __attribute__((cleanup(strada_memprof_site_restore))) = strada_memprof_site
 
 #endif /* STRADA_RUNTIME_H */
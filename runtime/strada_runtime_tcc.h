@@ -54,8 +54,12 @@ struct StradaValue {
         void *ptr;       /* Generic C pointer */
     } value;
 
-    /* C struct metadata (when type == STRADA_CSTRUCT) */
-    char *struct_name;   /* Name of C struct type */
+    /* C struct metadata (when type == STRADA_CSTRUCT). Strings keep their
+     * length in struct_size and their buffer capacity in str_cap. */
+    union {
+        char *struct_name;   /* Name of C struct type */
+        size_t str_cap;      /* Bytes allocated for pv (0 = struct_size + 1) */
+    };
     size_t struct_size;  /* Size of struct in bytes */
 
     /* Blessed package (for OOP - like Perl's bless) */
@@ -67,28 +71,50 @@ struct StradaArray {
     StradaValue **elements;
     size_t size;
     size_t capacity;
+    size_t head;
     int refcount;
+    uint32_t gc_bits;
 };
 
-/* Hash entry */
+/* Hash slot (key == NULL means the slot is empty) */
 struct StradaHashEntry {
     char *key;
     StradaValue *value;
-    struct StradaHashEntry *next;
+    uint32_t hash;
+    uint32_t key_len;
 };
 
-/* Hash structure - like Perl's HV */
+/* Hash structure - like Perl's HV (open addressing) */
 struct StradaHash {
-    StradaHashEntry **buckets;
+    StradaHashEntry *entries;
     size_t num_buckets;
     size_t num_entries;
     int refcount;
+    uint32_t gc_bits;
 };
 
+/* Compiler-emitted literal hash key (see strada_runtime.h) */
+typedef struct StradaHashKey {
+    const char *name;
+    const char *key;
+    uint32_t hash;
+} StradaHashKey;
+
+/* Immortal values (see strada_runtime.h) */
+#define STRADA_REFCOUNT_IMMORTAL 0x40000000
+#define STRADA_SMALL_INT_MIN (-128)
+#define STRADA_SMALL_INT_MAX 1023
+extern StradaValue strada_small_ints[];
+#define STRADA_SMALL_INT(i) (&strada_small_ints[(i) - STRADA_SMALL_INT_MIN])
+
 /* Core value creation */
 StradaValue* strada_new_undef(void);
 StradaValue* strada_new_int(int64_t value);
+StradaValue* strada_new_bool(int b);
+StradaValue* strada_empty_str(void);
 StradaValue* strada_new_num(double value);
+StradaValue* strada_box_int(StradaValue **box, int64_t i);
+StradaValue* strada_box_num(StradaValue **box, double n);
 StradaValue* strada_new_str(const char *value);
 StradaValue* strada_new_str_len(const char *value, size_t len);
 StradaValue* strada_new_array(void);
@@ -123,9 +149,11 @@ const char* strada_typeof(StradaValue *sv);
 /* String operations */
 StradaValue* strada_str_concat(StradaValue *a, StradaValue *b);
 StradaValue* strada_concat_sv(StradaValue *a, StradaValue *b);  /* Fast concat on StradaValues */
+StradaValue* strada_concat_inplace(StradaValue *a, StradaValue *b);  /* Append to an unaliased local, consumes a */
 StradaValue* strada_str_repeat(StradaValue *s, StradaValue *n);
 int64_t strada_str_length(StradaValue *sv);
 StradaValue* strada_substr(StradaValue *sv, int64_t start, int64_t len);
+size_t strada_char_length_sv(StradaValue *sv);
 int64_t strada_index(StradaValue *haystack, StradaValue *needle, int64_t start);
 StradaValue* strada_uc(StradaValue *sv);
 StradaValue* strada_lc(StradaValue *sv);
@@ -154,6 +182,10 @@ StradaValue* strada_array_splice(StradaValue *arr, StradaValue *offset, StradaVa
 StradaValue* strada_hash_get(StradaHash *hash, const char *key);
 void strada_hash_set(StradaHash *hash, const char *key, StradaValue *val);
 int strada_hash_exists(StradaHash *hash, const char *key);
+StradaValue* strada_hash_get_h(StradaHash *hash, StradaHashKey *hk);
+void strada_hash_set_h(StradaHash *hash, StradaHashKey *hk, StradaValue *val);
+int strada_hash_exists_h(StradaHash *hash, StradaHashKey *hk);
+void strada_hash_delete_h(StradaHash *hash, StradaHashKey *hk);
 void strada_hash_delete(StradaHash *hash, const char *key);
 StradaValue* strada_hash_keys(StradaHash *hash);
 StradaValue* strada_hash_values(StradaHash *hash);
@@ -199,6 +231,9 @@ int strada_file_exists(const char *filename);
 /* Regex */
 StradaValue* strada_regex_match(StradaValue *str, StradaValue *pattern, StradaValue *flags);
 StradaValue* strada_regex_subst(StradaValue *str, StradaValue *pattern, StradaValue *replacement, StradaValue *flags);
+StradaValue* strada_regex_static(StradaValue **slot, const char *pattern, const char *flags);
+int strada_regex_match_rx(const char *str, StradaValue *rx);
+char* strada_regex_replace_rx(const char *str, StradaValue *rx, const char *replacement, int global);
 
 /* OOP */
 StradaValue* strada_bless(StradaValue *ref, StradaValue *classname);
@@ -207,11 +242,15 @@ int strada_isa(StradaValue *obj, const char *classname);
 void strada_register_method(const char *classname, const char *methodname, void *func);
 void strada_method_register(const char *classname, const char *methodname, void *func);
 StradaValue* strada_method_call(StradaValue *obj, const char *method, StradaValue *args);
+typedef struct StradaMethodSlot StradaMethodSlot;
+StradaValue* strada_method_call_ic(StradaValue *obj, const char *method, StradaValue *args,
+                                   StradaMethodSlot **ic);
 StradaValue* strada_can(StradaValue *obj, const char *method);
 
 /* Closures */
 StradaValue* strada_closure_new(void *func, int arg_count, int capture_count, StradaValue ***captures);
 StradaValue* strada_closure_call(StradaValue *closure, StradaValue *args);
+StradaValue* strada_closure_call_v(StradaValue *closure, int argc, StradaValue **argv);
 StradaValue* strada_closure_call_method(StradaValue *closure, StradaValue *self, StradaValue *args);
 
 /* Exceptions */
@@ -252,6 +291,7 @@ StradaValue* strada_dumper_str(StradaValue *sv);
 
 /* Anonymous constructors */
 StradaValue* strada_anon_hash(int count, ...);
+StradaValue* strada_anon_hash_h(int count, ...);
 StradaValue* strada_anon_array(int count, ...);
 
 /* Memory profiling */
@@ -259,11 +299,28 @@ void strada_memprof_enable(void);
 void strada_memprof_disable(void);
 void strada_memprof_reset(void);
 void strada_memprof_report(void);
+StradaValue* strada_memprof_snapshot(const char *path);
+StradaValue* strada_memprof_diff(const char *before, const char *after);
+StradaValue* strada_weaken(StradaValue *ref);
+int strada_isweak(StradaValue *sv);
+void strada_gc_enable(void);
+void strada_gc_disable(void);
+int64_t strada_gc_collect(void);
+void strada_gc_set_threshold(int64_t n);
+StradaValue* strada_gc_stats(void);
 
 /* Function profiling */
+typedef struct StradaProfFunc {
+    const char *name;
+    uint64_t calls;
+    uint64_t self_ns;
+    uint64_t total_ns;
+    int registered;
+    struct StradaProfFunc *next;
+} StradaProfFunc;
 void strada_profile_init(void);
-void strada_profile_enter(const char *func_name);
-void strada_profile_exit(const char *func_name);
+void strada_profile_enter(StradaProfFunc *fn);
+void strada_profile_exit(StradaProfFunc *fn);
 void strada_profile_report(void);
 
 #endif /* STRADA_RUNTIME_TCC_H */
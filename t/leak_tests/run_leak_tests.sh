@@ -59,7 +59,8 @@ for test in "${TESTS[@]}"; do
     echo ""
 
     # Run with valgrind and capture output
-    VALGRIND_OUT=$(valgrind --leak-check=full --error-exitcode=99 "t/leak_tests/${test}" 2>&1)
+    # Bypass the slab allocator so valgrind sees every value allocation
+    VALGRIND_OUT=$(STRADA_ALLOC=system valgrind --leak-check=full --error-exitcode=99 "t/leak_tests/${test}" 2>&1)
     VALGRIND_EXIT=$?
 
     # Show program output
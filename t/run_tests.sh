@@ -26,6 +26,17 @@ STRADAC="$PROJECT_DIR/stradac"
 RUNTIME="$PROJECT_DIR/runtime/strada_runtime.o"
 RUNTIME_H="$PROJECT_DIR/runtime"
 EXAMPLES_DIR="$PROJECT_DIR/examples"
+
+# Runtime build options detected by ./configure (regex engine)
+RUNTIME_CFLAGS=""
+RUNTIME_LIBS=""
+if [ -f "$PROJECT_DIR/config.sh" ]; then
+    . "$PROJECT_DIR/config.sh"
+    if [ "$STRADA_HAVE_PCRE2" = "1" ]; then
+        RUNTIME_CFLAGS="-DSTRADA_HAVE_PCRE2 $STRADA_PCRE2_CFLAGS"
+        RUNTIME_LIBS="$STRADA_PCRE2_LIBS"
+    fi
+fi
 BUILD_DIR="/tmp/strada_tests_$$"
 
 # Colors (disabled if not a terminal)
@@ -154,13 +165,13 @@ compile_strada() {
     local exe_file="$BUILD_DIR/${name}"
 
     # Compile Strada to C
-    if ! timeout 30 "$STRADAC" "$src" "$c_file" > "$BUILD_DIR/${name}_strada.log" 2>&1; then
+    if ! timeout 30 "$STRADAC" ${STRADAC_FLAGS:-} "$src" "$c_file" > "$BUILD_DIR/${name}_strada.log" 2>&1; then
         return 1
     fi
 
     # Compile C to executable
     # Note: -rdynamic exports symbols so shared libraries can use the executable's runtime
-    if ! gcc -rdynamic -o "$exe_file" "$c_file" "$RUNTIME" -I"$RUNTIME_H" -ldl -lm ${EXTRA_LDFLAGS:-} > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
+    if ! gcc -rdynamic -o "$exe_file" "$c_file" "$RUNTIME" -I"$RUNTIME_H" -ldl -lm $RUNTIME_LIBS ${EXTRA_LDFLAGS:-} > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
         return 2
     fi
 
@@ -461,7 +472,7 @@ test_import_object() {
     local c_file="$BUILD_DIR/${name}.c"
     local exe_file="$BUILD_DIR/${name}"
 
-    if ! timeout 30 "$STRADAC" "$src" "$c_file" > "$BUILD_DIR/${name}_strada.log" 2>&1; then
+    if ! timeout 30 "$STRADAC" ${STRADAC_FLAGS:-} "$src" "$c_file" > "$BUILD_DIR/${name}_strada.log" 2>&1; then
         FAILED=$((FAILED + 1))
         local err=$(cat "$BUILD_DIR/${name}_strada.log" 2>/dev/null | head -1)
         log_fail "run: $desc" "Compile failed: $err"
@@ -469,7 +480,7 @@ test_import_object() {
     fi
 
     # Compile C to executable - INCLUDE the .o file
-    if ! gcc -o "$exe_file" "$c_file" "$lib_o" "$RUNTIME" -I"$RUNTIME_H" -ldl -lm > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
+    if ! gcc -o "$exe_file" "$c_file" "$lib_o" "$RUNTIME" -I"$RUNTIME_H" -ldl -lm $RUNTIME_LIBS > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
         FAILED=$((FAILED + 1))
         local err=$(cat "$BUILD_DIR/${name}_gcc.log" 2>/dev/null | head -1)
         log_fail "run: $desc" "GCC compile failed: $err"
@@ -527,7 +538,7 @@ test_import_archive() {
     fi
 
     # Compile runtime to .o for archive
-    if ! gcc -c "$PROJECT_DIR/runtime/strada_runtime.c" -o "$lib_runtime_o" -I"$RUNTIME_H" > "$BUILD_DIR/${lib_name}_runtime_gcc.log" 2>&1; then
+    if ! gcc -c $RUNTIME_CFLAGS "$PROJECT_DIR/runtime/strada_runtime.c" -o "$lib_runtime_o" -I"$RUNTIME_H" > "$BUILD_DIR/${lib_name}_runtime_gcc.log" 2>&1; then
         FAILED=$((FAILED + 1))
         local err=$(cat "$BUILD_DIR/${lib_name}_runtime_gcc.log" 2>/dev/null | head -1)
         log_fail "run: $desc" "Runtime .o compile failed: $err"
@@ -546,7 +557,7 @@ test_import_archive() {
     local c_file="$BUILD_DIR/${name}.c"
     local exe_file="$BUILD_DIR/${name}"
 
-    if ! timeout 30 "$STRADAC" "$src" "$c_file" > "$BUILD_DIR/${name}_strada.log" 2>&1; then
+    if ! timeout 30 "$STRADAC" ${STRADAC_FLAGS:-} "$src" "$c_file" > "$BUILD_DIR/${name}_strada.log" 2>&1; then
         FAILED=$((FAILED + 1))
         local err=$(cat "$BUILD_DIR/${name}_strada.log" 2>/dev/null | head -1)
         log_fail "run: $desc" "Compile failed: $err"
@@ -554,7 +565,7 @@ test_import_archive() {
     fi
 
     # Compile C to executable - archive includes runtime, so skip separate runtime
-    if ! gcc -rdynamic -o "$exe_file" "$c_file" "$lib_a" -I"$RUNTIME_H" -ldl -lm -lpthread > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
+    if ! gcc -rdynamic -o "$exe_file" "$c_file" "$lib_a" -I"$RUNTIME_H" -ldl -lm -lpthread $RUNTIME_LIBS > "$BUILD_DIR/${name}_gcc.log" 2>&1; then
         FAILED=$((FAILED + 1))
         local err=$(cat "$BUILD_DIR/${name}_gcc.log" 2>/dev/null | head -1)
         log_fail "run: $desc" "GCC compile failed: $err"
@@ -578,6 +589,133 @@ test_import_archive() {
     fi
 }
 
+# Test: incremental build through the strada driver
+# Builds twice with one cache: the first run compiles the module units, the
+# second must reuse every cached unit object. Both binaries must print pattern.
+test_incremental() {
+    local src="$1"
+    local name="$2"
+    local pattern="$3"
+    local desc="${4:-$name}"
+    local timeout_secs="${5:-5}"
+    local cache="$BUILD_DIR/${name}_cache"
+
+    TOTAL=$((TOTAL + 1))
+
+    local pass
+    for pass in 1 2; do
+        if ! timeout 60 "$PROJECT_DIR/strada" -v --incremental --cache-dir "$cache" -o "$BUILD_DIR/${name}" "$src" > "$BUILD_DIR/${name}_build${pass}.log" 2>&1; then
+            FAILED=$((FAILED + 1))
+            log_fail "incremental: $desc" "Build $pass failed: $(grep -m1 -i error "$BUILD_DIR/${name}_build${pass}.log")"
+            return 1
+        fi
+        local built=$(grep -c "Compiling unit" "$BUILD_DIR/${name}_build${pass}.log")
+        if [ $pass -eq 1 ] && [ "$built" -eq 0 ]; then
+            FAILED=$((FAILED + 1))
+            log_fail "incremental: $desc" "No module units compiled"
+            return 1
+        fi
+        if [ $pass -eq 2 ] && [ "$built" -ne 0 ]; then
+            FAILED=$((FAILED + 1))
+            log_fail "incremental: $desc" "$built unit(s) rebuilt without changes"
+            return 1
+        fi
+        run_program "$name" "$timeout_secs"
+        if ! grep -q "$pattern" "$BUILD_DIR/${name}.out" 2>/dev/null; then
+            FAILED=$((FAILED + 1))
+            log_fail "incremental: $desc" "Pattern not found after build $pass: $pattern"
+            return 1
+        fi
+    done
+
+    PASSED=$((PASSED + 1))
+    log_pass "incremental: $desc"
+    return 0
+}
+
+# Test: run a script with strada --jit, passing it arguments
+# The first run compiles (libtcc, or gcc without it) into a fresh cache;
+# the second must load the cached program without compiling.
+test_jit() {
+    local src="$1"
+    local name="$2"
+    local pattern="$3"
+    local desc="${4:-$name}"
+    shift 4
+    local cache="$BUILD_DIR/${name}_cache"
+
+    TOTAL=$((TOTAL + 1))
+
+    rm -rf "$cache"
+    local pass
+    for pass in 1 2; do
+        local log="$BUILD_DIR/${name}_run${pass}.log"
+        timeout 60 "$PROJECT_DIR/strada" -v --jit --cache-dir "$cache" "$src" "$@" > "$log" 2>&1
+        if ! grep -q "$pattern" "$log"; then
+            FAILED=$((FAILED + 1))
+            log_fail "jit: $desc" "Pattern not found in run $pass: $(grep -m1 -i 'error\|FAIL' "$log")"
+            return 1
+        fi
+        if [ $pass -eq 2 ] && ! grep -q "Cached:" "$log"; then
+            FAILED=$((FAILED + 1))
+            log_fail "jit: $desc" "Second run compiled again"
+            return 1
+        fi
+    done
+
+    PASSED=$((PASSED + 1))
+    log_pass "jit: $desc"
+    return 0
+}
+
+# Build with --lto, then train with --pgo=gen/--pgo-run and run the
+# profile-optimized binary
+test_pgo_lto() {
+    local src="$1"
+    local name="$2"
+    local pattern="$3"
+    local desc="${4:-$name}"
+    local timeout_secs="${5:-5}"
+    local prof="$BUILD_DIR/${name}_prof"
+
+    TOTAL=$((TOTAL + 1))
+
+    if ! timeout 120 "$PROJECT_DIR/strada" --lto -O3 -o "$BUILD_DIR/${name}" "$src" > "$BUILD_DIR/${name}_lto.log" 2>&1; then
+        FAILED=$((FAILED + 1))
+        log_fail "lto/pgo: $desc" "LTO build failed: $(grep -m1 -i error "$BUILD_DIR/${name}_lto.log")"
+        return 1
+    fi
+    run_program "$name" "$timeout_secs"
+    if ! grep -q "$pattern" "$BUILD_DIR/${name}.out" 2>/dev/null; then
+        FAILED=$((FAILED + 1))
+        log_fail "lto/pgo: $desc" "Pattern not found after LTO build: $pattern"
+        return 1
+    fi
+
+    rm -rf "$prof"
+    if ! timeout 180 "$PROJECT_DIR/strada" --lto --pgo=gen "$prof" --pgo-run "$BUILD_DIR/${name} > /dev/null" \
+            -o "$BUILD_DIR/${name}" "$src" > "$BUILD_DIR/${name}_pgo.log" 2>&1; then
+        FAILED=$((FAILED + 1))
+        log_fail "lto/pgo: $desc" "PGO build failed: $(grep -m1 -i error "$BUILD_DIR/${name}_pgo.log")"
+        return 1
+    fi
+    if [ -z "$(find "$prof" -name '*.gcda' -print -quit)" ]; then
+        FAILED=$((FAILED + 1))
+        log_fail "lto/pgo: $desc" "Training wrote no profile"
+        return 1
+    fi
+    run_program "$name" "$timeout_secs"
+    if ! grep -q "$pattern" "$BUILD_DIR/${name}.out" 2>/dev/null; then
+        FAILED=$((FAILED + 1))
+        log_fail "lto/pgo: $desc" "Pattern not found after PGO build: $pattern"
+        return 1
+    fi
+
+    PASSED=$((PASSED + 1))
+    log_pass "lto/pgo: $desc"
+    return 0
+}
+
 # ============================================================
 # Main Test Execution
 # ============================================================
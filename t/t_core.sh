@@ -12,6 +12,10 @@ test_exit_code "$EXAMPLES_DIR/test_exit_error.strada" "test_exit_error" 1 "Exit
 
 # Test: String functions - check for key output patterns
 test_output_contains "$EXAMPLES_DIR/test_strings.strada" "test_strings" "All tests passed" "String functions"
+test_output_contains "$EXAMPLES_DIR/test_string_kernels.strada" "test_string_kernels" "PASS: string kernels test" "String kernels"
+test_output_contains "$EXAMPLES_DIR/test_small_strings.strada" "test_small_strings" "PASS: small strings test" "Small strings"
+test_output_contains "$EXAMPLES_DIR/test_string_slices.strada" "test_string_slices" "PASS: string slices test" "String slices"
+test_output_contains "$EXAMPLES_DIR/test_string_append.strada" "test_string_append" "PASS: string append test" "In-place string append"
 
 # Test: Control flow
 test_run "$EXAMPLES_DIR/control_flow_demo.strada" "control_flow_demo" "Control flow"
@@ -27,7 +31,10 @@ test_run "$EXAMPLES_DIR/test_refs.strada" "test_refs" "Refs"
 test_run "$EXAMPLES_DIR/test_native_hash.strada" "test_native_hash" "Native hash"
 test_run "$EXAMPLES_DIR/test_hash_barekeys.strada" "test_hash_barekeys" "Hash barekeys"
 test_output_contains "$EXAMPLES_DIR/test_hash_refcount.strada" "test_hash_refcount" "All hash refcount tests passed" "Hash refcount"
+test_output_contains "$EXAMPLES_DIR/test_hash_open_addressing.strada" "test_hash_open_addressing" "PASS: open addressing hash test" "Hash open addressing"
+test_output_contains "$EXAMPLES_DIR/test_hash_interned_keys.strada" "test_hash_interned_keys" "PASS: interned hash keys test" "Hash interned keys"
 test_output_contains "$EXAMPLES_DIR/anon_array_refcount.strada" "anon_array_refcount" "PASS: Anonymous array refcount test" "Anon array refcount"
+test_output_contains "$EXAMPLES_DIR/test_array_queue.strada" "test_array_queue" "PASS: array queue test" "Array queues"
 test_output_contains "$EXAMPLES_DIR/temp_cleanup_test.strada" "temp_cleanup_test" "PASS: Temporary cleanup test completed" "Temp cleanup"
 
 # Test: Parameter reassignment (tests that caller's values are not corrupted)
@@ -42,6 +49,12 @@ test_run "$EXAMPLES_DIR/test_packages.strada" "test_packages" "Packages"
 # Test: Regex
 test_run "$EXAMPLES_DIR/test_regex.strada" "test_regex" "Regex"
 test_run "$EXAMPLES_DIR/test_inline_regex.strada" "test_inline_regex" "Inline regex"
+test_output_contains "$EXAMPLES_DIR/test_regex_cache.strada" "test_regex_cache" "PASS: regex cache test" "Regex cache"
+if [ "${STRADA_HAVE_PCRE2:-0}" = "1" ]; then
+    test_output_contains "$EXAMPLES_DIR/test_regex_pcre2.strada" "test_regex_pcre2" "PASS: PCRE2 regex test" "PCRE2 regex"
+else
+    test_skip "PCRE2 regex" "runtime built with POSIX regex"
+fi
 
 # Test: Optional parameters
 test_run "$EXAMPLES_DIR/optional_params.strada" "optional_params" "Optional params"
@@ -66,6 +79,7 @@ test_run "$EXAMPLES_DIR/negative_index.strada" "negative_index" "Negative index"
 
 # Test: Try/catch
 test_run "$EXAMPLES_DIR/test_try_catch.strada" "test_try_catch" "Try/catch"
+test_output_contains "$EXAMPLES_DIR/test_try_unwind.strada" "test_try_unwind" "PASS: try unwind test" "Try unwind"
 test_output_contains "$SCRIPT_DIR/test_exception_rethrow.strada" "test_exception_rethrow" "PASS: All 5 exceptions caught" "Exception re-throw"
 
 # Test: Goto and loop labels
@@ -78,10 +92,12 @@ test_run "$EXAMPLES_DIR/test_foreach.strada" "test_foreach" "Foreach loops"
 
 # Test: JSON
 test_run "$EXAMPLES_DIR/test_json.strada" "test_json" "JSON"
+test_output_contains "$EXAMPLES_DIR/test_json_native.strada" "test_json_native" "PASS: native json test" "Native JSON"
 
 # Test: Sort
 test_run "$EXAMPLES_DIR/test_sort.strada" "test_sort" "Sort"
 test_run "$EXAMPLES_DIR/test_map_sort.strada" "test_map_sort" "Map sort"
+test_output_contains "$EXAMPLES_DIR/test_sort_keyed.strada" "test_sort_keyed" "PASS: keyed sort test" "Keyed sort"
 
 # Test: Magic constants
 test_run "$EXAMPLES_DIR/test_magic_constants.strada" "test_magic_constants" "Magic constants"
@@ -98,6 +114,7 @@ test_run "$EXAMPLES_DIR/test_free.strada" "test_free" "Memory free"
 
 # Test: File operations
 test_run "$EXAMPLES_DIR/test_file_write.strada" "test_file_write" "File write"
+test_output_contains "$EXAMPLES_DIR/test_line_reader.strada" "test_line_reader" "PASS: line reader test" "Line reader"
 
 # Test: Process operations
 test_run "$EXAMPLES_DIR/test_process.strada" "test_process" "Process ops"
@@ -109,6 +126,15 @@ test_run "$EXAMPLES_DIR/test_posix.strada" "test_posix" "POSIX functions"
 # Test: Signals (only compile - requires manual signal sending)
 test_compile "$EXAMPLES_DIR/test_signals.strada" "test_signals" "Signal handling"
 
+# Test: Threads, work-stealing pool and channels
+test_output_contains "$EXAMPLES_DIR/test_work_stealing.strada" "test_work_stealing" "PASS: work stealing test" "Work-stealing pool"
+test_output_contains "$EXAMPLES_DIR/test_parallel_builtins.strada" "test_parallel_builtins" "PASS: parallel builtins test" "pmap/pgrep/psort"
+test_output_contains "$EXAMPLES_DIR/test_channel_ring.strada" "test_channel_ring" "PASS: channel ring test" "Channel ring"
+
+# Test: Event loop and sockets
+test_output_contains "$EXAMPLES_DIR/test_event_loop.strada" "test_event_loop" "PASS: event loop test" "Event loop"
+test_output_contains "$EXAMPLES_DIR/test_socket_zero_copy.strada" "test_socket_zero_copy" "PASS: zero-copy socket test" "Zero-copy sockets"
+
 # Test: C integration
 test_run "$EXAMPLES_DIR/c_shared_lib.strada" "c_shared_lib" "C shared library"
 
@@ -132,10 +158,16 @@ test_output_contains "$EXAMPLES_DIR/test_misc_libc.strada" "test_misc_libc" "All
 # changed to capture-by-value for thread safety - compile only
 test_compile "$EXAMPLES_DIR/test_closures.strada" "test_closures" "Closures"
 test_output_contains "$EXAMPLES_DIR/test_closure_params.strada" "test_closure_params" "All closure parameter tests passed" "Closure params"
+test_output_contains "$EXAMPLES_DIR/test_closure_call.strada" "test_closure_call" "PASS: closure call test" "Closure call"
 
 # Test: Operators
 test_run "$EXAMPLES_DIR/test_operators.strada" "test_operators" "Operators"
 
+# Test: Native code for typed locals and constant expressions
+test_output_contains "$EXAMPLES_DIR/test_unboxed_locals.strada" "test_unboxed_locals" "PASS: unboxed locals test" "Unboxed locals"
+test_output_contains "$EXAMPLES_DIR/test_temp_elision.strada" "test_temp_elision" "PASS: temp elision test" "Temp elision"
+test_output_contains "$EXAMPLES_DIR/test_const_functions.strada" "test_const_functions" "PASS: const functions test" "Constant function folding"
+
 # Test: Switch statement
 test_run "$EXAMPLES_DIR/test_switch.strada" "test_switch" "Switch statement"
 
@@ -144,12 +176,14 @@ test_run "$EXAMPLES_DIR/test_ternary.strada" "test_ternary" "Ternary operator"
 
 # Test: Range operator
 test_run "$EXAMPLES_DIR/test_range.strada" "test_range" "Range operator"
+test_output_contains "$EXAMPLES_DIR/test_range_loops.strada" "test_range_loops" "PASS: range loops test" "Range loops"
 
 # Test: Namespaces
 test_run "$EXAMPLES_DIR/test_namespaces.strada" "test_namespaces" "Namespaces"
 
 # Test: Multiple inheritance
 test_run "$EXAMPLES_DIR/test_multi_inherit.strada" "test_multi_inherit" "Multiple inheritance"
+test_output_contains "$EXAMPLES_DIR/test_method_cache.strada" "test_method_cache" "PASS: method cache test" "Method dispatch caches"
 
 # Test: More OOP
 test_run "$EXAMPLES_DIR/test_oop2.strada" "test_oop2" "OOP extended"
@@ -165,15 +199,20 @@ test_run "$EXAMPLES_DIR/test_interpolation.strada" "test_interpolation" "String
 
 # Test: File slurp
 test_run "$EXAMPLES_DIR/test_slurp.strada" "test_slurp" "File slurp"
+test_output_contains "$EXAMPLES_DIR/test_slurp_mmap.strada" "test_slurp_mmap" "PASS: slurp mmap test" "Mapped slurp"
 
 # Test: ARGV handling
 test_run "$EXAMPLES_DIR/test_argv.strada" "test_argv" "ARGV handling"
 
 # Test: CSV parsing
 test_run "$EXAMPLES_DIR/text_csv_demo.strada" "text_csv_demo" "CSV parsing"
+test_output_contains "$EXAMPLES_DIR/test_csv_native.strada" "test_csv_native" "PASS: native csv test" "Native CSV"
 
 # Test: Memory management
 test_run "$EXAMPLES_DIR/test_memory.strada" "test_memory" "Memory management"
+test_output_contains "$EXAMPLES_DIR/test_weak_gc.strada" "test_weak_gc" "PASS: weak refs and cycle collector test" "Weak refs and cycle collector"
+test_output_contains "$EXAMPLES_DIR/test_slab_alloc.strada" "test_slab_alloc" "PASS: slab allocator cross-thread test" "Slab allocator"
+test_output_contains "$EXAMPLES_DIR/test_immortal_values.strada" "test_immortal_values" "PASS: immortal values test" "Immortal values"
 
 # Test: Command line tools (compile only - they need args)
 test_compile "$EXAMPLES_DIR/ls.strada" "ls" "ls command"
@@ -181,21 +220,48 @@ test_compile "$EXAMPLES_DIR/ps.strada" "ps" "ps command"
 
 # Test: LWP library
 test_output_contains "$EXAMPLES_DIR/test_lwp.strada" "test_lwp" "All LWP tests passed" "LWP HTTP library"
+test_output_contains "$EXAMPLES_DIR/test_lwp_keepalive.strada" "test_lwp_keepalive" "PASS: lwp keep-alive test" "LWP keep-alive"
 
 # Test: DateTime library
 test_output_contains "$EXAMPLES_DIR/test_datetime.strada" "test_datetime" "All DateTime tests passed" "DateTime library"
 
+# Test: Forma templates
+test_output_contains "$EXAMPLES_DIR/test_forma_compiled.strada" "test_forma_compiled" "PASS: forma compiled test" "Forma compiled templates"
+
+# Test: Sampling profiler
+test_output_contains "$EXAMPLES_DIR/test_prof_sample.strada" "test_prof_sample" "PASS: sampling profiler test" "Sampling profiler"
+
 # Test: Nesso ORM (requires SQLite)
 EXTRA_LDFLAGS="-lsqlite3"
 test_output_contains "lib/Nesso/test_nesso.strada" "test_nesso" "PASS: All Nesso tests passed" "Nesso ORM"
 EXTRA_LDFLAGS=""
 
+# Test: DBI statement cache and batches (requires SQLite)
+EXTRA_LDFLAGS="-lsqlite3"
+test_output_contains "$EXAMPLES_DIR/test_dbi_batch.strada" "test_dbi_batch" "PASS: dbi batch test" "DBI statement cache and batches"
+EXTRA_LDFLAGS=""
+
+# Test: Streaming compression (requires zlib)
+EXTRA_LDFLAGS="-lz"
+test_output_contains "$EXAMPLES_DIR/test_compress_stream.strada" "test_compress_stream" "PASS: compress stream test" "Streaming compression"
+EXTRA_LDFLAGS=""
+
 # Test: Nested use statements (modules that use other modules)
 test_output_contains "$SCRIPT_DIR/test_nested_use.strada" "test_nested_use" "All nested use tests passed" "Nested use"
 
 # Test: OOP with nested use statements
 test_output_contains "$SCRIPT_DIR/test_nested_oop.strada" "test_nested_oop" "All nested OOP tests passed" "Nested OOP"
 
+# Test: Incremental builds (each module cached as its own object)
+test_incremental "$SCRIPT_DIR/test_nested_oop.strada" "test_nested_oop_incr" "All nested OOP tests passed" "Nested OOP"
+test_incremental "$EXAMPLES_DIR/test_forma_compiled.strada" "test_forma_compiled_incr" "PASS: forma compiled test" "Forma"
+
+# Test: Scripts run through libtcc with strada --jit, cached by content
+test_jit "$EXAMPLES_DIR/test_jit_run.strada" "test_jit_run" "PASS: jit run test" "Script with arguments" alpha beta
+
+# Test: Link-time and profile-guided optimization builds
+test_pgo_lto "$EXAMPLES_DIR/test_json_native.strada" "test_json_native_pgo" "PASS: native json test" "Native JSON"
+
 # Test: OOP with import_lib
 test_import_lib "$SCRIPT_DIR/test_import_lib_oop.strada" "test_import_lib_oop" "$SCRIPT_DIR/nested_use_test/OOPLib.strada" "OOPLib" "import_lib OOP"
 
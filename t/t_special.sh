@@ -68,3 +68,9 @@ test_run "$EXAMPLES_DIR/function_args_demo.strada" "function_args_demo" "Functio
 
 # Test: Example program
 test_run "$EXAMPLES_DIR/example.strada" "example" "Example program"
+
+# Test: --single-threaded build (non-atomic refcounts throughout)
+STRADAC_FLAGS="--single-threaded" test_output_contains "$EXAMPLES_DIR/test_single_threaded.strada" "test_single_threaded" "PASS: single-threaded refcounts" "Single-threaded refcounts"
+
+# Test: --memprof allocation sites, heap snapshots and diffs
+STRADAC_FLAGS="--memprof" test_output_contains "$EXAMPLES_DIR/test_memprof_sites.strada" "test_memprof_sites" "PASS: memprof sites test" "Memory profiler sites"
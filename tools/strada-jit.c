@@ -0,0 +1,292 @@
+/*
+ This file is part of the Strada Language (https://github.com/mjflick/strada-lang).
+ Copyright (c) 2026 Michael J. Flickinger
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, version 2.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* strada-jit.c - Run generated C in process with libtcc (strada --jit)
+ *
+ * The runtime is linked into this program and exported with -rdynamic,
+ * so TinyCC only compiles the program itself; every strada_* call is
+ * resolved against the runtime that is already loaded.
+ *
+ *   strada-jit [options] PROGRAM.c [ARGV0 ARGS...]
+ *       Compile PROGRAM.c in memory and jump to its main()
+ *   strada-jit [options] -o FILE.so PROGRAM.c
+ *       Compile PROGRAM.c to a shared object for --load
+ *   strada-jit --load FILE.so [ARGV0 ARGS...]
+ *       Run a shared object written by -o without compiling anything
+ *   strada-jit --probe
+ *       Exit 0 if libtcc can be loaded
+ *
+ * Options: -I DIR, -L DIR, -l LIB, -D NAME[=VALUE], and -a FILE to
+ * compile or link another .c, .o or .a file with the program.
+ *
+ * Exit status 125 means libtcc was not found and 124 that TinyCC could
+ * not compile the program; otherwise it is the program's own.
+ *
+ * libtcc is opened with dlopen() so this builds without its headers.
+ * The output type numbers for shared objects and object files were
+ * swapped between TinyCC releases, so the one that writes a shared
+ * object is found with a probe compile before -o uses it.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#define JIT_NO_TCC 125
+#define JIT_COMPILE_FAILED 124
+
+#define TCC_OUTPUT_MEMORY 1
+#define TCC_RELOCATE_AUTO ((void *)1)
+
+typedef struct TCCState TCCState;
+
+static TCCState *(*p_tcc_new)(void);
+static void (*p_tcc_delete)(TCCState *s);
+static void (*p_tcc_set_error_func)(TCCState *s, void *opaque, void (*fn)(void *, const char *));
+static void (*p_tcc_set_options)(TCCState *s, const char *str);
+static int (*p_tcc_set_output_type)(TCCState *s, int type);
+static int (*p_tcc_add_include_path)(TCCState *s, const char *path);
+static int (*p_tcc_add_library_path)(TCCState *s, const char *path);
+static int (*p_tcc_add_library)(TCCState *s, const char *name);
+static void (*p_tcc_define_symbol)(TCCState *s, const char *sym, const char *value);
+static int (*p_tcc_add_file)(TCCState *s, const char *path);
+static int (*p_tcc_compile_string)(TCCState *s, const char *code);
+static int (*p_tcc_output_file)(TCCState *s, const char *path);
+/* One argument since TinyCC 0.9.28; the extra one is ignored there */
+static int (*p_tcc_relocate)(TCCState *s, void *ptr);
+static void *(*p_tcc_get_symbol)(TCCState *s, const char *name);
+
+typedef struct {
+    char opt;
+    const char *value;
+} JitOption;
+
+static JitOption *jit_opts = NULL;
+static int jit_opt_count = 0;
+
+static void jit_error(void *opaque, const char *msg) {
+    (void)opaque;
+    fprintf(stderr, "%s\n", msg);
+}
+
+static int jit_load_tcc(void) {
+    static const char *names[] = {
+        "libtcc.so", "libtcc.so.1", "libtcc.so.0",
+        "/usr/lib/x86_64-linux-gnu/libtcc.so", "/usr/local/lib/libtcc.so",
+        "/usr/lib/libtcc.so", NULL
+    };
+    const char *env = getenv("STRADA_LIBTCC");
+    void *lib = env ? dlopen(env, RTLD_NOW | RTLD_GLOBAL) : NULL;
+    for (int i = 0; !lib && names[i]; i++) {
+        lib = dlopen(names[i], RTLD_NOW | RTLD_GLOBAL);
+    }
+    if (!lib) return 0;
+
+    p_tcc_new = (TCCState *(*)(void))dlsym(lib, "tcc_new");
+    p_tcc_delete = (void (*)(TCCState *))dlsym(lib, "tcc_delete");
+    p_tcc_set_error_func = (void (*)(TCCState *, void *, void (*)(void *, const char *)))dlsym(lib, "tcc_set_error_func");
+    p_tcc_set_options = (void (*)(TCCState *, const char *))dlsym(lib, "tcc_set_options");
+    p_tcc_set_output_type = (int (*)(TCCState *, int))dlsym(lib, "tcc_set_output_type");
+    p_tcc_add_include_path = (int (*)(TCCState *, const char *))dlsym(lib, "tcc_add_include_path");
+    p_tcc_add_library_path = (int (*)(TCCState *, const char *))dlsym(lib, "tcc_add_library_path");
+    p_tcc_add_library = (int (*)(TCCState *, const char *))dlsym(lib, "tcc_add_library");
+    p_tcc_define_symbol = (void (*)(TCCState *, const char *, const char *))dlsym(lib, "tcc_define_symbol");
+    p_tcc_add_file = (int (*)(TCCState *, const char *))dlsym(lib, "tcc_add_file");
+    p_tcc_compile_string = (int (*)(TCCState *, const char *))dlsym(lib, "tcc_compile_string");
+    p_tcc_output_file = (int (*)(TCCState *, const char *))dlsym(lib, "tcc_output_file");
+    p_tcc_relocate = (int (*)(TCCState *, void *))dlsym(lib, "tcc_relocate");
+    p_tcc_get_symbol = (void *(*)(TCCState *, const char *))dlsym(lib, "tcc_get_symbol");
+
+    return p_tcc_new && p_tcc_delete && p_tcc_set_output_type && p_tcc_add_include_path &&
+           p_tcc_add_library_path && p_tcc_add_library && p_tcc_define_symbol &&
+           p_tcc_add_file && p_tcc_compile_string && p_tcc_output_file &&
+           p_tcc_relocate && p_tcc_get_symbol;
+}
+
+/* A state set up with the command line options, ready for the program */
+static TCCState *jit_state(int output_type) {
+    TCCState *s = p_tcc_new();
+    if (!s) return NULL;
+    if (p_tcc_set_error_func) p_tcc_set_error_func(s, NULL, jit_error);
+    /* -w: generated code is warning-free under gcc; tcc's extra
+     * warnings would only be noise on a script's stderr */
+    if (p_tcc_set_options) p_tcc_set_options(s, "-w");
+    p_tcc_set_output_type(s, output_type);
+    for (int i = 0; i < jit_opt_count; i++) {
+        const char *v = jit_opts[i].value;
+        switch (jit_opts[i].opt) {
+            case 'I': p_tcc_add_include_path(s, v); break;
+            case 'L': p_tcc_add_library_path(s, v); break;
+            case 'D': {
+                const char *eq = strchr(v, '=');
+                if (eq) {
+                    char *name = strndup(v, (size_t)(eq - v));
+                    p_tcc_define_symbol(s, name, eq + 1);
+                    free(name);
+                } else {
+                    p_tcc_define_symbol(s, v, "1");
+                }
+                break;
+            }
+        }
+    }
+    return s;
+}
+
+/* Files and libraries go after the program so its symbols come first */
+static int jit_add_program(TCCState *s, const char *program) {
+    if (p_tcc_add_file(s, program) < 0) return 0;
+    for (int i = 0; i < jit_opt_count; i++) {
+        const char *v = jit_opts[i].value;
+        if (jit_opts[i].opt == 'a' && p_tcc_add_file(s, v) < 0) return 0;
+        if (jit_opts[i].opt == 'l' && p_tcc_add_library(s, v) < 0) {
+            fprintf(stderr, "strada-jit: library not found: -l%s\n", v);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* The output type that makes tcc_output_file() write a shared object;
+ * the probe file is written as PATH and removed again */
+static int jit_dll_type(const char *path) {
+    int found = 0;
+    for (int type = 3; type <= 4 && !found; type++) {
+        TCCState *s = p_tcc_new();
+        if (!s) break;
+        p_tcc_set_output_type(s, type);
+        if (p_tcc_compile_string(s, "int strada_jit_probe;") == 0 && p_tcc_output_file(s, path) == 0) {
+            unsigned char hdr[18] = {0};
+            FILE *f = fopen(path, "rb");
+            if (f) {
+                size_t got = fread(hdr, 1, sizeof(hdr), f);
+                fclose(f);
+                /* e_type, little endian: 3 is ET_DYN */
+                if (got == sizeof(hdr) && memcmp(hdr, "\177ELF", 4) == 0 && hdr[16] == 3 && hdr[17] == 0) {
+                    found = type;
+                }
+            }
+        }
+        p_tcc_delete(s);
+    }
+    unlink(path);
+    return found;
+}
+
+static int jit_run_main(void *sym, int argc, char **argv) {
+    int (*program_main)(int, char **) = (int (*)(int, char **))sym;
+    return program_main(argc, argv);
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: strada-jit [options] PROGRAM.c [ARGV0 ARGS...]\n"
+        "       strada-jit [options] -o FILE.so PROGRAM.c\n"
+        "       strada-jit --load FILE.so [ARGV0 ARGS...]\n"
+        "       strada-jit --probe\n"
+        "Options: -I DIR  -L DIR  -l LIB  -D NAME[=VALUE]  -a FILE\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *output = NULL;
+    int i = 1;
+
+    if (argc >= 3 && strcmp(argv[1], "--load") == 0) {
+        /* A program compiled earlier: nothing left to compile */
+        void *lib = dlopen(argv[2], RTLD_NOW | RTLD_GLOBAL);
+        void *sym = lib ? dlsym(lib, "main") : NULL;
+        if (!sym) {
+            fprintf(stderr, "strada-jit: cannot load %s: %s\n", argv[2], dlerror());
+            return JIT_COMPILE_FAILED;
+        }
+        if (argc > 3) return jit_run_main(sym, argc - 3, argv + 3);
+        return jit_run_main(sym, 1, argv + 2);
+    }
+    if (argc == 2 && strcmp(argv[1], "--probe") == 0) {
+        return jit_load_tcc() ? 0 : JIT_NO_TCC;
+    }
+
+    jit_opts = calloc((size_t)argc, sizeof(JitOption));
+    if (!jit_opts) return 1;
+    while (i < argc && argv[i][0] == '-' && argv[i][1] != '\0') {
+        char opt = argv[i][1];
+        const char *value;
+        if (strchr("ILlDao", opt) == NULL) usage();
+        if (argv[i][2] != '\0') {
+            value = argv[i] + 2;
+            i++;
+        } else if (i + 1 < argc) {
+            value = argv[i + 1];
+            i += 2;
+        } else {
+            usage();
+        }
+        if (opt == 'o') {
+            output = value;
+        } else {
+            jit_opts[jit_opt_count].opt = opt;
+            jit_opts[jit_opt_count].value = value;
+            jit_opt_count++;
+        }
+    }
+    if (i >= argc || (output && i + 1 != argc)) usage();
+    const char *program = argv[i];
+
+    if (!jit_load_tcc()) {
+        fprintf(stderr, "strada-jit: libtcc not found (install libtcc-dev or set STRADA_LIBTCC)\n");
+        return JIT_NO_TCC;
+    }
+
+    if (output) {
+        /* Written beside the target and renamed, so a concurrent
+         * --load never sees half a file */
+        size_t len = strlen(output) + 32;
+        char *tmp = malloc(len);
+        if (!tmp) return 1;
+        snprintf(tmp, len, "%s.%ld.tmp", output, (long)getpid());
+        int type = jit_dll_type(tmp);
+        if (!type) {
+            fprintf(stderr, "strada-jit: this libtcc cannot write shared objects\n");
+            return JIT_COMPILE_FAILED;
+        }
+        TCCState *s = jit_state(type);
+        if (!s || !jit_add_program(s, program)) return JIT_COMPILE_FAILED;
+        if (p_tcc_output_file(s, tmp) < 0 || rename(tmp, output) != 0) {
+            unlink(tmp);
+            return JIT_COMPILE_FAILED;
+        }
+        free(tmp);
+        p_tcc_delete(s);
+        return 0;
+    }
+
+    TCCState *s = jit_state(TCC_OUTPUT_MEMORY);
+    if (!s || !jit_add_program(s, program) || p_tcc_relocate(s, TCC_RELOCATE_AUTO) < 0) {
+        return JIT_COMPILE_FAILED;
+    }
+    void *sym = p_tcc_get_symbol(s, "main");
+    if (!sym) {
+        fprintf(stderr, "strada-jit: %s has no main()\n", program);
+        return JIT_COMPILE_FAILED;
+    }
+    /* The state owns the code, so it stays alive until exit */
+    if (i + 1 < argc) return jit_run_main(sym, argc - i - 1, argv + i + 1);
+    return jit_run_main(sym, 1, argv + i);
+}